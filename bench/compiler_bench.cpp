@@ -0,0 +1,189 @@
+// Google Benchmark suite for the compiler itself: loading, graph construction, DOT export and MLIR
+// emission on synthetic graphs of growing size. Every benchmark reports its fitted complexity, so a
+// step from O(N) to O(N^2) (e.g. a container copy per AddNode) shows up as a changed BigO line.
+//
+// usage: tc-compiler-bench [--benchmark_filter=<regex>] [--benchmark_format=json] ...
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+#include "onnx/onnx_pb.h"
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+#include "helpers/output_sink.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+#include "onnx_loader/onnx_loader.hpp"
+#include "synthetic_graphs.hpp"
+
+namespace {
+
+constexpr int64_t kMinNodes = int64_t{1} << 8;
+// 2^16 ops of a chain or fan-out are 2^17 nodes
+constexpr int64_t kMaxNodes = int64_t{1} << 16;
+// emission writes a few hundred bytes per op, keep the largest module in the tens of MiB
+constexpr int64_t kMaxEmittedOps = int64_t{1} << 14;
+constexpr int64_t kMinElements = int64_t{1} << 12;
+constexpr int64_t kMaxElements = int64_t{1} << 20;
+
+// counts what the emitter writes and drops it, so only emission is timed
+class CountingSink final : public hlp::OutputSink {
+  public:
+    void Write(std::string_view data) override { bytes_ += data.size(); }
+    size_t Bytes() const { return bytes_; }
+
+  private:
+    size_t bytes_ = 0;
+};
+
+void SetShape(onnx::ValueInfoProto* info, const tc::Value& value) {
+    info->set_name(value.Name());
+    auto* tensor_type = info->mutable_type()->mutable_tensor_type();
+    tensor_type->set_elem_type(onnx::TensorProto::FLOAT);
+    for (int64_t dim : value.MaybeTensorType()->Shape()) {
+        tensor_type->mutable_shape()->add_dim()->set_dim_value(dim);
+    }
+}
+
+// the ONNX model a synthetic graph would be loaded from; float32 and attribute-free ops only
+std::string SerializeModel(const tc::Graph& graph) {
+    onnx::ModelProto model;
+    model.set_ir_version(8);
+    model.add_opset_import()->set_version(17);
+    onnx::GraphProto* onnx_graph = model.mutable_graph();
+    onnx_graph->set_name("synthetic");
+
+    for (const tc::INode* node : graph) {
+        if (const auto* value = dynamic_cast<const tc::Value*>(node)) {
+            switch (value->GetBelongsTo()) {
+                case tc::Value::BelongTo::kInput:
+                    SetShape(onnx_graph->add_input(), *value);
+                    break;
+                case tc::Value::BelongTo::kOutput:
+                    SetShape(onnx_graph->add_output(), *value);
+                    break;
+                case tc::Value::BelongTo::kInternal:
+                    SetShape(onnx_graph->add_value_info(), *value);
+                    break;
+                case tc::Value::BelongTo::kInitializer: {
+                    onnx::TensorProto* tensor = onnx_graph->add_initializer();
+                    tensor->set_name(value->Name());
+                    tensor->set_data_type(onnx::TensorProto::FLOAT);
+                    for (int64_t dim : value->InitializerData()->type.Shape()) {
+                        tensor->add_dims(dim);
+                    }
+                    tensor->set_raw_data(value->InitializerData()->raw);
+                    break;
+                }
+            }
+        } else if (const auto* op = dynamic_cast<const tc::Operation*>(node)) {
+            onnx::NodeProto* onnx_node = onnx_graph->add_node();
+            onnx_node->set_name(op->Name());
+            onnx_node->set_op_type(tc::Operation::OpTypeToStr(op->Type()));
+            for (const tc::Value* input : op->Inputs()) {
+                onnx_node->add_input(input->Name());
+            }
+            for (const tc::Value* output : op->Outputs()) {
+                onnx_node->add_output(output->Name());
+            }
+        }
+    }
+
+    std::string raw;
+    model.SerializeToString(&raw);
+    return raw;
+}
+
+template <tc::Graph (*Make)(int64_t)>
+void BM_AddNode(benchmark::State& state) {
+    for (auto _ : state) {
+        tc::Graph graph = Make(state.range(0));
+        benchmark::DoNotOptimize(graph);
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+template <tc::Graph (*Make)(int64_t)>
+void BM_ParseRaw(benchmark::State& state) {
+    const std::string raw = SerializeModel(Make(state.range(0)));
+    tc::OnnxLoader loader;
+    for (auto _ : state) {
+        tc::Graph graph = loader.ParseRaw(raw);
+        benchmark::DoNotOptimize(graph);
+    }
+    state.SetComplexityN(state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(raw.size()));
+}
+
+template <tc::Graph (*Make)(int64_t)>
+void BM_ToDot(benchmark::State& state) {
+    const tc::Graph graph = Make(state.range(0));
+    for (auto _ : state) {
+        std::string dot = graph.ToDot();
+        benchmark::DoNotOptimize(dot);
+    }
+    state.SetComplexityN(state.range(0));
+}
+
+template <tc::Graph (*Make)(int64_t)>
+void BM_EmitModule(benchmark::State& state) {
+    const tc::Graph graph = Make(state.range(0));
+    const tc::MlirBackend backend;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        CountingSink out;
+        backend.EmitModule(graph, out, tc::MlirEmitterOptions{});
+        bytes += out.Bytes();
+    }
+    state.SetComplexityN(state.range(0));
+    state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+
+tc::Graph Chain(int64_t length) {
+    return tc::bench::MakeReluChain(length);
+}
+
+tc::Graph FanOut(int64_t fan_out) {
+    return tc::bench::MakeFanOut(fan_out);
+}
+
+tc::Graph Initializer(int64_t elements) {
+    return tc::bench::MakeLargeInitializer(elements);
+}
+
+} // namespace
+
+BENCHMARK(BM_AddNode<Chain>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AddNode<FanOut>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_ParseRaw<Chain>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseRaw<FanOut>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseRaw<Initializer>)
+    ->RangeMultiplier(4)
+    ->Range(kMinElements, kMaxElements)
+    ->Complexity()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_ToDot<Chain>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ToDot<FanOut>)->RangeMultiplier(4)->Range(kMinNodes, kMaxNodes)->Complexity()->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_EmitModule<Chain>)
+    ->RangeMultiplier(4)
+    ->Range(kMinNodes, kMaxEmittedOps)
+    ->Complexity()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EmitModule<FanOut>)
+    ->RangeMultiplier(4)
+    ->Range(kMinNodes, kMaxEmittedOps)
+    ->Complexity()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EmitModule<Initializer>)
+    ->RangeMultiplier(4)
+    ->Range(kMinElements, kMaxElements)
+    ->Complexity()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,115 @@
+// Compares emission time and peak RSS of the textual ModuleEmitter against the
+// in-memory OpBuilder backend on a synthetic MLP chain.
+// Every mode runs in a forked child so that ru_maxrss is measured per mode.
+//
+// usage: emitter_compare [layers=32] [width=256]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "graph/graph.hpp"
+#include "helpers/output_sink.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+#include "synthetic_graphs.hpp"
+
+#if defined(TC_HAVE_MLIR)
+#include <mlir/IR/MLIRContext.h>
+
+#include "mlir_backend/mlir_builder.hpp"
+#endif
+
+namespace {
+
+struct Mode {
+    std::string name;
+    std::function<size_t(const tc::Graph&)> run; // returns produced text size, 0 if none
+};
+
+void RunMode(const Mode& mode, const tc::Graph& graph) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        std::perror("pipe");
+        std::exit(EXIT_FAILURE);
+    }
+
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+        ::close(fds[0]);
+        const auto start = std::chrono::steady_clock::now();
+        const size_t text_bytes = mode.run(graph);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const double report[2] = {ms, static_cast<double>(text_bytes)};
+        if (::write(fds[1], report, sizeof(report)) != static_cast<ssize_t>(sizeof(report))) {
+            std::_Exit(EXIT_FAILURE);
+        }
+        std::_Exit(EXIT_SUCCESS);
+    }
+
+    ::close(fds[1]);
+    double report[2] = {0.0, 0.0};
+    const bool got_report = ::read(fds[0], report, sizeof(report)) == static_cast<ssize_t>(sizeof(report));
+    ::close(fds[0]);
+
+    int status = 0;
+    rusage usage{};
+    ::wait4(pid, &status, 0, &usage);
+    if (!got_report || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::printf("%-16s failed\n", mode.name.c_str());
+        return;
+    }
+    std::printf("%-16s %12.1f %14ld %14.1f\n",
+                mode.name.c_str(), report[0], usage.ru_maxrss / 1024, report[1] / (1024.0 * 1024.0));
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    const int64_t layers = argc > 1 ? std::atoll(argv[1]) : 32;
+    const int64_t width = argc > 2 ? std::atoll(argv[2]) : 256;
+    const tc::Graph graph = tc::bench::MakeMlpChain(layers, width);
+
+    std::vector<Mode> modes;
+    modes.push_back({"graph only", [](const tc::Graph&) -> size_t { return 0; }});
+    modes.push_back({"text", [](const tc::Graph& g) -> size_t {
+        return tc::MlirBackend{}.EmitModule(g).size();
+    }});
+    modes.push_back({"text streamed", [](const tc::Graph& g) -> size_t {
+        const int fd = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+        hlp::FdSink out{fd};
+        tc::MlirBackend{}.EmitModule(g, out);
+        out.Flush();
+        ::close(fd);
+        return 0;
+    }});
+#if defined(TC_HAVE_MLIR)
+    modes.push_back({"builder", [](const tc::Graph& g) -> size_t {
+        mlir::MLIRContext context;
+        auto module = tc::BuildMlirModule(context, g);
+        return module ? 0 : 1;
+    }});
+    modes.push_back({"builder+print", [](const tc::Graph& g) -> size_t {
+        mlir::MLIRContext context;
+        auto module = tc::BuildMlirModule(context, g);
+        return tc::PrintMlirModule(*module).size();
+    }});
+#endif
+
+    std::printf("synthetic MLP: %lld layers x %lld wide\n", static_cast<long long>(layers), static_cast<long long>(width));
+    std::printf("%-16s %12s %14s %14s\n", "mode", "time, ms", "peak RSS, MiB", "text, MiB");
+    for (const Mode& mode : modes) {
+        RunMode(mode, graph);
+    }
+#if !defined(TC_HAVE_MLIR)
+    std::printf("(built without MLIR libraries: builder modes skipped)\n");
+#endif
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#ifndef SYNTHETIC_GRAPHS_HPP_
+#define SYNTHETIC_GRAPHS_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+
+namespace tc::bench {
+
+inline std::string RandomPayload(size_t count, std::mt19937& rng) {
+    std::uniform_real_distribution<float> dist{-1.0f, 1.0f};
+    std::string raw(count * sizeof(float), '\0');
+    for (size_t i = 0; i < count; ++i) {
+        const float v = dist(rng);
+        std::memcpy(raw.data() + i * sizeof(float), &v, sizeof(float));
+    }
+    return raw;
+}
+
+// MLP-like chain: X[batch,width] -> (Gemm(W_i,B_i) -> Relu) x layers -> Y
+inline Graph MakeMlpChain(int64_t layers, int64_t width, int64_t batch = 1) {
+    std::mt19937 rng{42};
+    Graph graph;
+
+    Value* cur = graph.AddNode<Value>("X", Value::BelongTo::kInput);
+    cur->MergeTensorType(TensorType{TensorElemType::kFloat32, {batch, width}});
+
+    for (int64_t i = 0; i < layers; ++i) {
+        const std::string id = std::to_string(i);
+        Value* w = graph.AddNode<Value>(
+            "W" + id, Value::BelongTo::kInitializer,
+            TensorData{TensorType{TensorElemType::kFloat32, {width, width}},
+                       RandomPayload(static_cast<size_t>(width * width), rng)});
+        Value* b = graph.AddNode<Value>(
+            "B" + id, Value::BelongTo::kInitializer,
+            TensorData{TensorType{TensorElemType::kFloat32, {width}},
+                       RandomPayload(static_cast<size_t>(width), rng)});
+
+        Value* fc = graph.AddNode<Value>("fc" + id, Value::BelongTo::kInternal);
+        fc->MergeTensorType(TensorType{TensorElemType::kFloat32, {batch, width}});
+        const bool last = i + 1 == layers;
+        Value* act = graph.AddNode<Value>(last ? std::string{"Y"} : "act" + id,
+                                          last ? Value::BelongTo::kOutput : Value::BelongTo::kInternal);
+        act->MergeTensorType(TensorType{TensorElemType::kFloat32, {batch, width}});
+
+        graph.AddNode<Operation>("gemm" + id, Operation::OpType::kGemm,
+                                 std::vector<Value*>{cur, w, b}, std::vector<Value*>{fc});
+        graph.AddNode<Operation>("relu" + id, Operation::OpType::kRelu,
+                                 std::vector<Value*>{fc}, std::vector<Value*>{act});
+        cur = act;
+    }
+    return graph;
+}
+
+// X[1,width] -> Relu x length -> Y: the deepest graph per node
+inline Graph MakeReluChain(int64_t length, int64_t width = 16) {
+    Graph graph;
+    Value* cur = graph.AddNode<Value>("X", Value::BelongTo::kInput);
+    cur->MergeTensorType(TensorType{TensorElemType::kFloat32, {1, width}});
+    for (int64_t i = 0; i < length; ++i) {
+        const bool last = i + 1 == length;
+        Value* next = graph.AddNode<Value>(last ? std::string{"Y"} : "act" + std::to_string(i),
+                                           last ? Value::BelongTo::kOutput : Value::BelongTo::kInternal);
+        next->MergeTensorType(TensorType{TensorElemType::kFloat32, {1, width}});
+        graph.AddNode<Operation>("relu" + std::to_string(i), Operation::OpType::kRelu,
+                                 std::vector<Value*>{cur}, std::vector<Value*>{next});
+        cur = next;
+    }
+    return graph;
+}
+
+// X[1,width] read by fan_out Relus, each writing its own output Y_i: the widest graph per node
+inline Graph MakeFanOut(int64_t fan_out, int64_t width = 16) {
+    Graph graph;
+    Value* x = graph.AddNode<Value>("X", Value::BelongTo::kInput);
+    x->MergeTensorType(TensorType{TensorElemType::kFloat32, {1, width}});
+    for (int64_t i = 0; i < fan_out; ++i) {
+        Value* y = graph.AddNode<Value>("Y" + std::to_string(i), Value::BelongTo::kOutput);
+        y->MergeTensorType(TensorType{TensorElemType::kFloat32, {1, width}});
+        graph.AddNode<Operation>("relu" + std::to_string(i), Operation::OpType::kRelu,
+                                 std::vector<Value*>{x}, std::vector<Value*>{y});
+    }
+    return graph;
+}
+
+// Y = X + W with W an elements-long initializer: all of the cost is in the constant
+inline Graph MakeLargeInitializer(int64_t elements) {
+    std::mt19937 rng{42};
+    Graph graph;
+    const TensorType type{TensorElemType::kFloat32, {elements}};
+    Value* x = graph.AddNode<Value>("X", Value::BelongTo::kInput);
+    x->MergeTensorType(type);
+    Value* w = graph.AddNode<Value>("W", Value::BelongTo::kInitializer,
+                                    TensorData{type, RandomPayload(static_cast<size_t>(elements), rng)});
+    Value* y = graph.AddNode<Value>("Y", Value::BelongTo::kOutput);
+    y->MergeTensorType(type);
+    graph.AddNode<Operation>("add", Operation::OpType::kAdd, std::vector<Value*>{x, w}, std::vector<Value*>{y});
+    return graph;
+}
+
+} // namespace tc::bench
+
+#endif // SYNTHETIC_GRAPHS_HPP_
@@ -0,0 +1,464 @@
+// End-to-end latency and throughput of a compiled model. The model is JIT-compiled or loaded
+// from a library built by `tc.x model.onnx --emit-shared`, fed random inputs of its input
+// types and run from --threads callers through one Session. Prints a JSON report, so runs
+// can be stored and compared across commits. --profile adds per-operation times of code compiled
+// with instrumentation (the JIT does so itself, libraries need `tc.x --instrument`). --counters
+// adds hardware event counts of the measured calls, and of every op when profiling.
+// --tuning-db compiles MatMul/Gemm with the loop schedules of a tuning database; --autotune first
+// measures the candidate schedules of every op the database has no entry for and saves the winners.
+//
+// usage: tc-bench <model.onnx> [--library <model.so>] [--batch N] [--dims d0,d1,...]
+//                 [--iterations 1000] [--warmup 100] [--threads 1] [--seed 42] [--output <path>]
+//                 [--profile] [--trace-out <path>] [--counters] [--tuning-db <path> [--autotune]]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "graph/cost_model.hpp"
+#include "graph/graph.hpp"
+#include "graph/rebatch.hpp"
+#include "helpers/json.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+#include "onnx_loader/onnx_loader.hpp"
+#include "mlir_backend/tuning.hpp"
+#include "runtime/autotuner.hpp"
+#include "runtime/compiled_model.hpp"
+#include "runtime/perf_counters.hpp"
+#include "runtime/profiler.hpp"
+#include "runtime/session.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::string model_path;
+    std::string library_path;
+    std::string output_path;
+    std::string trace_path;
+    std::string tuning_db_path;
+    bool autotune = false;
+    bool profile = false;
+    bool counters = false;
+    int64_t batch = 0;
+    std::vector<int64_t> dims;
+    size_t iterations = 1000;
+    size_t warmup = 100;
+    size_t threads = 1;
+    uint32_t seed = 42;
+};
+
+const char* kUsage =
+    "usage: tc-bench <model.onnx> [--library <model.so>] [--batch N] [--dims d0,d1,...]\n"
+    "                [--iterations 1000] [--warmup 100] [--threads 1] [--seed 42] [--output <path>]\n"
+    "                [--profile] [--trace-out <path>] [--counters] [--tuning-db <path> [--autotune]]\n";
+
+size_t ParseCount(const std::string& value, const std::string& flag) {
+    size_t used = 0;
+    unsigned long long n = 0;
+    try {
+        n = std::stoull(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size()) {
+        throw std::runtime_error{"invalid value for " + flag + ": " + value};
+    }
+    return static_cast<size_t>(n);
+}
+
+BenchOptions ParseArgs(int argc, const char* argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&] {
+            if (i + 1 >= argc) {
+                throw std::runtime_error{"missing value for flag " + arg};
+            }
+            return std::string{argv[++i]};
+        };
+        if (arg == "--library") {
+            opt.library_path = value();
+        } else if (arg == "--output") {
+            opt.output_path = value();
+        } else if (arg == "--profile") {
+            opt.profile = true;
+        } else if (arg == "--trace-out") {
+            opt.trace_path = value();
+            opt.profile = true;
+        } else if (arg == "--counters") {
+            opt.counters = true;
+        } else if (arg == "--tuning-db") {
+            opt.tuning_db_path = value();
+        } else if (arg == "--autotune") {
+            opt.autotune = true;
+        } else if (arg == "--batch") {
+            opt.batch = static_cast<int64_t>(ParseCount(value(), arg));
+        } else if (arg == "--dims") {
+            std::stringstream list{value()};
+            for (std::string item; std::getline(list, item, ',');) {
+                opt.dims.push_back(static_cast<int64_t>(ParseCount(item, arg)));
+            }
+        } else if (arg == "--iterations") {
+            opt.iterations = ParseCount(value(), arg);
+        } else if (arg == "--warmup") {
+            opt.warmup = ParseCount(value(), arg);
+        } else if (arg == "--threads") {
+            opt.threads = ParseCount(value(), arg);
+        } else if (arg == "--seed") {
+            opt.seed = static_cast<uint32_t>(ParseCount(value(), arg));
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error{"unknown flag: " + arg};
+        } else if (opt.model_path.empty()) {
+            opt.model_path = arg;
+        } else {
+            throw std::runtime_error{"too many positional arguments"};
+        }
+    }
+    if (opt.model_path.empty()) {
+        throw std::runtime_error{"model path is required"};
+    }
+    if (opt.iterations == 0 || opt.threads == 0) {
+        throw std::runtime_error{"--iterations and --threads must be positive"};
+    }
+    if (opt.autotune && (opt.tuning_db_path.empty() || !opt.library_path.empty())) {
+        throw std::runtime_error{"--autotune needs --tuning-db and the JIT"};
+    }
+    return opt;
+}
+
+// dense buffer of random values of type; floats in [-1, 1), integers in [-8, 8], bools 0/1
+std::vector<std::byte> RandomTensor(tc::TensorElemType type, size_t count, std::mt19937& rng) {
+    std::vector<std::byte> raw(count * tc::TensorType::ElemSizeInBytes(type));
+    auto fill = [&]<typename T>(T, auto dist) {
+        for (size_t i = 0; i < count; ++i) {
+            const T v = static_cast<T>(dist(rng));
+            std::memcpy(raw.data() + i * sizeof(T), &v, sizeof(T));
+        }
+    };
+    switch (type) {
+        case tc::TensorElemType::kFloat32: fill(float{}, std::uniform_real_distribution<float>{-1.0f, 1.0f}); break;
+        case tc::TensorElemType::kFloat64: fill(double{}, std::uniform_real_distribution<double>{-1.0, 1.0}); break;
+        case tc::TensorElemType::kInt32:   fill(int32_t{}, std::uniform_int_distribution<int32_t>{-8, 8}); break;
+        case tc::TensorElemType::kInt64:   fill(int64_t{}, std::uniform_int_distribution<int64_t>{-8, 8}); break;
+        case tc::TensorElemType::kBool:    fill(uint8_t{}, std::uniform_int_distribution<int>{0, 1}); break;
+        case tc::TensorElemType::kUnknown: throw std::runtime_error{"input of unknown element type"};
+    }
+    return raw;
+}
+
+int64_t NumElements(const std::vector<int64_t>& shape) {
+    int64_t total = 1;
+    for (int64_t dim : shape) {
+        total *= dim;
+    }
+    return total;
+}
+
+// input and output buffers of one calling thread
+struct Buffers {
+    std::vector<std::vector<std::byte>> storage;
+    std::vector<const void*> inputs;
+    std::vector<void*> outputs;
+};
+
+Buffers MakeBuffers(const tc::runtime::CompiledModel& model, const std::vector<int64_t>& dims, std::mt19937& rng) {
+    Buffers buffers;
+    const auto& specs = model.Inputs();
+    for (size_t i = 0; i < specs.size(); ++i) {
+        std::vector<int64_t> shape = specs[i].type.Shape();
+        for (size_t d = 0; d < model.Dims().size(); ++d) {
+            if (model.Dims()[d].input == i) {
+                shape[model.Dims()[d].axis] = dims[d];
+            }
+        }
+        const auto count = static_cast<size_t>(NumElements(shape));
+        buffers.storage.push_back(RandomTensor(specs[i].type.ElemType(), count, rng));
+        buffers.inputs.push_back(buffers.storage.back().data());
+    }
+    const auto shapes = model.OutputShapes(dims);
+    for (size_t o = 0; o < shapes.size(); ++o) {
+        const size_t elem = tc::TensorType::ElemSizeInBytes(model.Outputs()[o].type.ElemType());
+        buffers.storage.emplace_back(static_cast<size_t>(NumElements(shapes[o])) * elem);
+        buffers.outputs.push_back(buffers.storage.back().data());
+    }
+    return buffers;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// per-op profile of the measured calls as a JSON array; also prints it as a table to stderr
+std::string ProfileJson(const tc::runtime::Profiler& profiler, const tc::Graph& graph,
+                        const std::vector<int64_t>& dims, size_t runs) {
+    // the cost model needs the shapes of the calls that were run
+    const std::vector<tc::runtime::OpProfile> ops =
+        dims.empty() ? profiler.Summarize(graph, runs) : profiler.Summarize(tc::Specialize(graph, dims), runs);
+    if (profiler.Events().empty()) {
+        spdlog::warn("no profile events: was the library built with tc.x --instrument?");
+    }
+    std::cerr << tc::runtime::Profiler::FormatTable(ops);
+
+    std::ostringstream json;
+    json << "[";
+    for (size_t i = 0; i < ops.size(); ++i) {
+        const tc::runtime::OpProfile& op = ops[i];
+        json << (i != 0 ? ",\n    " : "\n    ") << "{\"name\": " << hlp::JsonQuote(op.name)
+             << ", \"type\": " << hlp::JsonQuote(op.type) << ", \"calls\": " << op.calls
+             << ", \"total_us\": " << op.total_us << ", \"share\": " << op.share
+             << ", \"flops_per_s\": " << op.flops_per_s << ", \"bytes_per_s\": " << op.bytes_per_s;
+        if (op.counters.cycles >= 0 || op.counters.instructions >= 0) {
+            json << ", \"cycles\": " << op.counters.cycles << ", \"instructions\": " << op.counters.instructions
+                 << ", \"cache_misses\": " << op.counters.cache_misses
+                 << ", \"branch_misses\": " << op.counters.branch_misses << ", \"ipc\": " << op.ipc
+                 << ", \"cache_misses_per_flop\": " << op.cache_misses_per_flop;
+        }
+        json << "}";
+    }
+    json << "\n  ]";
+    return json.str();
+}
+
+// FLOPs of one call from the cost model, -1 if some op's are unknown
+int64_t ModelFlops(const tc::Graph& graph) {
+    int64_t flops = 0;
+    for (const tc::OpCostEntry& entry : tc::CostReport(graph)) {
+        if (entry.cost.flops < 0) {
+            return -1;
+        }
+        flops += entry.cost.flops;
+    }
+    return flops;
+}
+
+// hardware counters of the measured calls, per call; only the calling threads are counted,
+// which is all of the work as long as the session has no pool
+std::string CountersJson(const tc::runtime::CounterValues& total, size_t runs, int64_t model_flops,
+                         bool available) {
+    auto per_run = [&](int64_t count) {
+        return count < 0 ? -1.0 : static_cast<double>(count) / static_cast<double>(runs);
+    };
+    const double misses_per_flop = model_flops > 0 && total.cache_misses >= 0
+                                       ? per_run(total.cache_misses) / static_cast<double>(model_flops)
+                                       : -1.0;
+    std::ostringstream json;
+    json << "{\"available\": " << (available ? "true" : "false")
+         << ", \"cycles_per_run\": " << per_run(total.cycles)
+         << ", \"instructions_per_run\": " << per_run(total.instructions)
+         << ", \"cache_misses_per_run\": " << per_run(total.cache_misses)
+         << ", \"branch_misses_per_run\": " << per_run(total.branch_misses) << ", \"ipc\": " << total.Ipc()
+         << ", \"flops_per_run\": " << model_flops << ", \"cache_misses_per_flop\": " << misses_per_flop << "}";
+    return json.str();
+}
+
+tc::Graph LoadGraph(const BenchOptions& opt) {
+    tc::OnnxLoader loader;
+    tc::Graph graph = loader.Load(opt.model_path);
+    if (opt.batch > 0) {
+        return tc::Rebatch(graph, opt.batch);
+    }
+    return graph;
+}
+
+std::string TuningJson(const std::vector<tc::runtime::AutotuneResult>& results) {
+    std::ostringstream json;
+    json << "[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const tc::runtime::AutotuneResult& r = results[i];
+        json << (i != 0 ? ",\n" : "\n") << "    {\"signature\": " << hlp::JsonQuote(r.signature)
+             << ", \"op\": " << hlp::JsonQuote(r.op) << ", \"schedule\": " << hlp::JsonQuote(tc::FormatSchedule(r.schedule))
+             << ", \"us\": " << r.micros << ", \"default_us\": " << r.default_micros
+             << ", \"candidates\": " << r.candidates << "}";
+    }
+    json << (results.empty() ? "]" : "\n  ]");
+    return json.str();
+}
+
+std::string Run(const BenchOptions& opt) {
+    const tc::Graph graph = LoadGraph(opt);
+
+    std::vector<tc::runtime::AutotuneResult> tuned;
+    std::shared_ptr<tc::TuningDatabase> tuning;
+    if (!opt.tuning_db_path.empty()) {
+        tuning = std::make_shared<tc::TuningDatabase>(tc::TuningDatabase::Load(opt.tuning_db_path));
+    }
+    if (opt.autotune) {
+        tuned = tc::runtime::Autotune(graph, *tuning);
+        tuning->Save(opt.tuning_db_path);
+    }
+
+    const Clock::time_point compile_start = Clock::now();
+    tc::runtime::JitOptions jit_options;
+    jit_options.instrument = opt.profile;
+    jit_options.tuning = tuning;
+    const std::shared_ptr<const tc::runtime::CompiledModel> model =
+        opt.library_path.empty() ? tc::runtime::CompiledModel::Jit(graph, jit_options)
+                                 : tc::runtime::CompiledModel::LoadSharedLibrary(opt.library_path, graph);
+    const double compile_ms = std::chrono::duration<double, std::milli>(Clock::now() - compile_start).count();
+
+    if (opt.dims.size() != model->Dims().size()) {
+        throw std::runtime_error{"the model has " + std::to_string(model->Dims().size()) +
+                                 " dynamic dimensions, --dims gave " + std::to_string(opt.dims.size())};
+    }
+
+    tc::runtime::SessionOptions session_options;
+    session_options.concurrency = opt.threads;
+    session_options.max_dims = opt.dims;
+    const tc::runtime::Session session{model, session_options};
+
+    std::mt19937 rng{opt.seed};
+    std::vector<Buffers> buffers;
+    for (size_t t = 0; t < opt.threads; ++t) {
+        buffers.push_back(MakeBuffers(*model, opt.dims, rng));
+    }
+
+    // every thread warms up on its own, then all start the measured iterations together
+    std::latch ready{static_cast<std::ptrdiff_t>(opt.threads) + 1};
+    std::latch go{1};
+    std::atomic<size_t> next{0};
+    std::vector<std::vector<double>> per_thread(opt.threads);
+    std::vector<tc::runtime::CounterValues> thread_counters(opt.threads, tc::runtime::CounterValues::Zero());
+    std::atomic<bool> counters_available{true};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < opt.threads; ++t) {
+        threads.emplace_back([&, t] {
+            const Buffers& own = buffers[t];
+            for (size_t i = 0; i < opt.warmup; ++i) {
+                session.Run(own.inputs, own.outputs, opt.dims);
+            }
+            per_thread[t].reserve(opt.iterations);
+            std::optional<tc::runtime::PerfCounters> counters;
+            if (opt.counters) {
+                counters.emplace();
+                if (!counters->Available()) {
+                    counters_available = false;
+                    counters.reset();
+                }
+            }
+            ready.count_down();
+            go.wait();
+            while (next.fetch_add(1, std::memory_order_relaxed) < opt.iterations) {
+                const tc::runtime::CounterValues before = counters ? counters->Read() : tc::runtime::CounterValues{};
+                const Clock::time_point start = Clock::now();
+                session.Run(own.inputs, own.outputs, opt.dims);
+                const Clock::time_point end = Clock::now();
+                if (counters) {
+                    thread_counters[t] += counters->Read() - before;
+                }
+                per_thread[t].push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+        });
+    }
+    tc::runtime::Profiler profiler{tc::runtime::ProfilerOptions{opt.counters}};
+    ready.arrive_and_wait();
+    if (opt.profile) {
+        profiler.Start();
+    }
+    const Clock::time_point start = Clock::now();
+    go.count_down();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    profiler.Stop();
+
+    std::vector<double> latencies;
+    for (const std::vector<double>& l : per_thread) {
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0.0;
+    for (double l : latencies) {
+        total += l;
+    }
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"model\": " << hlp::JsonQuote(opt.model_path) << ",\n"
+         << "  \"backend\": " << hlp::JsonQuote(opt.library_path.empty() ? "jit" : "library") << ",\n"
+         << "  \"batch\": " << opt.batch << ",\n"
+         << "  \"dims\": [";
+    for (size_t d = 0; d < opt.dims.size(); ++d) {
+        json << (d != 0 ? ", " : "") << opt.dims[d];
+    }
+    json << "],\n"
+         << "  \"threads\": " << opt.threads << ",\n"
+         << "  \"warmup\": " << opt.warmup << ",\n"
+         << "  \"iterations\": " << latencies.size() << ",\n"
+         << "  \"compile_ms\": " << compile_ms << ",\n"
+         << "  \"latency_us\": {\"min\": " << latencies.front() << ", \"mean\": "
+         << total / static_cast<double>(latencies.size()) << ", \"p50\": " << Percentile(latencies, 0.50)
+         << ", \"p90\": " << Percentile(latencies, 0.90) << ", \"p99\": " << Percentile(latencies, 0.99)
+         << ", \"max\": " << latencies.back() << "},\n"
+         << "  \"throughput_per_s\": " << static_cast<double>(latencies.size()) / elapsed;
+    if (opt.autotune) {
+        json << ",\n  \"tuning\": " << TuningJson(tuned);
+    }
+    if (opt.counters) {
+        tc::runtime::CounterValues total = tc::runtime::CounterValues::Zero();
+        if (counters_available) {
+            for (const tc::runtime::CounterValues& counters : thread_counters) {
+                total += counters;
+            }
+        } else {
+            spdlog::warn("no hardware counters, reporting timing only ({})", tc::runtime::PerfCounters{}.Unavailable());
+            total = tc::runtime::CounterValues{};
+        }
+        const int64_t flops = opt.dims.empty() ? ModelFlops(graph) : ModelFlops(tc::Specialize(graph, opt.dims));
+        json << ",\n  \"counters\": " << CountersJson(total, latencies.size(), flops, counters_available);
+    }
+    if (opt.profile) {
+        json << ",\n  \"ops\": " << ProfileJson(profiler, graph, opt.dims, latencies.size());
+        if (!opt.trace_path.empty()) {
+            std::ofstream{opt.trace_path} << profiler.ChromeTrace(graph);
+        }
+    }
+    json << "\n}\n";
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    // stdout carries the report
+    spdlog::set_default_logger(spdlog::stderr_color_mt("tc-bench"));
+
+    try {
+        const BenchOptions opt = ParseArgs(argc, argv);
+        const std::string report = Run(opt);
+        if (opt.output_path.empty()) {
+            std::cout << report;
+        } else {
+            std::ofstream out{opt.output_path};
+            out << report;
+            if (!out) {
+                throw std::runtime_error{"unable to write " + opt.output_path};
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << '\n' << kUsage;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
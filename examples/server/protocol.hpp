@@ -0,0 +1,93 @@
+// Wire format shared by tc_serve and tc_loadgen over a SOCK_STREAM Unix socket.
+//
+// On accept the server sends a Hello: magic, input count, output count, then the byte size of
+// one request row of every input and every output (uint64 each, host byte order). After that
+// the client repeats: send the input rows back to back, read the output rows back to back.
+
+#ifndef SERVER_PROTOCOL_HPP_
+#define SERVER_PROTOCOL_HPP_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace tc::server {
+
+constexpr uint32_t kMagic = 0x31534354; // "TCS1"
+
+// false on orderly EOF before the first byte, throws on errors and truncated messages
+inline bool ReadFull(int fd, void* data, size_t size) {
+    auto* out = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = ::read(fd, out + done, size - done);
+        if (n == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw std::runtime_error{"connection closed mid-message"};
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error{std::string{"read: "} + std::strerror(errno)};
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline void WriteFull(int fd, const void* data, size_t size) {
+    const auto* in = static_cast<const char*>(data);
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t n = ::send(fd, in + done, size - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error{std::string{"write: "} + std::strerror(errno)};
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+struct Hello {
+    std::vector<uint64_t> input_bytes;
+    std::vector<uint64_t> output_bytes;
+
+    void Write(int fd) const {
+        const uint32_t header[3] = {kMagic, static_cast<uint32_t>(input_bytes.size()),
+                                    static_cast<uint32_t>(output_bytes.size())};
+        WriteFull(fd, header, sizeof(header));
+        WriteFull(fd, input_bytes.data(), input_bytes.size() * sizeof(uint64_t));
+        WriteFull(fd, output_bytes.data(), output_bytes.size() * sizeof(uint64_t));
+    }
+
+    static Hello Read(int fd) {
+        uint32_t header[3] = {};
+        if (!ReadFull(fd, header, sizeof(header)) || header[0] != kMagic) {
+            throw std::runtime_error{"not a tc_serve socket"};
+        }
+        Hello hello;
+        hello.input_bytes.resize(header[1]);
+        hello.output_bytes.resize(header[2]);
+        if (!ReadFull(fd, hello.input_bytes.data(), hello.input_bytes.size() * sizeof(uint64_t)) ||
+            !ReadFull(fd, hello.output_bytes.data(), hello.output_bytes.size() * sizeof(uint64_t))) {
+            throw std::runtime_error{"truncated hello"};
+        }
+        return hello;
+    }
+};
+
+} // namespace tc::server
+
+#endif // SERVER_PROTOCOL_HPP_
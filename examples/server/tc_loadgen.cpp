@@ -0,0 +1,172 @@
+// Closed-loop load generator for tc_serve: every connection sends its next request as soon as
+// the previous answer arrived. Reports throughput and the latency distribution, so runs with
+// different --connections trace the server's throughput/latency curve.
+//
+// usage: tc_loadgen --socket <path> [--connections 16] [--seconds 5]
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions {
+    std::string socket_path;
+    size_t connections = 16;
+    double seconds = 5.0;
+};
+
+const char* kUsage = "usage: tc_loadgen --socket <path> [--connections 16] [--seconds 5]\n";
+
+LoadOptions ParseArgs(int argc, const char* argv[]) {
+    LoadOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error{"missing value for flag " + arg};
+        }
+        const std::string value = argv[++i];
+        if (arg == "--socket") {
+            opt.socket_path = value;
+        } else if (arg == "--connections") {
+            opt.connections = static_cast<size_t>(std::stoull(value));
+        } else if (arg == "--seconds") {
+            opt.seconds = std::stod(value);
+        } else {
+            throw std::runtime_error{"unknown flag: " + arg};
+        }
+    }
+    if (opt.socket_path.empty()) {
+        throw std::runtime_error{"--socket is required"};
+    }
+    if (opt.connections == 0) {
+        throw std::runtime_error{"--connections must be positive"};
+    }
+    return opt;
+}
+
+int ConnectUnix(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error{"socket path too long: " + path};
+    }
+    path.copy(addr.sun_path, path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error{"socket: " + std::string{std::strerror(errno)}};
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error{"unable to connect to " + path + ": " + error};
+    }
+    return fd;
+}
+
+// request latencies of one connection in microseconds
+std::vector<double> RunConnection(const std::string& path, Clock::time_point deadline) {
+    const int fd = ConnectUnix(path);
+    const tc::server::Hello hello = tc::server::Hello::Read(fd);
+
+    std::string request;
+    for (uint64_t bytes : hello.input_bytes) {
+        request.append(bytes, '\0');
+    }
+    uint64_t response_bytes = 0;
+    for (uint64_t bytes : hello.output_bytes) {
+        response_bytes += bytes;
+    }
+    std::string response(response_bytes, '\0');
+
+    std::vector<double> latencies;
+    latencies.reserve(1 << 16);
+    while (Clock::now() < deadline) {
+        const Clock::time_point start = Clock::now();
+        tc::server::WriteFull(fd, request.data(), request.size());
+        if (!tc::server::ReadFull(fd, response.data(), response.size())) {
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    ::close(fd);
+    return latencies;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void Run(const LoadOptions& opt) {
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline =
+        start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>{opt.seconds});
+
+    std::vector<std::vector<double>> per_connection(opt.connections);
+    std::vector<std::string> errors(opt.connections);
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < opt.connections; ++c) {
+        threads.emplace_back([&, c] {
+            try {
+                per_connection[c] = RunConnection(opt.socket_path, deadline);
+            } catch (const std::exception& e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const std::string& error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error{error};
+        }
+    }
+
+    std::vector<double> latencies;
+    for (const std::vector<double>& l : per_connection) {
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+    if (latencies.empty()) {
+        throw std::runtime_error{"no request completed"};
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::printf("connections %zu  requests %zu  throughput %.0f req/s\n", opt.connections, latencies.size(),
+                static_cast<double>(latencies.size()) / elapsed);
+    std::printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", Percentile(latencies, 0.50),
+                Percentile(latencies, 0.90), Percentile(latencies, 0.99), latencies.back());
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        Run(ParseArgs(argc, argv));
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << '\n' << kUsage;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+// Local inference server: answers single-row requests over a Unix socket (see protocol.hpp)
+// and runs them in dynamic batches. Each power-of-two batch size up to --max-batch gets its
+// own specialization of the model, JIT-compiled or loaded from <library-dir>/b<N>.so as built by
+// `tc.x model.onnx --batch N --emit-shared b<N>.so`.
+//
+// usage: tc_serve <model.onnx> --socket <path> [--max-batch 8] [--max-delay-us 1000]
+//                 [--library-dir <dir>] [--threads 0]
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "graph/graph.hpp"
+#include "graph/rebatch.hpp"
+#include "onnx_loader/onnx_loader.hpp"
+#include "protocol.hpp"
+#include "runtime/batcher.hpp"
+#include "runtime/compiled_model.hpp"
+#include "runtime/thread_pool.hpp"
+
+namespace {
+
+struct ServeOptions {
+    std::string model_path;
+    std::string socket_path;
+    std::string library_dir;
+    size_t max_batch = 8;
+    int64_t max_delay_us = 1000;
+    size_t threads = 0; // 0: no pool, every batch runs on the dispatcher thread
+};
+
+const char* kUsage =
+    "usage: tc_serve <model.onnx> --socket <path> [--max-batch 8] [--max-delay-us 1000]\n"
+    "                [--library-dir <dir>] [--threads 0]\n";
+
+size_t ParseCount(const std::string& value, const std::string& flag) {
+    size_t used = 0;
+    unsigned long long n = 0;
+    try {
+        n = std::stoull(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size()) {
+        throw std::runtime_error{"invalid value for " + flag + ": " + value};
+    }
+    return static_cast<size_t>(n);
+}
+
+ServeOptions ParseArgs(int argc, const char* argv[]) {
+    ServeOptions opt;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&] {
+            if (i + 1 >= argc) {
+                throw std::runtime_error{"missing value for flag " + arg};
+            }
+            return std::string{argv[++i]};
+        };
+        if (arg == "--socket") {
+            opt.socket_path = value();
+        } else if (arg == "--library-dir") {
+            opt.library_dir = value();
+        } else if (arg == "--max-batch") {
+            opt.max_batch = ParseCount(value(), arg);
+        } else if (arg == "--max-delay-us") {
+            opt.max_delay_us = static_cast<int64_t>(ParseCount(value(), arg));
+        } else if (arg == "--threads") {
+            opt.threads = ParseCount(value(), arg);
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error{"unknown flag: " + arg};
+        } else if (opt.model_path.empty()) {
+            opt.model_path = arg;
+        } else {
+            throw std::runtime_error{"too many positional arguments"};
+        }
+    }
+    if (opt.model_path.empty() || opt.socket_path.empty()) {
+        throw std::runtime_error{"model path and --socket are required"};
+    }
+    if (opt.max_batch == 0) {
+        throw std::runtime_error{"--max-batch must be positive"};
+    }
+    return opt;
+}
+
+std::vector<std::shared_ptr<const tc::runtime::CompiledModel>> CompileVariants(const ServeOptions& opt) {
+    tc::OnnxLoader loader;
+    const tc::Graph graph = loader.Load(opt.model_path);
+
+    std::vector<size_t> sizes;
+    for (size_t b = 1; b < opt.max_batch; b *= 2) {
+        sizes.push_back(b);
+    }
+    sizes.push_back(opt.max_batch);
+
+    std::vector<std::shared_ptr<const tc::runtime::CompiledModel>> variants;
+    for (size_t b : sizes) {
+        const tc::Graph batched = tc::Rebatch(graph, static_cast<int64_t>(b));
+        if (opt.library_dir.empty()) {
+            variants.push_back(tc::runtime::CompiledModel::Jit(batched));
+        } else {
+            const std::filesystem::path library = std::filesystem::path{opt.library_dir} / ("b" + std::to_string(b) + ".so");
+            variants.push_back(tc::runtime::CompiledModel::LoadSharedLibrary(library.string(), batched));
+        }
+        std::fprintf(stderr, "tc_serve: batch %zu ready\n", b);
+    }
+    return variants;
+}
+
+int ListenUnix(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error{"socket path too long: " + path};
+    }
+    path.copy(addr.sun_path, path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error{"socket: " + std::string{std::strerror(errno)}};
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error{"unable to listen on " + path + ": " + error};
+    }
+    return fd;
+}
+
+void ServeConnection(int fd, tc::runtime::DynamicBatcher& batcher, const tc::server::Hello& hello) {
+    std::vector<std::vector<std::byte>> inputs;
+    std::vector<std::vector<std::byte>> outputs;
+    std::vector<const void*> input_ptrs;
+    std::vector<void*> output_ptrs;
+    for (uint64_t bytes : hello.input_bytes) {
+        input_ptrs.push_back(inputs.emplace_back(bytes).data());
+    }
+    for (uint64_t bytes : hello.output_bytes) {
+        output_ptrs.push_back(outputs.emplace_back(bytes).data());
+    }
+
+    try {
+        hello.Write(fd);
+        while (true) {
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                if (!tc::server::ReadFull(fd, inputs[i].data(), inputs[i].size())) {
+                    return;
+                }
+            }
+            batcher.Infer(input_ptrs, output_ptrs);
+            for (const std::vector<std::byte>& output : outputs) {
+                tc::server::WriteFull(fd, output.data(), output.size());
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "tc_serve: connection dropped: %s\n", e.what());
+    }
+}
+
+int g_stop_pipe[2] = {-1, -1};
+
+void OnSignal(int /*signo*/) {
+    const char byte = 0;
+    [[maybe_unused]] const ssize_t n = ::write(g_stop_pipe[1], &byte, 1);
+}
+
+void Serve(const ServeOptions& opt) {
+    tc::runtime::BatcherOptions batcher_options;
+    batcher_options.max_delay = std::chrono::microseconds{opt.max_delay_us};
+    if (opt.threads != 0) {
+        batcher_options.pool = std::make_shared<tc::runtime::ThreadPool>(tc::runtime::ThreadPoolOptions{opt.threads, {}});
+    }
+    tc::runtime::DynamicBatcher batcher{CompileVariants(opt), batcher_options};
+
+    tc::server::Hello hello;
+    hello.input_bytes.assign(batcher.InputRowBytes().begin(), batcher.InputRowBytes().end());
+    hello.output_bytes.assign(batcher.OutputRowBytes().begin(), batcher.OutputRowBytes().end());
+
+    if (::pipe2(g_stop_pipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error{"pipe: " + std::string{std::strerror(errno)}};
+    }
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    const int listen_fd = ListenUnix(opt.socket_path);
+    std::fprintf(stderr, "tc_serve: listening on %s (max batch %zu, max delay %lld us)\n", opt.socket_path.c_str(),
+                 batcher.MaxBatch(), static_cast<long long>(opt.max_delay_us));
+
+    // connection threads are detached and remove their fd when they finish, so a long-running
+    // server holds only the live ones; shutdown waits for client_fds to drain
+    std::mutex clients_mutex;
+    std::condition_variable clients_done;
+    std::vector<int> client_fds;
+    std::string poll_error; // thrown once the connections are drained
+    while (true) {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {g_stop_pipe[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            poll_error = "poll: " + std::string{std::strerror(errno)};
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        {
+            std::lock_guard lock{clients_mutex};
+            client_fds.push_back(fd);
+        }
+        try {
+            std::thread{[&, fd] {
+                ServeConnection(fd, batcher, hello);
+                std::lock_guard lock{clients_mutex};
+                client_fds.erase(std::find(client_fds.begin(), client_fds.end(), fd));
+                ::close(fd);
+                // under the lock: Serve() cannot return, and destroy what this thread uses, before it lets go
+                clients_done.notify_all();
+            }}.detach();
+        } catch (const std::system_error& e) {
+            // leaving Serve() here would destroy what the other connection threads use
+            std::fprintf(stderr, "tc_serve: connection refused: %s\n", e.what());
+            std::lock_guard lock{clients_mutex};
+            client_fds.erase(std::find(client_fds.begin(), client_fds.end(), fd));
+            ::close(fd);
+        }
+    }
+
+    // unblock the connection threads, then let the batcher finish what is queued
+    {
+        std::unique_lock lock{clients_mutex};
+        for (int fd : client_fds) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        clients_done.wait(lock, [&] { return client_fds.empty(); });
+    }
+    ::close(listen_fd);
+    ::unlink(opt.socket_path.c_str());
+    if (!poll_error.empty()) {
+        throw std::runtime_error{poll_error};
+    }
+
+    const tc::runtime::BatcherStats stats = batcher.Stats();
+    std::fprintf(stderr, "tc_serve: %llu requests in %llu batches (mean %.2f, %llu padded rows)\n",
+                 static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.batches),
+                 stats.batches != 0 ? static_cast<double>(stats.requests) / static_cast<double>(stats.batches) : 0.0,
+                 static_cast<unsigned long long>(stats.padded_rows));
+}
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        Serve(ParseArgs(argc, argv));
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << '\n' << kUsage;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
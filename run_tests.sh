@@ -1,5 +1,6 @@
 #!/bin/bash
+set -e
 
 pushd build
-    ctest
+    ctest --output-on-failure
 popd
@@ -0,0 +1,51 @@
+// counting replacements of the global allocation functions, for the allocs column of --time-report;
+// over-aligned allocations keep the library's functions and are not counted
+
+#include <cstdlib>
+#include <new>
+
+#include "helpers/phase_timer.hpp"
+
+void* operator new(std::size_t size, const std::nothrow_t& /*tag*/) noexcept {
+    hlp::g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return ::operator new(size, tag);
+}
+
+void* operator new(std::size_t size) {
+    if (void* p = ::operator new(size, std::nothrow)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t /*size*/) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t& /*tag*/) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t& /*tag*/) noexcept {
+    std::free(p);
+}
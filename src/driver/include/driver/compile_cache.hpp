@@ -0,0 +1,46 @@
+#ifndef COMPILE_CACHE_HPP_
+#define COMPILE_CACHE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "driver/driver_options.hpp"
+
+namespace tc::driver {
+
+// On-disk content-addressed store of emitted artifacts.
+// Every artifact is a flat file <dir>/<key>.<kind>; file mtime is the LRU clock.
+class CompileCache {
+  public:
+    CompileCache(std::filesystem::path dir, uintmax_t max_bytes);
+
+    bool Contains(const std::string& key, std::string_view kind) const;
+
+    // copies the cached artifact to dst (or stdout for "-") and marks it recently used
+    bool Fetch(const std::string& key, std::string_view kind, const std::string& dst) const;
+
+    // atomically publishes src under the key, safe against concurrent writers
+    void Store(const std::string& key, std::string_view kind, const std::filesystem::path& src);
+
+    // drops least recently used artifacts until the directory fits into max_bytes
+    void Evict() const;
+
+  private:
+    std::filesystem::path dir_;
+    uintmax_t max_bytes_;
+
+    std::filesystem::path EntryPath(const std::string& key, std::string_view kind) const;
+};
+
+// combines the graph fingerprint with every option that changes the emitted artifacts
+std::string CacheKey(std::string_view graph_fingerprint, const DriverOptions& opt);
+
+// true if every requested artifact was served from the cache
+bool FetchArtifacts(const CompileCache& cache, const std::string& key, const DriverOptions& opt);
+void StoreArtifacts(CompileCache& cache, const std::string& key, const DriverOptions& opt);
+
+} // namespace tc::driver
+
+#endif // COMPILE_CACHE_HPP_
@@ -1,7 +1,9 @@
 #ifndef DRIVER_OPTIONS_HPP_
 #define DRIVER_OPTIONS_HPP_
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace tc::driver {
 
@@ -11,13 +13,58 @@ struct DriverOptions {
     std::string emit_mlir_path;
     std::string emit_llvm_path;
     std::string emit_asm_path;
+    std::string emit_obj_path;
+    std::string emit_shared_path;
+    std::string emit_header_path;
+
+    // > 0: compile the graph rebatched to this many rows (see tc::Rebatch)
+    int64_t batch = 0;
+    // > 0: move Conv regions to the NCHW[b]c layout with this b (see tc::AssignBlockedLayout)
+    int64_t channel_block = 0;
+    // sizes of the dynamic input dimensions to compile static variants for
+    // (see MlirEmitterOptions::specializations)
+    std::vector<std::vector<int64_t>> specializations;
+    // wrap every operation in profiling hooks (see MlirEmitterOptions::instrument)
+    bool instrument = false;
+    // tuning database of loop schedules (see mlir_backend/tuning.hpp), none if empty
+    std::string tuning_db_path;
+    // lowering of Conv ops (see MlirEmitterOptions::conv_algorithm): auto, direct, im2col, winograd,
+    // depthwise or pointwise
+    std::string conv_algorithm = "auto";
 
     std::string target_triple;
     std::string mcpu;
+    // compile once per CPU and link the objects behind a load-time CPU dispatcher (see fat_binary.hpp)
+    std::vector<std::string> mcpus;
     std::string opt_level = "-O2";
+    bool external_tools = false;
+    bool text_emitter = false;
+
+    std::string cache_dir;
+    uintmax_t cache_max_bytes = uintmax_t{1} << 30;
+
+    // print the per-op cost model sorted by this key (see tc::ParseCostSortKey) to stderr
+    std::string cost_report;
+    // machine balance for the roofline bound of the cost report and --dot-cost
+    double ridge_flops_per_byte = 8.0;
+    bool dot_cost = false;
+
+    // time the compiler's own phases (see helpers/phase_timer.hpp): a table on stderr and/or a Chrome trace
+    bool time_report = false;
+    std::string trace_out_path;
+
+    bool NeedsCodegen() const {
+        return !emit_llvm_path.empty() || !emit_asm_path.empty() || !emit_obj_path.empty() || !emit_shared_path.empty();
+    }
 
     bool NeedsMlir() const {
-        return !emit_mlir_path.empty() || !emit_llvm_path.empty() || !emit_asm_path.empty();
+        return !emit_mlir_path.empty() || NeedsCodegen();
+    }
+
+    // object/shared/header outputs switch the whole compile to the C ABI:
+    // bare-pointer arguments plus a caller-provided workspace
+    bool UsesCAbi() const {
+        return !emit_obj_path.empty() || !emit_shared_path.empty() || !emit_header_path.empty();
     }
 };
 
@@ -0,0 +1,34 @@
+#ifndef FAT_BINARY_HPP_
+#define FAT_BINARY_HPP_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "driver/driver_options.hpp"
+
+namespace tc::driver {
+
+// CPU features (as named by __builtin_cpu_supports) a machine needs to run code compiled for
+// -mcpu=cpu; throws for CPUs without a dispatch rule, e.g. "native" or non-x86 ones
+std::vector<std::string> CpuDispatchFeatures(const std::string& cpu);
+
+// suffix of the symbols compiled for cpu, e.g. "_x86_64_v3"
+std::string CpuSymbolSuffix(const std::string& cpu);
+
+// C source defining every symbol as a GNU ifunc: when the object is loaded it binds to
+// symbol + CpuSymbolSuffix(cpu) for the first of cpus the machine supports, or for the last one
+std::string CpuDispatcherSource(const std::vector<std::string>& cpus, const std::vector<std::string>& symbols);
+
+// compiles the module for one target: opt narrowed to a single --mcpu with --emit-obj set to a scratch
+// file and every other output cleared; the module's symbols must carry symbol_suffix
+using TargetCompiler = std::function<void(const DriverOptions& target, const std::string& symbol_suffix)>;
+
+// Runs compile_target for every opt.mcpus entry concurrently, then links the objects with the
+// dispatcher of symbols into --emit-obj (a relocatable cc -r link) and/or --emit-shared.
+void EmitFatBinary(const DriverOptions& opt, const std::vector<std::string>& symbols,
+                   const TargetCompiler& compile_target);
+
+} // namespace tc::driver
+
+#endif // FAT_BINARY_HPP_
@@ -0,0 +1,34 @@
+#ifndef INPROCESS_LOWERING_HPP_
+#define INPROCESS_LOWERING_HPP_
+
+#include <string>
+
+#include "driver/driver_options.hpp"
+
+#if defined(TC_HAVE_MLIR)
+#include <mlir/IR/BuiltinOps.h>
+#endif
+
+namespace tc::driver {
+
+// true when tc was built against the MLIR/LLVM libraries (TC_HAVE_MLIR)
+bool InProcessLoweringAvailable();
+
+// Parses mlir_text, runs LlvmLoweringPasses() through mlir::PassManager, translates to LLVM IR
+// and runs the LLVM code generator, all without touching disk or spawning tools.
+// Writes the requested --emit-llvm/--emit-asm/--emit-obj/--emit-shared outputs.
+void LowerInProcess(const DriverOptions& opt, const std::string& mlir_text);
+
+#if defined(TC_HAVE_MLIR)
+// same, starting from a module that already lives in memory (e.g. from BuildMlirModule);
+// the module is lowered in place
+void LowerInProcess(const DriverOptions& opt, mlir::ModuleOp module);
+
+// runs LlvmLoweringPasses() on module in place, leaving it in the LLVM dialect with the
+// LLVM IR translations registered on its context; initializes the LLVM targets on first use
+void RunLlvmLoweringPipeline(mlir::ModuleOp module, bool bare_ptr_call_conv = false);
+#endif
+
+} // namespace tc::driver
+
+#endif // INPROCESS_LOWERING_HPP_
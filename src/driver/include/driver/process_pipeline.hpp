@@ -0,0 +1,51 @@
+#ifndef PROCESS_PIPELINE_HPP_
+#define PROCESS_PIPELINE_HPP_
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace tc::driver {
+
+using Command = std::vector<std::string>;
+
+std::string JoinCommand(const Command& argv);
+
+// Commands chained stdout -> stdin like a shell pipeline, started with posix_spawnp (PATH lookup, no shell).
+// The caller feeds the first stage through InputFd(); the last stage writes to output_fd, or to a pipe
+// readable through OutputFd() when output_fd is kPipeOutput. Unwaited stages are killed on destruction.
+class ProcessPipeline {
+  public:
+    static constexpr int kPipeOutput = -1;
+
+    ProcessPipeline(std::vector<Command> stages, int output_fd);
+    ~ProcessPipeline();
+
+    ProcessPipeline(const ProcessPipeline&) = delete;
+    ProcessPipeline& operator=(const ProcessPipeline&) = delete;
+
+    int InputFd() const { return input_fd_; }
+    int OutputFd() const { return output_fd_; }
+
+    // EOF for the first stage
+    void CloseInput();
+    // stops reading the last stage; it dies with SIGPIPE on its next write
+    void CloseOutput();
+
+    // closes the input, reaps every stage and throws for the first one that failed.
+    // A stage killed by SIGPIPE only lost its reader; the reader's own failure is what gets reported.
+    void Wait();
+
+  private:
+    std::vector<Command> stages_;
+    std::vector<pid_t> pids_;
+    int input_fd_ = -1;
+    int output_fd_ = -1;
+
+    void Abort();
+};
+
+} // namespace tc::driver
+
+#endif // PROCESS_PIPELINE_HPP_
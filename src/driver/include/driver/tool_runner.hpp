@@ -2,16 +2,55 @@
 #define TOOL_RUNNER_HPP_
 
 #include <filesystem>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "driver/driver_options.hpp"
+#include "helpers/output_sink.hpp"
 
 namespace tc::driver {
 
 void SetupLogging(int argc, const char* argv[]);
 std::string ReadTextFile(const std::filesystem::path& path);
 void WriteTextFile(const std::string& path, const std::string& text);
-void LowerToLlvmAndAsm(const DriverOptions& opt, const std::string& mlir_text);
+
+// produces the output piece by piece into the given sink; may be invoked more than once
+using SinkWriter = std::function<void(hlp::OutputSink&)>;
+
+// streams the writer's output to path ("-" is stdout) through a bounded buffer
+void StreamToFile(const std::string& path, const SinkWriter& write);
+
+// Private per-invocation directory for files no tool can avoid, created on first use
+// and removed with its contents.
+class ScratchDir {
+  public:
+    ScratchDir() = default;
+    ~ScratchDir();
+
+    ScratchDir(const ScratchDir&) = delete;
+    ScratchDir& operator=(const ScratchDir&) = delete;
+
+    std::filesystem::path File(std::string_view name);
+
+  private:
+    std::filesystem::path path_;
+};
+
+// passes that lower the emitted module to the LLVM dialect; bare_ptr_call_conv makes every memref
+// argument a plain pointer (C ABI of --emit-obj/--emit-shared)
+std::vector<std::string> LlvmLoweringPasses(bool bare_ptr_call_conv = false);
+
+// the same passes as a textual pipeline, shared by mlir-opt --pass-pipeline and the in-process pass manager
+std::string LlvmLoweringPipelineSpec(bool bare_ptr_call_conv = false);
+
+// cc -shared -o shared_path objects...
+void LinkSharedLibrary(const std::vector<std::filesystem::path>& objects, const std::string& shared_path);
+
+// streams the module produced by write_mlir to --emit-mlir and lowers it to the requested
+// --emit-llvm / --emit-asm / --emit-obj / --emit-shared outputs
+void EmitMlirAndLower(const DriverOptions& opt, const SinkWriter& write_mlir);
 
 } // namespace tc::driver
 
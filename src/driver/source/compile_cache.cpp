@@ -0,0 +1,230 @@
+#include "driver/compile_cache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "driver/inprocess_lowering.hpp"
+#include "driver/tool_runner.hpp"
+#include "helpers/phase_timer.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+
+#if defined(TC_HAVE_MLIR)
+#include <llvm/Config/llvm-config.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace tc::driver {
+
+namespace {
+
+// bump when the key material or the entries change shape; changes to the emitted code bump
+// tc::kEmitterRevision instead
+constexpr const char* kCacheFormat = "tc-cache-v1";
+
+constexpr const char* kLoweringTools[] = {"mlir-opt", "mlir-translate", "llc"};
+
+// a lowering tool as the external pipeline finds it on PATH: the resolved file with its size
+// and modification time, so upgrading the tool changes the key
+std::string ToolIdentity(const char* tool) {
+    const char* path = std::getenv("PATH");
+    std::string_view dirs = path != nullptr ? path : "";
+    while (!dirs.empty()) {
+        const size_t end = std::min(dirs.find(':'), dirs.size());
+        const fs::path candidate = fs::path{std::string{dirs.substr(0, end)}} / tool;
+        dirs.remove_prefix(std::min(end + 1, dirs.size()));
+        std::error_code ec;
+        const fs::path resolved = fs::canonical(candidate, ec);
+        if (ec || !fs::is_regular_file(resolved, ec) || ::access(resolved.c_str(), X_OK) != 0) {
+            continue;
+        }
+        const uintmax_t size = fs::file_size(resolved, ec);
+        const auto mtime = fs::last_write_time(resolved, ec).time_since_epoch().count();
+        return std::string{tool} + " " + resolved.string() + " " + std::to_string(size) + " " + std::to_string(mtime);
+    }
+    return std::string{tool} + " missing";
+}
+
+struct Artifact {
+    std::string_view kind;
+    const std::string& path;
+};
+
+std::vector<Artifact> RequestedArtifacts(const DriverOptions& opt) {
+    std::vector<Artifact> out;
+    if (!opt.emit_mlir_path.empty()) out.push_back({"mlir", opt.emit_mlir_path});
+    if (!opt.emit_llvm_path.empty()) out.push_back({"ll", opt.emit_llvm_path});
+    if (!opt.emit_asm_path.empty()) out.push_back({"s", opt.emit_asm_path});
+    if (!opt.emit_obj_path.empty()) out.push_back({"o", opt.emit_obj_path});
+    if (!opt.emit_shared_path.empty()) out.push_back({"so", opt.emit_shared_path});
+    return out;
+}
+
+} // namespace
+
+CompileCache::CompileCache(fs::path dir, uintmax_t max_bytes)
+    : dir_{std::move(dir)}, max_bytes_{max_bytes} {
+    fs::create_directories(dir_);
+}
+
+fs::path CompileCache::EntryPath(const std::string& key, std::string_view kind) const {
+    return dir_ / (key + "." + std::string{kind});
+}
+
+bool CompileCache::Contains(const std::string& key, std::string_view kind) const {
+    std::error_code ec;
+    return fs::is_regular_file(EntryPath(key, kind), ec);
+}
+
+bool CompileCache::Fetch(const std::string& key, std::string_view kind, const std::string& dst) const {
+    const fs::path entry = EntryPath(key, kind);
+    std::error_code ec;
+    if (!fs::is_regular_file(entry, ec)) {
+        return false;
+    }
+
+    if (dst == "-") {
+        WriteTextFile(dst, ReadTextFile(entry));
+    } else {
+        fs::copy_file(entry, dst, fs::copy_options::overwrite_existing);
+    }
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    spdlog::info("cache hit: {} -> {}", entry.string(), dst);
+    return true;
+}
+
+void CompileCache::Store(const std::string& key, std::string_view kind, const fs::path& src) {
+    const fs::path entry = EntryPath(key, kind);
+    const fs::path staging = dir_ / ("." + entry.filename().string() + ".tmp." + std::to_string(::getpid()));
+
+    fs::copy_file(src, staging, fs::copy_options::overwrite_existing);
+    fs::rename(staging, entry);
+    spdlog::info("cache store: {}", entry.string());
+}
+
+void CompileCache::Evict() const {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type mtime;
+        uintmax_t size;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& de : fs::directory_iterator{dir_, ec}) {
+        if (!de.is_regular_file(ec) || de.path().filename().string().starts_with(".")) {
+            continue;
+        }
+        Entry e{de.path(), de.last_write_time(ec), de.file_size(ec)};
+        total += e.size;
+        entries.push_back(std::move(e));
+    }
+    if (total <= max_bytes_) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& l, const Entry& r) {
+        return l.mtime < r.mtime;
+    });
+    for (const Entry& e : entries) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        if (fs::remove(e.path, ec)) {
+            total -= e.size;
+            spdlog::info("cache evict: {}", e.path.string());
+        }
+    }
+}
+
+std::string CacheKey(std::string_view graph_fingerprint, const DriverOptions& opt) {
+    std::string key_material;
+    key_material += kCacheFormat;
+    key_material += "\nemitter " + std::to_string(kEmitterRevision);
+    // what lowers the module: the LLVM linked in, or the external tools
+    if (opt.external_tools || !InProcessLoweringAvailable()) {
+        for (const char* tool : kLoweringTools) {
+            key_material += '\n' + ToolIdentity(tool);
+        }
+    } else {
+#if defined(TC_HAVE_MLIR)
+        key_material += "\nin-process llvm " LLVM_VERSION_STRING;
+#endif
+    }
+    for (std::string_view field : {graph_fingerprint,
+                                   std::string_view{opt.target_triple},
+                                   std::string_view{opt.mcpu},
+                                   std::string_view{opt.opt_level},
+                                   std::string_view{opt.UsesCAbi() ? "c-abi" : "memref-abi"},
+                                   std::string_view{opt.instrument ? "instrumented" : "plain"},
+                                   std::string_view{opt.text_emitter ? "text-emitter" : "op-builder"},
+                                   std::string_view{opt.conv_algorithm}}) {
+        key_material += '\n';
+        key_material += field;
+    }
+    for (const std::string& cpu : opt.mcpus) {
+        key_material += "\nmcpus " + cpu;
+    }
+    for (const std::vector<int64_t>& sizes : opt.specializations) {
+        key_material += "\nspecialize";
+        for (int64_t size : sizes) {
+            key_material += ' ' + std::to_string(size);
+        }
+    }
+    // schedules change the emitted loops, so the key covers the database's contents, not its path
+    std::error_code ec;
+    if (!opt.tuning_db_path.empty() && fs::exists(opt.tuning_db_path, ec)) {
+        key_material += "\ntuning\n" + ReadTextFile(opt.tuning_db_path);
+    }
+
+    // short FNV-1a over the already strong fingerprint plus the tuning fields
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : key_material) {
+        h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    }
+    static constexpr char kDigits[] = "0123456789abcdef";
+    std::string suffix(16, '0');
+    for (size_t i = 0; i < 16; ++i) {
+        suffix[i] = kDigits[(h >> (60 - 4 * i)) & 0xf];
+    }
+    return std::string{graph_fingerprint} + "-" + suffix;
+}
+
+bool FetchArtifacts(const CompileCache& cache, const std::string& key, const DriverOptions& opt) {
+    const hlp::ScopedPhase phase{"cache fetch"};
+    const std::vector<Artifact> artifacts = RequestedArtifacts(opt);
+    for (const Artifact& a : artifacts) {
+        if (!cache.Contains(key, a.kind)) {
+            return false;
+        }
+    }
+    for (const Artifact& a : artifacts) {
+        if (!cache.Fetch(key, a.kind, a.path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StoreArtifacts(CompileCache& cache, const std::string& key, const DriverOptions& opt) {
+    const hlp::ScopedPhase phase{"cache store"};
+    for (const Artifact& a : RequestedArtifacts(opt)) {
+        if (a.path == "-") {
+            continue;
+        }
+        cache.Store(key, a.kind, a.path);
+    }
+    cache.Evict();
+}
+
+} // namespace tc::driver
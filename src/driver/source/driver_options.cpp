@@ -1,5 +1,8 @@
 #include "driver/driver_options.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -10,6 +13,8 @@ namespace tc::driver {
 
 namespace {
 
+constexpr std::string_view kConvAlgorithms[] = {"auto", "direct", "im2col", "winograd", "depthwise", "pointwise"};
+
 std::string RequireValue(int argc, const char* argv[], int& i, std::string_view flag) {
     if (i + 1 >= argc) {
         throw std::runtime_error{"missing value for flag " + std::string(flag)};
@@ -18,6 +23,74 @@ std::string RequireValue(int argc, const char* argv[], int& i, std::string_view
     return argv[i];
 }
 
+uintmax_t ParseMebibytes(const std::string& value, std::string_view flag) {
+    size_t used = 0;
+    unsigned long long mib = 0;
+    try {
+        mib = std::stoull(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size()) {
+        throw std::runtime_error{"invalid size for flag " + std::string(flag) + ": " + value};
+    }
+    return static_cast<uintmax_t>(mib) << 20;
+}
+
+// what names the value in the error, e.g. "batch size"
+int64_t ParsePositive(const std::string& value, std::string_view flag, std::string_view what) {
+    size_t used = 0;
+    long long number = 0;
+    try {
+        number = std::stoll(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || number <= 0) {
+        throw std::runtime_error{"invalid " + std::string(what) + " for flag " + std::string(flag) + ": " + value};
+    }
+    return static_cast<int64_t>(number);
+}
+
+double ParseRidge(const std::string& value, std::string_view flag) {
+    size_t used = 0;
+    double ridge = 0;
+    try {
+        ridge = std::stod(value, &used);
+    } catch (const std::exception&) {
+        used = 0;
+    }
+    if (used == 0 || used != value.size() || !(ridge > 0)) {
+        throw std::runtime_error{"invalid FLOP/byte ratio for flag " + std::string(flag) + ": " + value};
+    }
+    return ridge;
+}
+
+std::vector<int64_t> ParseSizes(const std::string& value, std::string_view flag) {
+    std::vector<int64_t> sizes;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        const size_t end = std::min(value.find(',', begin), value.size());
+        sizes.push_back(ParsePositive(value.substr(begin, end - begin), flag, "batch size"));
+        begin = end + 1;
+    }
+    return sizes;
+}
+
+std::vector<std::string> SplitList(const std::string& value, std::string_view flag) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        const size_t end = std::min(value.find(',', begin), value.size());
+        if (end == begin) {
+            throw std::runtime_error{"empty list entry for flag " + std::string(flag) + ": " + value};
+        }
+        items.push_back(value.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
 } // namespace
 
 std::string Usage(const char* argv0) {
@@ -30,11 +103,55 @@ std::string Usage(const char* argv0) {
         << "  --emit-mlir <path>    write emitted MLIR\n"
         << "  --emit-llvm <path>    lower to LLVM IR\n"
         << "  --emit-asm <path>     lower to assembly\n"
+        << "  --emit-obj <path>     lower to a relocatable object (C ABI)\n"
+        << "  --emit-shared <path>  link a shared library (C ABI, needs cc)\n"
+        << "  --emit-header <path>  write the C header of the entry point\n"
+        << "\n"
+        << "graph:\n"
+        << "  --batch <N>           specialize for N rows: the leading dimension of\n"
+        << "                        the inputs and of everything computed from them\n"
+        << "  --specialize <N[,M..]> also compile a static variant for these sizes of\n"
+        << "                        the dynamic input dimensions, in header order;\n"
+        << "                        repeatable, the entry dispatches per call\n"
+        << "  --instrument          call the runtime profiling hooks around every\n"
+        << "                        operation (see runtime/profiler.hpp)\n"
+        << "  --tuning-db <path>    MatMul/Gemm loop schedules found by\n"
+        << "                        `tc-bench --autotune`; untuned ops keep the\n"
+        << "                        default loops\n"
+        << "  --conv <algorithm>    lowering of every Conv: auto (per op, by shape),\n"
+        << "                        direct, im2col, winograd, depthwise or\n"
+        << "                        pointwise\n"
+        << "  --nchwc <b>           run Convs and the elementwise ops between them\n"
+        << "                        in the blocked NCHW[b]c layout, b the SIMD\n"
+        << "                        width in floats (8 for AVX2, 16 for AVX-512)\n"
         << "\n"
         << "llvm tuning:\n"
         << "  --target-triple <triple>\n"
         << "  --mcpu <cpu>\n"
-        << "  --O0 | --O1 | --O2 | --O3\n";
+        << "  --mcpus <cpu,cpu..>   one object per CPU in a single library; the best\n"
+        << "                        one the machine supports is bound at load time,\n"
+        << "                        the last CPU is the fallback (--emit-obj/-shared)\n"
+        << "  --O0 | --O1 | --O2 | --O3\n"
+        << "  --external-tools      lower via mlir-opt/mlir-translate/llc even if\n"
+        << "                        tc was built with the MLIR libraries\n"
+        << "  --text-emitter        emit MLIR as text and re-parse it instead of\n"
+        << "                        building the module in memory\n"
+        << "\n"
+        << "compilation cache:\n"
+        << "  --cache-dir <path>    reuse artifacts of identical graph+flags\n"
+        << "  --cache-size <MiB>    LRU size bound of the cache dir (default 1024)\n"
+        << "\n"
+        << "diagnostics:\n"
+        << "  --cost-report <key>   print FLOPs, bytes and arithmetic intensity of\n"
+        << "                        every op to stderr, sorted by order, flops,\n"
+        << "                        bytes or intensity\n"
+        << "  --dot-cost            add the same costs to --emit-dot, ops colored by\n"
+        << "                        roofline bound (blue memory, red compute)\n"
+        << "  --ridge <FLOP/byte>   machine balance that separates the two bounds\n"
+        << "                        (default 8)\n"
+        << "  --time-report         print wall time, RSS change and allocations of\n"
+        << "                        every compiler phase to stderr\n"
+        << "  --trace-out <path>    write the phases as Chrome trace JSON\n";
     return oss.str();
 }
 
@@ -60,6 +177,46 @@ DriverOptions ParseArgs(int argc, const char* argv[]) {
             opt.emit_asm_path = RequireValue(argc, argv, i, arg);
             continue;
         }
+        if (arg == "--emit-obj") {
+            opt.emit_obj_path = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--emit-shared") {
+            opt.emit_shared_path = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--emit-header") {
+            opt.emit_header_path = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--batch") {
+            opt.batch = ParsePositive(RequireValue(argc, argv, i, arg), arg, "batch size");
+            continue;
+        }
+        if (arg == "--nchwc") {
+            opt.channel_block = ParsePositive(RequireValue(argc, argv, i, arg), arg, "channel block");
+            continue;
+        }
+        if (arg == "--specialize") {
+            opt.specializations.push_back(ParseSizes(RequireValue(argc, argv, i, arg), arg));
+            continue;
+        }
+        if (arg == "--instrument") {
+            opt.instrument = true;
+            continue;
+        }
+        if (arg == "--tuning-db") {
+            opt.tuning_db_path = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--conv") {
+            opt.conv_algorithm = RequireValue(argc, argv, i, arg);
+            if (std::find(std::begin(kConvAlgorithms), std::end(kConvAlgorithms), opt.conv_algorithm) ==
+                std::end(kConvAlgorithms)) {
+                throw std::runtime_error{"invalid Conv algorithm for flag " + arg + ": " + opt.conv_algorithm};
+            }
+            continue;
+        }
         if (arg == "--target-triple") {
             opt.target_triple = RequireValue(argc, argv, i, arg);
             continue;
@@ -68,10 +225,50 @@ DriverOptions ParseArgs(int argc, const char* argv[]) {
             opt.mcpu = RequireValue(argc, argv, i, arg);
             continue;
         }
+        if (arg == "--mcpus") {
+            opt.mcpus = SplitList(RequireValue(argc, argv, i, arg), arg);
+            continue;
+        }
         if (arg == "--O0" || arg == "--O1" || arg == "--O2" || arg == "--O3") {
             opt.opt_level = std::string{"-O"} + arg.substr(3);
             continue;
         }
+        if (arg == "--external-tools") {
+            opt.external_tools = true;
+            continue;
+        }
+        if (arg == "--text-emitter") {
+            opt.text_emitter = true;
+            continue;
+        }
+        if (arg == "--cache-dir") {
+            opt.cache_dir = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--cache-size") {
+            opt.cache_max_bytes = ParseMebibytes(RequireValue(argc, argv, i, arg), arg);
+            continue;
+        }
+        if (arg == "--cost-report") {
+            opt.cost_report = RequireValue(argc, argv, i, arg);
+            continue;
+        }
+        if (arg == "--dot-cost") {
+            opt.dot_cost = true;
+            continue;
+        }
+        if (arg == "--ridge") {
+            opt.ridge_flops_per_byte = ParseRidge(RequireValue(argc, argv, i, arg), arg);
+            continue;
+        }
+        if (arg == "--time-report") {
+            opt.time_report = true;
+            continue;
+        }
+        if (arg == "--trace-out") {
+            opt.trace_out_path = RequireValue(argc, argv, i, arg);
+            continue;
+        }
         if (!arg.empty() && arg[0] == '-') {
             throw std::runtime_error{"unknown flag: " + arg};
         }
@@ -85,6 +282,21 @@ DriverOptions ParseArgs(int argc, const char* argv[]) {
         throw std::runtime_error{"too many positional arguments"};
     }
 
+    if (opt.emit_shared_path == "-") {
+        throw std::runtime_error{"--emit-shared needs a file path"};
+    }
+    if (!opt.mcpus.empty()) {
+        if (!opt.mcpu.empty()) {
+            throw std::runtime_error{"--mcpu and --mcpus are mutually exclusive"};
+        }
+        if (!opt.emit_llvm_path.empty() || !opt.emit_asm_path.empty()) {
+            throw std::runtime_error{"--mcpus emits objects only, use --mcpu for --emit-llvm/--emit-asm"};
+        }
+        if (opt.emit_obj_path.empty() && opt.emit_shared_path.empty()) {
+            throw std::runtime_error{"--mcpus needs --emit-obj or --emit-shared"};
+        }
+    }
+
     opt.model_path = positional[0];
     return opt;
 }
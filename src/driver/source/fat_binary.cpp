@@ -0,0 +1,190 @@
+#include "driver/fat_binary.hpp"
+
+#include <cctype>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "driver/process_pipeline.hpp"
+#include "driver/tool_runner.hpp"
+#include "helpers/phase_timer.hpp"
+
+namespace fs = std::filesystem;
+
+namespace tc::driver {
+
+namespace {
+
+constexpr const char* kCompiler = "cc";
+
+struct CpuRule {
+    std::vector<std::string> cpus;
+    std::vector<std::string> features;
+};
+
+// x86-64 microarchitecture levels and the CPUs that imply them; a level's features are what
+// __builtin_cpu_supports can check cheaply, not the full list the level guarantees
+const std::vector<CpuRule>& CpuRules() {
+    static const std::vector<CpuRule> rules{
+        {{"x86-64", "generic", "k8", "nocona", "core2", "penryn"}, {}},
+        {{"x86-64-v2", "nehalem", "westmere", "silvermont", "goldmont", "btver2"}, {"sse4.2", "popcnt"}},
+        {{"sandybridge", "ivybridge"}, {"sse4.2", "popcnt", "avx"}},
+        {{"x86-64-v3", "haswell", "broadwell", "skylake", "alderlake", "znver1", "znver2", "znver3"},
+         {"avx2", "fma", "bmi2"}},
+        {{"x86-64-v4", "skylake-avx512", "cascadelake", "cooperlake", "icelake-client", "icelake-server",
+          "tigerlake", "sapphirerapids", "znver4"},
+         {"avx512f", "avx512bw", "avx512dq", "avx512vl"}},
+    };
+    return rules;
+}
+
+fs::path CompileDispatcher(ScratchDir& scratch, const std::string& source) {
+    const fs::path c_file = scratch.File("dispatch.c");
+    const fs::path object = scratch.File("dispatch.o");
+    std::ofstream{c_file} << source;
+    ProcessPipeline cc{{{kCompiler, "-c", "-fPIC", "-O2", "-o", object.string(), c_file.string()}}, STDERR_FILENO};
+    cc.Wait();
+    return object;
+}
+
+} // namespace
+
+std::vector<std::string> CpuDispatchFeatures(const std::string& cpu) {
+    for (const CpuRule& rule : CpuRules()) {
+        for (const std::string& name : rule.cpus) {
+            if (name == cpu) {
+                return rule.features;
+            }
+        }
+    }
+    std::string known;
+    for (const CpuRule& rule : CpuRules()) {
+        for (const std::string& name : rule.cpus) {
+            known += (known.empty() ? "" : ", ") + name;
+        }
+    }
+    throw std::runtime_error{"no load-time dispatch rule for CPU '" + cpu + "', known: " + known};
+}
+
+std::string CpuSymbolSuffix(const std::string& cpu) {
+    std::string suffix = "_";
+    for (char c : cpu) {
+        suffix += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    return suffix;
+}
+
+std::string CpuDispatcherSource(const std::vector<std::string>& cpus, const std::vector<std::string>& symbols) {
+    if (cpus.empty()) {
+        throw std::runtime_error{"CPU dispatch needs at least one CPU"};
+    }
+
+    std::ostringstream out;
+    out << "/* generated by tc; do not edit */\n"
+        << "typedef void (*tc_fn)(void);\n"
+        << "\n"
+        << "/* index into the CPUs the module was compiled for; runs from ifunc resolvers, before constructors */\n"
+        << "static int tc_target(void) {\n"
+        << "    __builtin_cpu_init();\n";
+    for (size_t i = 0; i + 1 < cpus.size(); ++i) {
+        const std::vector<std::string> features = CpuDispatchFeatures(cpus[i]);
+        out << "    if (";
+        for (size_t f = 0; f < features.size(); ++f) {
+            out << (f != 0 ? " && " : "") << "__builtin_cpu_supports(\"" << features[f] << "\")";
+        }
+        out << (features.empty() ? "1" : "") << ") return " << i << "; /* " << cpus[i] << " */\n";
+    }
+    out << "    return " << cpus.size() - 1 << "; /* " << cpus.back() << " */\n"
+        << "}\n";
+
+    for (const std::string& symbol : symbols) {
+        out << "\n";
+        for (const std::string& cpu : cpus) {
+            out << "void " << symbol << CpuSymbolSuffix(cpu) << "(void);\n";
+        }
+        out << "static tc_fn tc_resolve_" << symbol << "(void) {\n"
+            << "    static const tc_fn fns[] = {";
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            out << (i != 0 ? ", " : "") << symbol << CpuSymbolSuffix(cpus[i]);
+        }
+        out << "};\n"
+            << "    return fns[tc_target()];\n"
+            << "}\n"
+            << "void " << symbol << "(void) __attribute__((ifunc(\"tc_resolve_" << symbol << "\")));\n";
+    }
+    return out.str();
+}
+
+void EmitFatBinary(const DriverOptions& opt, const std::vector<std::string>& symbols,
+                   const TargetCompiler& compile_target) {
+    ScratchDir scratch;
+    const std::string dispatcher = CpuDispatcherSource(opt.mcpus, symbols);
+
+    std::vector<fs::path> objects;
+    std::vector<DriverOptions> targets;
+    for (const std::string& cpu : opt.mcpus) {
+        DriverOptions target;
+        target.model_path = opt.model_path;
+        target.batch = opt.batch;
+        target.specializations = opt.specializations;
+        target.instrument = opt.instrument;
+        target.target_triple = opt.target_triple;
+        target.mcpu = cpu;
+        target.opt_level = opt.opt_level;
+        target.external_tools = opt.external_tools;
+        target.text_emitter = opt.text_emitter;
+        objects.push_back(scratch.File("module" + CpuSymbolSuffix(cpu) + ".o"));
+        target.emit_obj_path = objects.back().string();
+        targets.push_back(std::move(target));
+    }
+
+    std::vector<std::exception_ptr> errors(targets.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        workers.emplace_back([&, i] {
+            try {
+                const hlp::ScopedPhase phase{"compile for " + targets[i].mcpu};
+                compile_target(targets[i], CpuSymbolSuffix(targets[i].mcpu));
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const hlp::ScopedPhase phase{"link fat binary"};
+    objects.push_back(CompileDispatcher(scratch, dispatcher));
+    spdlog::info("fat binary: {} targets, {} dispatched symbols", opt.mcpus.size(), symbols.size());
+
+    if (!opt.emit_obj_path.empty()) {
+        const fs::path linked = scratch.File("fat.o");
+        Command cmd{kCompiler, "-r", "-nostdlib", "-o", linked.string()};
+        for (const fs::path& object : objects) {
+            cmd.push_back(object.string());
+        }
+        ProcessPipeline link{{std::move(cmd)}, STDERR_FILENO};
+        link.Wait();
+        WriteTextFile(opt.emit_obj_path, ReadTextFile(linked));
+    }
+    if (!opt.emit_shared_path.empty()) {
+        LinkSharedLibrary(objects, opt.emit_shared_path);
+    }
+}
+
+} // namespace tc::driver
@@ -0,0 +1,221 @@
+#include "driver/inprocess_lowering.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "driver/tool_runner.hpp"
+#include "helpers/phase_timer.hpp"
+
+#if defined(TC_HAVE_MLIR)
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <mlir/IR/BuiltinOps.h>
+#include <mlir/IR/Diagnostics.h>
+#include <mlir/IR/MLIRContext.h>
+#include <mlir/InitAllDialects.h>
+#include <mlir/InitAllPasses.h>
+#include <mlir/Parser/Parser.h>
+#include <mlir/Pass/PassManager.h>
+#include <mlir/Pass/PassRegistry.h>
+#include <mlir/Target/LLVMIR/Dialect/Builtin/BuiltinToLLVMIRTranslation.h>
+#include <mlir/Target/LLVMIR/Dialect/LLVMIR/LLVMToLLVMIRTranslation.h>
+#include <mlir/Target/LLVMIR/Export.h>
+
+#endif // TC_HAVE_MLIR
+
+namespace tc::driver {
+
+#if defined(TC_HAVE_MLIR)
+
+namespace {
+
+void InitializeOnce() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+        mlir::registerAllPasses();
+    });
+}
+
+llvm::CodeGenOptLevel ToCodeGenOptLevel(const std::string& opt_level) {
+    if (opt_level == "-O0") return llvm::CodeGenOptLevel::None;
+    if (opt_level == "-O1") return llvm::CodeGenOptLevel::Less;
+    if (opt_level == "-O3") return llvm::CodeGenOptLevel::Aggressive;
+    return llvm::CodeGenOptLevel::Default;
+}
+
+std::unique_ptr<llvm::TargetMachine> CreateTargetMachine(const DriverOptions& opt) {
+    const std::string triple = opt.target_triple.empty() ? llvm::sys::getDefaultTargetTriple() : opt.target_triple;
+
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (target == nullptr) {
+        throw std::runtime_error{"in-process lowering: unknown target '" + triple + "': " + error};
+    }
+
+    std::string cpu = opt.mcpu;
+    if (cpu == "native") {
+        cpu = llvm::sys::getHostCPUName().str();
+    } else if (cpu.empty()) {
+        cpu = "generic";
+    }
+
+    // objects that end up in a shared library must be position independent
+    const std::optional<llvm::Reloc::Model> reloc =
+        opt.UsesCAbi() ? std::optional{llvm::Reloc::PIC_} : std::nullopt;
+    std::unique_ptr<llvm::TargetMachine> tm{target->createTargetMachine(
+        triple, cpu, "", llvm::TargetOptions{}, reloc, std::nullopt, ToCodeGenOptLevel(opt.opt_level))};
+    if (tm == nullptr) {
+        throw std::runtime_error{"in-process lowering: unable to create target machine for " + triple};
+    }
+    return tm;
+}
+
+std::string EmitCode(llvm::TargetMachine& tm, llvm::Module& module, llvm::CodeGenFileType type) {
+    const hlp::ScopedPhase phase{type == llvm::CodeGenFileType::ObjectFile ? "llvm codegen (obj)" : "llvm codegen (asm)"};
+    llvm::SmallString<0> code;
+    llvm::raw_svector_ostream code_os{code};
+    llvm::legacy::PassManager codegen;
+    if (tm.addPassesToEmitFile(codegen, code_os, nullptr, type)) {
+        throw std::runtime_error{"in-process lowering: target cannot emit this file type"};
+    }
+    codegen.run(module);
+    return std::string{code.str()};
+}
+
+} // namespace
+
+bool InProcessLoweringAvailable() {
+    return true;
+}
+
+void LowerInProcess(const DriverOptions& opt, const std::string& mlir_text) {
+    mlir::DialectRegistry registry;
+    mlir::registerAllDialects(registry);
+    mlir::MLIRContext context{registry};
+
+    std::string diagnostics;
+    llvm::raw_string_ostream diag_os{diagnostics};
+    mlir::OwningOpRef<mlir::ModuleOp> module;
+    {
+        const hlp::ScopedPhase phase{"parse MLIR text"};
+        mlir::ScopedDiagnosticHandler handler{&context, [&](mlir::Diagnostic& diag) {
+            diag_os << diag.getLocation() << ": " << diag << "\n";
+            return mlir::success();
+        }};
+        module = mlir::parseSourceString<mlir::ModuleOp>(mlir_text, &context);
+    }
+    if (!module) {
+        throw std::runtime_error{"in-process lowering: parse failed\n" + diag_os.str()};
+    }
+
+    LowerInProcess(opt, *module);
+}
+
+void RunLlvmLoweringPipeline(mlir::ModuleOp module, bool bare_ptr_call_conv) {
+    InitializeOnce();
+
+    mlir::MLIRContext& context = *module->getContext();
+    mlir::registerBuiltinDialectTranslation(context);
+    mlir::registerLLVMDialectTranslation(context);
+
+    std::string diagnostics;
+    llvm::raw_string_ostream diag_os{diagnostics};
+    mlir::ScopedDiagnosticHandler handler{&context, [&](mlir::Diagnostic& diag) {
+        diag_os << diag.getLocation() << ": " << diag << "\n";
+        return mlir::success();
+    }};
+
+    const hlp::ScopedPhase phase{"MLIR lowering passes"};
+    const std::string spec = LlvmLoweringPipelineSpec(bare_ptr_call_conv);
+    spdlog::info("in-process pipeline: {}", spec);
+    mlir::PassManager pm{&context, mlir::ModuleOp::getOperationName()};
+    if (mlir::failed(mlir::parsePassPipeline(spec, pm, diag_os))) {
+        throw std::runtime_error{"in-process lowering: pass pipeline parse failed\n" + diag_os.str()};
+    }
+    if (mlir::failed(pm.run(module))) {
+        throw std::runtime_error{"in-process lowering: MLIR lowering failed\n" + diag_os.str()};
+    }
+}
+
+void LowerInProcess(const DriverOptions& opt, mlir::ModuleOp module) {
+    RunLlvmLoweringPipeline(module, opt.UsesCAbi());
+
+    llvm::LLVMContext llvm_context;
+    std::unique_ptr<llvm::Module> llvm_module;
+    {
+        const hlp::ScopedPhase phase{"translate to LLVM IR"};
+        llvm_module = mlir::translateModuleToLLVMIR(module, llvm_context);
+    }
+    if (!llvm_module) {
+        throw std::runtime_error{"in-process lowering: translation to LLVM IR failed"};
+    }
+
+    std::unique_ptr<llvm::TargetMachine> tm = CreateTargetMachine(opt);
+    llvm_module->setDataLayout(tm->createDataLayout());
+    llvm_module->setTargetTriple(tm->getTargetTriple().str());
+
+    if (!opt.emit_llvm_path.empty()) {
+        std::string ir;
+        llvm::raw_string_ostream ir_os{ir};
+        llvm_module->print(ir_os, nullptr);
+        WriteTextFile(opt.emit_llvm_path, ir_os.str());
+    }
+
+    const bool need_object = !opt.emit_obj_path.empty() || !opt.emit_shared_path.empty();
+    if (!opt.emit_asm_path.empty()) {
+        // codegen rewrites the module it runs on, so keep the original for the object
+        std::unique_ptr<llvm::Module> asm_module = need_object ? llvm::CloneModule(*llvm_module) : std::move(llvm_module);
+        WriteTextFile(opt.emit_asm_path, EmitCode(*tm, *asm_module, llvm::CodeGenFileType::AssemblyFile));
+    }
+
+    if (need_object) {
+        const std::string object = EmitCode(*tm, *llvm_module, llvm::CodeGenFileType::ObjectFile);
+        if (!opt.emit_obj_path.empty()) {
+            WriteTextFile(opt.emit_obj_path, object);
+        }
+        if (!opt.emit_shared_path.empty()) {
+            ScratchDir scratch;
+            const std::filesystem::path object_file = scratch.File("module.o");
+            WriteTextFile(object_file.string(), object);
+            LinkSharedLibrary({object_file}, opt.emit_shared_path);
+        }
+    }
+}
+
+#else // TC_HAVE_MLIR
+
+bool InProcessLoweringAvailable() {
+    return false;
+}
+
+void LowerInProcess(const DriverOptions& /*opt*/, const std::string& /*mlir_text*/) {
+    throw std::runtime_error{"in-process lowering: tc was built without the MLIR libraries"};
+}
+
+#endif // TC_HAVE_MLIR
+
+} // namespace tc::driver
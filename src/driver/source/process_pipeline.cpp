@@ -0,0 +1,209 @@
+#include "driver/process_pipeline.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+extern char** environ;
+
+namespace tc::driver {
+
+namespace {
+
+std::string ShellQuote(const std::string& value) {
+    std::string out = "'";
+    for (char c : value) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+// a consumer that quits early must surface as EPIPE in the writer, not kill tc.x
+void IgnoreSigpipeOnce() {
+    static std::once_flag once;
+    std::call_once(once, [] { std::signal(SIGPIPE, SIG_IGN); });
+}
+
+std::pair<int, int> MakePipe() {
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) != 0) {
+        throw std::runtime_error{std::string{"pipe failed: "} + std::strerror(errno)};
+    }
+    return {fds[0], fds[1]};
+}
+
+void CloseFd(int& fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+// every pipe end is O_CLOEXEC, so the child keeps only the two descriptors dup'ed onto stdin/stdout
+pid_t Spawn(const Command& cmd, int stdin_fd, int stdout_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    std::vector<char*> argv;
+    argv.reserve(cmd.size() + 1);
+    for (const std::string& arg : cmd) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = -1;
+    const int rc = ::posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+        throw std::runtime_error{"unable to start " + cmd[0] + ": " + std::strerror(rc)};
+    }
+    return pid;
+}
+
+int WaitPid(pid_t pid) {
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+} // namespace
+
+std::string JoinCommand(const Command& argv) {
+    std::string out;
+    for (size_t i = 0; i < argv.size(); ++i) {
+        if (i != 0) {
+            out += ' ';
+        }
+        out += ShellQuote(argv[i]);
+    }
+    return out;
+}
+
+ProcessPipeline::ProcessPipeline(std::vector<Command> stages, int output_fd) : stages_{std::move(stages)} {
+    if (stages_.empty()) {
+        throw std::runtime_error{"process pipeline without stages"};
+    }
+    IgnoreSigpipeOnce();
+
+    int stage_in = -1;
+    int stage_out = -1;
+    int next_in = -1;
+    try {
+        std::tie(stage_in, input_fd_) = MakePipe();
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            if (i + 1 < stages_.size()) {
+                std::tie(next_in, stage_out) = MakePipe();
+            } else if (output_fd == kPipeOutput) {
+                std::tie(output_fd_, stage_out) = MakePipe();
+            } else {
+                stage_out = output_fd;
+            }
+
+            spdlog::info("run: {}", JoinCommand(stages_[i]));
+            pids_.push_back(Spawn(stages_[i], stage_in, stage_out));
+
+            CloseFd(stage_in);
+            if (stage_out != output_fd) {
+                CloseFd(stage_out);
+            }
+            stage_out = -1;
+            stage_in = std::exchange(next_in, -1);
+        }
+    } catch (...) {
+        CloseFd(stage_in);
+        if (stage_out != output_fd) {
+            CloseFd(stage_out);
+        }
+        CloseFd(next_in);
+        Abort();
+        throw;
+    }
+}
+
+ProcessPipeline::~ProcessPipeline() {
+    Abort();
+}
+
+void ProcessPipeline::CloseInput() {
+    CloseFd(input_fd_);
+}
+
+void ProcessPipeline::CloseOutput() {
+    CloseFd(output_fd_);
+}
+
+void ProcessPipeline::Wait() {
+    CloseInput();
+
+    std::string failure;
+    for (size_t i = 0; i < pids_.size(); ++i) {
+        const int status = WaitPid(pids_[i]);
+        if (status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            continue;
+        }
+        if (status >= 0 && WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE) {
+            continue;
+        }
+        if (failure.empty()) {
+            failure = "command failed: " + JoinCommand(stages_[i]);
+            if (status >= 0 && WIFEXITED(status)) {
+                failure += " (exit code " + std::to_string(WEXITSTATUS(status)) + ")";
+            } else if (status >= 0 && WIFSIGNALED(status)) {
+                failure += " (signal " + std::to_string(WTERMSIG(status)) + ")";
+            }
+        }
+    }
+    pids_.clear();
+    CloseOutput();
+
+    if (!failure.empty()) {
+        throw std::runtime_error{failure};
+    }
+}
+
+void ProcessPipeline::Abort() {
+    CloseInput();
+    CloseOutput();
+    for (pid_t pid : pids_) {
+        ::kill(pid, SIGKILL);
+    }
+    for (pid_t pid : pids_) {
+        WaitPid(pid);
+    }
+    pids_.clear();
+}
+
+} // namespace tc::driver
@@ -1,17 +1,32 @@
 #include "driver/tool_runner.hpp"
 
+#include <cerrno>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <spdlog/common.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/spdlog.h>
 
+#include "driver/inprocess_lowering.hpp"
+#include "driver/process_pipeline.hpp"
+#include "helpers/phase_timer.hpp"
+
 namespace fs = std::filesystem;
 
 namespace tc::driver {
@@ -21,59 +36,220 @@ namespace {
 constexpr const char* kMlirOpt = "mlir-opt";
 constexpr const char* kMlirTranslate = "mlir-translate";
 constexpr const char* kLlc = "llc";
+constexpr const char* kLinker = "cc";
 
-void AppendLlvmLoweringPipeline(std::vector<std::string>* cmd) {
-    cmd->push_back("--canonicalize");
-    cmd->push_back("--cse");
-    cmd->push_back("--convert-scf-to-cf");
-    cmd->push_back("--expand-strided-metadata");
-    cmd->push_back("--convert-index-to-llvm");
-    cmd->push_back("--convert-arith-to-llvm");
-    cmd->push_back("--convert-func-to-llvm");
-    cmd->push_back("--finalize-memref-to-llvm");
-    cmd->push_back("--convert-cf-to-llvm");
-    cmd->push_back("--reconcile-unrealized-casts");
-}
+// Destination of one artifact: the requested file written in place, or the inherited stdout.
+// Only the first "-" artifact streams to stdout directly; later ones (and ones that must exist
+// as a file, e.g. an object to link) go through a scratch file replayed by Finish(), so
+// concurrently running stages never interleave on stdout.
+class ArtifactOutput {
+  public:
+    ArtifactOutput(const std::string& path,
+                   bool& stdout_taken,
+                   ScratchDir& scratch,
+                   std::string_view scratch_name,
+                   bool needs_file = false) {
+        if (path == "-" && !stdout_taken && !needs_file) {
+            stdout_taken = true;
+            fd_ = STDOUT_FILENO;
+            return;
+        }
+        if (path == "-") {
+            stdout_taken = true;
+            deferred_ = true;
+        }
+        file_ = deferred_ ? scratch.File(scratch_name) : fs::path{path};
+        fd_ = ::open(file_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error{"unable to open file for writing: " + file_.string()};
+        }
+        owned_ = true;
+        target_ = path;
+    }
+
+    ArtifactOutput(const ArtifactOutput&) = delete;
+    ArtifactOutput& operator=(const ArtifactOutput&) = delete;
 
-std::string ShellQuote(const std::string& value) {
-    std::string out = "'";
-    for (char c : value) {
-        if (c == '\'') {
-            out += "'\\''";
-        } else {
-            out += c;
+    ~ArtifactOutput() {
+        if (owned_) {
+            ::close(fd_);
         }
     }
-    out += "'";
-    return out;
-}
 
-std::string JoinCommand(const std::vector<std::string>& argv) {
-    std::string out;
-    for (size_t i = 0; i < argv.size(); ++i) {
-        if (i != 0) {
-            out += ' ';
+    int Fd() const { return fd_; }
+    // the file the artifact is written to; empty when it streams to stdout
+    const fs::path& File() const { return file_; }
+
+    void Finish() {
+        if (!owned_) {
+            return;
+        }
+        owned_ = false;
+        if (::close(fd_) != 0) {
+            throw std::runtime_error{"unable to write " + target_};
+        }
+        if (!deferred_) {
+            spdlog::info("wrote: {}", target_);
+            return;
+        }
+        std::ifstream in{file_, std::ios::binary};
+        std::cout << in.rdbuf();
+    }
+
+  private:
+    int fd_ = -1;
+    bool owned_ = false;
+    bool deferred_ = false;
+    std::string target_;
+    fs::path file_;
+};
+
+// emitted module on its way into mlir-opt, optionally teed into --emit-mlir;
+// remembers whether mlir-opt stopped reading, in which case its exit status is the real error
+class ToolInputSink final : public hlp::OutputSink {
+  public:
+    ToolInputSink(int pipe_fd, hlp::OutputSink* tee) : pipe_{pipe_fd}, tee_{tee} {}
+
+    void Write(std::string_view data) override {
+        if (tee_ != nullptr) {
+            tee_->Write(data);
+        }
+        Guard([&] { pipe_.Write(data); });
+    }
+
+    void Flush() override {
+        if (tee_ != nullptr) {
+            tee_->Flush();
         }
-        out += ShellQuote(argv[i]);
+        Guard([&] { pipe_.Flush(); });
+    }
+
+    bool Broken() const { return broken_; }
+
+  private:
+    hlp::FdSink pipe_;
+    hlp::OutputSink* tee_;
+    bool broken_ = false;
+
+    template <typename F>
+    void Guard(F&& f) {
+        try {
+            f();
+        } catch (...) {
+            broken_ = true;
+            throw;
+        }
+    }
+};
+
+// copies src into every destination until EOF
+void Tee(int src, const std::vector<int>& dsts) {
+    std::vector<std::unique_ptr<hlp::FdSink>> sinks;
+    for (int fd : dsts) {
+        sinks.push_back(std::make_unique<hlp::FdSink>(fd));
+    }
+
+    std::vector<char> buffer(size_t{1} << 16);
+    for (;;) {
+        const ssize_t n = ::read(src, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error{std::string{"read failed: "} + std::strerror(errno)};
+        }
+        if (n == 0) {
+            break;
+        }
+        for (const auto& sink : sinks) {
+            sink->Write(std::string_view{buffer.data(), static_cast<size_t>(n)});
+        }
+    }
+    for (const auto& sink : sinks) {
+        sink->Flush();
     }
-    return out;
 }
 
-void CopyFileToTarget(const fs::path& src, const std::string& dst) {
-    WriteTextFile(dst, ReadTextFile(src));
+Command MlirOptCommand(const DriverOptions& opt) {
+    return Command{kMlirOpt, "--pass-pipeline=" + LlvmLoweringPipelineSpec(opt.UsesCAbi())};
 }
 
-void RunCommand(const std::vector<std::string>& argv) {
-    const std::string cmd = JoinCommand(argv);
-    spdlog::info("run: {}", cmd);
-    const int rc = std::system(cmd.c_str());
-    if (rc != 0) {
-        throw std::runtime_error{"command failed: " + cmd};
+Command LlcCommand(const DriverOptions& opt, std::string_view filetype) {
+    Command cmd{kLlc, opt.opt_level};
+    if (!opt.target_triple.empty()) {
+        cmd.push_back("-mtriple=" + opt.target_triple);
+    }
+    if (!opt.mcpu.empty()) {
+        cmd.push_back("-mcpu=" + opt.mcpu);
+    }
+    if (opt.UsesCAbi()) {
+        cmd.push_back("-relocation-model=pic");
     }
+    cmd.push_back("-filetype=" + std::string{filetype});
+    cmd.push_back("-o");
+    cmd.push_back("-");
+    return cmd;
 }
 
 } // namespace
 
+ScratchDir::~ScratchDir() {
+    if (!path_.empty()) {
+        std::error_code ec;
+        fs::remove_all(path_, ec);
+    }
+}
+
+fs::path ScratchDir::File(std::string_view name) {
+    if (path_.empty()) {
+        std::string templ = (fs::temp_directory_path() / "tc-XXXXXX").string();
+        if (::mkdtemp(templ.data()) == nullptr) {
+            throw std::runtime_error{"unable to create scratch directory in " + fs::temp_directory_path().string()};
+        }
+        path_ = templ;
+    }
+    return path_ / name;
+}
+
+std::vector<std::string> LlvmLoweringPasses(bool bare_ptr_call_conv) {
+    return {
+        "canonicalize",
+        "cse",
+        "convert-scf-to-cf",
+        "expand-strided-metadata",
+        "convert-index-to-llvm",
+        "convert-arith-to-llvm",
+        bare_ptr_call_conv ? "convert-func-to-llvm{use-bare-ptr-memref-call-conv=1}" : "convert-func-to-llvm",
+        "finalize-memref-to-llvm",
+        "convert-cf-to-llvm",
+        "reconcile-unrealized-casts",
+    };
+}
+
+std::string LlvmLoweringPipelineSpec(bool bare_ptr_call_conv) {
+    std::string spec = "builtin.module(";
+    const std::vector<std::string> passes = LlvmLoweringPasses(bare_ptr_call_conv);
+    for (size_t i = 0; i < passes.size(); ++i) {
+        if (i != 0) {
+            spec += ',';
+        }
+        spec += passes[i];
+    }
+    spec += ")";
+    return spec;
+}
+
+void LinkSharedLibrary(const std::vector<fs::path>& objects, const std::string& shared_path) {
+    const hlp::ScopedPhase phase{"link shared library"};
+    Command cmd{kLinker, "-shared", "-o", shared_path};
+    for (const fs::path& object : objects) {
+        cmd.push_back(object.string());
+    }
+    ProcessPipeline link{{std::move(cmd)}, STDERR_FILENO};
+    link.Wait();
+    spdlog::info("wrote: {}", shared_path);
+}
+
 void SetupLogging(int argc, const char* argv[]) {
     auto logger = spdlog::basic_logger_mt("tc", "tc.log", true);
     spdlog::set_default_logger(logger);
@@ -115,57 +291,165 @@ void WriteTextFile(const std::string& path, const std::string& text) {
     spdlog::info("wrote: {}", path);
 }
 
-void LowerToLlvmAndAsm(const DriverOptions& opt, const std::string& mlir_text) {
-    const bool need_llvm = !opt.emit_llvm_path.empty();
-    const bool need_asm = !opt.emit_asm_path.empty();
-    if (!need_llvm && !need_asm) {
+void StreamToFile(const std::string& path, const SinkWriter& write) {
+    if (path == "-") {
+        std::cout.flush();
+        hlp::FdSink out{STDOUT_FILENO};
+        write(out);
+        out.Flush();
         return;
     }
 
-    fs::path temp_dir = fs::temp_directory_path() / "tc_mlir_pipeline";
-    fs::create_directories(temp_dir);
+    hlp::FileSink out{path};
+    write(out);
+    out.Close();
+    spdlog::info("wrote: {}", path);
+}
 
-    const fs::path input_mlir = temp_dir / "input.mlir";
-    const fs::path lowered_mlir = temp_dir / "lowered.mlir";
-    const fs::path llvm_ir = temp_dir / "module.ll";
-    const fs::path asm_file = temp_dir / "module.s";
+void EmitMlirAndLower(const DriverOptions& opt, const SinkWriter& write_mlir) {
+    if (!opt.NeedsCodegen()) {
+        if (!opt.emit_mlir_path.empty()) {
+            StreamToFile(opt.emit_mlir_path, write_mlir);
+        }
+        return;
+    }
 
-    WriteTextFile(input_mlir.string(), mlir_text);
+    if (!opt.external_tools && InProcessLoweringAvailable()) {
+        // the MLIR parser wants the module as one contiguous buffer
+        hlp::StringSink mlir_text;
+        write_mlir(mlir_text);
+        if (!opt.emit_mlir_path.empty()) {
+            WriteTextFile(opt.emit_mlir_path, mlir_text.Str());
+        }
+        LowerInProcess(opt, mlir_text.Str());
+        return;
+    }
 
-    std::vector<std::string> mlir_opt_cmd{kMlirOpt, input_mlir.string()};
-    AppendLlvmLoweringPipeline(&mlir_opt_cmd);
-    mlir_opt_cmd.push_back("-o");
-    mlir_opt_cmd.push_back(lowered_mlir.string());
-    RunCommand(mlir_opt_cmd);
+    const hlp::ScopedPhase phase{"lower with external tools"};
+    // mlir-opt | mlir-translate [| llc]: every tool reads stdin and writes stdout. A single consumer of
+    // the LLVM IR is chained directly; otherwise a tee thread fans the IR out to the .ll target and
+    // one llc process per requested file type
+    const bool need_shared = !opt.emit_shared_path.empty();
+    ScratchDir scratch;
+    bool stdout_taken = false;
+    std::optional<ArtifactOutput> mlir_out;
+    std::optional<ArtifactOutput> llvm_out;
+    std::optional<ArtifactOutput> asm_out;
+    std::optional<ArtifactOutput> obj_out;
+    if (!opt.emit_mlir_path.empty()) {
+        mlir_out.emplace(opt.emit_mlir_path, stdout_taken, scratch, "module.mlir");
+    }
+    if (!opt.emit_llvm_path.empty()) {
+        llvm_out.emplace(opt.emit_llvm_path, stdout_taken, scratch, "module.ll");
+    }
+    if (!opt.emit_asm_path.empty()) {
+        asm_out.emplace(opt.emit_asm_path, stdout_taken, scratch, "module.s");
+    }
+    if (!opt.emit_obj_path.empty() || need_shared) {
+        const std::string obj_path = opt.emit_obj_path.empty() ? scratch.File("module.o").string() : opt.emit_obj_path;
+        obj_out.emplace(obj_path, stdout_taken, scratch, "module.o", need_shared);
+    }
+
+    struct IrConsumer {
+        std::optional<Command> llc;
+        int fd;
+    };
+    std::vector<IrConsumer> consumers;
+    if (llvm_out.has_value()) {
+        consumers.push_back({std::nullopt, llvm_out->Fd()});
+    }
+    if (asm_out.has_value()) {
+        consumers.push_back({LlcCommand(opt, "asm"), asm_out->Fd()});
+    }
+    if (obj_out.has_value()) {
+        consumers.push_back({LlcCommand(opt, "obj"), obj_out->Fd()});
+    }
 
-    std::vector<std::string> mlir_translate_cmd{kMlirTranslate, lowered_mlir.string(), "--mlir-to-llvmir", "-o", llvm_ir.string()};
-    RunCommand(mlir_translate_cmd);
+    std::vector<Command> stages{MlirOptCommand(opt), Command{kMlirTranslate, "--mlir-to-llvmir"}};
+    const bool fan_out = consumers.size() > 1;
+    if (!fan_out && consumers[0].llc.has_value()) {
+        stages.push_back(*consumers[0].llc);
+    }
+    ProcessPipeline front{std::move(stages), fan_out ? ProcessPipeline::kPipeOutput : consumers[0].fd};
 
-    if (need_llvm) {
-        CopyFileToTarget(llvm_ir, opt.emit_llvm_path);
+    std::vector<std::unique_ptr<ProcessPipeline>> llcs;
+    std::vector<int> tee_fds;
+    std::thread tee;
+    std::exception_ptr tee_error;
+    if (fan_out) {
+        for (const IrConsumer& consumer : consumers) {
+            if (!consumer.llc.has_value()) {
+                tee_fds.push_back(consumer.fd);
+                continue;
+            }
+            llcs.push_back(std::make_unique<ProcessPipeline>(std::vector<Command>{*consumer.llc}, consumer.fd));
+            tee_fds.push_back(llcs.back()->InputFd());
+        }
+        tee = std::thread{[&] {
+            try {
+                Tee(front.OutputFd(), tee_fds);
+            } catch (...) {
+                tee_error = std::current_exception();
+            }
+            front.CloseOutput();
+            for (const auto& llc : llcs) {
+                llc->CloseInput();
+            }
+        }};
     }
+    auto wait_all = [&] {
+        front.Wait();
+        for (const auto& llc : llcs) {
+            llc->Wait();
+        }
+    };
 
-    if (need_asm) {
-        std::vector<std::string> llc_cmd{kLlc, llvm_ir.string(), opt.opt_level};
-        if (!opt.target_triple.empty()) {
-            llc_cmd.push_back("-mtriple=" + opt.target_triple);
+    bool input_broken = false;
+    try {
+        std::optional<hlp::FdSink> mlir_sink;
+        if (mlir_out.has_value()) {
+            mlir_sink.emplace(mlir_out->Fd());
+        }
+        ToolInputSink input{front.InputFd(), mlir_sink.has_value() ? &*mlir_sink : nullptr};
+        try {
+            write_mlir(input);
+            input.Flush();
+        } catch (...) {
+            input_broken = input.Broken();
+            throw;
+        }
+    } catch (...) {
+        front.CloseInput();
+        if (tee.joinable()) {
+            tee.join();
         }
-        if (!opt.mcpu.empty()) {
-            llc_cmd.push_back("-mcpu=" + opt.mcpu);
+        if (input_broken) {
+            // a tool that quit early explains the broken pipe better than EPIPE does
+            wait_all();
         }
-        llc_cmd.push_back("-filetype=asm");
-        llc_cmd.push_back("-o");
-        llc_cmd.push_back(asm_file.string());
-        RunCommand(llc_cmd);
-        CopyFileToTarget(asm_file, opt.emit_asm_path);
+        throw;
+    }
+
+    front.CloseInput();
+    if (tee.joinable()) {
+        tee.join();
+    }
+    wait_all();
+    if (tee_error) {
+        std::rethrow_exception(tee_error);
     }
 
-    std::error_code ec;
-    fs::remove(input_mlir, ec);
-    fs::remove(lowered_mlir, ec);
-    fs::remove(llvm_ir, ec);
-    fs::remove(asm_file, ec);
-    fs::remove(temp_dir, ec);
+    for (std::optional<ArtifactOutput>* out : {&mlir_out, &llvm_out, &asm_out}) {
+        if (out->has_value()) {
+            (*out)->Finish();
+        }
+    }
+    if (!opt.emit_obj_path.empty()) {
+        obj_out->Finish();
+    }
+    if (need_shared) {
+        LinkSharedLibrary({obj_out->File()}, opt.emit_shared_path);
+    }
 }
 
 } // namespace tc::driver
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef COST_MODEL_HPP_
+#define COST_MODEL_HPP_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+
+namespace tc {
+
+// Work of one run of an operation as written in the graph, before any fusion or reuse:
+// multiply-adds count as two FLOPs, comparisons as one; every operand is read and every
+// result written once. Conv counts only the taps that land inside its input, so strides,
+// dilations, pads and groups all show. Fields are -1 when a shape they depend on is dynamic or
+// unknown.
+struct OpCost {
+    int64_t flops = 0;
+    int64_t bytes_read = 0;
+    int64_t bytes_written = 0;
+};
+
+OpCost EstimateCost(const Operation& op);
+
+// FLOPs per byte read or written; -1 if unknown or nothing moves
+double ArithmeticIntensity(const OpCost& cost);
+
+// The roof of the roofline model that caps an op: below the ridge point (peak FLOP/s over
+// peak bytes/s of the machine) bandwidth limits it, above the ridge the arithmetic units do.
+enum class Bound { kUnknown, kMemory, kCompute };
+
+// roughly an AVX2 FMA core against its share of DRAM bandwidth
+inline constexpr double kDefaultRidgeFlopsPerByte = 8.0;
+
+Bound ClassifyBound(const OpCost& cost, double ridge_flops_per_byte);
+std::string_view BoundToStr(Bound bound);
+
+struct OpCostEntry {
+    const Operation* op;
+    OpCost cost;
+    double intensity;
+    Bound bound;
+};
+
+enum class CostSortKey { kGraphOrder, kFlops, kBytes, kIntensity };
+
+// "order", "flops", "bytes" or "intensity"; throws otherwise
+CostSortKey ParseCostSortKey(std::string_view key);
+
+// every operation of the graph in graph order
+std::vector<OpCostEntry> CostReport(const Graph& graph, double ridge_flops_per_byte = kDefaultRidgeFlopsPerByte);
+// largest first and unknown values last; ties keep their order
+void SortCostReport(std::vector<OpCostEntry>& entries, CostSortKey key);
+std::string FormatCostReport(const std::vector<OpCostEntry>& entries);
+
+} // namespace tc
+
+#endif // COST_MODEL_HPP_
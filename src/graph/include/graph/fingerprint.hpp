@@ -0,0 +1,17 @@
+#ifndef FINGERPRINT_HPP_
+#define FINGERPRINT_HPP_
+
+#include <string>
+
+#include "graph/graph.hpp"
+
+namespace tc {
+
+// 128-bit structural hash of a graph rendered as 32 hex chars.
+// Covers node order, names, op types, attributes, tensor types and initializer payloads,
+// i.e. everything the backend looks at. Not cryptographic.
+std::string Fingerprint(const Graph& graph);
+
+} // namespace tc
+
+#endif // FINGERPRINT_HPP_
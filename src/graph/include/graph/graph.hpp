@@ -66,15 +66,15 @@ class NodeContainer {
         std::unique_ptr<NodeT> node = std::make_unique<NodeT>(name, std::forward<Args>(args)...);
         NodeT* raw_ptr = node.get();
 
-        NodesOwner tmp_owner{nodes_};
-        NameTable tmp_table{name_table_};
-
-        tmp_owner.push_back(raw_ptr);
-        tmp_table.insert({name, raw_ptr});
-
-        // commit
-        std::swap(nodes_, tmp_owner);
-        std::swap(name_table_, tmp_table);
+        // push_back is all-or-nothing, so only the table insert needs undoing to keep both
+        // containers unchanged on failure; copying them per node made building a graph quadratic
+        nodes_.push_back(raw_ptr);
+        try {
+            name_table_.insert({name, raw_ptr});
+        } catch (...) {
+            nodes_.pop_back();
+            throw;
+        }
 
         node.release();
 
@@ -124,6 +124,9 @@ struct DotOptions {
     size_t max_attr_chars = 140;
     size_t max_attr_items = 16;
     bool rank_left_to_right = false;
+    // FLOPs, bytes and arithmetic intensity on every op, filled by roofline bound (see cost_model.hpp)
+    bool show_cost = false;
+    double ridge_flops_per_byte = 8.0;
 };
 
 class Graph {
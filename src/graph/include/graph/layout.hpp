@@ -0,0 +1,24 @@
+#ifndef LAYOUT_HPP_
+#define LAYOUT_HPP_
+
+#include <cstdint>
+
+#include "graph/graph.hpp"
+
+namespace tc {
+
+// Copy of graph with its Convs, and the elementwise ops between them, moved to the blocked NCHW[b]c
+// layout: [N, C / b, H, W, b], so the b channels of one pixel are contiguous and a Conv reduces over
+// them with one SIMD lane per output channel when b is the vector width (8 for f32 on AVX2, 16 on
+// AVX-512). A Conv is blocked when its weights are an initializer and both its input and output
+// channels per group are multiples of b; it becomes an NchwcConv whose weights are packed into a new
+// initializer [C_out / b, C_in / group / b, kh, kw, b, b]. Add, Mul and Relu stay blocked while an
+// operand is: their other operands must be scalars, per-channel initializers ([C, 1, 1] or
+// [1, C, 1, 1], repacked) or rank-4 tensors over the same channels. ReorderInput / ReorderOutput
+// convert where a blocked region is entered or left, once per value, so inputs and outputs of the
+// graph keep their layout and names.
+Graph AssignBlockedLayout(const Graph& graph, int64_t block);
+
+} // namespace tc
+
+#endif // LAYOUT_HPP_
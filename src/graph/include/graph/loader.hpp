@@ -1,10 +1,8 @@
 #ifndef LOADER_HPP_
 #define LOADER_HPP_
 
-#include <stdexcept>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <string_view>
 
 #include "graph/graph.hpp"
 
@@ -14,21 +12,10 @@ class ILoader {
   public:
     virtual ~ILoader() = default;
   private:
-    virtual Graph ParseRaw(const std::string& model_raw) = 0;
+    virtual Graph ParseRaw(std::string_view model_raw) = 0;
   public:
-    Graph Load(const std::string& model_path) {
-        std::stringstream buffer;
-        {
-            std::ifstream model_file{model_path, std::ios::binary};
-            if (!model_file.good()) {
-                throw std::runtime_error{"Unable to open model file"};
-            }
-            buffer << model_file.rdbuf();
-        }
-        std::string model_raw = buffer.str();
-
-        return ParseRaw(model_raw);
-    }
+    // maps the model file read-only and parses it in place, without staging a copy in memory
+    Graph Load(const std::string& model_path);
 };
 
 } // namespace tc
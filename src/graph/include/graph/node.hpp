@@ -36,6 +36,29 @@ class TensorType {
     bool HasKnownElemType() const { return elem_type_ != TensorElemType::kUnknown; }
     bool HasRank() const { return !shape_.empty(); }
 
+    // -1 while any dimension is dynamic
+    int64_t NumElements() const {
+        int64_t total = 1;
+        for (int64_t dim : shape_) {
+            if (dim < 0) return -1;
+            total *= dim;
+        }
+        return total;
+    }
+
+    // storage size of one element in a dense buffer (i1 takes a whole byte)
+    static size_t ElemSizeInBytes(TensorElemType elem_type) {
+        switch (elem_type) {
+            case TensorElemType::kUnknown: return 0;
+            case TensorElemType::kFloat32: return 4;
+            case TensorElemType::kFloat64: return 8;
+            case TensorElemType::kInt32:   return 4;
+            case TensorElemType::kInt64:   return 8;
+            case TensorElemType::kBool:    return 1;
+        }
+        return 0;
+    }
+
     static std::string ElemTypeToStr(TensorElemType elem_type) {
         switch (elem_type) {
             case TensorElemType::kUnknown: return "unknown";
@@ -190,6 +213,11 @@ class Operation : public IOperation {
         kMatMul,
         kGemm,
         kTranspose,
+        // blocked layout (see graph/layout.hpp), never loaded from a model: NCHW to NCHW[b]c,
+        // NCHW[b]c back to NCHW, and Conv over NCHW[b]c with pre-packed weights
+        kReorderInput,
+        kReorderOutput,
+        kNchwcConv,
     };
 
   private:
@@ -232,6 +260,9 @@ class Operation : public IOperation {
             case OpType::kMatMul:    return "MatMul";
             case OpType::kGemm:      return "Gemm";
             case OpType::kTranspose: return "Transpose";
+            case OpType::kReorderInput:  return "ReorderInput";
+            case OpType::kReorderOutput: return "ReorderOutput";
+            case OpType::kNchwcConv:     return "NchwcConv";
         }
         return "<unknown>";
     }
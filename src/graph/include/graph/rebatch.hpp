@@ -0,0 +1,21 @@
+#ifndef REBATCH_HPP_
+#define REBATCH_HPP_
+
+#include <cstdint>
+
+#include "graph/graph.hpp"
+
+namespace tc {
+
+// leading dimension shared by all graph inputs; throws if they disagree
+int64_t BatchSizeOf(const Graph& graph);
+
+// Copy of graph with the batch dimension of the inputs, and of every value computed from them,
+// set to batch. Weights keep their shapes. Throws if an operation moves the batch dimension
+// away from the front (e.g. Transpose with perm[0] != 0, Gemm with transA) or mixes it into a
+// reduced axis, since such a graph has no batch-specialized version with the same entry.
+Graph Rebatch(const Graph& graph, int64_t batch);
+
+} // namespace tc
+
+#endif // REBATCH_HPP_
@@ -0,0 +1,289 @@
+#include "graph/cost_model.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graph/attribute.hpp"
+
+namespace tc {
+
+namespace {
+
+// values without a tensor type (models without shape inference) count as fully dynamic
+const std::vector<int64_t>& ShapeOf(const Value& value) {
+    static const std::vector<int64_t> kUnknown{-1};
+    return value.HasTensorType() ? value.MaybeTensorType()->Shape() : kUnknown;
+}
+
+int64_t IntAttr(const Operation& op, const std::string& name, int64_t fallback) {
+    auto it = op.Attrs().find(name);
+    return it == op.Attrs().end() ? fallback : it->second.As<int64_t>();
+}
+
+int64_t BytesOf(const Value& value) {
+    if (!value.HasTensorType()) {
+        return -1;
+    }
+    const TensorType& type = *value.MaybeTensorType();
+    const int64_t elements = type.NumElements();
+    return elements < 0 ? -1 : elements * static_cast<int64_t>(TensorType::ElemSizeInBytes(type.ElemType()));
+}
+
+// -1 if any term is -1
+int64_t SumKnown(const std::vector<int64_t>& terms) {
+    int64_t total = 0;
+    for (int64_t term : terms) {
+        if (term < 0) {
+            return -1;
+        }
+        total += term;
+    }
+    return total;
+}
+
+int64_t Product(int64_t lhs, int64_t rhs) {
+    return lhs < 0 || rhs < 0 ? -1 : lhs * rhs;
+}
+
+std::vector<int64_t> IntsAttr(const Operation& op, const std::string& name, std::vector<int64_t> fallback) {
+    auto it = op.Attrs().find(name);
+    return it == op.Attrs().end() ? fallback : it->second.As<std::vector<int64_t>>();
+}
+
+int64_t OutputElements(const Operation& op) {
+    int64_t outputs = 0;
+    for (const Value* output : op.Outputs()) {
+        const int64_t elements = output->HasTensorType() ? output->MaybeTensorType()->NumElements() : -1;
+        outputs = outputs < 0 || elements < 0 ? -1 : outputs + elements;
+    }
+    return outputs;
+}
+
+// 2*M*N*K for op(A) [M, K] times op(B) [K, N], plus the scaled and added C
+int64_t GemmFlops(const Operation& op) {
+    const std::vector<int64_t>& a = ShapeOf(*op.Inputs().at(0));
+    const std::vector<int64_t>& b = ShapeOf(*op.Inputs().at(1));
+    if (a.size() != 2 || b.size() != 2) {
+        return -1;
+    }
+    const bool trans_a = IntAttr(op, "transA", 0) != 0;
+    const bool trans_b = IntAttr(op, "transB", 0) != 0;
+    const int64_t m = trans_a ? a[1] : a[0];
+    const int64_t k = trans_a ? a[0] : a[1];
+    const int64_t n = trans_b ? b[0] : b[1];
+    const int64_t mn = Product(m, n);
+    const int64_t bias = op.Inputs().size() > 2 ? Product(mn, 2) : 0;
+    return SumKnown({Product(Product(mn, k), 2), bias});
+}
+
+// kernel taps that land inside the input, summed over the outputs of one spatial axis;
+// taps on the padding multiply zeros and are not counted
+int64_t ValidTaps(int64_t in, int64_t kernel, int64_t out, int64_t stride, int64_t dilation, int64_t pad_begin) {
+    int64_t taps = 0;
+    for (int64_t o = 0; o < out; ++o) {
+        for (int64_t k = 0; k < kernel; ++k) {
+            const int64_t pos = o * stride - pad_begin + k * dilation;
+            taps += pos >= 0 && pos < in ? 1 : 0;
+        }
+    }
+    return taps;
+}
+
+// X [N, C_in, in...] with W [C_out, C_in / group, k...]: every output channel reduces over its
+// group's input channels and the taps that the strides, dilations and pads leave inside X.
+// NchwcConv has the same spatial axes with the channels split into blocks of b: X [N, C_in / b, in..., b]
+// and W [C_out / b, C_in / group / b, k..., b, b]
+int64_t ConvFlops(const Operation& op) {
+    const std::vector<int64_t>& x = ShapeOf(*op.Inputs().at(0));
+    const std::vector<int64_t>& w = ShapeOf(*op.Inputs().at(1));
+    const std::vector<int64_t>& y = ShapeOf(*op.Outputs().at(0));
+    const size_t block_axes = op.Type() == Operation::OpType::kNchwcConv ? 1 : 0;
+    if (x.size() < 3 + block_axes || w.size() != x.size() + block_axes) {
+        return -1;
+    }
+    const size_t spatial = x.size() - 2 - block_axes;
+    std::vector<int64_t> pads = IntsAttr(op, "pads", std::vector<int64_t>(2 * spatial, 0));
+    if (pads.size() == spatial) {
+        pads.insert(pads.end(), pads.begin(), pads.end());
+    }
+    const std::vector<int64_t> strides = IntsAttr(op, "strides", std::vector<int64_t>(spatial, 1));
+    const std::vector<int64_t> dilations = IntsAttr(op, "dilations", std::vector<int64_t>(spatial, 1));
+    if (pads.size() != 2 * spatial || strides.size() != spatial || dilations.size() != spatial) {
+        throw std::runtime_error{"cost model: " + op.Name() + ": pads/strides/dilations do not match the rank"};
+    }
+
+    int64_t taps = Product(w[0], w[1]);
+    int64_t outputs = w[0];
+    if (block_axes != 0) {
+        taps = Product(taps, Product(w.back(), w.back()));
+        outputs = Product(outputs, w.back());
+    }
+    for (size_t axis = 0; axis < spatial; ++axis) {
+        const int64_t in = x[axis + 2];
+        const int64_t kernel = w[axis + 2];
+        if (in < 0 || kernel < 0 || strides[axis] <= 0) {
+            return -1;
+        }
+        const int64_t extent = in + pads[axis] + pads[axis + spatial] - dilations[axis] * (kernel - 1) - 1;
+        const int64_t out = y.size() == x.size() && y[axis + 2] >= 0 ? y[axis + 2] : extent / strides[axis] + 1;
+        taps = Product(taps, ValidTaps(in, kernel, out, strides[axis], dilations[axis], pads[axis]));
+        outputs = Product(outputs, out);
+    }
+    const int64_t batch = x[0] >= 0 ? x[0] : (y.empty() ? -1 : y[0]);
+    const int64_t bias = op.Inputs().size() > 2 ? Product(batch, outputs) : 0;
+    return SumKnown({Product(Product(batch, taps), 2), bias});
+}
+
+int64_t Flops(const Operation& op) {
+    switch (op.Type()) {
+        case Operation::OpType::kAdd:
+        case Operation::OpType::kMul:
+        case Operation::OpType::kRelu:
+            return OutputElements(op);
+        case Operation::OpType::kTranspose:
+        case Operation::OpType::kReorderInput:
+        case Operation::OpType::kReorderOutput:
+            return 0;
+        case Operation::OpType::kMatMul: {
+            const std::vector<int64_t>& a = ShapeOf(*op.Inputs().at(0));
+            return a.empty() || a.back() < 0 ? -1 : Product(OutputElements(op), 2 * a.back());
+        }
+        case Operation::OpType::kGemm:
+            return GemmFlops(op);
+        case Operation::OpType::kConv:
+        case Operation::OpType::kNchwcConv:
+            return ConvFlops(op);
+    }
+    return -1;
+}
+
+} // namespace
+
+OpCost EstimateCost(const Operation& op) {
+    OpCost cost;
+    std::vector<int64_t> read;
+    for (const Value* input : op.Inputs()) {
+        read.push_back(BytesOf(*input));
+    }
+    std::vector<int64_t> written;
+    for (const Value* output : op.Outputs()) {
+        written.push_back(BytesOf(*output));
+    }
+    cost.bytes_read = SumKnown(read);
+    cost.bytes_written = SumKnown(written);
+    cost.flops = Flops(op);
+    return cost;
+}
+
+double ArithmeticIntensity(const OpCost& cost) {
+    const int64_t bytes = SumKnown({cost.bytes_read, cost.bytes_written});
+    if (cost.flops < 0 || bytes <= 0) {
+        return -1;
+    }
+    return static_cast<double>(cost.flops) / static_cast<double>(bytes);
+}
+
+Bound ClassifyBound(const OpCost& cost, double ridge_flops_per_byte) {
+    const double intensity = ArithmeticIntensity(cost);
+    if (intensity < 0) {
+        return Bound::kUnknown;
+    }
+    return intensity < ridge_flops_per_byte ? Bound::kMemory : Bound::kCompute;
+}
+
+std::string_view BoundToStr(Bound bound) {
+    switch (bound) {
+        case Bound::kMemory:
+            return "memory";
+        case Bound::kCompute:
+            return "compute";
+        case Bound::kUnknown:
+            break;
+    }
+    return "-";
+}
+
+CostSortKey ParseCostSortKey(std::string_view key) {
+    if (key == "order") {
+        return CostSortKey::kGraphOrder;
+    }
+    if (key == "flops") {
+        return CostSortKey::kFlops;
+    }
+    if (key == "bytes") {
+        return CostSortKey::kBytes;
+    }
+    if (key == "intensity") {
+        return CostSortKey::kIntensity;
+    }
+    throw std::runtime_error{"cost report: unknown sort key '" + std::string{key} +
+                             "', expected order, flops, bytes or intensity"};
+}
+
+std::vector<OpCostEntry> CostReport(const Graph& graph, double ridge_flops_per_byte) {
+    std::vector<OpCostEntry> entries;
+    for (const INode* node : graph) {
+        if (const auto* op = dynamic_cast<const Operation*>(node)) {
+            const OpCost cost = EstimateCost(*op);
+            entries.push_back(OpCostEntry{op, cost, ArithmeticIntensity(cost), ClassifyBound(cost, ridge_flops_per_byte)});
+        }
+    }
+    return entries;
+}
+
+void SortCostReport(std::vector<OpCostEntry>& entries, CostSortKey key) {
+    if (key == CostSortKey::kGraphOrder) {
+        return;
+    }
+    auto metric = [key](const OpCostEntry& entry) -> double {
+        switch (key) {
+            case CostSortKey::kFlops:
+                return static_cast<double>(entry.cost.flops);
+            case CostSortKey::kBytes:
+                return static_cast<double>(SumKnown({entry.cost.bytes_read, entry.cost.bytes_written}));
+            case CostSortKey::kIntensity:
+                return entry.intensity;
+            case CostSortKey::kGraphOrder:
+                break;
+        }
+        return -1;
+    };
+    // unknown (-1) sorts last
+    std::stable_sort(entries.begin(), entries.end(), [&](const OpCostEntry& lhs, const OpCostEntry& rhs) {
+        return metric(lhs) > metric(rhs);
+    });
+}
+
+std::string FormatCostReport(const std::vector<OpCostEntry>& entries) {
+    auto column = [](double value, double scale, int precision) {
+        char text[32];
+        if (value < 0) {
+            std::snprintf(text, sizeof(text), "%12s", "-");
+        } else {
+            std::snprintf(text, sizeof(text), "%12.*f", precision, value / scale);
+        }
+        return std::string{text};
+    };
+
+    std::string table;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-24s %-10s %12s %12s %12s %12s %s\n", "op", "type", "MFLOP", "KiB read",
+                  "KiB written", "FLOP/byte", "bound");
+    table += line;
+    for (const OpCostEntry& entry : entries) {
+        std::snprintf(line, sizeof(line), "%-24s %-10s ", entry.op->Name().c_str(),
+                      Operation::OpTypeToStr(entry.op->Type()).c_str());
+        table += line;
+        table += column(static_cast<double>(entry.cost.flops), 1e6, 3) + " " +
+                 column(static_cast<double>(entry.cost.bytes_read), 1024.0, 1) + " " +
+                 column(static_cast<double>(entry.cost.bytes_written), 1024.0, 1) + " " +
+                 column(entry.intensity, 1.0, 2) + " " + std::string{BoundToStr(entry.bound)} + "\n";
+    }
+    return table;
+}
+
+} // namespace tc
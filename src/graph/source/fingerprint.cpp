@@ -0,0 +1,175 @@
+#include "graph/fingerprint.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "graph/attribute.hpp"
+#include "graph/node.hpp"
+#include "helpers/phase_timer.hpp"
+
+namespace tc {
+
+namespace {
+
+// bump when the meaning of the hashed fields changes
+constexpr uint64_t kFingerprintVersion = 1;
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+constexpr uint64_t kMixOffset = 0x9e3779b97f4a7c15ull;
+constexpr uint64_t kMixPrime = 0xff51afd7ed558ccdull;
+
+uint64_t Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// two independent 64-bit lanes: FNV-1a and a multiply-rotate mix
+class Hasher {
+  private:
+    uint64_t a_ = kFnvOffset;
+    uint64_t b_ = kMixOffset;
+
+    void Word(uint64_t w) {
+        a_ = (a_ ^ w) * kFnvPrime;
+        b_ = Rotl((b_ ^ w) * kMixPrime, 31);
+    }
+
+  public:
+    void Bytes(std::string_view bytes) {
+        U64(bytes.size());
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+            uint64_t w = 0;
+            std::memcpy(&w, bytes.data() + i, sizeof(uint64_t));
+            Word(w);
+        }
+        uint64_t tail = 0;
+        if (i < bytes.size()) {
+            std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+        }
+        Word(tail);
+    }
+
+    void U64(uint64_t value) { Word(value); }
+    void I64(int64_t value) { Word(static_cast<uint64_t>(value)); }
+
+    void F32(float value) {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Word(bits);
+    }
+
+    std::string Hex() const {
+        static constexpr char kDigits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        uint64_t lanes[2] = {a_ ^ Rotl(b_, 17), b_ ^ (a_ * kMixPrime)};
+        for (size_t lane = 0; lane < 2; ++lane) {
+            for (size_t i = 0; i < 16; ++i) {
+                out[lane * 16 + i] = kDigits[(lanes[lane] >> (60 - 4 * i)) & 0xf];
+            }
+        }
+        return out;
+    }
+};
+
+void HashTensorType(Hasher& h, const TensorType& type) {
+    h.U64(static_cast<uint64_t>(type.ElemType()));
+    h.U64(type.Shape().size());
+    for (int64_t dim : type.Shape()) {
+        h.I64(dim);
+    }
+}
+
+void HashAttr(Hasher& h, const Attribute& attr) {
+    h.Bytes(attr.Name());
+    h.U64(attr.GetValue().index());
+    std::visit(
+        [&](auto&& x) {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, int64_t>) {
+                h.I64(x);
+            } else if constexpr (std::is_same_v<T, float>) {
+                h.F32(x);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+                h.Bytes(x);
+            } else if constexpr (std::is_same_v<T, std::vector<int64_t>>) {
+                h.U64(x.size());
+                for (int64_t v : x) h.I64(v);
+            } else if constexpr (std::is_same_v<T, std::vector<float>>) {
+                h.U64(x.size());
+                for (float v : x) h.F32(v);
+            } else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+                h.U64(x.size());
+                for (const std::string& v : x) h.Bytes(v);
+            }
+        },
+        attr.GetValue()
+    );
+}
+
+void HashValue(Hasher& h, const Value& value) {
+    h.U64(0);
+    h.Bytes(value.Name());
+    h.U64(static_cast<uint64_t>(value.GetBelongsTo()));
+    h.U64(value.HasTensorType() ? 1 : 0);
+    if (value.HasTensorType()) {
+        HashTensorType(h, *value.MaybeTensorType());
+    }
+    h.U64(value.HasInitializerData() ? 1 : 0);
+    if (value.HasInitializerData()) {
+        HashTensorType(h, value.InitializerData()->type);
+        h.Bytes(value.InitializerData()->raw);
+    }
+}
+
+void HashOperation(Hasher& h, const Operation& op) {
+    h.U64(1);
+    h.Bytes(op.Name());
+    h.U64(static_cast<uint64_t>(op.Type()));
+
+    auto hash_values = [&](const std::vector<Value*>& values) {
+        h.U64(values.size());
+        for (const Value* v : values) {
+            h.Bytes(v != nullptr ? std::string_view{v->Name()} : std::string_view{});
+        }
+    };
+    hash_values(op.Inputs());
+    hash_values(op.Outputs());
+
+    // AttributeMap is unordered, hash in key order to stay deterministic
+    std::vector<const Attribute*> attrs;
+    attrs.reserve(op.Attrs().size());
+    for (const auto& kv : op.Attrs()) {
+        attrs.push_back(&kv.second);
+    }
+    std::sort(attrs.begin(), attrs.end(), [](const Attribute* l, const Attribute* r) {
+        return l->Name() < r->Name();
+    });
+    h.U64(attrs.size());
+    for (const Attribute* attr : attrs) {
+        HashAttr(h, *attr);
+    }
+}
+
+} // namespace
+
+std::string Fingerprint(const Graph& graph) {
+    const hlp::ScopedPhase phase{"fingerprint"};
+    Hasher h;
+    h.U64(kFingerprintVersion);
+    for (const INode* node : graph) {
+        if (const auto* value = dynamic_cast<const Value*>(node)) {
+            HashValue(h, *value);
+        } else if (const auto* op = dynamic_cast<const Operation*>(node)) {
+            HashOperation(h, *op);
+        }
+    }
+    return h.Hex();
+}
+
+} // namespace tc
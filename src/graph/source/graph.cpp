@@ -1,7 +1,9 @@
 #include "graph/graph.hpp"
 #include "graph/node.hpp"
+#include "graph/cost_model.hpp"
 
 #include <algorithm>
+#include <cstdio>
 #include <sstream>
 #include <string_view>
 #include <type_traits>
@@ -132,6 +134,40 @@ std::string ValueFillColor(Value::BelongTo b) {
     return "#FFFFFF";
 }
 
+std::string OpFillColor(Bound b) {
+    switch (b) {
+        case Bound::kMemory:  return "#90CAF9";
+        case Bound::kCompute: return "#EF9A9A";
+        case Bound::kUnknown: return "#B39DDB";
+    }
+    return "#B39DDB";
+}
+
+// "12.3 MFLOP, 45.6 KiB, 0.27 FLOP/B"; unknown parts are "?"
+std::string CostToLabel(const OpCost& cost) {
+    char text[128];
+    const double intensity = ArithmeticIntensity(cost);
+    const bool bytes_known = cost.bytes_read >= 0 && cost.bytes_written >= 0;
+    std::string label;
+    if (cost.flops >= 0) {
+        std::snprintf(text, sizeof(text), "%.3g MFLOP", static_cast<double>(cost.flops) / 1e6);
+        label += text;
+    } else {
+        label += "? MFLOP";
+    }
+    if (bytes_known) {
+        std::snprintf(text, sizeof(text), ", %.3g KiB", static_cast<double>(cost.bytes_read + cost.bytes_written) / 1024.0);
+        label += text;
+    } else {
+        label += ", ? KiB";
+    }
+    if (intensity >= 0) {
+        std::snprintf(text, sizeof(text), ", %.3g FLOP/B", intensity);
+        label += text;
+    }
+    return label;
+}
+
 } // namespace
 
 std::string Graph::ToDot(const DotOptions& opt) const {
@@ -175,8 +211,16 @@ std::string Graph::ToDot(const DotOptions& opt) const {
                 label += attrs;
             }
 
+            Bound bound = Bound::kUnknown;
+            if (opt.show_cost) {
+                const OpCost cost = EstimateCost(*op);
+                bound = ClassifyBound(cost, opt.ridge_flops_per_byte);
+                label += "\\n";
+                label += CostToLabel(cost);
+            }
+
             dot << "  " << id_of(op)
-                << " [shape=box, style=\"rounded,filled\", fillcolor=\"#B39DDB\""
+                << " [shape=box, style=\"rounded,filled\", fillcolor=\"" << OpFillColor(bound) << "\""
                 << ", labeljust=\"l\""
                 << ", label=\"" << EscapeDot(label) << "\"];\n";
             continue;
@@ -0,0 +1,318 @@
+#include "graph/layout.hpp"
+
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "graph/attribute.hpp"
+#include "graph/node.hpp"
+#include "helpers/phase_timer.hpp"
+
+namespace tc {
+
+namespace {
+
+[[noreturn]] void Fail(const std::string& message) {
+    throw std::runtime_error{"layout: " + message};
+}
+
+const TensorType& TypeOf(const Value& value) {
+    if (!value.HasTensorType()) {
+        Fail("value '" + value.Name() + "' has no tensor type");
+    }
+    return *value.MaybeTensorType();
+}
+
+int64_t IntAttr(const Operation& op, const std::string& name, int64_t fallback) {
+    auto it = op.Attrs().find(name);
+    return it == op.Attrs().end() ? fallback : it->second.As<int64_t>();
+}
+
+bool IsElementwise(const Operation& op) {
+    return op.Type() == Operation::OpType::kAdd || op.Type() == Operation::OpType::kMul ||
+           op.Type() == Operation::OpType::kRelu;
+}
+
+class LayoutAssigner {
+  public:
+    LayoutAssigner(const Graph& graph, int64_t block) : graph_{graph}, block_{block} {}
+
+    Graph Run() {
+        // the entry takes its arguments in the order of these
+        for (const INode* node : graph_) {
+            const auto* value = dynamic_cast<const Value*>(node);
+            if (value != nullptr && value->GetBelongsTo() == Value::BelongTo::kInput) {
+                Plain(*value);
+            } else if (value != nullptr && value->GetBelongsTo() == Value::BelongTo::kOutput) {
+                AddValue(value->Name(), Value::BelongTo::kOutput, TypeOf(*value));
+            }
+        }
+
+        for (const INode* node : graph_) {
+            const auto* op = dynamic_cast<const Operation*>(node);
+            if (op == nullptr) {
+                continue;
+            }
+            if (BlocksConv(*op)) {
+                BlockConv(*op);
+            } else if (BlocksElementwise(*op)) {
+                BlockElementwise(*op);
+            } else {
+                CopyOperation(*op);
+            }
+        }
+
+        for (const INode* node : graph_) {
+            const auto* value = dynamic_cast<const Value*>(node);
+            if (value != nullptr && value->GetBelongsTo() == Value::BelongTo::kOutput) {
+                Plain(*value);
+            }
+        }
+        return std::move(out_);
+    }
+
+  private:
+    const Graph& graph_;
+    int64_t block_;
+    Graph out_;
+    // per value of graph_, its copy in out_ in each layout it is needed in
+    std::unordered_map<const Value*, Value*> plain_;
+    std::unordered_map<const Value*, Value*> blocked_;
+    std::unordered_map<const Value*, Value*> packed_weights_;
+
+    std::string FreshName(const std::string& base) const {
+        std::string name = base;
+        for (size_t n = 1; graph_.Contains(name) || out_.Contains(name); ++n) {
+            name = base + "_" + std::to_string(n);
+        }
+        return name;
+    }
+
+    std::string BlockedName(const std::string& name) const {
+        return FreshName(name + "_nchw" + std::to_string(block_) + "c");
+    }
+
+    Value* AddValue(const std::string& name, Value::BelongTo belong, const TensorType& type,
+                    std::optional<TensorData> data = std::nullopt) {
+        Value* value = out_.AddNode<Value>(name, belong, std::move(data));
+        value->MergeTensorType(type);
+        return value;
+    }
+
+    // [N, C, H, W] as [N, C / b, H, W, b]
+    TensorType BlockedType(const TensorType& type) const {
+        const std::vector<int64_t>& shape = type.Shape();
+        return TensorType{type.ElemType(), {shape[0], shape[1] / block_, shape[2], shape[3], block_}};
+    }
+
+    // rank 4 with a static channel count that splits into blocks
+    bool Blockable(const Value& value) const {
+        const std::vector<int64_t>& shape = TypeOf(value).Shape();
+        return shape.size() == 4 && shape[1] > 0 && shape[1] % block_ == 0;
+    }
+
+    // an initializer holding one value per channel, broadcast over N, H and W
+    bool IsChannelVector(const Value& value, int64_t channels) const {
+        if (!value.HasInitializerData()) {
+            return false;
+        }
+        const std::vector<int64_t>& shape = TypeOf(value).Shape();
+        if (shape.size() != 3 && shape.size() != 4) {
+            return false;
+        }
+        for (size_t axis = 0; axis < shape.size(); ++axis) {
+            if (shape[axis] != (axis + 3 == shape.size() ? channels : 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Value* Plain(const Value& value) {
+        if (auto it = plain_.find(&value); it != plain_.end()) {
+            return it->second;
+        }
+        Value* copy = nullptr;
+        if (auto it = blocked_.find(&value); it != blocked_.end()) {
+            copy = AddValue(value.Name(), value.GetBelongsTo(), TypeOf(value));
+            out_.AddNode<Operation>(FreshName(value.Name() + "_to_nchw"), Operation::OpType::kReorderOutput,
+                                    std::vector<Value*>{it->second}, std::vector<Value*>{copy});
+        } else {
+            copy = AddValue(value.Name(), value.GetBelongsTo(), TypeOf(value), value.InitializerData());
+        }
+        plain_.emplace(&value, copy);
+        return copy;
+    }
+
+    // operand of a blocked op: a Blockable() value or a per-channel initializer
+    Value* Blocked(const Value& value) {
+        if (auto it = blocked_.find(&value); it != blocked_.end()) {
+            return it->second;
+        }
+        Value* copy = nullptr;
+        if (value.HasInitializerData()) {
+            const TensorData packed = PackActivation(value);
+            copy = AddValue(BlockedName(value.Name()), Value::BelongTo::kInitializer, packed.type, packed);
+        } else {
+            copy = AddValue(BlockedName(value.Name()), Value::BelongTo::kInternal, BlockedType(TypeOf(value)));
+            out_.AddNode<Operation>(FreshName(value.Name() + "_to_nchw" + std::to_string(block_) + "c"),
+                                    Operation::OpType::kReorderInput, std::vector<Value*>{Plain(value)},
+                                    std::vector<Value*>{copy});
+        }
+        blocked_.emplace(&value, copy);
+        return copy;
+    }
+
+    // an initializer [N, C, H, W] or [C, 1, 1] as [N, C / b, H, W, b], packed at compile time
+    TensorData PackActivation(const Value& value) const {
+        const TensorData& data = *value.InitializerData();
+        std::vector<int64_t> shape = data.type.Shape();
+        if (shape.size() == 3) {
+            shape.insert(shape.begin(), 1);
+        }
+        const int64_t channels = shape[1];
+        const int64_t pixels = shape[2] * shape[3];
+        const size_t elem_size = TensorType::ElemSizeInBytes(data.type.ElemType());
+        if (data.raw.size() != static_cast<size_t>(shape[0] * channels * pixels) * elem_size) {
+            Fail("initializer '" + value.Name() + "' raw byte size mismatch");
+        }
+
+        TensorData packed{BlockedType(TensorType{data.type.ElemType(), shape}), std::string(data.raw.size(), '\0')};
+        for (int64_t n = 0; n < shape[0]; ++n) {
+            for (int64_t c = 0; c < channels; ++c) {
+                for (int64_t pixel = 0; pixel < pixels; ++pixel) {
+                    const int64_t from = (n * channels + c) * pixels + pixel;
+                    const int64_t to = ((n * (channels / block_) + c / block_) * pixels + pixel) * block_ + c % block_;
+                    std::memcpy(packed.raw.data() + to * elem_size, data.raw.data() + from * elem_size, elem_size);
+                }
+            }
+        }
+        return packed;
+    }
+
+    // W [C_out, C_in / group, kh, kw] as [C_out / b, C_in / group / b, kh, kw, b (in), b (out)]
+    Value* PackedWeights(const Value& w) {
+        if (auto it = packed_weights_.find(&w); it != packed_weights_.end()) {
+            return it->second;
+        }
+        const TensorData& data = *w.InitializerData();
+        const std::vector<int64_t>& shape = data.type.Shape();
+        const int64_t out_channels = shape[0];
+        const int64_t channels = shape[1];
+        const int64_t taps = shape[2] * shape[3];
+        const size_t elem_size = TensorType::ElemSizeInBytes(data.type.ElemType());
+        if (data.raw.size() != static_cast<size_t>(out_channels * channels * taps) * elem_size) {
+            Fail("initializer '" + w.Name() + "' raw byte size mismatch");
+        }
+
+        const TensorType packed_type{data.type.ElemType(),
+                                     {out_channels / block_, channels / block_, shape[2], shape[3], block_, block_}};
+        std::string raw(data.raw.size(), '\0');
+        for (int64_t oc = 0; oc < out_channels; ++oc) {
+            for (int64_t c = 0; c < channels; ++c) {
+                for (int64_t tap = 0; tap < taps; ++tap) {
+                    const int64_t from = (oc * channels + c) * taps + tap;
+                    const int64_t to = (((oc / block_) * (channels / block_) + c / block_) * taps + tap) * block_ * block_ +
+                                       (c % block_) * block_ + oc % block_;
+                    std::memcpy(raw.data() + to * elem_size, data.raw.data() + from * elem_size, elem_size);
+                }
+            }
+        }
+        Value* packed = AddValue(BlockedName(w.Name()), Value::BelongTo::kInitializer, packed_type,
+                                 TensorData{packed_type, std::move(raw)});
+        packed_weights_.emplace(&w, packed);
+        return packed;
+    }
+
+    bool BlocksConv(const Operation& op) const {
+        if (op.Type() != Operation::OpType::kConv || (op.Inputs().size() != 2 && op.Inputs().size() != 3) ||
+            op.Outputs().size() != 1) {
+            return false;
+        }
+        const Value& x = *op.Inputs()[0];
+        const Value& w = *op.Inputs()[1];
+        const Value& y = *op.Outputs()[0];
+        const TensorElemType elem_type = TypeOf(y).ElemType();
+        if (elem_type != TensorElemType::kFloat32 && elem_type != TensorElemType::kFloat64) {
+            return false;
+        }
+        if (!Blockable(x) || !Blockable(y) || !w.HasInitializerData() || TypeOf(w).Shape().size() != 4) {
+            return false;
+        }
+        const int64_t group = IntAttr(op, "group", 1);
+        const int64_t channels_per_group = TypeOf(w).Shape()[1];
+        return group > 0 && TypeOf(x).Shape()[1] == channels_per_group * group && channels_per_group % block_ == 0 &&
+               TypeOf(w).Shape()[0] == TypeOf(y).Shape()[1] && (TypeOf(y).Shape()[1] / group) % block_ == 0;
+    }
+
+    // an elementwise op over a blocked operand whose other operands can follow it
+    bool BlocksElementwise(const Operation& op) const {
+        if (!IsElementwise(op) || op.Outputs().size() != 1 || !Blockable(*op.Outputs()[0])) {
+            return false;
+        }
+        const int64_t channels = TypeOf(*op.Outputs()[0]).Shape()[1];
+        bool any_blocked = false;
+        for (const Value* input : op.Inputs()) {
+            const std::vector<int64_t>& shape = TypeOf(*input).Shape();
+            if (blocked_.contains(input) && !IsChannelVector(*input, channels)) {
+                any_blocked = true;
+            } else if (TypeOf(*input).NumElements() != 1 && !IsChannelVector(*input, channels) &&
+                       !(shape.size() == 4 && shape[1] == channels)) {
+                return false;
+            }
+        }
+        return any_blocked;
+    }
+
+    void CopyOperation(const Operation& op) {
+        std::vector<Value*> inputs;
+        for (const Value* input : op.Inputs()) {
+            inputs.push_back(Plain(*input));
+        }
+        std::vector<Value*> outputs;
+        for (const Value* output : op.Outputs()) {
+            outputs.push_back(Plain(*output));
+        }
+        out_.AddNode<Operation>(op.Name(), op.Type(), std::move(inputs), std::move(outputs), op.Attrs());
+    }
+
+    void AddBlockedOperation(const Operation& op, Operation::OpType type, std::vector<Value*> inputs) {
+        const Value& y = *op.Outputs()[0];
+        Value* output = AddValue(BlockedName(y.Name()), Value::BelongTo::kInternal, BlockedType(TypeOf(y)));
+        blocked_.emplace(&y, output);
+        out_.AddNode<Operation>(op.Name(), type, std::move(inputs), std::vector<Value*>{output}, op.Attrs());
+    }
+
+    void BlockConv(const Operation& op) {
+        std::vector<Value*> inputs{Blocked(*op.Inputs()[0]), PackedWeights(*op.Inputs()[1])};
+        if (op.Inputs().size() == 3) {
+            // [C_out] is already in the order of the output blocks
+            inputs.push_back(Plain(*op.Inputs()[2]));
+        }
+        AddBlockedOperation(op, Operation::OpType::kNchwcConv, std::move(inputs));
+    }
+
+    void BlockElementwise(const Operation& op) {
+        std::vector<Value*> inputs;
+        for (const Value* input : op.Inputs()) {
+            // scalars broadcast over [N, C / b, H, W, b] as they did over [N, C, H, W]
+            inputs.push_back(TypeOf(*input).NumElements() == 1 ? Plain(*input) : Blocked(*input));
+        }
+        AddBlockedOperation(op, op.Type(), std::move(inputs));
+    }
+};
+
+} // namespace
+
+Graph AssignBlockedLayout(const Graph& graph, int64_t block) {
+    const hlp::ScopedPhase phase{"layout"};
+    if (block <= 0) {
+        Fail("block must be positive, got " + std::to_string(block));
+    }
+    return LayoutAssigner{graph, block}.Run();
+}
+
+} // namespace tc
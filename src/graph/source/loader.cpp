@@ -0,0 +1,71 @@
+#include "graph/loader.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helpers/phase_timer.hpp"
+
+namespace tc {
+
+namespace {
+
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error{"Unable to open model file"};
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error{"Unable to stat model file"};
+        }
+        size_ = static_cast<size_t>(st.st_size);
+
+        if (size_ != 0) {
+            data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (data_ == MAP_FAILED) {
+            throw std::runtime_error{"Unable to map model file"};
+        }
+        if (data_ != nullptr) {
+            ::madvise(data_, size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_ != nullptr && data_ != MAP_FAILED) {
+            ::munmap(data_, size_);
+        }
+    }
+
+    std::string_view View() const {
+        return data_ == nullptr ? std::string_view{} : std::string_view{static_cast<const char*>(data_), size_};
+    }
+
+  private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace
+
+Graph ILoader::Load(const std::string& model_path) {
+    const hlp::ScopedPhase phase{"load model"};
+    const MappedFile model_file{model_path};
+    return ParseRaw(model_file.View());
+}
+
+} // namespace tc
@@ -0,0 +1,191 @@
+#include "graph/rebatch.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "graph/attribute.hpp"
+#include "graph/node.hpp"
+#include "helpers/phase_timer.hpp"
+
+namespace tc {
+
+namespace {
+
+[[noreturn]] void Fail(const std::string& message) {
+    throw std::runtime_error{"rebatch: " + message};
+}
+
+const std::vector<int64_t>& ShapeOf(const Value& value) {
+    if (!value.HasTensorType()) {
+        Fail("value '" + value.Name() + "' has no tensor type");
+    }
+    return value.MaybeTensorType()->Shape();
+}
+
+int64_t IntAttr(const Operation& op, const std::string& name, int64_t fallback) {
+    auto it = op.Attrs().find(name);
+    return it == op.Attrs().end() ? fallback : it->second.As<int64_t>();
+}
+
+// which operands of op may carry the batch dimension in front and still leave it in front of
+// the result; the others must not depend on the batch
+bool BatchFollowsOperand(const Operation& op, size_t operand) {
+    switch (op.Type()) {
+        case Operation::OpType::kAdd:
+        case Operation::OpType::kMul:
+        case Operation::OpType::kRelu:
+        case Operation::OpType::kReorderInput:
+        case Operation::OpType::kReorderOutput:
+            return true;
+        case Operation::OpType::kConv:
+        case Operation::OpType::kNchwcConv:
+        case Operation::OpType::kMatMul:
+            return operand == 0;
+        case Operation::OpType::kGemm:
+            return operand == 0 && IntAttr(op, "transA", 0) == 0;
+        case Operation::OpType::kTranspose: {
+            auto it = op.Attrs().find("perm");
+            if (it == op.Attrs().end()) {
+                // default perm reverses the axes
+                return ShapeOf(*op.Inputs()[0]).size() == 1;
+            }
+            const std::vector<int64_t>& perm = it->second.As<std::vector<int64_t>>();
+            return !perm.empty() && perm[0] == 0;
+        }
+    }
+    return false;
+}
+
+bool IsElementwise(const Operation& op) {
+    return op.Type() == Operation::OpType::kAdd || op.Type() == Operation::OpType::kMul ||
+           op.Type() == Operation::OpType::kRelu;
+}
+
+// operands broadcast from the right: a batched one must line up with the output, an unbatched
+// one must not span the batch dimension
+void CheckBroadcast(const Operation& op, const std::vector<int64_t>& out_shape,
+                    const std::unordered_set<std::string>& batched) {
+    for (const Value* input : op.Inputs()) {
+        const std::vector<int64_t>& shape = ShapeOf(*input);
+        const bool aligned = shape.size() == out_shape.size();
+        if (batched.contains(input->Name()) && !aligned) {
+            Fail("operand '" + input->Name() + "' of '" + op.Name() + "' broadcasts over the batch");
+        }
+        if (!batched.contains(input->Name()) && aligned && shape[0] != 1) {
+            Fail("operand '" + input->Name() + "' of '" + op.Name() + "' is sized by the batch");
+        }
+    }
+}
+
+// names of the values whose leading dimension is the batch, in graph order
+std::unordered_set<std::string> CollectBatchedValues(const Graph& graph, int64_t old_batch) {
+    std::unordered_set<std::string> batched;
+    for (const INode* node : graph) {
+        if (const auto* value = dynamic_cast<const Value*>(node)) {
+            if (value->GetBelongsTo() == Value::BelongTo::kInput) {
+                batched.insert(value->Name());
+            }
+            continue;
+        }
+        const auto* op = dynamic_cast<const Operation*>(node);
+        if (op == nullptr) {
+            continue;
+        }
+
+        bool any = false;
+        for (size_t i = 0; i < op->Inputs().size(); ++i) {
+            const Value* input = op->Inputs()[i];
+            if (!batched.contains(input->Name())) {
+                continue;
+            }
+            if (!BatchFollowsOperand(*op, i)) {
+                Fail("operation '" + op->Name() + "' (" + Operation::OpTypeToStr(op->Type()) +
+                     ") does not keep the batch dimension of operand " + std::to_string(i) + " in front");
+            }
+            any = true;
+        }
+        if (!any) {
+            continue;
+        }
+
+        for (const Value* output : op->Outputs()) {
+            const std::vector<int64_t>& shape = ShapeOf(*output);
+            if (shape.empty() || shape[0] != old_batch) {
+                Fail("output '" + output->Name() + "' of '" + op->Name() + "' does not start with the batch dimension");
+            }
+            if (IsElementwise(*op)) {
+                CheckBroadcast(*op, shape, batched);
+            }
+            batched.insert(output->Name());
+        }
+    }
+    return batched;
+}
+
+} // namespace
+
+int64_t BatchSizeOf(const Graph& graph) {
+    int64_t batch = -1;
+    for (const INode* node : graph) {
+        const auto* value = dynamic_cast<const Value*>(node);
+        if (value == nullptr || value->GetBelongsTo() != Value::BelongTo::kInput) {
+            continue;
+        }
+        const std::vector<int64_t>& shape = ShapeOf(*value);
+        if (shape.empty()) {
+            Fail("input '" + value->Name() + "' is a scalar");
+        }
+        if (batch >= 0 && shape[0] != batch) {
+            Fail("inputs disagree on the batch size: " + std::to_string(batch) + " vs " + std::to_string(shape[0]));
+        }
+        batch = shape[0];
+    }
+    if (batch < 0) {
+        Fail("graph has no inputs");
+    }
+    return batch;
+}
+
+Graph Rebatch(const Graph& graph, int64_t batch) {
+    const hlp::ScopedPhase phase{"rebatch"};
+    if (batch <= 0) {
+        Fail("batch size must be positive, got " + std::to_string(batch));
+    }
+    const std::unordered_set<std::string> batched = CollectBatchedValues(graph, BatchSizeOf(graph));
+
+    Graph out;
+    std::unordered_map<const Value*, Value*> mapped;
+    auto map_values = [&](const std::vector<Value*>& values) {
+        std::vector<Value*> result;
+        result.reserve(values.size());
+        for (const Value* value : values) {
+            result.push_back(mapped.at(value));
+        }
+        return result;
+    };
+
+    for (const INode* node : graph) {
+        if (const auto* value = dynamic_cast<const Value*>(node)) {
+            Value* copy = out.AddNode<Value>(value->Name(), value->GetBelongsTo(), value->InitializerData());
+            if (value->HasTensorType() && !value->HasInitializerData()) {
+                TensorType type = *value->MaybeTensorType();
+                if (batched.contains(value->Name())) {
+                    std::vector<int64_t> shape = type.Shape();
+                    shape[0] = batch;
+                    type = TensorType{type.ElemType(), std::move(shape)};
+                }
+                copy->MergeTensorType(type);
+            }
+            mapped.emplace(value, copy);
+        } else if (const auto* op = dynamic_cast<const Operation*>(node)) {
+            out.AddNode<Operation>(op->Name(), op->Type(), map_values(op->Inputs()), map_values(op->Outputs()),
+                                   op->Attrs());
+        }
+    }
+    return out;
+}
+
+} // namespace tc
@@ -0,0 +1,30 @@
+#ifndef JSON_HPP_
+#define JSON_HPP_
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace hlp {
+
+// text as a quoted JSON string
+inline std::string JsonQuote(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+} // namespace hlp
+
+#endif // JSON_HPP_
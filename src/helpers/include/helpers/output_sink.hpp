@@ -0,0 +1,145 @@
+#ifndef OUTPUT_SINK_HPP_
+#define OUTPUT_SINK_HPP_
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hlp {
+
+// Byte sink for generated text. Producers push fragments as they are formed,
+// so the consumer decides whether the whole output is ever held in memory.
+class OutputSink {
+  public:
+    virtual ~OutputSink() = default;
+
+    virtual void Write(std::string_view data) = 0;
+    virtual void Flush() {}
+
+    OutputSink& operator<<(std::string_view data) {
+        Write(data);
+        return *this;
+    }
+    OutputSink& operator<<(char c) {
+        Write(std::string_view{&c, 1});
+        return *this;
+    }
+};
+
+class StringSink final : public OutputSink {
+  public:
+    void Write(std::string_view data) override { str_.append(data); }
+
+    const std::string& Str() const { return str_; }
+    std::string Take() { return std::move(str_); }
+
+  private:
+    std::string str_;
+};
+
+// Buffers writes and forwards them to a file descriptor (file, pipe or stdout) in fixed-size chunks.
+// Does not own the descriptor.
+class FdSink : public OutputSink {
+  public:
+    explicit FdSink(int fd, size_t capacity = size_t{1} << 16) : fd_{fd}, capacity_{capacity} {
+        buffer_.reserve(capacity_);
+    }
+
+    FdSink(const FdSink&) = delete;
+    FdSink& operator=(const FdSink&) = delete;
+
+    ~FdSink() override {
+        try {
+            Flush();
+        } catch (...) {
+        }
+    }
+
+    void Write(std::string_view data) override {
+        if (buffer_.size() + data.size() <= capacity_) {
+            buffer_.append(data);
+            return;
+        }
+        Flush();
+        if (data.size() >= capacity_) {
+            WriteAll(data);
+        } else {
+            buffer_.append(data);
+        }
+    }
+
+    void Flush() override {
+        if (buffer_.empty()) {
+            return;
+        }
+        const std::string pending = std::exchange(buffer_, {});
+        buffer_.reserve(capacity_);
+        WriteAll(pending);
+    }
+
+  protected:
+    int fd_;
+
+  private:
+    size_t capacity_;
+    std::string buffer_;
+
+    void WriteAll(std::string_view data) const {
+        while (!data.empty()) {
+            const ssize_t n = ::write(fd_, data.data(), data.size());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error{std::string{"write failed: "} + std::strerror(errno)};
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+};
+
+// FdSink over a file it creates (or truncates) and closes.
+class FileSink final : public FdSink {
+  public:
+    explicit FileSink(const std::string& path) : FdSink{OpenForWriting(path)}, path_{path} {}
+
+    ~FileSink() override {
+        if (fd_ >= 0) {
+            try {
+                Flush();
+            } catch (...) {
+            }
+            ::close(fd_);
+        }
+    }
+
+    // flushes and reports close errors, which is where delayed write failures surface
+    void Close() {
+        Flush();
+        const int fd = std::exchange(fd_, -1);
+        if (::close(fd) != 0) {
+            throw std::runtime_error{"unable to close file: " + path_};
+        }
+    }
+
+  private:
+    std::string path_;
+
+    static int OpenForWriting(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error{"unable to open file for writing: " + path};
+        }
+        return fd;
+    }
+};
+
+} // namespace hlp
+
+#endif // OUTPUT_SINK_HPP_
@@ -0,0 +1,197 @@
+#ifndef PHASE_TIMER_HPP_
+#define PHASE_TIMER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "helpers/json.hpp"
+
+namespace hlp {
+
+// bumped by the counting operator new of tc.x (src/alloc_counter.cpp); stays 0 in binaries without it
+inline std::atomic<uint64_t> g_allocations{0};
+
+// one finished ScopedPhase
+struct PhaseRecord {
+    std::string name;
+    int depth;          // of nested phases on the same thread
+    uint32_t thread;    // in order of first phase
+    int64_t begin_ns;   // since Enable()
+    int64_t end_ns;
+    int64_t rss_delta;  // resident set size change in bytes, process wide
+    uint64_t allocations; // operator new calls in the phase, process wide
+};
+
+// Collects compiler phases for --time-report / --trace-out. Disabled, a ScopedPhase costs one atomic load.
+class PhaseRecorder {
+  public:
+    static PhaseRecorder& Instance() {
+        static PhaseRecorder recorder;
+        return recorder;
+    }
+
+    void Enable() {
+        start_ns_ = NowNs();
+        enabled_.store(true, std::memory_order_release);
+    }
+
+    bool Enabled() const {
+        return enabled_.load(std::memory_order_acquire);
+    }
+
+    // in begin order, parents before their children
+    std::vector<PhaseRecord> Records() const {
+        std::vector<PhaseRecord> records;
+        {
+            std::lock_guard lock{mutex_};
+            records = records_;
+        }
+        std::stable_sort(records.begin(), records.end(), [](const PhaseRecord& a, const PhaseRecord& b) {
+            return a.begin_ns != b.begin_ns ? a.begin_ns < b.begin_ns : a.depth < b.depth;
+        });
+        return records;
+    }
+
+    // one row per phase, children indented under their parent
+    std::string Table() const {
+        const std::vector<PhaseRecord> records = Records();
+        double total_ms = 0;
+        for (const PhaseRecord& record : records) {
+            if (record.depth == 0) {
+                total_ms += static_cast<double>(record.end_ns - record.begin_ns) / 1e6;
+            }
+        }
+
+        std::string table;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-40s %6s %12s %7s %12s %12s\n", "phase", "thread", "wall ms", "%",
+                      "rss KiB", "allocs");
+        table += line;
+        for (const PhaseRecord& record : records) {
+            const std::string name = std::string(static_cast<size_t>(record.depth) * 2, ' ') + record.name;
+            const double ms = static_cast<double>(record.end_ns - record.begin_ns) / 1e6;
+            std::snprintf(line, sizeof(line), "%-40s %6u %12.3f %7.1f %+12lld %12llu\n", name.c_str(),
+                          record.thread, ms, total_ms > 0 ? ms * 100.0 / total_ms : 0.0,
+                          static_cast<long long>(record.rss_delta / 1024),
+                          static_cast<unsigned long long>(record.allocations));
+            table += line;
+        }
+        return table;
+    }
+
+    // chrome://tracing / Perfetto JSON with one complete event per phase
+    std::string ChromeTrace() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        for (const PhaseRecord& record : Records()) {
+            out << (first ? "\n" : ",\n") << "{\"name\": " << JsonQuote(record.name)
+                << ", \"cat\": \"phase\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << record.thread
+                << ", \"ts\": " << static_cast<double>(record.begin_ns) / 1e3
+                << ", \"dur\": " << static_cast<double>(record.end_ns - record.begin_ns) / 1e3
+                << ", \"args\": {\"rss_delta\": " << record.rss_delta << ", \"allocations\": " << record.allocations
+                << "}}";
+            first = false;
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+  private:
+    friend class ScopedPhase;
+
+    std::atomic<bool> enabled_{false};
+    int64_t start_ns_ = 0;
+    std::atomic<uint32_t> threads_{0};
+    mutable std::mutex mutex_;
+    std::vector<PhaseRecord> records_;
+
+    static int64_t NowNs() {
+        timespec now{};
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+    }
+
+    static int64_t ResidentBytes() {
+        long pages = 0;
+        long resident = 0;
+        if (FILE* statm = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+                resident = 0;
+            }
+            std::fclose(statm);
+        }
+        return static_cast<int64_t>(resident) * ::sysconf(_SC_PAGESIZE);
+    }
+
+    uint32_t ThreadNumber() {
+        thread_local const uint32_t number = threads_.fetch_add(1, std::memory_order_relaxed);
+        return number;
+    }
+
+    static int& Depth() {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    void Add(PhaseRecord record) {
+        std::lock_guard lock{mutex_};
+        records_.push_back(std::move(record));
+    }
+};
+
+// Times the enclosing scope as one phase of the PhaseRecorder, if it is enabled.
+class ScopedPhase {
+  public:
+    explicit ScopedPhase(std::string_view name) {
+        PhaseRecorder& recorder = PhaseRecorder::Instance();
+        if (!recorder.Enabled()) {
+            return;
+        }
+        active_ = true;
+        name_ = name;
+        depth_ = PhaseRecorder::Depth()++;
+        rss_ = PhaseRecorder::ResidentBytes();
+        allocations_ = g_allocations.load(std::memory_order_relaxed);
+        begin_ns_ = PhaseRecorder::NowNs();
+    }
+
+    ~ScopedPhase() {
+        if (!active_) {
+            return;
+        }
+        PhaseRecorder& recorder = PhaseRecorder::Instance();
+        const int64_t end_ns = PhaseRecorder::NowNs();
+        --PhaseRecorder::Depth();
+        recorder.Add(PhaseRecord{std::move(name_), depth_, recorder.ThreadNumber(), begin_ns_ - recorder.start_ns_,
+                                 end_ns - recorder.start_ns_, PhaseRecorder::ResidentBytes() - rss_,
+                                 g_allocations.load(std::memory_order_relaxed) - allocations_});
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+  private:
+    bool active_ = false;
+    std::string name_;
+    int depth_ = 0;
+    int64_t rss_ = 0;
+    uint64_t allocations_ = 0;
+    int64_t begin_ns_ = 0;
+};
+
+} // namespace hlp
+
+#endif // PHASE_TIMER_HPP_
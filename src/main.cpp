@@ -1,38 +1,177 @@
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "driver/compile_cache.hpp"
 #include "driver/driver_options.hpp"
+#include "driver/fat_binary.hpp"
 #include "driver/tool_runner.hpp"
+#include "graph/cost_model.hpp"
+#include "graph/fingerprint.hpp"
 #include "graph/graph.hpp"
+#include "graph/layout.hpp"
+#include "graph/rebatch.hpp"
+#include "helpers/phase_timer.hpp"
 #include "mlir_backend/mlir_backend.hpp"
+#include "mlir_backend/tuning.hpp"
 #include "onnx_loader/onnx_loader.hpp"
 
-int main(int argc, const char* argv[]) {
-    tc::driver::SetupLogging(argc, argv);
+#if defined(TC_HAVE_MLIR)
+#include <mlir/IR/MLIRContext.h>
 
-    try {
-        const tc::driver::DriverOptions opt = tc::driver::ParseArgs(argc, argv);
+#include "driver/inprocess_lowering.hpp"
+#include "mlir_backend/mlir_builder.hpp"
+#endif
 
-        tc::OnnxLoader loader;
-        const tc::Graph graph = loader.Load(opt.model_path);
+namespace {
 
-        if (!opt.emit_dot_path.empty()) {
-            tc::driver::WriteTextFile(opt.emit_dot_path, graph.ToDot(tc::DotOptions{}));
-        }
+tc::Graph LoadGraph(const tc::driver::DriverOptions& opt) {
+    tc::OnnxLoader loader;
+    tc::Graph graph = loader.Load(opt.model_path);
+    if (opt.batch > 0) {
+        tc::Graph rebatched = tc::Rebatch(graph, opt.batch);
+        return opt.channel_block > 0 ? tc::AssignBlockedLayout(rebatched, opt.channel_block) : std::move(rebatched);
+    }
+    if (opt.channel_block > 0) {
+        return tc::AssignBlockedLayout(graph, opt.channel_block);
+    }
+    return graph;
+}
+
+// builds the module through mlir::OpBuilder and lowers it without a textual round trip
+bool EmitAndLowerInMemory([[maybe_unused]] const tc::driver::DriverOptions& opt,
+                          [[maybe_unused]] const tc::Graph& graph,
+                          [[maybe_unused]] const tc::MlirEmitterOptions& emit_options) {
+#if defined(TC_HAVE_MLIR)
+    if (opt.external_tools || opt.text_emitter) {
+        return false;
+    }
+
+    mlir::MLIRContext context;
+    mlir::OwningOpRef<mlir::ModuleOp> module = tc::BuildMlirModule(context, graph, emit_options);
+    if (!opt.emit_mlir_path.empty()) {
+        tc::driver::StreamToFile(opt.emit_mlir_path, [&](hlp::OutputSink& out) {
+            tc::PrintMlirModule(*module, out);
+        });
+    }
+    if (opt.NeedsCodegen()) {
+        tc::driver::LowerInProcess(opt, *module);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// --time-report / --trace-out, once the compile is over, whether it succeeded or not
+void ReportPhases(const tc::driver::DriverOptions& opt) {
+    const hlp::PhaseRecorder& recorder = hlp::PhaseRecorder::Instance();
+    if (!recorder.Enabled()) {
+        return;
+    }
+    if (opt.time_report) {
+        std::cerr << recorder.Table();
+    }
+    if (!opt.trace_out_path.empty()) {
+        tc::driver::WriteTextFile(opt.trace_out_path, recorder.ChromeTrace());
+    }
+}
+
+void Compile(const tc::driver::DriverOptions& opt) {
+    const hlp::ScopedPhase phase{"compile"};
+    const tc::Graph graph = LoadGraph(opt);
+
+    if (!opt.cost_report.empty()) {
+        std::vector<tc::OpCostEntry> report = tc::CostReport(graph, opt.ridge_flops_per_byte);
+        tc::SortCostReport(report, tc::ParseCostSortKey(opt.cost_report));
+        std::cerr << tc::FormatCostReport(report);
+    }
 
-        std::string mlir_text;
-        if (opt.NeedsMlir()) {
-            tc::MlirBackend backend;
-            mlir_text = backend.EmitModule(graph, tc::MlirEmitterOptions{});
+    if (!opt.emit_dot_path.empty()) {
+        const hlp::ScopedPhase dot_phase{"emit DOT"};
+        tc::DotOptions dot_options;
+        dot_options.show_cost = opt.dot_cost;
+        dot_options.ridge_flops_per_byte = opt.ridge_flops_per_byte;
+        tc::driver::WriteTextFile(opt.emit_dot_path, graph.ToDot(dot_options));
+    }
+
+    tc::MlirEmitterOptions emit_options;
+    emit_options.use_workspace = opt.UsesCAbi();
+    emit_options.emit_tasks = opt.UsesCAbi();
+    emit_options.specializations = opt.specializations;
+    emit_options.instrument = opt.instrument;
+    emit_options.conv_algorithm = tc::ParseConvAlgorithm(opt.conv_algorithm);
+    if (!opt.tuning_db_path.empty()) {
+        emit_options.tuning = std::make_shared<const tc::TuningDatabase>(tc::TuningDatabase::Load(opt.tuning_db_path));
+    }
+
+    tc::MlirBackend backend;
+    if (!opt.emit_header_path.empty()) {
+        tc::driver::StreamToFile(opt.emit_header_path, [&](hlp::OutputSink& out) {
+            backend.EmitCHeader(graph, out, emit_options);
+        });
+    }
+
+    std::optional<tc::driver::CompileCache> cache;
+    std::string cache_key;
+    if (!opt.cache_dir.empty() && opt.NeedsMlir()) {
+        cache.emplace(opt.cache_dir, opt.cache_max_bytes);
+        cache_key = tc::driver::CacheKey(tc::Fingerprint(graph), opt);
+        if (tc::driver::FetchArtifacts(*cache, cache_key, opt)) {
+            return;
         }
+    }
 
+    if (!opt.mcpus.empty()) {
         if (!opt.emit_mlir_path.empty()) {
-            tc::driver::WriteTextFile(opt.emit_mlir_path, mlir_text);
+            tc::driver::StreamToFile(opt.emit_mlir_path, [&](hlp::OutputSink& out) {
+                backend.EmitModule(graph, out, emit_options);
+            });
         }
+        const auto compile_target = [&](const tc::driver::DriverOptions& target, const std::string& suffix) {
+            tc::MlirEmitterOptions target_options = emit_options;
+            target_options.symbol_suffix = suffix;
+            if (!EmitAndLowerInMemory(target, graph, target_options)) {
+                tc::driver::EmitMlirAndLower(target, [&](hlp::OutputSink& out) {
+                    backend.EmitModule(graph, out, target_options);
+                });
+            }
+        };
+        tc::driver::EmitFatBinary(opt, tc::ExportedSymbols(graph, emit_options), compile_target);
+    } else if (opt.NeedsMlir() && !EmitAndLowerInMemory(opt, graph, emit_options)) {
+        tc::driver::EmitMlirAndLower(opt, [&](hlp::OutputSink& out) {
+            backend.EmitModule(graph, out, emit_options);
+        });
+    }
+
+    if (cache.has_value()) {
+        tc::driver::StoreArtifacts(*cache, cache_key, opt);
+    }
+}
 
-        tc::driver::LowerToLlvmAndAsm(opt, mlir_text);
+} // namespace
+
+int main(int argc, const char* argv[]) {
+    tc::driver::SetupLogging(argc, argv);
+
+    try {
+        const tc::driver::DriverOptions opt = tc::driver::ParseArgs(argc, argv);
+
+        if (opt.time_report || !opt.trace_out_path.empty()) {
+            hlp::PhaseRecorder::Instance().Enable();
+        }
+        try {
+            Compile(opt);
+        } catch (...) {
+            ReportPhases(opt);
+            throw;
+        }
+        ReportPhases(opt);
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << '\n';
         std::cerr << tc::driver::Usage(argv[0]);
@@ -1,19 +1,154 @@
 #ifndef MLIR_BACKEND_HPP_
 #define MLIR_BACKEND_HPP_
 
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "graph/graph.hpp"
+#include "helpers/output_sink.hpp"
 
 namespace tc {
 
+class TuningDatabase;
+
+// how Conv ops are lowered
+enum class ConvAlgorithm {
+    kAuto,   // per op, by shape (see detail::ChooseConvAlgorithm)
+    kDirect, // one loop nest over the output with the reduction and its bounds checks innermost
+    kIm2col, // input patches packed into workspace scratch, then a matrix product over them
+    // F(2x2,3x3) or F(4x4,3x3) on 3x3 stride-1 kernels from an initializer: weights transformed
+    // at compile time, input and output transformed per tile
+    kWinograd,
+    // group == channels: per channel, each kernel tap slides over whole output rows
+    kDepthwise,
+    // 1x1, stride 1, no padding: a matrix product of the weights with X read in place
+    kPointwise,
+};
+
+// "auto", "direct", "im2col", "winograd", "depthwise", "pointwise"; ParseConvAlgorithm throws
+// on anything else
+std::string_view ConvAlgorithmName(ConvAlgorithm algorithm);
+ConvAlgorithm ParseConvAlgorithm(std::string_view name);
+
 struct MlirEmitterOptions {
     std::string entry_name = "main";
+    // marks the entry with llvm.emit_c_interface: the LLVM lowering then also emits
+    // _mlir_ciface_<entry>, taking one pointer per memref descriptor instead of expanded fields
+    bool emit_c_interface = false;
+    // temporaries are views into a caller-provided workspace (memref<Nxi8>, the last entry argument)
+    // instead of memref.alloc'd per call; also emits <entry>_workspace_size() -> i64 returning N.
+    // With dynamic dimensions every tensor argument keeps a static type so the bare-pointer call
+    // convention still applies: dynamically shaped tensors are passed as memref<1xT> base pointers,
+    // the sizes of EntrySignature::dims follow the workspace as memref<Kxi64>, and
+    // <entry>_workspace_size and the task extents take that array as their only argument
+    bool use_workspace = false;
+    // with use_workspace: also emits every operation as a task the runtime can split across threads,
+    // <entry>_task<i>(entry args..., i64 lo, i64 hi) running the op's outermost non-unit output loop
+    // over [lo, hi) only, with <entry>_task<i>_extent() -> i64 and <entry>_task_count() -> i64.
+    // Calling the tasks in order, each over its whole extent, is equivalent to calling the entry.
+    bool emit_tasks = false;
+    // sizes of EntrySignature::dims to compile fully static variants for. The module then holds
+    // <entry>_spec<k> per specialization and the dynamic code as <entry>_generic, each with its own
+    // workspace size and tasks; the usual entry symbols keep their signatures and dispatch every
+    // call on its dims, falling back to the generic variant for sizes that were not specialized
+    std::vector<std::vector<int64_t>> specializations;
+    // appended to every emitted function symbol, e.g. "_haswell" for entry_main_haswell and
+    // entry_main_workspace_size_haswell, so modules compiled per target CPU can be linked together
+    std::string symbol_suffix;
+    // wraps every operation of the entry and of the tasks in calls to the external
+    // kProfileEnterHook / kProfileExitHook functions, passing the op's index in graph order;
+    // the code then needs a definition of both (see runtime/profiler.hpp). Off, nothing is emitted
+    bool instrument = false;
+    // loop schedules of MatMul and Gemm by TuningSignature (see mlir_backend/tuning.hpp); ops without
+    // an entry, and every op when null, get the default untiled loop nests
+    std::shared_ptr<const TuningDatabase> tuning;
+    // anything but kAuto forces that lowering on every Conv it supports; the others stay direct
+    ConvAlgorithm conv_algorithm = ConvAlgorithm::kAuto;
 };
 
+// void(i64 op_index) hooks called by instrumented code right before and after each operation
+inline constexpr std::string_view kProfileEnterHook = "tc_profile_enter";
+inline constexpr std::string_view kProfileExitHook = "tc_profile_exit";
+
+// input dimension whose size is only known at call time (-1 in the model)
+struct DynamicDim {
+    const Value* input;
+    size_t axis;
+};
+
+// graph values bound to the entry function's arguments: all inputs, then all outputs
+struct EntrySignature {
+    std::vector<const Value*> inputs;
+    std::vector<const Value*> outputs;
+    // dynamic input dimensions, by input then axis; the sizes of every other dynamic
+    // dimension in the graph are derived from them through the operations
+    std::vector<DynamicDim> dims;
+};
+
+EntrySignature EntrySignatureOf(const Graph& graph);
+
+// Host-side twin of the size propagation in the emitted code: the output shapes for given sizes of
+// EntrySignature::dims. Copies what it needs, so the graph may go away after construction.
+class ShapeResolver {
+  public:
+    explicit ShapeResolver(const Graph& graph);
+
+    size_t DimCount() const { return dims_.size(); }
+    // throws unless dims holds DimCount() positive sizes
+    std::vector<std::vector<int64_t>> OutputShapes(std::span<const int64_t> dims) const;
+
+  private:
+    struct Step {
+        size_t value;
+        size_t axis;
+        size_t operand;
+        size_t operand_axis;
+        int64_t offset;
+        int64_t stride;
+    };
+
+    std::vector<std::vector<int64_t>> shapes_; // -1 for dynamic dimensions
+    std::vector<std::pair<size_t, size_t>> dims_;
+    std::vector<Step> steps_;
+    std::vector<size_t> outputs_;
+};
+
+// Copy of graph with EntrySignature::dims set to dims and every dimension derived from them
+// resolved, so the result has static shapes only. Throws like ShapeResolver::OutputShapes.
+Graph Specialize(const Graph& graph, std::span<const int64_t> dims);
+
+// symbol of the emitted entry function, e.g. "entry_main"
+std::string EntrySymbol(const MlirEmitterOptions& options = {});
+// symbols of the functions emitted next to the entry (see use_workspace and emit_tasks)
+std::string WorkspaceSizeSymbol(const MlirEmitterOptions& options = {});
+std::string TaskCountSymbol(const MlirEmitterOptions& options = {});
+std::string TaskSymbol(const MlirEmitterOptions& options, size_t index);
+std::string TaskExtentSymbol(const MlirEmitterOptions& options, size_t index);
+// the entry and every function emitted next to it, as a caller of the module sees them
+std::vector<std::string> ExportedSymbols(const Graph& graph, const MlirEmitterOptions& options = {});
+// options of the variants emitted for MlirEmitterOptions::specializations; variant is an index
+// into them, or their count for the generic fallback
+MlirEmitterOptions VariantOptions(const MlirEmitterOptions& options, size_t variant);
+
+// bumped whenever the emitted code changes for the same graph and options; part of the
+// compilation cache key (see driver/compile_cache.hpp)
+inline constexpr int kEmitterRevision = 15;
+
 class MlirBackend {
   public:
+    // streams the module into out as it is produced; initializers are formatted straight from
+    // their raw bytes, so memory use does not grow with the size of the weights
+    void EmitModule(const Graph& graph, hlp::OutputSink& out, const MlirEmitterOptions& options = {}) const;
+
     std::string EmitModule(const Graph& graph, const MlirEmitterOptions& options = {}) const;
+
+    // C declarations of the entry as compiled with use_workspace and the bare-pointer call convention
+    void EmitCHeader(const Graph& graph, hlp::OutputSink& out, const MlirEmitterOptions& options = {}) const;
 };
 
 } // namespace tc
@@ -0,0 +1,32 @@
+#ifndef MLIR_BUILDER_HPP_
+#define MLIR_BUILDER_HPP_
+
+#if defined(TC_HAVE_MLIR)
+
+#include <string>
+
+#include <mlir/IR/BuiltinOps.h>
+#include <mlir/IR/MLIRContext.h>
+#include <mlir/IR/OwningOpRef.h>
+
+#include "graph/graph.hpp"
+#include "helpers/output_sink.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+
+namespace tc {
+
+// In-memory counterpart of MlirBackend::EmitModule: creates the same func/arith/memref/scf ops
+// directly through mlir::OpBuilder, so the module never exists as text unless printed.
+// Loads the required dialects into context; the module is verified before it is returned.
+mlir::OwningOpRef<mlir::ModuleOp> BuildMlirModule(mlir::MLIRContext& context,
+                                                  const Graph& graph,
+                                                  const MlirEmitterOptions& options = {});
+
+void PrintMlirModule(mlir::ModuleOp module, hlp::OutputSink& out);
+std::string PrintMlirModule(mlir::ModuleOp module);
+
+} // namespace tc
+
+#endif // TC_HAVE_MLIR
+
+#endif // MLIR_BUILDER_HPP_
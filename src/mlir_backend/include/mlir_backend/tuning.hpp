@@ -0,0 +1,79 @@
+#ifndef TUNING_HPP_
+#define TUNING_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "graph/node.hpp"
+
+namespace tc {
+
+// Loop structure the emitters give a MatMul or Gemm. The default is the untiled nest that
+// computes one output element per iteration with the reduction innermost.
+struct ContractionSchedule {
+    enum class Order {
+        kMnk, // dot product per output element, reduction innermost
+        kMkn, // rows of B are accumulated into a row of Y, so the innermost loop is unit-stride on both
+    };
+
+    Order order = Order::kMnk;
+    // iterations of the m, n and k loops per tile; 0 leaves the loop untiled. tile_k needs kMkn,
+    // which keeps the partial sums in Y between tiles of the reduction
+    int64_t tile_m = 0;
+    int64_t tile_n = 0;
+    int64_t tile_k = 0;
+
+    bool IsDefault() const { return *this == ContractionSchedule{}; }
+    bool operator==(const ContractionSchedule& other) const = default;
+};
+
+// "order=mkn tile_m=32 tile_n=64 tile_k=0"; ParseSchedule throws on anything else
+std::string FormatSchedule(const ContractionSchedule& schedule);
+ContractionSchedule ParseSchedule(std::string_view text);
+
+// true for the operations a ContractionSchedule applies to
+bool IsTunable(const Operation& op);
+// what the best schedule of op depends on: type, element type, operand shapes and the layout
+// attributes, e.g. "Gemm f32 64x128 256x128 256 transA=0 transB=1". Throws unless IsTunable(op)
+std::string TuningSignature(const Operation& op);
+// schedules worth measuring for op, the default first; tiles that cover a whole static
+// dimension are left out since they emit the untiled loop with extra overhead
+std::vector<ContractionSchedule> CandidateSchedules(const Operation& op);
+
+// Best known schedule per TuningSignature, as found by runtime::Autotune and kept in a text file
+// that later compiles pass to the emitters (MlirEmitterOptions::tuning). One line per entry:
+// <signature> TAB <schedule> TAB <measured microseconds>, sorted by signature.
+class TuningDatabase {
+  public:
+    struct Entry {
+        ContractionSchedule schedule;
+        double micros = -1; // time of one call of the op alone, -1 if unknown
+    };
+
+    // a missing file is an empty database, a malformed one throws
+    static TuningDatabase Load(const std::string& path);
+    static TuningDatabase Parse(std::string_view text);
+
+    // writes through a temporary file, so a concurrent reader sees the old or the new database
+    void Save(const std::string& path) const;
+    std::string Serialize() const;
+
+    void Set(const std::string& signature, const Entry& entry);
+    // nullptr without an entry
+    const Entry* Find(const std::string& signature) const;
+    // the schedule the emitters use for op: its entry's, the default one without an entry
+    ContractionSchedule ScheduleFor(const Operation& op) const;
+
+    size_t Size() const { return entries_.size(); }
+
+  private:
+    std::map<std::string, Entry, std::less<>> entries_;
+};
+
+} // namespace tc
+
+#endif // TUNING_HPP_
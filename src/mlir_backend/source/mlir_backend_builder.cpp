@@ -0,0 +1,1929 @@
+#include "mlir_backend/mlir_builder.hpp"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <mlir/Dialect/Arith/IR/Arith.h>
+#include <mlir/Dialect/Func/IR/FuncOps.h>
+#include <mlir/Dialect/MemRef/IR/MemRef.h>
+#include <mlir/Dialect/SCF/IR/SCF.h>
+#include <mlir/IR/Builders.h>
+#include <mlir/IR/BuiltinAttributes.h>
+#include <mlir/IR/BuiltinTypes.h>
+#include <mlir/IR/Location.h>
+#include <mlir/IR/Verifier.h>
+
+#include "mlir_backend_internal.hpp"
+
+namespace tc::detail {
+
+namespace {
+
+using Indices = std::vector<mlir::Value>;
+
+class ModuleBuilder {
+  public:
+    ModuleBuilder(mlir::MLIRContext& context, const Graph& graph, MlirEmitterOptions options)
+        : context_{context}, builder_{&context}, loc_{builder_.getUnknownLoc()},
+          graph_{graph}, options_{std::move(options)} {}
+
+    mlir::OwningOpRef<mlir::ModuleOp> Build();
+
+  private:
+    mlir::MLIRContext& context_;
+    mlir::OpBuilder builder_;
+    mlir::Location loc_;
+    const Graph& graph_;
+    MlirEmitterOptions options_;
+    size_t unique_id_ = 0;
+    std::unordered_map<std::string, mlir::Value> value_refs_;
+    std::unordered_map<std::string, std::string> global_refs_;
+    std::vector<const Value*> inputs_;
+    std::vector<const Value*> outputs_;
+    std::vector<const Value*> initializers_;
+    std::vector<const Value*> temporaries_;
+    std::vector<const Operation*> operations_;
+    WorkspaceLayout workspace_;
+    mlir::Value workspace_ref_;
+    std::vector<DynamicDim> dims_;
+    bool dynamic_ = false;
+    mlir::Value dims_ref_;
+    // index values of the dynamic dimensions of the function being built, per value and axis
+    std::unordered_map<std::string, std::vector<mlir::Value>> dim_refs_;
+    std::unordered_map<std::string, mlir::Value> dynamic_offsets_;
+
+    // [lo, hi) replacing the bounds of the next top-level loop nest's split loop
+    struct SplitLoop {
+        mlir::Value lo;
+        mlir::Value hi;
+        size_t dim = 0;
+    };
+    std::optional<SplitLoop> pending_split_;
+    LoopBound split_bound_ = 1;
+
+    mlir::Type ElemType(TensorElemType elem_type);
+    mlir::MemRefType MemRefType(const Value& value);
+    mlir::MemRefType ArgType(const Value& value);
+    mlir::MemRefType DimsType();
+    const std::vector<int64_t>& ShapeOf(const Value& value) const;
+    mlir::Value RefOf(const Value& value) const;
+
+    void Collect();
+    void BuildGlobal(const std::string& name, const std::string& symbol, mlir::MemRefType memref_type,
+                     const TensorData& data);
+    void BuildGlobals(mlir::ModuleOp module);
+    void BuildDerivedGlobals(mlir::ModuleOp module);
+    void BuildEntryFunctions(mlir::ModuleOp module);
+    std::vector<mlir::Type> ArgumentTypes();
+    void BindArguments(mlir::Block* block);
+    void BindArgumentsAndStorage(mlir::Block* block);
+    void BindInputDims();
+    void BindDims();
+    void CastDynamicArguments();
+    mlir::Value DynamicWorkspace();
+    void BuildFunction(mlir::ModuleOp module);
+    // value builds the body and returns the i64 result; takes_dims adds the dims array argument
+    void BuildI64Function(mlir::ModuleOp module, const std::string& symbol, bool takes_dims,
+                          const std::function<mlir::Value()>& value);
+    void BuildTaskFunctions(mlir::ModuleOp module);
+    void BuildProfileHookDecls(mlir::ModuleOp module);
+    // calls hook with the op's index in graph order (MlirEmitterOptions::instrument)
+    void ProfileHook(std::string_view hook, size_t op_index);
+
+    mlir::Value& DimSlot(const Value& value, size_t axis);
+    mlir::Value DimRef(const Value& value, size_t axis);
+    mlir::Value BoundRef(const LoopBound& bound);
+    std::vector<mlir::Value> DynamicSizes(const Value& value);
+    mlir::Value IndexToI64(mlir::Value index);
+
+    void BuildSpecialized(mlir::ModuleOp module);
+    mlir::Value VariantIndex();
+    // scf.index_switch on index: case k builds variant k through body, the default the generic
+    // code (body(count)); body returns the value to yield unless result_type is null
+    mlir::Value VariantSwitch(mlir::Value index, mlir::Type result_type, const std::function<mlir::Value(size_t)>& body);
+    void VariantCall(ModuleBuilder& variant, const std::string& symbol, mlir::Block* block, size_t trailing_i64);
+    mlir::Value VariantI64Call(const ModuleBuilder& variant, const std::string& symbol);
+
+    mlir::Value IndexConst(int64_t value);
+    mlir::Value NumericConst(TensorElemType elem_type, double value);
+    mlir::Value Load(const Value& value, const Indices& indices);
+    void Store(mlir::Value scalar, const Value& value, const Indices& indices);
+    Indices BroadcastIndices(const Value& src, const Value& dst, const Indices& dst_indices);
+    void LoopNest(const std::vector<LoopBound>& bounds,
+                  size_t dim,
+                  Indices& indices,
+                  const std::function<void(const Indices&)>& body);
+    void LoopNestImpl(const std::vector<LoopBound>& bounds,
+                      size_t dim,
+                      Indices& indices,
+                      const std::function<void(const Indices&)>& body,
+                      const SplitLoop* split);
+    // loop over [lb, ub) in steps of tile, calling body with the [lo, hi) of every tile;
+    // for tile 0 no loop is built and body gets [lb, ub) itself
+    void TileLoop(mlir::Value lb, mlir::Value ub, int64_t tile, const std::function<void(mlir::Value, mlir::Value)>& body);
+    void RangeLoop(mlir::Value lb, mlir::Value ub, const std::function<void(mlir::Value)>& body);
+    mlir::Value AddLike(mlir::Value lhs, mlir::Value rhs, TensorElemType elem_type);
+    mlir::Value MulLike(mlir::Value lhs, mlir::Value rhs, TensorElemType elem_type);
+    mlir::Value ScalarAccumulator(TensorElemType elem_type);
+    void Accumulate(mlir::Value acc, mlir::Value prod, TensorElemType elem_type);
+
+    // alpha * acc + beta * C[ij]
+    mlir::Value ContractionEpilogue(const Contraction& contraction, mlir::Value acc, const Indices& ij);
+    void BuildScheduledContraction(const Contraction& contraction, const ContractionSchedule& schedule);
+
+    void BuildElementwiseBinary(const Operation& op, bool is_add);
+    void BuildRelu(const Operation& op);
+    void BuildMatMul(const Operation& op);
+    void BuildTranspose(const Operation& op);
+    void BuildReorder(const Operation& op);
+    void BuildGemm(const Operation& op);
+    void BuildConv(const Operation& op);
+    // see ModuleEmitter::EmitConvInteriorColumns and EmitConvKernelRows
+    std::pair<mlir::Value, mlir::Value> ConvInteriorColumns(const ConvParams& conv);
+    struct ConvRows {
+        mlir::Value ih_base;
+        mlir::Value r_lo;
+        mlir::Value r_hi;
+    };
+    ConvRows ConvKernelRows(const ConvParams& conv, mlir::Value oh);
+    mlir::Value IndexDiv(mlir::Value lhs, int64_t rhs, bool ceil);
+    void BuildDirectConv(const ConvParams& conv);
+    void BuildNchwcConv(const ConvParams& conv);
+    void BuildIm2colConv(const Operation& op, const ConvParams& conv);
+    void BuildWinogradConv(const Operation& op, const ConvParams& conv);
+    void BuildDepthwiseConv(const ConvParams& conv);
+    void BuildPointwiseConv(const ConvParams& conv);
+    // see ModuleEmitter::EmitLinearCombination
+    mlir::Value LinearCombination(const std::vector<double>& coefs, const std::vector<mlir::Value>& terms,
+                                  TensorElemType elem_type);
+    void BuildOperation(const Operation& op);
+};
+
+mlir::OwningOpRef<mlir::ModuleOp> ModuleBuilder::Build() {
+    context_.loadDialect<mlir::func::FuncDialect,
+                         mlir::arith::ArithDialect,
+                         mlir::memref::MemRefDialect,
+                         mlir::scf::SCFDialect>();
+
+    Collect();
+    ValidateSpecializations(dims_, options_);
+
+    mlir::OwningOpRef<mlir::ModuleOp> module = mlir::ModuleOp::create(loc_);
+    BuildGlobals(*module);
+    BuildDerivedGlobals(*module);
+    if (options_.instrument) {
+        BuildProfileHookDecls(*module);
+    }
+    if (options_.specializations.empty()) {
+        BuildEntryFunctions(*module);
+    } else {
+        BuildSpecialized(*module);
+    }
+
+    if (mlir::failed(mlir::verify(*module))) {
+        Fail("built module failed verification");
+    }
+    return module;
+}
+
+void ModuleBuilder::Collect() {
+    inputs_ = CollectValuesByBelong(graph_, Value::BelongTo::kInput);
+    outputs_ = CollectValuesByBelong(graph_, Value::BelongTo::kOutput);
+    initializers_ = CollectValuesByBelong(graph_, Value::BelongTo::kInitializer);
+    temporaries_ = CollectInternalValues(graph_);
+    operations_ = CollectOperations(graph_);
+
+    ValidateGraphValues(inputs_, outputs_, initializers_, temporaries_);
+    if (options_.use_workspace) {
+        workspace_ = PlanWorkspace(temporaries_, operations_, ScratchBytesOf(options_, operations_));
+    }
+    dims_ = CollectDynamicDims(inputs_);
+    for (const std::vector<const Value*>* values : {&inputs_, &outputs_, &temporaries_}) {
+        for (const Value* value : *values) {
+            dynamic_ = dynamic_ || HasDynamicShape(RequireTensorType(*value));
+        }
+    }
+}
+
+void ModuleBuilder::BuildEntryFunctions(mlir::ModuleOp module) {
+    BuildFunction(module);
+    if (options_.use_workspace) {
+        BuildI64Function(module, WorkspaceSizeSymbol(options_), true, [&] {
+            if (workspace_.dynamic.empty()) {
+                return mlir::Value{builder_.create<mlir::arith::ConstantOp>(loc_, builder_.getI64IntegerAttr(workspace_.size))};
+            }
+            BindDims();
+            return IndexToI64(DynamicWorkspace());
+        });
+    }
+    if (options_.use_workspace && options_.emit_tasks) {
+        BuildTaskFunctions(module);
+    }
+}
+
+mlir::Type ModuleBuilder::ElemType(TensorElemType elem_type) {
+    switch (elem_type) {
+        case TensorElemType::kFloat32: return builder_.getF32Type();
+        case TensorElemType::kFloat64: return builder_.getF64Type();
+        case TensorElemType::kInt32: return builder_.getI32Type();
+        case TensorElemType::kInt64: return builder_.getI64Type();
+        case TensorElemType::kBool: return builder_.getI1Type();
+        case TensorElemType::kUnknown: break;
+    }
+    Fail("unknown tensor element type");
+}
+
+mlir::MemRefType ModuleBuilder::MemRefType(const Value& value) {
+    const TensorType& type = RequireTensorType(value);
+    std::vector<int64_t> shape = type.Shape();
+    for (int64_t& dim : shape) {
+        dim = dim < 0 ? mlir::ShapedType::kDynamic : dim;
+    }
+    return mlir::MemRefType::get(shape, ElemType(type.ElemType()));
+}
+
+// dynamically shaped tensors cross the bare-pointer ABI as base pointers of a static type
+mlir::MemRefType ModuleBuilder::ArgType(const Value& value) {
+    const TensorType& type = RequireTensorType(value);
+    if (options_.use_workspace && HasDynamicShape(type)) {
+        return mlir::MemRefType::get({1}, ElemType(type.ElemType()));
+    }
+    return MemRefType(value);
+}
+
+mlir::MemRefType ModuleBuilder::DimsType() {
+    return mlir::MemRefType::get({static_cast<int64_t>(dims_.size())}, builder_.getI64Type());
+}
+
+const std::vector<int64_t>& ModuleBuilder::ShapeOf(const Value& value) const {
+    return RequireTensorType(value).Shape();
+}
+
+mlir::Value ModuleBuilder::RefOf(const Value& value) const {
+    auto it = value_refs_.find(value.Name());
+    if (it == value_refs_.end()) {
+        Fail("missing storage binding for value '" + value.Name() + "'");
+    }
+    return it->second;
+}
+
+void ModuleBuilder::BuildGlobal(const std::string& name, const std::string& symbol, mlir::MemRefType memref_type,
+                                const TensorData& data) {
+    const auto tensor_type = mlir::RankedTensorType::get(memref_type.getShape(), memref_type.getElementType());
+
+    const size_t count = static_cast<size_t>(memref_type.getNumElements());
+    mlir::DenseElementsAttr init;
+    if (data.type.ElemType() == TensorElemType::kBool) {
+        // ONNX stores one byte per bool while MLIR packs i1 payloads, go through bool values
+        if (data.raw.size() != count) {
+            Fail("initializer raw byte size mismatch");
+        }
+        std::vector<bool> bits(count);
+        for (size_t i = 0; i < count; ++i) {
+            bits[i] = data.raw[i] != 0;
+        }
+        init = mlir::DenseElementsAttr::get(tensor_type, llvm::ArrayRef<bool>{bits});
+    } else {
+        const size_t elem_bytes = memref_type.getElementTypeBitWidth() / 8;
+        if (data.raw.size() != count * elem_bytes) {
+            Fail("initializer raw byte size mismatch");
+        }
+        init = mlir::DenseElementsAttr::getFromRawBuffer(
+            tensor_type, llvm::ArrayRef<char>{data.raw.data(), data.raw.size()});
+    }
+
+    builder_.create<mlir::memref::GlobalOp>(
+        mlir::NameLoc::get(builder_.getStringAttr(name)),
+        symbol,
+        builder_.getStringAttr("private"),
+        memref_type,
+        init,
+        /*constant=*/true,
+        /*alignment=*/mlir::IntegerAttr{});
+}
+
+void ModuleBuilder::BuildGlobals(mlir::ModuleOp module) {
+    builder_.setInsertionPointToEnd(module.getBody());
+    for (const Value* value : initializers_) {
+        const std::string symbol = SanitizeIdentifier(value->Name(), "g") + "_" + std::to_string(unique_id_++);
+        global_refs_.emplace(value->Name(), symbol);
+        BuildGlobal(value->Name(), symbol, MemRefType(*value), *value->InitializerData());
+    }
+}
+
+// see ModuleEmitter::EmitDerivedGlobals
+void ModuleBuilder::BuildDerivedGlobals(mlir::ModuleOp module) {
+    builder_.setInsertionPointToEnd(module.getBody());
+    for (const Operation* op : operations_) {
+        if (op->Type() != Operation::OpType::kConv) {
+            continue;
+        }
+        const ConvParams conv = ParseConv(*op);
+        const std::string key = WinogradWeightsKey(conv);
+        if (ChooseConvAlgorithm(options_, conv) != ConvAlgorithm::kWinograd || global_refs_.contains(key)) {
+            continue;
+        }
+        const std::string symbol = global_refs_.at(conv.w->Name()) + "_winograd" + std::to_string(WinogradTile(conv));
+        global_refs_.emplace(key, symbol);
+        const TensorData weights = WinogradWeights(conv);
+        BuildGlobal(key, symbol, mlir::MemRefType::get(weights.type.Shape(), ElemType(weights.type.ElemType())), weights);
+    }
+}
+
+// inputs, outputs, the workspace, then the dynamic dimension sizes
+std::vector<mlir::Type> ModuleBuilder::ArgumentTypes() {
+    std::vector<mlir::Type> arg_types;
+    for (const Value* value : inputs_) {
+        arg_types.push_back(ArgType(*value));
+    }
+    for (const Value* value : outputs_) {
+        arg_types.push_back(ArgType(*value));
+    }
+    if (options_.use_workspace) {
+        arg_types.push_back(mlir::MemRefType::get({workspace_.size}, builder_.getI8Type()));
+        if (!dims_.empty()) {
+            arg_types.push_back(DimsType());
+        }
+    }
+    return arg_types;
+}
+
+// binds the leading ArgumentTypes() arguments of block
+void ModuleBuilder::BindArguments(mlir::Block* block) {
+    size_t arg_idx = 0;
+    for (const Value* value : inputs_) {
+        value_refs_[value->Name()] = block->getArgument(static_cast<unsigned>(arg_idx++));
+    }
+    for (const Value* value : outputs_) {
+        value_refs_[value->Name()] = block->getArgument(static_cast<unsigned>(arg_idx++));
+    }
+    if (options_.use_workspace) {
+        workspace_ref_ = block->getArgument(static_cast<unsigned>(arg_idx++));
+        if (!dims_.empty()) {
+            dims_ref_ = block->getArgument(static_cast<unsigned>(arg_idx++));
+        }
+    }
+}
+
+// binds the arguments of block, the dynamic sizes, the globals and the temporaries
+void ModuleBuilder::BindArgumentsAndStorage(mlir::Block* block) {
+    BindArguments(block);
+    if (dynamic_) {
+        BindDims();
+        if (options_.use_workspace) {
+            CastDynamicArguments();
+        }
+    }
+
+    for (const Value* value : initializers_) {
+        value_refs_[value->Name()] = builder_.create<mlir::memref::GetGlobalOp>(
+            loc_, MemRefType(*value), global_refs_.at(value->Name()));
+    }
+
+    for (const Value* value : temporaries_) {
+        const std::vector<mlir::Value> sizes = DynamicSizes(*value);
+        if (options_.use_workspace) {
+            auto it = workspace_.offsets.find(value->Name());
+            const mlir::Value offset = it != workspace_.offsets.end() ? IndexConst(it->second)
+                                                                      : dynamic_offsets_.at(value->Name());
+            value_refs_[value->Name()] = builder_.create<mlir::memref::ViewOp>(
+                loc_, MemRefType(*value), workspace_ref_, offset, mlir::ValueRange{sizes});
+            continue;
+        }
+        value_refs_[value->Name()] = builder_.create<mlir::memref::AllocOp>(loc_, MemRefType(*value), mlir::ValueRange{sizes});
+    }
+}
+
+// sizes of the dynamic input dimensions
+void ModuleBuilder::BindInputDims() {
+    dim_refs_.clear();
+    for (size_t i = 0; i < dims_.size(); ++i) {
+        const DynamicDim& dim = dims_[i];
+        if (options_.use_workspace) {
+            const mlir::Value raw = builder_.create<mlir::memref::LoadOp>(
+                loc_, dims_ref_, mlir::ValueRange{IndexConst(static_cast<int64_t>(i))});
+            DimSlot(*dim.input, dim.axis) = builder_.create<mlir::arith::IndexCastOp>(loc_, builder_.getIndexType(), raw);
+        } else {
+            DimSlot(*dim.input, dim.axis) = builder_.create<mlir::memref::DimOp>(
+                loc_, RefOf(*dim.input), static_cast<int64_t>(dim.axis));
+        }
+    }
+}
+
+// sizes of the dynamic input dimensions, then of every dynamic operation output in graph order
+void ModuleBuilder::BindDims() {
+    BindInputDims();
+    for (const Operation* op : operations_) {
+        for (const Value* output : op->Outputs()) {
+            for (size_t axis = 0; axis < ShapeOf(*output).size(); ++axis) {
+                if (ShapeOf(*output)[axis] >= 0) {
+                    continue;
+                }
+                const DimSource source = InferDimSource(*op, *output, axis);
+                mlir::Value size = DimRef(*source.operand, source.axis);
+                if (source.stride != 0) {
+                    size = builder_.create<mlir::arith::AddIOp>(loc_, size, IndexConst(source.offset));
+                    size = builder_.create<mlir::arith::DivSIOp>(loc_, size, IndexConst(source.stride));
+                    size = builder_.create<mlir::arith::AddIOp>(loc_, size, IndexConst(1));
+                }
+                DimSlot(*output, axis) = size;
+            }
+        }
+    }
+}
+
+// views the base pointers of dynamically shaped arguments (and the workspace) with their run-time sizes
+void ModuleBuilder::CastDynamicArguments() {
+    for (const std::vector<const Value*>* values : {&inputs_, &outputs_}) {
+        for (const Value* value : *values) {
+            const std::vector<int64_t>& shape = ShapeOf(*value);
+            if (!HasDynamicShape(RequireTensorType(*value))) {
+                continue;
+            }
+
+            // row-major strides stay constants up to the innermost dynamic dimension
+            std::vector<mlir::OpFoldResult> strides(shape.size());
+            int64_t static_stride = 1;
+            mlir::Value stride_ref;
+            for (size_t axis = shape.size(); axis-- > 0;) {
+                strides[axis] = stride_ref ? mlir::OpFoldResult{stride_ref} : mlir::OpFoldResult{builder_.getIndexAttr(static_stride)};
+                if (axis == 0) {
+                    break;
+                }
+                if (shape[axis] >= 0 && !stride_ref) {
+                    static_stride *= shape[axis];
+                    continue;
+                }
+                const mlir::Value lhs = stride_ref ? stride_ref : IndexConst(static_stride);
+                stride_ref = builder_.create<mlir::arith::MulIOp>(loc_, lhs, DimRef(*value, axis));
+            }
+
+            std::vector<mlir::OpFoldResult> sizes;
+            for (size_t axis = 0; axis < shape.size(); ++axis) {
+                sizes.push_back(shape[axis] < 0 ? mlir::OpFoldResult{DimRef(*value, axis)}
+                                                : mlir::OpFoldResult{builder_.getIndexAttr(shape[axis])});
+            }
+            value_refs_[value->Name()] = builder_.create<mlir::memref::ReinterpretCastOp>(
+                loc_, MemRefType(*value), RefOf(*value), builder_.getIndexAttr(0), sizes, strides);
+        }
+    }
+
+    if (!workspace_.dynamic.empty()) {
+        const mlir::Value total = DynamicWorkspace();
+        workspace_ref_ = builder_.create<mlir::memref::ReinterpretCastOp>(
+            loc_, mlir::MemRefType::get({mlir::ShapedType::kDynamic}, builder_.getI8Type()), workspace_ref_,
+            builder_.getIndexAttr(0), llvm::ArrayRef<mlir::OpFoldResult>{total},
+            llvm::ArrayRef<mlir::OpFoldResult>{builder_.getIndexAttr(1)});
+    }
+}
+
+// offsets of the dynamically shaped temporaries behind the static part; returns the total size
+mlir::Value ModuleBuilder::DynamicWorkspace() {
+    constexpr int64_t kAlign = WorkspaceLayout::kAlignment;
+    mlir::Value end = IndexConst(workspace_.size);
+    for (const Value* value : workspace_.dynamic) {
+        dynamic_offsets_[value->Name()] = end;
+        const TensorType& type = RequireTensorType(*value);
+        mlir::Value bytes = IndexConst(static_cast<int64_t>(TensorType::ElemSizeInBytes(type.ElemType())));
+        for (size_t axis = 0; axis < type.Shape().size(); ++axis) {
+            bytes = builder_.create<mlir::arith::MulIOp>(loc_, bytes, DimRef(*value, axis));
+        }
+        mlir::Value aligned = builder_.create<mlir::arith::AddIOp>(loc_, bytes, IndexConst(kAlign - 1));
+        aligned = builder_.create<mlir::arith::DivUIOp>(loc_, aligned, IndexConst(kAlign));
+        aligned = builder_.create<mlir::arith::MulIOp>(loc_, aligned, IndexConst(kAlign));
+        end = builder_.create<mlir::arith::AddIOp>(loc_, end, aligned);
+    }
+    return end;
+}
+
+mlir::Value& ModuleBuilder::DimSlot(const Value& value, size_t axis) {
+    std::vector<mlir::Value>& refs = dim_refs_[value.Name()];
+    refs.resize(ShapeOf(value).size());
+    return refs[axis];
+}
+
+mlir::Value ModuleBuilder::DimRef(const Value& value, size_t axis) {
+    const int64_t size = ShapeOf(value).at(axis);
+    if (size >= 0) {
+        return IndexConst(size);
+    }
+    const mlir::Value ref = DimSlot(value, axis);
+    if (!ref) {
+        Fail("size of dimension " + std::to_string(axis) + " of '" + value.Name() + "' is unknown");
+    }
+    return ref;
+}
+
+mlir::Value ModuleBuilder::BoundRef(const LoopBound& bound) {
+    return bound.IsDynamic() ? DimRef(*bound.value, bound.axis) : IndexConst(bound.size);
+}
+
+// operands of memref.alloc / memref.view for the dynamic dimensions of value
+std::vector<mlir::Value> ModuleBuilder::DynamicSizes(const Value& value) {
+    std::vector<mlir::Value> sizes;
+    for (size_t axis = 0; axis < ShapeOf(value).size(); ++axis) {
+        if (ShapeOf(value)[axis] < 0) {
+            sizes.push_back(DimRef(value, axis));
+        }
+    }
+    return sizes;
+}
+
+mlir::Value ModuleBuilder::IndexToI64(mlir::Value index) {
+    return builder_.create<mlir::arith::IndexCastOp>(loc_, builder_.getI64Type(), index);
+}
+
+void ModuleBuilder::BuildFunction(mlir::ModuleOp module) {
+    builder_.setInsertionPointToEnd(module.getBody());
+    auto func = builder_.create<mlir::func::FuncOp>(
+        loc_,
+        EntrySymbol(options_),
+        builder_.getFunctionType(ArgumentTypes(), {}));
+    if (options_.emit_c_interface) {
+        func->setAttr("llvm.emit_c_interface", builder_.getUnitAttr());
+    }
+    mlir::Block* entry = func.addEntryBlock();
+    builder_.setInsertionPointToStart(entry);
+    BindArgumentsAndStorage(entry);
+
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        const Operation& op = *operations_[i];
+        loc_ = mlir::NameLoc::get(builder_.getStringAttr(op.Name()));
+        ProfileHook(kProfileEnterHook, i);
+        BuildOperation(op);
+        ProfileHook(kProfileExitHook, i);
+    }
+    loc_ = builder_.getUnknownLoc();
+
+    if (!options_.use_workspace) {
+        for (auto it = temporaries_.rbegin(); it != temporaries_.rend(); ++it) {
+            builder_.create<mlir::memref::DeallocOp>(loc_, RefOf(**it));
+        }
+    }
+
+    builder_.create<mlir::func::ReturnOp>(loc_);
+}
+
+void ModuleBuilder::BuildI64Function(mlir::ModuleOp module, const std::string& symbol, bool takes_dims,
+                                     const std::function<mlir::Value()>& value) {
+    std::vector<mlir::Type> arg_types;
+    if (takes_dims && !dims_.empty()) {
+        arg_types.push_back(DimsType());
+    }
+    builder_.setInsertionPointToEnd(module.getBody());
+    auto func = builder_.create<mlir::func::FuncOp>(
+        loc_,
+        symbol,
+        builder_.getFunctionType(arg_types, {builder_.getI64Type()}));
+    mlir::Block* block = func.addEntryBlock();
+    builder_.setInsertionPointToStart(block);
+    if (!arg_types.empty()) {
+        dims_ref_ = block->getArgument(0);
+    }
+    const mlir::Value result = value();
+    builder_.create<mlir::func::ReturnOp>(loc_, result);
+}
+
+void ModuleBuilder::BuildTaskFunctions(mlir::ModuleOp module) {
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        const Operation& op = *operations_[i];
+        value_refs_.clear();
+
+        std::vector<mlir::Type> arg_types = ArgumentTypes();
+        const size_t lo_idx = arg_types.size();
+        arg_types.push_back(builder_.getI64Type());
+        arg_types.push_back(builder_.getI64Type());
+
+        builder_.setInsertionPointToEnd(module.getBody());
+        auto func = builder_.create<mlir::func::FuncOp>(
+            loc_,
+            TaskSymbol(options_, i),
+            builder_.getFunctionType(arg_types, {}));
+        mlir::Block* block = func.addEntryBlock();
+        builder_.setInsertionPointToStart(block);
+        BindArgumentsAndStorage(block);
+
+        loc_ = mlir::NameLoc::get(builder_.getStringAttr(op.Name()));
+        const mlir::Value lo = builder_.create<mlir::arith::IndexCastOp>(
+            loc_, builder_.getIndexType(), block->getArgument(static_cast<unsigned>(lo_idx)));
+        const mlir::Value hi = builder_.create<mlir::arith::IndexCastOp>(
+            loc_, builder_.getIndexType(), block->getArgument(static_cast<unsigned>(lo_idx + 1)));
+        split_bound_ = 1;
+        pending_split_ = SplitLoop{lo, hi};
+        ProfileHook(kProfileEnterHook, i);
+        BuildOperation(op);
+        ProfileHook(kProfileExitHook, i);
+        pending_split_.reset();
+        loc_ = builder_.getUnknownLoc();
+        builder_.create<mlir::func::ReturnOp>(loc_);
+
+        const LoopBound extent = split_bound_;
+        BuildI64Function(module, TaskExtentSymbol(options_, i), true, [&] {
+            if (!extent.IsDynamic()) {
+                return mlir::Value{builder_.create<mlir::arith::ConstantOp>(loc_, builder_.getI64IntegerAttr(extent.size))};
+            }
+            BindDims();
+            return IndexToI64(DimRef(*extent.value, extent.axis));
+        });
+    }
+    BuildI64Function(module, TaskCountSymbol(options_), false, [&] {
+        return mlir::Value{builder_.create<mlir::arith::ConstantOp>(
+            loc_, builder_.getI64IntegerAttr(static_cast<int64_t>(operations_.size())))};
+    });
+}
+
+void ModuleBuilder::BuildProfileHookDecls(mlir::ModuleOp module) {
+    builder_.setInsertionPointToEnd(module.getBody());
+    for (std::string_view hook : {kProfileEnterHook, kProfileExitHook}) {
+        auto decl = builder_.create<mlir::func::FuncOp>(
+            loc_,
+            hook,
+            builder_.getFunctionType({builder_.getI64Type()}, {}));
+        decl.setPrivate();
+    }
+}
+
+void ModuleBuilder::ProfileHook(std::string_view hook, size_t op_index) {
+    if (!options_.instrument) {
+        return;
+    }
+    const mlir::Value index = builder_.create<mlir::arith::ConstantOp>(
+        loc_, builder_.getI64IntegerAttr(static_cast<int64_t>(op_index)));
+    builder_.create<mlir::func::CallOp>(loc_, hook, mlir::TypeRange{}, mlir::ValueRange{index});
+}
+
+// one fully static variant per specialization, then the dynamic code, behind dispatchers that
+// keep the symbols and signatures of the unspecialized module
+void ModuleBuilder::BuildSpecialized(mlir::ModuleOp module) {
+    const size_t count = options_.specializations.size();
+    std::vector<Graph> graphs;
+    graphs.reserve(count);
+    std::vector<std::unique_ptr<ModuleBuilder>> variants;
+    for (size_t k = 0; k <= count; ++k) {
+        const Graph* graph = &graph_;
+        if (k < count) {
+            graphs.push_back(Specialize(graph_, options_.specializations[k]));
+            graph = &graphs.back();
+        }
+        variants.push_back(std::make_unique<ModuleBuilder>(context_, *graph, VariantOptions(options_, k)));
+        ModuleBuilder& variant = *variants.back();
+        variant.Collect();
+        variant.global_refs_ = global_refs_;
+        // a static variant may lower a Conv the dynamic code does not
+        variant.BuildDerivedGlobals(module);
+        global_refs_ = variant.global_refs_;
+        variant.BuildEntryFunctions(module);
+    }
+
+    builder_.setInsertionPointToEnd(module.getBody());
+    auto func = builder_.create<mlir::func::FuncOp>(loc_, EntrySymbol(options_),
+                                                    builder_.getFunctionType(ArgumentTypes(), {}));
+    if (options_.emit_c_interface) {
+        func->setAttr("llvm.emit_c_interface", builder_.getUnitAttr());
+    }
+    mlir::Block* entry = func.addEntryBlock();
+    builder_.setInsertionPointToStart(entry);
+    BindArguments(entry);
+    VariantSwitch(VariantIndex(), {}, [&](size_t k) {
+        VariantCall(*variants[k], EntrySymbol(variants[k]->options_), entry, 0);
+        return mlir::Value{};
+    });
+    builder_.create<mlir::func::ReturnOp>(loc_);
+
+    if (options_.use_workspace) {
+        BuildI64Function(module, WorkspaceSizeSymbol(options_), true, [&] {
+            return VariantSwitch(VariantIndex(), builder_.getI64Type(), [&](size_t k) {
+                return VariantI64Call(*variants[k], WorkspaceSizeSymbol(variants[k]->options_));
+            });
+        });
+    }
+    if (!options_.use_workspace || !options_.emit_tasks) {
+        return;
+    }
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        std::vector<mlir::Type> arg_types = ArgumentTypes();
+        arg_types.push_back(builder_.getI64Type());
+        arg_types.push_back(builder_.getI64Type());
+
+        builder_.setInsertionPointToEnd(module.getBody());
+        auto task = builder_.create<mlir::func::FuncOp>(loc_, TaskSymbol(options_, i),
+                                                        builder_.getFunctionType(arg_types, {}));
+        mlir::Block* block = task.addEntryBlock();
+        builder_.setInsertionPointToStart(block);
+        BindArguments(block);
+        VariantSwitch(VariantIndex(), {}, [&](size_t k) {
+            VariantCall(*variants[k], TaskSymbol(variants[k]->options_, i), block, 2);
+            return mlir::Value{};
+        });
+        builder_.create<mlir::func::ReturnOp>(loc_);
+
+        BuildI64Function(module, TaskExtentSymbol(options_, i), true, [&] {
+            return VariantSwitch(VariantIndex(), builder_.getI64Type(), [&](size_t k) {
+                return VariantI64Call(*variants[k], TaskExtentSymbol(variants[k]->options_, i));
+            });
+        });
+    }
+    BuildI64Function(module, TaskCountSymbol(options_), false, [&] {
+        return mlir::Value{builder_.create<mlir::arith::ConstantOp>(
+            loc_, builder_.getI64IntegerAttr(static_cast<int64_t>(operations_.size())))};
+    });
+}
+
+// index of the first specialization matching the dims of the call, or their count
+mlir::Value ModuleBuilder::VariantIndex() {
+    BindInputDims();
+    const size_t count = options_.specializations.size();
+    mlir::Value index = IndexConst(static_cast<int64_t>(count));
+    for (size_t k = count; k-- > 0;) {
+        mlir::Value match;
+        for (size_t i = 0; i < dims_.size(); ++i) {
+            const mlir::Value equal = builder_.create<mlir::arith::CmpIOp>(
+                loc_, mlir::arith::CmpIPredicate::eq, DimSlot(*dims_[i].input, dims_[i].axis),
+                IndexConst(options_.specializations[k][i]));
+            match = match ? mlir::Value{builder_.create<mlir::arith::AndIOp>(loc_, match, equal)} : equal;
+        }
+        index = builder_.create<mlir::arith::SelectOp>(loc_, match, IndexConst(static_cast<int64_t>(k)), index);
+    }
+    return index;
+}
+
+mlir::Value ModuleBuilder::VariantSwitch(mlir::Value index, mlir::Type result_type,
+                                         const std::function<mlir::Value(size_t)>& body) {
+    const size_t count = options_.specializations.size();
+    std::vector<int64_t> cases(count);
+    for (size_t k = 0; k < count; ++k) {
+        cases[k] = static_cast<int64_t>(k);
+    }
+    std::vector<mlir::Type> result_types;
+    if (result_type) {
+        result_types.push_back(result_type);
+    }
+    auto op = builder_.create<mlir::scf::IndexSwitchOp>(loc_, result_types, index,
+                                                        builder_.getDenseI64ArrayAttr(cases),
+                                                        static_cast<unsigned>(count));
+    const mlir::OpBuilder::InsertionGuard guard{builder_};
+    for (size_t k = 0; k <= count; ++k) {
+        mlir::Region& region = k < count ? op.getCaseRegions()[static_cast<unsigned>(k)] : op.getDefaultRegion();
+        builder_.createBlock(&region);
+        const mlir::Value value = body(k);
+        builder_.create<mlir::scf::YieldOp>(loc_, value ? mlir::ValueRange{value} : mlir::ValueRange{});
+    }
+    return result_type ? op.getResult(0) : mlir::Value{};
+}
+
+// calls symbol of variant with the arguments of block (a dispatcher), viewed with the variant's types
+void ModuleBuilder::VariantCall(ModuleBuilder& variant, const std::string& symbol, mlir::Block* block,
+                                size_t trailing_i64) {
+    const std::vector<mlir::Type> types = variant.ArgumentTypes();
+    std::vector<mlir::Value> args;
+    auto pass = [&](mlir::Value arg, const std::vector<int64_t>& shape) {
+        const auto to = mlir::cast<mlir::MemRefType>(types[args.size()]);
+        if (arg.getType() == to) {
+            args.push_back(arg);
+        } else if (!options_.use_workspace) {
+            args.push_back(builder_.create<mlir::memref::CastOp>(loc_, to, arg));
+        } else {
+            std::vector<int64_t> strides(shape.size());
+            int64_t stride = 1;
+            for (size_t axis = shape.size(); axis-- > 0;) {
+                strides[axis] = stride;
+                stride *= shape[axis];
+            }
+            args.push_back(builder_.create<mlir::memref::ReinterpretCastOp>(loc_, to, arg, 0, shape, strides));
+        }
+    };
+
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        pass(block->getArgument(static_cast<unsigned>(args.size())), variant.ShapeOf(*variant.inputs_[i]));
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        pass(block->getArgument(static_cast<unsigned>(args.size())), variant.ShapeOf(*variant.outputs_[i]));
+    }
+    if (options_.use_workspace) {
+        pass(workspace_ref_, {variant.workspace_.size});
+        if (!variant.dims_.empty()) {
+            args.push_back(dims_ref_);
+        }
+    }
+    const unsigned first_trailing = block->getNumArguments() - static_cast<unsigned>(trailing_i64);
+    for (unsigned i = 0; i < trailing_i64; ++i) {
+        args.push_back(block->getArgument(first_trailing + i));
+    }
+    builder_.create<mlir::func::CallOp>(loc_, symbol, mlir::TypeRange{}, args);
+}
+
+mlir::Value ModuleBuilder::VariantI64Call(const ModuleBuilder& variant, const std::string& symbol) {
+    std::vector<mlir::Value> args;
+    if (!variant.dims_.empty()) {
+        args.push_back(dims_ref_);
+    }
+    return builder_.create<mlir::func::CallOp>(loc_, symbol, mlir::TypeRange{builder_.getI64Type()}, args).getResult(0);
+}
+
+mlir::Value ModuleBuilder::IndexConst(int64_t value) {
+    return builder_.create<mlir::arith::ConstantIndexOp>(loc_, value);
+}
+
+mlir::Value ModuleBuilder::NumericConst(TensorElemType elem_type, double value) {
+    const mlir::Type type = ElemType(elem_type);
+    if (elem_type == TensorElemType::kBool) {
+        return builder_.create<mlir::arith::ConstantOp>(loc_, builder_.getIntegerAttr(type, value == 0.0 ? 0 : 1));
+    }
+    if (IsFloatType(elem_type)) {
+        return builder_.create<mlir::arith::ConstantOp>(loc_, builder_.getFloatAttr(type, value));
+    }
+    return builder_.create<mlir::arith::ConstantOp>(loc_, builder_.getIntegerAttr(type, static_cast<int64_t>(value)));
+}
+
+mlir::Value ModuleBuilder::Load(const Value& value, const Indices& indices) {
+    return builder_.create<mlir::memref::LoadOp>(loc_, RefOf(value), indices);
+}
+
+void ModuleBuilder::Store(mlir::Value scalar, const Value& value, const Indices& indices) {
+    builder_.create<mlir::memref::StoreOp>(loc_, scalar, RefOf(value), indices);
+}
+
+Indices ModuleBuilder::BroadcastIndices(const Value& src, const Value& dst, const Indices& dst_indices) {
+    const std::vector<int64_t>& src_shape = ShapeOf(src);
+    const std::vector<int64_t>& dst_shape = ShapeOf(dst);
+    if (src_shape.size() > dst_shape.size()) {
+        Fail("cannot broadcast '" + src.Name() + "' into '" + dst.Name() + "'");
+    }
+
+    Indices indices;
+    const size_t rank_gap = dst_shape.size() - src_shape.size();
+    for (size_t i = 0; i < src_shape.size(); ++i) {
+        const int64_t src_dim = src_shape[i];
+        const int64_t dst_dim = dst_shape[rank_gap + i];
+        if (src_dim == dst_dim) {
+            indices.push_back(dst_indices[rank_gap + i]);
+        } else if (src_dim == 1) {
+            indices.push_back(IndexConst(0));
+        } else if (src_dim < 0 || dst_dim < 0) {
+            // dynamic dimensions are assumed not to broadcast
+            indices.push_back(dst_indices[rank_gap + i]);
+        } else {
+            Fail("incompatible broadcast from '" + src.Name() + "' to '" + dst.Name() + "'");
+        }
+    }
+    return indices;
+}
+
+void ModuleBuilder::LoopNest(const std::vector<LoopBound>& bounds,
+                             size_t dim,
+                             Indices& indices,
+                             const std::function<void(const Indices&)>& body) {
+    if (dim != 0 || !pending_split_.has_value()) {
+        LoopNestImpl(bounds, dim, indices, body, nullptr);
+        return;
+    }
+    SplitLoop split = *std::exchange(pending_split_, std::nullopt);
+    split.dim = ParallelSplitDim(bounds);
+    split_bound_ = bounds.empty() ? LoopBound{1} : bounds[split.dim];
+    LoopNestImpl(bounds, dim, indices, body, &split);
+}
+
+void ModuleBuilder::LoopNestImpl(const std::vector<LoopBound>& bounds,
+                                 size_t dim,
+                                 Indices& indices,
+                                 const std::function<void(const Indices&)>& body,
+                                 const SplitLoop* split) {
+    if (dim == bounds.size()) {
+        body(indices);
+        return;
+    }
+
+    const bool split_here = split != nullptr && split->dim == dim;
+    const mlir::Value lb = split_here ? split->lo : IndexConst(0);
+    const mlir::Value ub = split_here ? split->hi : BoundRef(bounds[dim]);
+    auto loop = builder_.create<mlir::scf::ForOp>(loc_, lb, ub, IndexConst(1));
+    mlir::OpBuilder::InsertionGuard guard{builder_};
+    builder_.setInsertionPointToStart(loop.getBody());
+    indices.push_back(loop.getInductionVar());
+    LoopNestImpl(bounds, dim + 1, indices, body, split);
+    indices.pop_back();
+}
+
+void ModuleBuilder::TileLoop(mlir::Value lb,
+                             mlir::Value ub,
+                             int64_t tile,
+                             const std::function<void(mlir::Value, mlir::Value)>& body) {
+    if (tile == 0) {
+        body(lb, ub);
+        return;
+    }
+
+    const mlir::Value step = IndexConst(tile);
+    auto loop = builder_.create<mlir::scf::ForOp>(loc_, lb, ub, step);
+    mlir::OpBuilder::InsertionGuard guard{builder_};
+    builder_.setInsertionPointToStart(loop.getBody());
+    mlir::Value tile_end = builder_.create<mlir::arith::AddIOp>(loc_, loop.getInductionVar(), step);
+    body(loop.getInductionVar(), builder_.create<mlir::arith::MinSIOp>(loc_, tile_end, ub));
+}
+
+void ModuleBuilder::RangeLoop(mlir::Value lb, mlir::Value ub, const std::function<void(mlir::Value)>& body) {
+    auto loop = builder_.create<mlir::scf::ForOp>(loc_, lb, ub, IndexConst(1));
+    mlir::OpBuilder::InsertionGuard guard{builder_};
+    builder_.setInsertionPointToStart(loop.getBody());
+    body(loop.getInductionVar());
+}
+
+mlir::Value ModuleBuilder::AddLike(mlir::Value lhs, mlir::Value rhs, TensorElemType elem_type) {
+    if (IsFloatType(elem_type)) {
+        return builder_.create<mlir::arith::AddFOp>(loc_, lhs, rhs);
+    }
+    if (elem_type == TensorElemType::kInt32 || elem_type == TensorElemType::kInt64) {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    }
+    Fail("unsupported add type");
+}
+
+mlir::Value ModuleBuilder::MulLike(mlir::Value lhs, mlir::Value rhs, TensorElemType elem_type) {
+    if (IsFloatType(elem_type)) {
+        return builder_.create<mlir::arith::MulFOp>(loc_, lhs, rhs);
+    }
+    if (elem_type == TensorElemType::kInt32 || elem_type == TensorElemType::kInt64) {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    }
+    Fail("unsupported mul type");
+}
+
+mlir::Value ModuleBuilder::ScalarAccumulator(TensorElemType elem_type) {
+    auto acc = builder_.create<mlir::memref::AllocaOp>(loc_, mlir::MemRefType::get({}, ElemType(elem_type)));
+    builder_.create<mlir::memref::StoreOp>(loc_, NumericConst(elem_type, 0.0), acc, mlir::ValueRange{});
+    return acc;
+}
+
+void ModuleBuilder::Accumulate(mlir::Value acc, mlir::Value prod, TensorElemType elem_type) {
+    mlir::Value cur = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{});
+    builder_.create<mlir::memref::StoreOp>(loc_, AddLike(cur, prod, elem_type), acc, mlir::ValueRange{});
+}
+
+void ModuleBuilder::BuildElementwiseBinary(const Operation& op, bool is_add) {
+    if (op.Inputs().size() != 2 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 2 inputs and 1 output");
+    }
+
+    const Value& lhs_value = *op.Inputs()[0];
+    const Value& rhs_value = *op.Inputs()[1];
+    const Value& out_value = *op.Outputs()[0];
+    const TensorElemType elem_type = RequireTensorType(out_value).ElemType();
+
+    Indices indices;
+    LoopNest(BoundsOf(out_value), 0, indices, [&](const Indices& ivs) {
+        mlir::Value lhs = Load(lhs_value, BroadcastIndices(lhs_value, out_value, ivs));
+        mlir::Value rhs = Load(rhs_value, BroadcastIndices(rhs_value, out_value, ivs));
+        Store(is_add ? AddLike(lhs, rhs, elem_type) : MulLike(lhs, rhs, elem_type), out_value, ivs);
+    });
+}
+
+void ModuleBuilder::BuildRelu(const Operation& op) {
+    if (op.Inputs().size() != 1 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 1 input and 1 output");
+    }
+
+    const Value& input = *op.Inputs()[0];
+    const Value& output = *op.Outputs()[0];
+    const TensorElemType elem_type = RequireTensorType(output).ElemType();
+    if (!IsFloatType(elem_type) && !IsIntegerLikeType(elem_type)) {
+        Fail(op.Name() + ": unsupported Relu element type");
+    }
+    if (elem_type == TensorElemType::kBool) {
+        Fail(op.Name() + ": bool Relu is not supported");
+    }
+
+    Indices indices;
+    LoopNest(BoundsOf(output), 0, indices, [&](const Indices& ivs) {
+        mlir::Value arg = Load(input, BroadcastIndices(input, output, ivs));
+        mlir::Value zero = NumericConst(elem_type, 0.0);
+        mlir::Value result = IsFloatType(elem_type)
+            ? mlir::Value{builder_.create<mlir::arith::MaximumFOp>(loc_, arg, zero)}
+            : mlir::Value{builder_.create<mlir::arith::MaxSIOp>(loc_, arg, zero)};
+        Store(result, output, ivs);
+    });
+}
+
+void ModuleBuilder::BuildMatMul(const Operation& op) {
+    if (op.Inputs().size() != 2 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 2 inputs and 1 output");
+    }
+
+    const Value& a = *op.Inputs()[0];
+    const Value& b = *op.Inputs()[1];
+    const Value& y = *op.Outputs()[0];
+    const TensorType& a_type = RequireTensorType(a);
+    const TensorType& b_type = RequireTensorType(b);
+    const TensorType& y_type = RequireTensorType(y);
+    if (a_type.Shape().size() != 2 || b_type.Shape().size() != 2 || y_type.Shape().size() != 2) {
+        Fail(op.Name() + ": MatMul currently supports rank-2 tensors only");
+    }
+    if (DimsConflict(a_type.Shape()[1], b_type.Shape()[0])) {
+        Fail(op.Name() + ": incompatible MatMul inner dimensions");
+    }
+    if (!IsFloatType(y_type.ElemType()) && y_type.ElemType() != TensorElemType::kInt32 && y_type.ElemType() != TensorElemType::kInt64) {
+        Fail(op.Name() + ": unsupported MatMul element type");
+    }
+
+    const ContractionSchedule schedule = ScheduleOf(options_, op);
+    if (!schedule.IsDefault()) {
+        BuildScheduledContraction(Contraction{&a, &b, nullptr, &y, false, false, 1.0f, 1.0f, LoopBound{y, 0},
+                                              LoopBound{y, 1}, LoopBound{a, 1}},
+                                  schedule);
+        return;
+    }
+
+    const TensorElemType elem_type = y_type.ElemType();
+    Indices outer_indices;
+    LoopNest({LoopBound{y, 0}, LoopBound{y, 1}}, 0, outer_indices, [&](const Indices& ij) {
+        mlir::Value acc = ScalarAccumulator(elem_type);
+        Indices inner_indices;
+        LoopNest({LoopBound{a, 1}}, 0, inner_indices, [&](const Indices& kk) {
+            Accumulate(acc, MulLike(Load(a, {ij[0], kk[0]}), Load(b, {kk[0], ij[1]}), elem_type), elem_type);
+        });
+        Store(builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{}), y, ij);
+    });
+}
+
+void ModuleBuilder::BuildTranspose(const Operation& op) {
+    if (op.Inputs().size() != 1 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 1 input and 1 output");
+    }
+
+    const Value& input = *op.Inputs()[0];
+    const Value& output = *op.Outputs()[0];
+    const size_t rank = ShapeOf(output).size();
+    if (ShapeOf(input).size() != rank) {
+        Fail(op.Name() + ": input/output rank mismatch for Transpose");
+    }
+
+    std::vector<int64_t> perm = GetIntsAttr(op.Attrs(), "perm", {});
+    if (perm.empty()) {
+        perm.resize(rank);
+        for (size_t i = 0; i < rank; ++i) {
+            perm[i] = static_cast<int64_t>(rank - 1 - i);
+        }
+    }
+    if (perm.size() != rank) {
+        Fail(op.Name() + ": invalid permutation rank");
+    }
+
+    std::vector<size_t> inverse_perm(rank);
+    for (size_t out_axis = 0; out_axis < rank; ++out_axis) {
+        const int64_t src_axis = perm[out_axis];
+        if (src_axis < 0 || src_axis >= static_cast<int64_t>(rank)) {
+            Fail(op.Name() + ": invalid permutation axis");
+        }
+        inverse_perm[static_cast<size_t>(src_axis)] = out_axis;
+    }
+
+    Indices indices;
+    LoopNest(BoundsOf(output), 0, indices, [&](const Indices& out_indices) {
+        Indices in_indices(rank);
+        for (size_t src_axis = 0; src_axis < rank; ++src_axis) {
+            in_indices[src_axis] = out_indices[inverse_perm[src_axis]];
+        }
+        Store(Load(input, in_indices), output, out_indices);
+    });
+}
+
+// see ModuleEmitter::EmitReorder
+void ModuleBuilder::BuildReorder(const Operation& op) {
+    if (op.Inputs().size() != 1 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 1 input and 1 output");
+    }
+
+    const bool to_blocked = op.Type() == Operation::OpType::kReorderInput;
+    const Value& plain = to_blocked ? *op.Inputs()[0] : *op.Outputs()[0];
+    const Value& blocked = to_blocked ? *op.Outputs()[0] : *op.Inputs()[0];
+    const std::vector<int64_t>& blocked_shape = ShapeOf(blocked);
+    if (ShapeOf(plain).size() != 4 || blocked_shape.size() != 5 || blocked_shape[4] <= 0 ||
+        DimsConflict(ShapeOf(plain)[1], blocked_shape[1] * blocked_shape[4])) {
+        Fail(op.Name() + ": expected [N, C, H, W] and [N, C / b, H, W, b]");
+    }
+
+    Indices indices;
+    LoopNest(BoundsOf(blocked), 0, indices, [&](const Indices& ivs) {
+        const mlir::Value c_base = builder_.create<mlir::arith::MulIOp>(loc_, ivs[1], IndexConst(blocked_shape[4]));
+        const Indices plain_indices{ivs[0], builder_.create<mlir::arith::AddIOp>(loc_, c_base, ivs[4]), ivs[2], ivs[3]};
+        if (to_blocked) {
+            Store(Load(plain, plain_indices), blocked, ivs);
+        } else {
+            Store(Load(blocked, ivs), plain, plain_indices);
+        }
+    });
+}
+
+void ModuleBuilder::BuildGemm(const Operation& op) {
+    if ((op.Inputs().size() != 2 && op.Inputs().size() != 3) || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 2 or 3 inputs and 1 output");
+    }
+
+    const Value& a = *op.Inputs()[0];
+    const Value& b = *op.Inputs()[1];
+    const Value* c = op.Inputs().size() == 3 ? op.Inputs()[2] : nullptr;
+    const Value& y = *op.Outputs()[0];
+
+    const TensorType& a_type = RequireTensorType(a);
+    const TensorType& b_type = RequireTensorType(b);
+    const TensorType& y_type = RequireTensorType(y);
+    if (a_type.Shape().size() != 2 || b_type.Shape().size() != 2 || y_type.Shape().size() != 2) {
+        Fail(op.Name() + ": Gemm currently supports rank-2 tensors only");
+    }
+    if (!IsFloatType(y_type.ElemType())) {
+        Fail(op.Name() + ": Gemm currently supports floating-point tensors only");
+    }
+
+    const int64_t trans_a = GetIntAttr(op.Attrs(), "transA", 0);
+    const int64_t trans_b = GetIntAttr(op.Attrs(), "transB", 0);
+    const float alpha = GetFloatAttr(op.Attrs(), "alpha", 1.0f);
+    const float beta = GetFloatAttr(op.Attrs(), "beta", 1.0f);
+
+    const LoopBound a_m{a, trans_a ? 1u : 0u};
+    const LoopBound a_k{a, trans_a ? 0u : 1u};
+    const LoopBound b_k{b, trans_b ? 1u : 0u};
+    const LoopBound b_n{b, trans_b ? 0u : 1u};
+    if (DimsConflict(a_k.size, b_k.size)) {
+        Fail(op.Name() + ": Gemm inner dimensions mismatch");
+    }
+    if (DimsConflict(y_type.Shape()[0], a_m.size) || DimsConflict(y_type.Shape()[1], b_n.size)) {
+        Fail(op.Name() + ": Gemm output shape mismatch");
+    }
+
+    const Contraction contraction{&a, &b, c, &y, trans_a != 0, trans_b != 0, alpha, beta, a_m, b_n, a_k};
+    const ContractionSchedule schedule = ScheduleOf(options_, op);
+    if (!schedule.IsDefault()) {
+        BuildScheduledContraction(contraction, schedule);
+        return;
+    }
+
+    const TensorElemType elem_type = y_type.ElemType();
+    Indices outer_indices;
+    LoopNest({a_m, b_n}, 0, outer_indices, [&](const Indices& ij) {
+        mlir::Value acc = ScalarAccumulator(elem_type);
+        Indices inner_indices;
+        LoopNest({a_k}, 0, inner_indices, [&](const Indices& kk) {
+            const Indices a_idx = trans_a ? Indices{kk[0], ij[0]} : Indices{ij[0], kk[0]};
+            const Indices b_idx = trans_b ? Indices{ij[1], kk[0]} : Indices{kk[0], ij[1]};
+            Accumulate(acc, MulLike(Load(a, a_idx), Load(b, b_idx), elem_type), elem_type);
+        });
+
+        mlir::Value result = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{});
+        Store(ContractionEpilogue(contraction, result, ij), y, ij);
+    });
+}
+
+mlir::Value ModuleBuilder::ContractionEpilogue(const Contraction& contraction, mlir::Value acc, const Indices& ij) {
+    const TensorElemType elem_type = RequireTensorType(*contraction.y).ElemType();
+    if (contraction.alpha != 1.0f) {
+        acc = MulLike(acc, NumericConst(elem_type, contraction.alpha), elem_type);
+    }
+    if (contraction.c != nullptr) {
+        mlir::Value c_value = Load(*contraction.c, BroadcastIndices(*contraction.c, *contraction.y, ij));
+        if (contraction.beta != 1.0f) {
+            c_value = MulLike(c_value, NumericConst(elem_type, contraction.beta), elem_type);
+        }
+        acc = AddLike(acc, c_value, elem_type);
+    }
+    return acc;
+}
+
+void ModuleBuilder::BuildScheduledContraction(const Contraction& contraction, const ContractionSchedule& schedule) {
+    if (schedule.tile_k != 0 && schedule.order != ContractionSchedule::Order::kMkn) {
+        Fail("tiling the reduction of a contraction needs the mkn loop order");
+    }
+    const Contraction& c = contraction;
+    const TensorElemType elem_type = RequireTensorType(*c.y).ElemType();
+    auto a_index = [&](mlir::Value i, mlir::Value kk) { return c.trans_a ? Indices{kk, i} : Indices{i, kk}; };
+    auto b_index = [&](mlir::Value kk, mlir::Value j) { return c.trans_b ? Indices{j, kk} : Indices{kk, j}; };
+
+    // a task runs the [lo, hi) of the same loop the default nest would split, and every tile of it
+    std::optional<SplitLoop> split = std::exchange(pending_split_, std::nullopt);
+    if (split.has_value()) {
+        split->dim = ParallelSplitDim({c.m, c.n});
+        split_bound_ = split->dim == 0 ? c.m : c.n;
+    }
+    const bool split_m = split.has_value() && split->dim == 0;
+    const bool split_n = split.has_value() && split->dim == 1;
+    const mlir::Value m_lo = split_m ? split->lo : IndexConst(0);
+    const mlir::Value m_hi = split_m ? split->hi : BoundRef(c.m);
+    const mlir::Value n_lo = split_n ? split->lo : IndexConst(0);
+    const mlir::Value n_hi = split_n ? split->hi : BoundRef(c.n);
+
+    if (schedule.order == ContractionSchedule::Order::kMnk) {
+        TileLoop(m_lo, m_hi, schedule.tile_m, [&](mlir::Value i_lo, mlir::Value i_hi) {
+            TileLoop(n_lo, n_hi, schedule.tile_n, [&](mlir::Value j_lo, mlir::Value j_hi) {
+                RangeLoop(i_lo, i_hi, [&](mlir::Value i) {
+                    RangeLoop(j_lo, j_hi, [&](mlir::Value j) {
+                        mlir::Value acc = ScalarAccumulator(elem_type);
+                        RangeLoop(IndexConst(0), BoundRef(c.k), [&](mlir::Value kk) {
+                            Accumulate(acc, MulLike(Load(*c.a, a_index(i, kk)), Load(*c.b, b_index(kk, j)), elem_type),
+                                       elem_type);
+                        });
+                        mlir::Value result = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{});
+                        Store(ContractionEpilogue(c, result, {i, j}), *c.y, {i, j});
+                    });
+                });
+            });
+        });
+        return;
+    }
+
+    // mkn: Y holds the partial sums, so it is zeroed first and scaled / biased after the last k tile
+    TileLoop(m_lo, m_hi, schedule.tile_m, [&](mlir::Value i_lo, mlir::Value i_hi) {
+        RangeLoop(i_lo, i_hi, [&](mlir::Value i) {
+            RangeLoop(n_lo, n_hi, [&](mlir::Value j) { Store(NumericConst(elem_type, 0.0), *c.y, {i, j}); });
+        });
+        TileLoop(IndexConst(0), BoundRef(c.k), schedule.tile_k, [&](mlir::Value k_lo, mlir::Value k_hi) {
+            TileLoop(n_lo, n_hi, schedule.tile_n, [&](mlir::Value j_lo, mlir::Value j_hi) {
+                RangeLoop(i_lo, i_hi, [&](mlir::Value i) {
+                    RangeLoop(k_lo, k_hi, [&](mlir::Value kk) {
+                        mlir::Value lhs = Load(*c.a, a_index(i, kk));
+                        RangeLoop(j_lo, j_hi, [&](mlir::Value j) {
+                            mlir::Value prod = MulLike(lhs, Load(*c.b, b_index(kk, j)), elem_type);
+                            Store(AddLike(Load(*c.y, {i, j}), prod, elem_type), *c.y, {i, j});
+                        });
+                    });
+                });
+            });
+        });
+        if (c.alpha != 1.0f || c.c != nullptr) {
+            RangeLoop(i_lo, i_hi, [&](mlir::Value i) {
+                RangeLoop(n_lo, n_hi, [&](mlir::Value j) {
+                    Store(ContractionEpilogue(c, Load(*c.y, {i, j}), {i, j}), *c.y, {i, j});
+                });
+            });
+        }
+    });
+}
+
+void ModuleBuilder::BuildConv(const Operation& op) {
+    const ConvParams conv = ParseConv(op);
+    switch (ChooseConvAlgorithm(options_, conv)) {
+        case ConvAlgorithm::kIm2col:
+            BuildIm2colConv(op, conv);
+            return;
+        case ConvAlgorithm::kWinograd:
+            BuildWinogradConv(op, conv);
+            return;
+        case ConvAlgorithm::kDepthwise:
+            BuildDepthwiseConv(conv);
+            return;
+        case ConvAlgorithm::kPointwise:
+            BuildPointwiseConv(conv);
+            return;
+        default:
+            BuildDirectConv(conv);
+            return;
+    }
+}
+
+mlir::Value ModuleBuilder::IndexDiv(mlir::Value lhs, int64_t rhs, bool ceil) {
+    if (rhs == 1) {
+        return lhs;
+    }
+    if (ceil) {
+        return builder_.create<mlir::arith::CeilDivSIOp>(loc_, lhs, IndexConst(rhs));
+    }
+    return builder_.create<mlir::arith::FloorDivSIOp>(loc_, lhs, IndexConst(rhs));
+}
+
+std::pair<mlir::Value, mlir::Value> ModuleBuilder::ConvInteriorColumns(const ConvParams& conv) {
+    const LoopBound out_w{*conv.y, 3};
+    const mlir::Value ow_lo = builder_.create<mlir::arith::MinSIOp>(
+        loc_, IndexConst((conv.pads[1] + conv.strides[1] - 1) / conv.strides[1]), BoundRef(out_w));
+    const mlir::Value last_iw = builder_.create<mlir::arith::AddIOp>(
+        loc_, BoundRef(LoopBound{*conv.x, 3}), IndexConst(conv.pads[1] - 1 - (conv.kernel_w - 1) * conv.dilations[1]));
+    const mlir::Value ow_end =
+        builder_.create<mlir::arith::AddIOp>(loc_, IndexDiv(last_iw, conv.strides[1], false), IndexConst(1));
+    const mlir::Value ow_hi = builder_.create<mlir::arith::MaxSIOp>(
+        loc_, builder_.create<mlir::arith::MinSIOp>(loc_, ow_end, BoundRef(out_w)), ow_lo);
+    return {ow_lo, ow_hi};
+}
+
+ModuleBuilder::ConvRows ModuleBuilder::ConvKernelRows(const ConvParams& conv, mlir::Value oh) {
+    const mlir::Value ih_base = builder_.create<mlir::arith::SubIOp>(
+        loc_, builder_.create<mlir::arith::MulIOp>(loc_, oh, IndexConst(conv.strides[0])), IndexConst(conv.pads[0]));
+    const mlir::Value above = builder_.create<mlir::arith::SubIOp>(loc_, IndexConst(0), ih_base);
+    const mlir::Value r_lo =
+        builder_.create<mlir::arith::MaxSIOp>(loc_, IndexDiv(above, conv.dilations[0], true), IndexConst(0));
+    const mlir::Value last_ih = builder_.create<mlir::arith::SubIOp>(loc_, BoundRef(LoopBound{*conv.x, 2}), IndexConst(1));
+    const mlir::Value below = builder_.create<mlir::arith::SubIOp>(loc_, last_ih, ih_base);
+    const mlir::Value r_end =
+        builder_.create<mlir::arith::AddIOp>(loc_, IndexDiv(below, conv.dilations[0], false), IndexConst(1));
+    const mlir::Value r_hi = builder_.create<mlir::arith::MinSIOp>(loc_, r_end, IndexConst(conv.kernel_h));
+    return {ih_base, r_lo, r_hi};
+}
+
+// see ModuleEmitter::EmitDirectConv
+void ModuleBuilder::BuildDirectConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const LoopBound width{x, 3};
+    const LoopBound out_w{y, 3};
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+    auto subi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::SubIOp>(loc_, lhs, rhs);
+    };
+
+    const auto columns = ConvInteriorColumns(conv);
+
+    Indices outer_indices;
+    LoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group, LoopBound{y, 2}}, 0, outer_indices,
+             [&](const Indices& ivs) {
+        const mlir::Value oc = addi(muli(ivs[1], IndexConst(conv.out_channels_per_group)), ivs[2]);
+        const mlir::Value c_base = muli(ivs[1], IndexConst(conv.channels_per_group));
+        const ConvRows rows = ConvKernelRows(conv, ivs[3]);
+
+        auto output_columns = [&](mlir::Value lb, mlir::Value ub, bool guarded) {
+            RangeLoop(lb, ub, [&](mlir::Value ow) {
+                mlir::Value acc = ScalarAccumulator(elem_type);
+                const mlir::Value iw_base = subi(muli(ow, IndexConst(conv.strides[1])), IndexConst(conv.pads[1]));
+                RangeLoop(IndexConst(0), IndexConst(conv.channels_per_group), [&](mlir::Value c) {
+                    RangeLoop(rows.r_lo, rows.r_hi, [&](mlir::Value r) {
+                        const mlir::Value ih = addi(rows.ih_base, muli(r, IndexConst(conv.dilations[0])));
+                        RangeLoop(IndexConst(0), IndexConst(conv.kernel_w), [&](mlir::Value s) {
+                            const mlir::Value iw = addi(iw_base, muli(s, IndexConst(conv.dilations[1])));
+                            std::optional<mlir::OpBuilder::InsertionGuard> guard;
+                            if (guarded) {
+                                mlir::Value ge = builder_.create<mlir::arith::CmpIOp>(
+                                    loc_, mlir::arith::CmpIPredicate::sge, iw, IndexConst(0));
+                                mlir::Value lt = builder_.create<mlir::arith::CmpIOp>(
+                                    loc_, mlir::arith::CmpIPredicate::slt, iw, BoundRef(width));
+                                auto if_op = builder_.create<mlir::scf::IfOp>(
+                                    loc_, builder_.create<mlir::arith::AndIOp>(loc_, ge, lt), /*withElseRegion=*/false);
+                                guard.emplace(builder_);
+                                builder_.setInsertionPointToStart(if_op.thenBlock());
+                            }
+                            mlir::Value prod = MulLike(Load(x, {ivs[0], addi(c_base, c), ih, iw}),
+                                                       Load(*conv.w, {oc, c, r, s}), elem_type);
+                            Accumulate(acc, prod, elem_type);
+                        });
+                    });
+                });
+
+                mlir::Value out_value = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{});
+                if (conv.bias != nullptr) {
+                    out_value = AddLike(out_value, Load(*conv.bias, {oc}), elem_type);
+                }
+                Store(out_value, y, {ivs[0], oc, ivs[3], ow});
+            });
+        };
+        output_columns(IndexConst(0), columns.first, true);
+        output_columns(columns.first, columns.second, false);
+        output_columns(columns.second, BoundRef(out_w), true);
+    });
+}
+
+// see ModuleEmitter::EmitNchwcConv
+void ModuleBuilder::BuildNchwcConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const int64_t block = conv.block;
+    const LoopBound width{x, 3};
+    const LoopBound out_w{y, 3};
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+    auto subi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::SubIOp>(loc_, lhs, rhs);
+    };
+    auto lanes = [&](const std::function<void(mlir::Value)>& body) {
+        RangeLoop(IndexConst(0), IndexConst(block), body);
+    };
+
+    const auto columns = ConvInteriorColumns(conv);
+
+    Indices outer_indices;
+    LoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group / block, LoopBound{y, 2}}, 0, outer_indices,
+             [&](const Indices& ivs) {
+        const mlir::Value ob = addi(muli(ivs[1], IndexConst(conv.out_channels_per_group / block)), ivs[2]);
+        const mlir::Value ib_base = muli(ivs[1], IndexConst(conv.channels_per_group / block));
+        const ConvRows rows = ConvKernelRows(conv, ivs[3]);
+
+        auto output_columns = [&](mlir::Value lb, mlir::Value ub, bool guarded) {
+            RangeLoop(lb, ub, [&](mlir::Value ow) {
+                mlir::Value acc =
+                    builder_.create<mlir::memref::AllocaOp>(loc_, mlir::MemRefType::get({block}, ElemType(elem_type)));
+                lanes([&](mlir::Value lane) {
+                    mlir::Value init = NumericConst(elem_type, 0.0);
+                    if (conv.bias != nullptr) {
+                        init = Load(*conv.bias, {addi(muli(ob, IndexConst(block)), lane)});
+                    }
+                    builder_.create<mlir::memref::StoreOp>(loc_, init, acc, mlir::ValueRange{lane});
+                });
+                const mlir::Value iw_base = subi(muli(ow, IndexConst(conv.strides[1])), IndexConst(conv.pads[1]));
+                RangeLoop(IndexConst(0), IndexConst(conv.channels_per_group / block), [&](mlir::Value icb) {
+                    RangeLoop(rows.r_lo, rows.r_hi, [&](mlir::Value r) {
+                        const mlir::Value ih = addi(rows.ih_base, muli(r, IndexConst(conv.dilations[0])));
+                        RangeLoop(IndexConst(0), IndexConst(conv.kernel_w), [&](mlir::Value s) {
+                            const mlir::Value iw = addi(iw_base, muli(s, IndexConst(conv.dilations[1])));
+                            std::optional<mlir::OpBuilder::InsertionGuard> guard;
+                            if (guarded) {
+                                mlir::Value ge = builder_.create<mlir::arith::CmpIOp>(
+                                    loc_, mlir::arith::CmpIPredicate::sge, iw, IndexConst(0));
+                                mlir::Value lt = builder_.create<mlir::arith::CmpIOp>(
+                                    loc_, mlir::arith::CmpIPredicate::slt, iw, BoundRef(width));
+                                auto if_op = builder_.create<mlir::scf::IfOp>(
+                                    loc_, builder_.create<mlir::arith::AndIOp>(loc_, ge, lt), /*withElseRegion=*/false);
+                                guard.emplace(builder_);
+                                builder_.setInsertionPointToStart(if_op.thenBlock());
+                            }
+                            const mlir::Value ib = addi(ib_base, icb);
+                            lanes([&](mlir::Value i) {
+                                const mlir::Value x_val = Load(x, {ivs[0], ib, ih, iw, i});
+                                lanes([&](mlir::Value lane) {
+                                    mlir::Value prod = MulLike(x_val, Load(*conv.w, {ob, icb, r, s, i, lane}), elem_type);
+                                    mlir::Value cur = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{lane});
+                                    builder_.create<mlir::memref::StoreOp>(loc_, AddLike(cur, prod, elem_type), acc,
+                                                                           mlir::ValueRange{lane});
+                                });
+                            });
+                        });
+                    });
+                });
+
+                lanes([&](mlir::Value lane) {
+                    mlir::Value out_value = builder_.create<mlir::memref::LoadOp>(loc_, acc, mlir::ValueRange{lane});
+                    Store(out_value, y, {ivs[0], ob, ivs[3], ow, lane});
+                });
+            });
+        };
+        output_columns(IndexConst(0), columns.first, true);
+        output_columns(columns.first, columns.second, false);
+        output_columns(columns.second, BoundRef(out_w), true);
+    });
+}
+
+// see ModuleEmitter::EmitIm2colConv
+void ModuleBuilder::BuildIm2colConv(const Operation& op, const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const auto scratch_type = mlir::MemRefType::get(Im2colScratchShape(conv), ElemType(elem_type));
+
+    mlir::Value scratch;
+    if (options_.use_workspace) {
+        scratch = builder_.create<mlir::memref::ViewOp>(loc_, scratch_type, workspace_ref_,
+                                                        IndexConst(workspace_.scratch.at(&op)), mlir::ValueRange{});
+    } else {
+        scratch = builder_.create<mlir::memref::AllocOp>(loc_, scratch_type);
+    }
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+    // out * stride - pad + tap * dilation
+    auto input_coord = [&](mlir::Value out, mlir::Value tap, size_t axis) -> mlir::Value {
+        mlir::Value shifted = builder_.create<mlir::arith::SubIOp>(loc_, muli(out, IndexConst(conv.strides[axis])),
+                                                                   IndexConst(conv.pads[axis]));
+        return addi(shifted, muli(tap, IndexConst(conv.dilations[axis])));
+    };
+    auto in_range = [&](mlir::Value coord, const LoopBound& size) -> mlir::Value {
+        mlir::Value ge = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::sge, coord, IndexConst(0));
+        mlir::Value lt = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::slt, coord, BoundRef(size));
+        return builder_.create<mlir::arith::AndIOp>(loc_, ge, lt);
+    };
+
+    const std::vector<LoopBound> rows{LoopBound{y, 0}, conv.group, LoopBound{y, 2}};
+    const size_t slot_dim = ParallelSplitDim(rows);
+    const LoopBound out_w{y, 3};
+    Indices row_indices;
+    LoopNest(rows, 0, row_indices, [&](const Indices& ivs) {
+        const mlir::Value slot = ivs[slot_dim];
+        const mlir::Value c_base = muli(ivs[1], IndexConst(conv.channels_per_group));
+        const mlir::Value oc_base = muli(ivs[1], IndexConst(conv.out_channels_per_group));
+        const mlir::Value zero = NumericConst(elem_type, 0.0);
+
+        Indices tap_indices;
+        LoopNest({conv.channels_per_group, conv.kernel_h, conv.kernel_w}, 0, tap_indices, [&](const Indices& t) {
+            const mlir::Value in_c = addi(c_base, t[0]);
+            const mlir::Value ih = input_coord(ivs[2], t[1], 0);
+            const mlir::Value in_h = in_range(ih, LoopBound{x, 2});
+            RangeLoop(IndexConst(0), BoundRef(out_w), [&](mlir::Value j) {
+                const mlir::Value iw = input_coord(j, t[2], 1);
+                mlir::Value in_bounds = builder_.create<mlir::arith::AndIOp>(loc_, in_h, in_range(iw, LoopBound{x, 3}));
+                auto if_op = builder_.create<mlir::scf::IfOp>(loc_, mlir::TypeRange{ElemType(elem_type)}, in_bounds,
+                                                              /*withElseRegion=*/true);
+                {
+                    mlir::OpBuilder::InsertionGuard guard{builder_};
+                    builder_.setInsertionPointToStart(if_op.thenBlock());
+                    builder_.create<mlir::scf::YieldOp>(loc_, Load(x, {ivs[0], in_c, ih, iw}));
+                    builder_.setInsertionPointToStart(if_op.elseBlock());
+                    builder_.create<mlir::scf::YieldOp>(loc_, zero);
+                }
+                builder_.create<mlir::memref::StoreOp>(loc_, if_op.getResult(0), scratch,
+                                                       mlir::ValueRange{slot, t[0], t[1], t[2], j});
+            });
+        });
+
+        RangeLoop(IndexConst(0), IndexConst(conv.out_channels_per_group), [&](mlir::Value ocg) {
+            const mlir::Value oc = addi(oc_base, ocg);
+            const mlir::Value init = conv.bias != nullptr ? Load(*conv.bias, {oc}) : NumericConst(elem_type, 0.0);
+            RangeLoop(IndexConst(0), BoundRef(out_w), [&](mlir::Value j) {
+                Store(init, y, {ivs[0], oc, ivs[2], j});
+            });
+            Indices k_indices;
+            LoopNest({conv.channels_per_group, conv.kernel_h, conv.kernel_w}, 0, k_indices, [&](const Indices& k) {
+                const mlir::Value w_val = Load(*conv.w, {oc, k[0], k[1], k[2]});
+                RangeLoop(IndexConst(0), BoundRef(out_w), [&](mlir::Value j) {
+                    mlir::Value patch = builder_.create<mlir::memref::LoadOp>(
+                        loc_, scratch, mlir::ValueRange{slot, k[0], k[1], k[2], j});
+                    mlir::Value sum = AddLike(Load(y, {ivs[0], oc, ivs[2], j}), MulLike(w_val, patch, elem_type), elem_type);
+                    Store(sum, y, {ivs[0], oc, ivs[2], j});
+                });
+            });
+        });
+    });
+
+    if (!options_.use_workspace) {
+        builder_.create<mlir::memref::DeallocOp>(loc_, scratch);
+    }
+}
+
+// see ModuleEmitter::EmitWinogradConv
+void ModuleBuilder::BuildWinogradConv(const Operation& op, const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const int64_t m = WinogradTile(conv);
+    const WinogradTransform& transform = WinogradTransformFor(m);
+    const int64_t a = m + 2;
+    const auto scratch_type = mlir::MemRefType::get(WinogradScratchShape(conv), ElemType(elem_type));
+    const auto weights_type = mlir::MemRefType::get(
+        {conv.group * conv.out_channels_per_group, conv.channels_per_group, a, a}, ElemType(elem_type));
+
+    const mlir::Value weights = builder_.create<mlir::memref::GetGlobalOp>(loc_, weights_type,
+                                                                           global_refs_.at(WinogradWeightsKey(conv)));
+    mlir::Value scratch;
+    if (options_.use_workspace) {
+        scratch = builder_.create<mlir::memref::ViewOp>(loc_, scratch_type, workspace_ref_,
+                                                        IndexConst(workspace_.scratch.at(&op)), mlir::ValueRange{});
+    } else {
+        scratch = builder_.create<mlir::memref::AllocOp>(loc_, scratch_type);
+    }
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+    auto in_range = [&](mlir::Value coord, const LoopBound& size) -> mlir::Value {
+        mlir::Value ge = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::sge, coord, IndexConst(0));
+        mlir::Value lt = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::slt, coord, BoundRef(size));
+        return builder_.create<mlir::arith::AndIOp>(loc_, ge, lt);
+    };
+    auto load = [&](mlir::Value memref, mlir::ValueRange indices) -> mlir::Value {
+        return builder_.create<mlir::memref::LoadOp>(loc_, memref, indices);
+    };
+    auto store = [&](mlir::Value scalar, mlir::Value memref, mlir::ValueRange indices) {
+        builder_.create<mlir::memref::StoreOp>(loc_, scalar, memref, indices);
+    };
+
+    const int64_t out_h = LoopBound{y, 2}.size;
+    const int64_t out_w = LoopBound{y, 3}.size;
+    const std::vector<LoopBound> tiles{LoopBound{y, 0}, conv.group, (out_h + m - 1) / m, (out_w + m - 1) / m};
+    const size_t slot_dim = ParallelSplitDim(tiles);
+    Indices tile_indices;
+    LoopNest(tiles, 0, tile_indices, [&](const Indices& ivs) {
+        const mlir::Value slot = ivs[slot_dim];
+        const mlir::Value c_base = muli(ivs[1], IndexConst(conv.channels_per_group));
+        const mlir::Value oc_base = muli(ivs[1], IndexConst(conv.out_channels_per_group));
+        const mlir::Value oh_base = muli(ivs[2], IndexConst(m));
+        const mlir::Value ow_base = muli(ivs[3], IndexConst(m));
+
+        Indices ih(a);
+        Indices iw(a);
+        Indices in_h(a);
+        Indices in_w(a);
+        const mlir::Value ih_base = builder_.create<mlir::arith::SubIOp>(loc_, oh_base, IndexConst(conv.pads[0]));
+        const mlir::Value iw_base = builder_.create<mlir::arith::SubIOp>(loc_, ow_base, IndexConst(conv.pads[1]));
+        for (int64_t i = 0; i < a; ++i) {
+            ih[i] = addi(ih_base, IndexConst(i));
+            in_h[i] = in_range(ih[i], LoopBound{x, 2});
+            iw[i] = addi(iw_base, IndexConst(i));
+            in_w[i] = in_range(iw[i], LoopBound{x, 3});
+        }
+
+        const mlir::Value zero = NumericConst(elem_type, 0.0);
+        RangeLoop(IndexConst(0), IndexConst(conv.channels_per_group), [&](mlir::Value c) {
+            const mlir::Value in_c = addi(c_base, c);
+            std::vector<Indices> d(a, Indices(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    mlir::Value in_bounds = builder_.create<mlir::arith::AndIOp>(loc_, in_h[i], in_w[j]);
+                    auto if_op = builder_.create<mlir::scf::IfOp>(loc_, mlir::TypeRange{ElemType(elem_type)}, in_bounds,
+                                                                  /*withElseRegion=*/true);
+                    {
+                        mlir::OpBuilder::InsertionGuard guard{builder_};
+                        builder_.setInsertionPointToStart(if_op.thenBlock());
+                        builder_.create<mlir::scf::YieldOp>(loc_, Load(x, {ivs[0], in_c, ih[i], iw[j]}));
+                        builder_.setInsertionPointToStart(if_op.elseBlock());
+                        builder_.create<mlir::scf::YieldOp>(loc_, zero);
+                    }
+                    d[i][j] = if_op.getResult(0);
+                }
+            }
+            std::vector<Indices> bd(a, Indices(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    Indices column;
+                    for (int64_t k = 0; k < a; ++k) {
+                        column.push_back(d[k][j]);
+                    }
+                    bd[i][j] = LinearCombination(transform.bt[i], column, elem_type);
+                }
+            }
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    store(LinearCombination(transform.bt[j], bd[i], elem_type), scratch,
+                          {slot, c, IndexConst(i), IndexConst(j)});
+                }
+            }
+        });
+
+        const mlir::Value acc = IndexConst(conv.channels_per_group);
+        RangeLoop(IndexConst(0), IndexConst(conv.out_channels_per_group), [&](mlir::Value ocg) {
+            const mlir::Value oc = addi(oc_base, ocg);
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    store(zero, scratch, {slot, acc, IndexConst(i), IndexConst(j)});
+                }
+            }
+            Indices k_indices;
+            LoopNest({conv.channels_per_group, a, a}, 0, k_indices, [&](const Indices& k) {
+                mlir::Value prod = MulLike(load(weights, {oc, k[0], k[1], k[2]}), load(scratch, {slot, k[0], k[1], k[2]}),
+                                           elem_type);
+                store(AddLike(load(scratch, {slot, acc, k[1], k[2]}), prod, elem_type), scratch, {slot, acc, k[1], k[2]});
+            });
+
+            std::vector<Indices> sums(a, Indices(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    sums[i][j] = load(scratch, {slot, acc, IndexConst(i), IndexConst(j)});
+                }
+            }
+            std::vector<Indices> am(m, Indices(a));
+            for (int64_t i = 0; i < m; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    Indices column;
+                    for (int64_t k = 0; k < a; ++k) {
+                        column.push_back(sums[k][j]);
+                    }
+                    am[i][j] = LinearCombination(transform.at[i], column, elem_type);
+                }
+            }
+            const mlir::Value bias = conv.bias != nullptr ? Load(*conv.bias, {oc}) : mlir::Value{};
+            for (int64_t i = 0; i < m; ++i) {
+                const mlir::Value oh = addi(oh_base, IndexConst(i));
+                for (int64_t j = 0; j < m; ++j) {
+                    const mlir::Value ow = addi(ow_base, IndexConst(j));
+                    mlir::Value out = LinearCombination(transform.at[j], am[i], elem_type);
+                    if (bias) {
+                        out = AddLike(out, bias, elem_type);
+                    }
+                    mlir::Value in_y;
+                    if (out_h % m != 0 && i >= out_h % m) {
+                        in_y = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::slt, oh,
+                                                                    IndexConst(out_h));
+                    }
+                    if (out_w % m != 0 && j >= out_w % m) {
+                        mlir::Value ow_lt = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::slt, ow,
+                                                                                 IndexConst(out_w));
+                        in_y = in_y ? builder_.create<mlir::arith::AndIOp>(loc_, in_y, ow_lt).getResult() : ow_lt;
+                    }
+                    if (!in_y) {
+                        Store(out, y, {ivs[0], oc, oh, ow});
+                        continue;
+                    }
+                    auto if_op = builder_.create<mlir::scf::IfOp>(loc_, in_y, /*withElseRegion=*/false);
+                    mlir::OpBuilder::InsertionGuard guard{builder_};
+                    builder_.setInsertionPointToStart(if_op.thenBlock());
+                    Store(out, y, {ivs[0], oc, oh, ow});
+                }
+            }
+        });
+    });
+
+    if (!options_.use_workspace) {
+        builder_.create<mlir::memref::DeallocOp>(loc_, scratch);
+    }
+}
+
+// see ModuleEmitter::EmitDepthwiseConv
+void ModuleBuilder::BuildDepthwiseConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const LoopBound out_w{y, 3};
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+
+    Indices row_indices;
+    LoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group, LoopBound{y, 2}}, 0, row_indices,
+             [&](const Indices& ivs) {
+        const mlir::Value oc = addi(muli(ivs[1], IndexConst(conv.out_channels_per_group)), ivs[2]);
+        const mlir::Value init = conv.bias != nullptr ? Load(*conv.bias, {oc}) : NumericConst(elem_type, 0.0);
+        RangeLoop(IndexConst(0), BoundRef(out_w), [&](mlir::Value j) { Store(init, y, {ivs[0], oc, ivs[3], j}); });
+
+        const mlir::Value ih_base = builder_.create<mlir::arith::SubIOp>(loc_, muli(ivs[3], IndexConst(conv.strides[0])),
+                                                                         IndexConst(conv.pads[0]));
+        RangeLoop(IndexConst(0), IndexConst(conv.kernel_h), [&](mlir::Value r) {
+            const mlir::Value ih = addi(ih_base, muli(r, IndexConst(conv.dilations[0])));
+            mlir::Value ge = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::sge, ih, IndexConst(0));
+            mlir::Value lt = builder_.create<mlir::arith::CmpIOp>(loc_, mlir::arith::CmpIPredicate::slt, ih,
+                                                                  BoundRef(LoopBound{x, 2}));
+            auto if_op = builder_.create<mlir::scf::IfOp>(loc_, builder_.create<mlir::arith::AndIOp>(loc_, ge, lt),
+                                                          /*withElseRegion=*/false);
+            mlir::OpBuilder::InsertionGuard guard{builder_};
+            builder_.setInsertionPointToStart(if_op.thenBlock());
+            for (int64_t s = 0; s < conv.kernel_w; ++s) {
+                const auto [lo, hi] = ReachableOutputs(LoopBound{x, 3}.size, out_w.size, conv.pads[1], conv.strides[1],
+                                                       s * conv.dilations[1]);
+                if (lo >= hi) {
+                    continue;
+                }
+                const mlir::Value w_val = Load(*conv.w, {oc, IndexConst(0), r, IndexConst(s)});
+                const mlir::Value shift = IndexConst(s * conv.dilations[1] - conv.pads[1]);
+                RangeLoop(IndexConst(lo), IndexConst(hi), [&](mlir::Value j) {
+                    const mlir::Value iw = addi(muli(j, IndexConst(conv.strides[1])), shift);
+                    mlir::Value prod = MulLike(w_val, Load(x, {ivs[0], ivs[1], ih, iw}), elem_type);
+                    Store(AddLike(Load(y, {ivs[0], oc, ivs[3], j}), prod, elem_type), y, {ivs[0], oc, ivs[3], j});
+                });
+            }
+        });
+    });
+}
+
+// see ModuleEmitter::EmitPointwiseConv
+void ModuleBuilder::BuildPointwiseConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const std::vector<LoopBound> plane{LoopBound{y, 2}, LoopBound{y, 3}};
+
+    auto muli = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::MulIOp>(loc_, lhs, rhs);
+    };
+    auto addi = [&](mlir::Value lhs, mlir::Value rhs) -> mlir::Value {
+        return builder_.create<mlir::arith::AddIOp>(loc_, lhs, rhs);
+    };
+
+    Indices channel_indices;
+    LoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group}, 0, channel_indices, [&](const Indices& ivs) {
+        const mlir::Value oc = addi(muli(ivs[1], IndexConst(conv.out_channels_per_group)), ivs[2]);
+        const mlir::Value c_base = muli(ivs[1], IndexConst(conv.channels_per_group));
+        const mlir::Value init = conv.bias != nullptr ? Load(*conv.bias, {oc}) : NumericConst(elem_type, 0.0);
+        Indices init_indices;
+        LoopNest(plane, 0, init_indices, [&](const Indices& hw) { Store(init, y, {ivs[0], oc, hw[0], hw[1]}); });
+
+        RangeLoop(IndexConst(0), IndexConst(conv.channels_per_group), [&](mlir::Value c) {
+            const mlir::Value in_c = addi(c_base, c);
+            const mlir::Value w_val = Load(*conv.w, {oc, c, IndexConst(0), IndexConst(0)});
+            Indices hw_indices;
+            LoopNest(plane, 0, hw_indices, [&](const Indices& hw) {
+                mlir::Value prod = MulLike(w_val, Load(x, {ivs[0], in_c, hw[0], hw[1]}), elem_type);
+                Store(AddLike(Load(y, {ivs[0], oc, hw[0], hw[1]}), prod, elem_type), y, {ivs[0], oc, hw[0], hw[1]});
+            });
+        });
+    });
+}
+
+mlir::Value ModuleBuilder::LinearCombination(const std::vector<double>& coefs, const std::vector<mlir::Value>& terms,
+                                             TensorElemType elem_type) {
+    mlir::Value sum;
+    for (size_t k = 0; k < coefs.size(); ++k) {
+        const double coef = coefs[k];
+        if (coef == 0.0) {
+            continue;
+        }
+        mlir::Value term = terms[k];
+        if (coef != 1.0 && coef != -1.0) {
+            term = MulLike(NumericConst(elem_type, coef), term, elem_type);
+        }
+        if (!sum && coef == -1.0) {
+            sum = builder_.create<mlir::arith::NegFOp>(loc_, term);
+        } else if (!sum) {
+            sum = term;
+        } else if (coef == -1.0) {
+            sum = builder_.create<mlir::arith::SubFOp>(loc_, sum, term);
+        } else {
+            sum = AddLike(sum, term, elem_type);
+        }
+    }
+    return sum ? sum : NumericConst(elem_type, 0.0);
+}
+
+void ModuleBuilder::BuildOperation(const Operation& op) {
+    switch (op.Type()) {
+        case Operation::OpType::kAdd:
+            BuildElementwiseBinary(op, true);
+            return;
+        case Operation::OpType::kMul:
+            BuildElementwiseBinary(op, false);
+            return;
+        case Operation::OpType::kRelu:
+            BuildRelu(op);
+            return;
+        case Operation::OpType::kMatMul:
+            BuildMatMul(op);
+            return;
+        case Operation::OpType::kTranspose:
+            BuildTranspose(op);
+            return;
+        case Operation::OpType::kGemm:
+            BuildGemm(op);
+            return;
+        case Operation::OpType::kConv:
+            BuildConv(op);
+            return;
+        case Operation::OpType::kReorderInput:
+        case Operation::OpType::kReorderOutput:
+            BuildReorder(op);
+            return;
+        case Operation::OpType::kNchwcConv:
+            BuildNchwcConv(ParseConv(op));
+            return;
+    }
+    Fail("unsupported operation kind");
+}
+
+} // namespace
+
+} // namespace tc::detail
+
+namespace tc {
+
+mlir::OwningOpRef<mlir::ModuleOp> BuildMlirModule(mlir::MLIRContext& context,
+                                                  const Graph& graph,
+                                                  const MlirEmitterOptions& options) {
+    const hlp::ScopedPhase phase{"build MLIR module"};
+    detail::ModuleBuilder builder{context, graph, options};
+    return builder.Build();
+}
+
+namespace {
+
+// forwards the printer's buffered output to an OutputSink
+class SinkOstream final : public llvm::raw_ostream {
+  public:
+    explicit SinkOstream(hlp::OutputSink& out) : out_{out} { SetBufferSize(size_t{1} << 16); }
+    ~SinkOstream() override { flush(); }
+
+  private:
+    hlp::OutputSink& out_;
+    uint64_t pos_ = 0;
+
+    void write_impl(const char* ptr, size_t size) override {
+        out_.Write(std::string_view{ptr, size});
+        pos_ += size;
+    }
+    uint64_t current_pos() const override { return pos_; }
+};
+
+} // namespace
+
+void PrintMlirModule(mlir::ModuleOp module, hlp::OutputSink& out) {
+    {
+        SinkOstream os{out};
+        module.print(os);
+    }
+    out.Flush();
+}
+
+std::string PrintMlirModule(mlir::ModuleOp module) {
+    hlp::StringSink out;
+    PrintMlirModule(module, out);
+    return out.Take();
+}
+
+} // namespace tc
@@ -0,0 +1,112 @@
+#include "mlir_backend_internal.hpp"
+
+#include <cctype>
+
+namespace tc::detail {
+
+namespace {
+
+std::string ElemTypeToC(TensorElemType elem_type) {
+    switch (elem_type) {
+        case TensorElemType::kFloat32: return "float";
+        case TensorElemType::kFloat64: return "double";
+        case TensorElemType::kInt32: return "int32_t";
+        case TensorElemType::kInt64: return "int64_t";
+        case TensorElemType::kBool: return "uint8_t";
+        case TensorElemType::kUnknown: break;
+    }
+    Fail("unknown tensor element type");
+}
+
+std::string UpperCase(std::string value) {
+    for (char& c : value) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return value;
+}
+
+std::string ParamDoc(const Value& value) {
+    return " *   " + value.Name() + ": " + RequireTensorType(value).ToStr() + "\n";
+}
+
+} // namespace
+
+} // namespace tc::detail
+
+namespace tc {
+
+void MlirBackend::EmitCHeader(const Graph& graph, hlp::OutputSink& out, const MlirEmitterOptions& options) const {
+    using namespace detail;
+    const hlp::ScopedPhase phase{"emit C header"};
+
+    const std::vector<const Value*> inputs = CollectValuesByBelong(graph, Value::BelongTo::kInput);
+    const std::vector<const Value*> outputs = CollectValuesByBelong(graph, Value::BelongTo::kOutput);
+    ValidateGraphValues(inputs, outputs,
+                        CollectValuesByBelong(graph, Value::BelongTo::kInitializer),
+                        CollectInternalValues(graph));
+
+    const std::vector<DynamicDim> dims = CollectDynamicDims(inputs);
+    const std::string entry = EntrySymbol(options);
+    const std::string guard = "TC_" + UpperCase(entry) + "_H_";
+
+    out << "/* generated by tc; do not edit */\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n"
+        << "\n"
+        << "#include <stdint.h>\n"
+        << "\n"
+        << "#ifdef __cplusplus\n"
+        << "extern \"C\" {\n"
+        << "#endif\n"
+        << "\n";
+
+    out << "/* bytes of scratch memory one call of " << entry << " needs; the buffer must be "
+        << std::to_string(WorkspaceLayout::kAlignment) << "-byte aligned\n"
+        << " * and may be reused across calls, but not shared by concurrent calls */\n"
+        << "int64_t " << WorkspaceSizeSymbol(options) << (dims.empty() ? "(void);\n" : "(const int64_t* dims);\n")
+        << "\n";
+
+    out << "/* dense row-major tensors, weights are compiled in\n"
+        << " * inputs:\n";
+    for (const Value* value : inputs) {
+        out << ParamDoc(*value);
+    }
+    out << " * outputs:\n";
+    for (const Value* value : outputs) {
+        out << ParamDoc(*value);
+    }
+    if (!dims.empty()) {
+        out << " * dims: sizes of the ? dimensions, in this order:\n";
+        for (const DynamicDim& dim : dims) {
+            out << " *   " << dim.input->Name() << "[" << std::to_string(dim.axis) << "]\n";
+        }
+    }
+    out << " */\n";
+
+    out << "void " << entry << "(";
+    bool first = true;
+    auto param = [&](const std::string& decl) {
+        out << (first ? "" : ",\n") << (first ? "" : std::string(entry.size() + 6, ' ')) << decl;
+        first = false;
+    };
+    for (const Value* value : inputs) {
+        param("const " + ElemTypeToC(RequireTensorType(*value).ElemType()) + "* " + SanitizeIdentifier(value->Name(), "in"));
+    }
+    for (const Value* value : outputs) {
+        param(ElemTypeToC(RequireTensorType(*value).ElemType()) + "* " + SanitizeIdentifier(value->Name(), "out"));
+    }
+    param("void* workspace");
+    if (!dims.empty()) {
+        param("const int64_t* dims");
+    }
+    out << ");\n"
+        << "\n"
+        << "#ifdef __cplusplus\n"
+        << "}\n"
+        << "#endif\n"
+        << "\n"
+        << "#endif /* " << guard << " */\n";
+    out.Flush();
+}
+
+} // namespace tc
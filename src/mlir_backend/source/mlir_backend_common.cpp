@@ -1,10 +1,13 @@
 #include "mlir_backend_internal.hpp"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <cmath>
 #include <cstring>
-#include <iomanip>
 #include <limits>
 #include <stdexcept>
+#include <system_error>
 
 namespace tc::detail {
 
@@ -37,10 +40,7 @@ namespace {
 std::string ShapePrefixToMlir(const std::vector<int64_t>& shape) {
     std::string out;
     for (int64_t dim : shape) {
-        if (dim < 0) {
-            Fail("dynamic shapes are not supported by the MLIR emitter");
-        }
-        out += std::to_string(dim);
+        out += dim < 0 ? "?" : std::to_string(dim);
         out += "x";
     }
     return out;
@@ -50,28 +50,17 @@ int64_t NumElements(const std::vector<int64_t>& shape) {
     int64_t total = 1;
     for (int64_t dim : shape) {
         if (dim < 0) {
-            Fail("dynamic shapes are not supported by the MLIR emitter");
+            Fail("the size of a dynamically shaped tensor is not known at compile time");
         }
         total *= dim;
     }
     return total;
 }
 
-template <typename T>
-std::vector<T> ReadPodValues(const std::string& raw, size_t count) {
-    const size_t expected_bytes = count * sizeof(T);
-    if (raw.size() != expected_bytes) {
-        Fail("initializer raw byte size mismatch");
-    }
-
-    std::vector<T> out(count);
-    if (expected_bytes != 0) {
-        std::memcpy(out.data(), raw.data(), expected_bytes);
-    }
-    return out;
-}
+using NumberBuffer = std::array<char, 48>;
 
-std::string FormatFloat(double value) {
+// same text as an ostream with max_digits10 precision (%.17g), minus the per-value stream
+std::string_view FormatFloatInto(NumberBuffer& buf, double value) {
     if (std::isnan(value)) {
         return "nan";
     }
@@ -79,43 +68,61 @@ std::string FormatFloat(double value) {
         return value > 0.0 ? "inf" : "-inf";
     }
 
-    std::ostringstream oss;
-    oss << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
-    std::string out = oss.str();
-    if (out == "-0") {
-        out = "0";
+    const auto [end, ec] = std::to_chars(buf.data(), buf.data() + buf.size() - 2, value,
+                                         std::chars_format::general,
+                                         std::numeric_limits<double>::max_digits10);
+    if (ec != std::errc{}) {
+        Fail("unable to format floating point constant");
     }
-    if (out.find_first_of(".eE") == std::string::npos) {
-        out += ".0";
+    size_t len = static_cast<size_t>(end - buf.data());
+    if (std::string_view{buf.data(), len} == "-0") {
+        return "0.0";
     }
-    if (out == "-0.0") {
-        out = "0.0";
+    if (std::string_view{buf.data(), len}.find_first_of(".eE") == std::string_view::npos) {
+        buf[len++] = '.';
+        buf[len++] = '0';
     }
-    return out;
+    return std::string_view{buf.data(), len};
 }
 
+template <typename T>
+std::string_view FormatIntInto(NumberBuffer& buf, T value) {
+    const auto [end, ec] = std::to_chars(buf.data(), buf.data() + buf.size(), value);
+    if (ec != std::errc{}) {
+        Fail("unable to format integer constant");
+    }
+    return std::string_view{buf.data(), static_cast<size_t>(end - buf.data())};
+}
+
+std::string FormatFloat(double value) {
+    NumberBuffer buf;
+    return std::string{FormatFloatInto(buf, value)};
+}
+
+// walks the raw little-endian payload in row-major order, reading each element in place
 template <typename T, typename Formatter>
-std::string DenseRecursive(const std::vector<T>& values,
-                           const std::vector<int64_t>& shape,
-                           size_t dim,
-                           size_t& pos,
-                           Formatter formatter) {
+void WriteDenseRecursive(hlp::OutputSink& out,
+                         const char* raw,
+                         const std::vector<int64_t>& shape,
+                         size_t dim,
+                         size_t& pos,
+                         Formatter formatter) {
     if (dim == shape.size()) {
-        if (pos >= values.size()) {
-            Fail("initializer traversal overflow");
-        }
-        return formatter(values[pos++]);
+        T value;
+        std::memcpy(&value, raw + pos * sizeof(T), sizeof(T));
+        ++pos;
+        formatter(out, value);
+        return;
     }
 
-    std::string out = "[";
+    out << '[';
     for (int64_t i = 0; i < shape[dim]; ++i) {
         if (i != 0) {
-            out += ", ";
+            out << ", ";
         }
-        out += DenseRecursive(values, shape, dim + 1, pos, formatter);
+        WriteDenseRecursive<T>(out, raw, shape, dim + 1, pos, formatter);
     }
-    out += "]";
-    return out;
+    out << ']';
 }
 
 } // namespace
@@ -127,46 +134,36 @@ std::string MemRefTypeToMlir(const TensorType& type) {
     return "memref<" + ShapePrefixToMlir(type.Shape()) + ElemTypeToMlir(type.ElemType()) + ">";
 }
 
-std::string DenseLiteral(const TensorData& data) {
+void WriteDenseLiteral(hlp::OutputSink& out, const TensorData& data) {
     const std::vector<int64_t>& shape = data.type.Shape();
     const size_t count = static_cast<size_t>(NumElements(shape));
 
-    auto make_dense = [&](const auto& values, auto formatter) -> std::string {
-        if (shape.empty()) {
-            if (values.empty()) {
-                Fail("scalar initializer has no payload");
-            }
-            return "dense<" + formatter(values[0]) + ">";
+    auto write_dense = [&](auto tag, auto formatter) {
+        using T = decltype(tag);
+        if (data.raw.size() != count * sizeof(T)) {
+            Fail("initializer raw byte size mismatch");
         }
-        size_t pos = 0;
-        const std::string body = DenseRecursive(values, shape, 0, pos, formatter);
-        if (pos != values.size()) {
-            Fail("initializer traversal underflow/overflow");
+        if (shape.empty() && count == 0) {
+            Fail("scalar initializer has no payload");
         }
-        return "dense<" + body + ">";
+        size_t pos = 0;
+        out << "dense<";
+        WriteDenseRecursive<T>(out, data.raw.data(), shape, 0, pos, formatter);
+        out << '>';
     };
 
+    NumberBuffer buf;
     switch (data.type.ElemType()) {
-        case TensorElemType::kFloat32: {
-            const auto values = ReadPodValues<float>(data.raw, count);
-            return make_dense(values, [](float v) { return FormatFloat(static_cast<double>(v)); });
-        }
-        case TensorElemType::kFloat64: {
-            const auto values = ReadPodValues<double>(data.raw, count);
-            return make_dense(values, [](double v) { return FormatFloat(v); });
-        }
-        case TensorElemType::kInt32: {
-            const auto values = ReadPodValues<int32_t>(data.raw, count);
-            return make_dense(values, [](int32_t v) { return std::to_string(v); });
-        }
-        case TensorElemType::kInt64: {
-            const auto values = ReadPodValues<int64_t>(data.raw, count);
-            return make_dense(values, [](int64_t v) { return std::to_string(v); });
-        }
-        case TensorElemType::kBool: {
-            const auto values = ReadPodValues<uint8_t>(data.raw, count);
-            return make_dense(values, [](uint8_t v) { return v == 0 ? std::string{"false"} : std::string{"true"}; });
-        }
+        case TensorElemType::kFloat32:
+            return write_dense(float{}, [&](hlp::OutputSink& o, float v) { o << FormatFloatInto(buf, static_cast<double>(v)); });
+        case TensorElemType::kFloat64:
+            return write_dense(double{}, [&](hlp::OutputSink& o, double v) { o << FormatFloatInto(buf, v); });
+        case TensorElemType::kInt32:
+            return write_dense(int32_t{}, [&](hlp::OutputSink& o, int32_t v) { o << FormatIntInto(buf, v); });
+        case TensorElemType::kInt64:
+            return write_dense(int64_t{}, [&](hlp::OutputSink& o, int64_t v) { o << FormatIntInto(buf, v); });
+        case TensorElemType::kBool:
+            return write_dense(uint8_t{}, [](hlp::OutputSink& o, uint8_t v) { o << (v == 0 ? "false" : "true"); });
         case TensorElemType::kUnknown:
             break;
     }
@@ -232,6 +229,94 @@ std::vector<const Operation*> CollectOperations(const Graph& graph) {
     return ops;
 }
 
+int64_t ByteSizeOf(const TensorType& type) {
+    return NumElements(type.Shape()) * static_cast<int64_t>(TensorType::ElemSizeInBytes(type.ElemType()));
+}
+
+// Temporaries whose live ranges [producing op, last consuming op] are disjoint share bytes; the
+// scratch of an op lives for that op only.
+// Greedy first fit, largest first: each tensor takes the lowest aligned offset that does not
+// overlap a tensor already placed and live at the same time.
+WorkspaceLayout PlanWorkspace(const std::vector<const Value*>& temporaries,
+                              const std::vector<const Operation*>& operations,
+                              const std::vector<int64_t>& scratch_bytes) {
+    struct Interval {
+        const Value* value; // null for the scratch of op
+        int64_t bytes;
+        size_t first;
+        size_t last;
+        int64_t offset;
+        const Operation* op = nullptr;
+    };
+    auto align = [](int64_t bytes) {
+        return (bytes + WorkspaceLayout::kAlignment - 1) / WorkspaceLayout::kAlignment * WorkspaceLayout::kAlignment;
+    };
+
+    WorkspaceLayout layout;
+    std::unordered_map<const Value*, size_t> index;
+    std::vector<Interval> intervals;
+    intervals.reserve(temporaries.size());
+    for (const Value* value : temporaries) {
+        if (HasDynamicShape(RequireTensorType(*value))) {
+            layout.dynamic.push_back(value);
+            continue;
+        }
+        index[value] = intervals.size();
+        intervals.push_back(Interval{value, align(ByteSizeOf(RequireTensorType(*value))), operations.size(), 0, 0});
+    }
+    for (size_t i = 0; i < scratch_bytes.size(); ++i) {
+        if (scratch_bytes[i] > 0) {
+            intervals.push_back(Interval{nullptr, align(scratch_bytes[i]), i, i, 0, operations[i]});
+        }
+    }
+    for (size_t i = 0; i < operations.size(); ++i) {
+        for (const std::vector<Value*>* values : {&operations[i]->Inputs(), &operations[i]->Outputs()}) {
+            for (const Value* value : *values) {
+                auto it = index.find(value);
+                if (it != index.end()) {
+                    Interval& interval = intervals[it->second];
+                    interval.first = std::min(interval.first, i);
+                    interval.last = std::max(interval.last, i);
+                }
+            }
+        }
+    }
+
+    std::vector<Interval*> order;
+    for (Interval& interval : intervals) {
+        order.push_back(&interval);
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Interval* a, const Interval* b) { return a->bytes > b->bytes; });
+
+    std::vector<const Interval*> placed;
+    for (Interval* interval : order) {
+        std::vector<const Interval*> live;
+        for (const Interval* other : placed) {
+            if (other->first <= interval->last && interval->first <= other->last) {
+                live.push_back(other);
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const Interval* a, const Interval* b) { return a->offset < b->offset; });
+
+        int64_t offset = 0;
+        for (const Interval* other : live) {
+            if (offset + interval->bytes <= other->offset) {
+                break;
+            }
+            offset = std::max(offset, other->offset + other->bytes);
+        }
+        interval->offset = offset;
+        placed.push_back(interval);
+        if (interval->value != nullptr) {
+            layout.offsets[interval->value->Name()] = offset;
+        } else {
+            layout.scratch[interval->op] = offset;
+        }
+        layout.size = std::max(layout.size, offset + interval->bytes);
+    }
+    return layout;
+}
+
 const TensorType& RequireTensorType(const Value& value) {
     if (!value.HasTensorType()) {
         Fail("value '" + value.Name() + "' has no tensor type");
@@ -239,6 +324,42 @@ const TensorType& RequireTensorType(const Value& value) {
     return *value.MaybeTensorType();
 }
 
+void ValidateGraphValues(const std::vector<const Value*>& inputs,
+                         const std::vector<const Value*>& outputs,
+                         const std::vector<const Value*>& initializers,
+                         const std::vector<const Value*>& temporaries) {
+    auto validate_value = [](const Value* value) {
+        const TensorType& type = RequireTensorType(*value);
+        (void)MemRefTypeToMlir(type);
+    };
+
+    for (const Value* value : inputs) {
+        validate_value(value);
+    }
+    for (const Value* value : outputs) {
+        validate_value(value);
+    }
+    for (const Value* value : initializers) {
+        validate_value(value);
+        if (!value->HasInitializerData()) {
+            Fail("initializer value '" + value->Name() + "' has no payload");
+        }
+        if (HasDynamicShape(*value->MaybeTensorType())) {
+            Fail("initializer value '" + value->Name() + "' has a dynamic shape");
+        }
+    }
+    for (const Value* value : temporaries) {
+        validate_value(value);
+    }
+    if (outputs.empty()) {
+        Fail("graph has no outputs");
+    }
+}
+
+ContractionSchedule ScheduleOf(const MlirEmitterOptions& options, const Operation& op) {
+    return options.tuning != nullptr ? options.tuning->ScheduleFor(op) : ContractionSchedule{};
+}
+
 float GetFloatAttr(const AttributeMap& attrs, const std::string& name, float default_value) {
     auto it = attrs.find(name);
     if (it == attrs.end()) {
@@ -349,6 +470,9 @@ std::vector<std::string> ModuleEmitter::BroadcastIndices(const Value& src,
             indices.push_back(dst_indices[rank_gap + i]);
         } else if (src_dim == 1) {
             indices.push_back(EmitIndexConst(0));
+        } else if (src_dim < 0 || dst_dim < 0) {
+            // dynamic dimensions are assumed not to broadcast
+            indices.push_back(dst_indices[rank_gap + i]);
         } else {
             Fail("incompatible broadcast from '" + src.Name() + "' to '" + dst.Name() + "'");
         }
@@ -356,29 +480,76 @@ std::vector<std::string> ModuleEmitter::BroadcastIndices(const Value& src,
     return indices;
 }
 
-void ModuleEmitter::EmitLoopNest(const std::vector<int64_t>& shape,
+void ModuleEmitter::EmitLoopNest(const std::vector<LoopBound>& bounds,
                                  size_t dim,
                                  std::vector<std::string>& indices,
                                  const std::function<void(const std::vector<std::string>&)>& body) {
-    if (dim == shape.size()) {
+    if (dim != 0 || !pending_split_.has_value()) {
+        EmitLoopNestImpl(bounds, dim, indices, body, nullptr);
+        return;
+    }
+    SplitLoop split = *std::exchange(pending_split_, std::nullopt);
+    split.dim = ParallelSplitDim(bounds);
+    split_bound_ = bounds.empty() ? LoopBound{1} : bounds[split.dim];
+    EmitLoopNestImpl(bounds, dim, indices, body, &split);
+}
+
+void ModuleEmitter::EmitLoopNestImpl(const std::vector<LoopBound>& bounds,
+                                     size_t dim,
+                                     std::vector<std::string>& indices,
+                                     const std::function<void(const std::vector<std::string>&)>& body,
+                                     const SplitLoop* split) {
+    if (dim == bounds.size()) {
         body(indices);
         return;
     }
 
-    const std::string lb = EmitIndexConst(0);
-    const std::string ub = EmitIndexConst(shape[dim]);
+    const bool split_here = split != nullptr && split->dim == dim;
+    const std::string lb = split_here ? split->lo : EmitIndexConst(0);
+    const std::string ub = split_here ? split->hi : BoundRef(bounds[dim]);
     const std::string step = EmitIndexConst(1);
     const std::string iv = NewSsa("i");
 
     EmitLine("scf.for " + iv + " = " + lb + " to " + ub + " step " + step + " {");
     ++indent_;
     indices.push_back(iv);
-    EmitLoopNest(shape, dim + 1, indices, body);
+    EmitLoopNestImpl(bounds, dim + 1, indices, body, split);
     indices.pop_back();
     --indent_;
     EmitLine("}");
 }
 
+void ModuleEmitter::EmitTileLoop(const std::string& lb,
+                                 const std::string& ub,
+                                 int64_t tile,
+                                 const std::function<void(const std::string&, const std::string&)>& body) {
+    if (tile == 0) {
+        body(lb, ub);
+        return;
+    }
+
+    const std::string step = EmitIndexConst(tile);
+    const std::string iv = NewSsa("t");
+    EmitLine("scf.for " + iv + " = " + lb + " to " + ub + " step " + step + " {");
+    ++indent_;
+    const std::string tile_end = EmitIndexBinary("addi", iv, step, "tile_end");
+    body(iv, EmitIndexBinary("minsi", tile_end, ub, "tile_hi"));
+    --indent_;
+    EmitLine("}");
+}
+
+void ModuleEmitter::EmitRangeLoop(const std::string& lb,
+                                  const std::string& ub,
+                                  const std::function<void(const std::string&)>& body) {
+    const std::string step = EmitIndexConst(1);
+    const std::string iv = NewSsa("i");
+    EmitLine("scf.for " + iv + " = " + lb + " to " + ub + " step " + step + " {");
+    ++indent_;
+    body(iv);
+    --indent_;
+    EmitLine("}");
+}
+
 std::string ModuleEmitter::EmitAddLike(const std::string& lhs,
                                        const std::string& rhs,
                                        TensorElemType elem_type,
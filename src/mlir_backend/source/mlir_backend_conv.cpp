@@ -1,154 +1,933 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
 #include "mlir_backend_internal.hpp"
 
+namespace tc {
+
+std::string_view ConvAlgorithmName(ConvAlgorithm algorithm) {
+    switch (algorithm) {
+        case ConvAlgorithm::kAuto: return "auto";
+        case ConvAlgorithm::kDirect: return "direct";
+        case ConvAlgorithm::kIm2col: return "im2col";
+        case ConvAlgorithm::kWinograd: return "winograd";
+        case ConvAlgorithm::kDepthwise: return "depthwise";
+        case ConvAlgorithm::kPointwise: return "pointwise";
+    }
+    return "unknown";
+}
+
+ConvAlgorithm ParseConvAlgorithm(std::string_view name) {
+    for (ConvAlgorithm algorithm : {ConvAlgorithm::kAuto, ConvAlgorithm::kDirect, ConvAlgorithm::kIm2col,
+                                    ConvAlgorithm::kWinograd, ConvAlgorithm::kDepthwise, ConvAlgorithm::kPointwise}) {
+        if (name == ConvAlgorithmName(algorithm)) {
+            return algorithm;
+        }
+    }
+    throw std::runtime_error{"unknown Conv algorithm '" + std::string{name} + "'"};
+}
+
+} // namespace tc
+
 namespace tc::detail {
 
-void ModuleEmitter::EmitConv(const Operation& op) {
+namespace {
+
+// im2col and Winograd prepare the input once and read it back for every output channel of the
+// group; below this many the preparation is not paid back
+constexpr int64_t kMinReuseOutChannels = 4;
+// im2col also drops the bounds checks from a reduction of at least this many taps
+constexpr int64_t kIm2colMinReduction = 8;
+// beyond this the scratch costs more cache and memory than the direct loops lose
+constexpr int64_t kIm2colMaxScratchBytes = int64_t{64} << 20;
+
+bool HasStaticShapes(const ConvParams& conv) {
+    return !HasDynamicShape(RequireTensorType(*conv.x)) && !HasDynamicShape(RequireTensorType(*conv.y));
+}
+
+// F(m x m, 3x3) of Lavin and Gray, "Fast Algorithms for Convolutional Neural Networks"
+const std::vector<std::vector<double>> kWinogradG2 = {
+    {1.0, 0.0, 0.0},
+    {0.5, 0.5, 0.5},
+    {0.5, -0.5, 0.5},
+    {0.0, 0.0, 1.0},
+};
+const std::vector<std::vector<double>> kWinogradG4 = {
+    {1.0 / 4, 0.0, 0.0},
+    {-1.0 / 6, -1.0 / 6, -1.0 / 6},
+    {-1.0 / 6, 1.0 / 6, -1.0 / 6},
+    {1.0 / 24, 1.0 / 12, 1.0 / 6},
+    {1.0 / 24, -1.0 / 12, 1.0 / 6},
+    {0.0, 0.0, 1.0},
+};
+const WinogradTransform kWinograd2{
+    2,
+    {{1, 0, -1, 0}, {0, 1, 1, 0}, {0, -1, 1, 0}, {0, 1, 0, -1}},
+    {{1, 1, 1, 0}, {0, 1, -1, -1}},
+};
+const WinogradTransform kWinograd4{
+    4,
+    {{4, 0, -5, 0, 1, 0},
+     {0, -4, -4, 1, 1, 0},
+     {0, 4, -4, -1, 1, 0},
+     {0, -2, -1, 2, 1, 0},
+     {0, 2, -1, -2, 1, 0},
+     {0, 4, 0, -5, 0, 1}},
+    {{1, 1, 1, 1, 1, 0}, {0, 1, -1, 2, -2, 0}, {0, 1, 1, 4, 4, 0}, {0, 1, -1, 8, -8, 1}},
+};
+// F(4x4) needs a third of the multiplies of F(2x2) per output but wastes more of its last tiles
+// and rounds more; it pays off once both output sides span two of its tiles
+constexpr int64_t kWinograd4MinOutSize = 8;
+
+int64_t CeilDiv(int64_t lhs, int64_t rhs) {
+    return (lhs + rhs - 1) / rhs;
+}
+
+std::vector<LoopBound> WinogradTiles(const ConvParams& conv, int64_t tile) {
+    return {LoopBound{*conv.y, 0}, conv.group, CeilDiv(LoopBound{*conv.y, 2}.size, tile),
+            CeilDiv(LoopBound{*conv.y, 3}.size, tile)};
+}
+
+int64_t Im2colScratchBytes(const ConvParams& conv) {
+    return ByteSizeOf(TensorType{RequireTensorType(*conv.y).ElemType(), Im2colScratchShape(conv)});
+}
+
+} // namespace
+
+ConvParams ParseConv(const Operation& op) {
     if ((op.Inputs().size() != 2 && op.Inputs().size() != 3) || op.Outputs().size() != 1) {
         Fail(op.Name() + ": expected 2 or 3 inputs and 1 output");
     }
 
-    const Value& x = *op.Inputs()[0];
-    const Value& w = *op.Inputs()[1];
-    const Value* bias = op.Inputs().size() == 3 ? op.Inputs()[2] : nullptr;
-    const Value& y = *op.Outputs()[0];
-
-    const TensorType& x_type = RequireTensorType(x);
-    const TensorType& w_type = RequireTensorType(w);
-    const TensorType& y_type = RequireTensorType(y);
-    if (x_type.Shape().size() != 4 || w_type.Shape().size() != 4 || y_type.Shape().size() != 4) {
+    ConvParams conv{};
+    conv.x = op.Inputs()[0];
+    conv.w = op.Inputs()[1];
+    conv.bias = op.Inputs().size() == 3 ? op.Inputs()[2] : nullptr;
+    conv.y = op.Outputs()[0];
+    const TensorType& x_type = RequireTensorType(*conv.x);
+    const TensorType& w_type = RequireTensorType(*conv.w);
+    const TensorType& y_type = RequireTensorType(*conv.y);
+    if (op.Type() == Operation::OpType::kNchwcConv) {
+        if (x_type.Shape().size() != 5 || w_type.Shape().size() != 6 || y_type.Shape().size() != 5) {
+            Fail(op.Name() + ": NchwcConv expects a rank-5 input and output and rank-6 weights");
+        }
+        conv.block = w_type.Shape()[5];
+        if (conv.block <= 0 || w_type.Shape()[4] != conv.block || x_type.Shape()[4] != conv.block ||
+            y_type.Shape()[4] != conv.block) {
+            Fail(op.Name() + ": NchwcConv channel blocks do not match");
+        }
+    } else if (x_type.Shape().size() != 4 || w_type.Shape().size() != 4 || y_type.Shape().size() != 4) {
         Fail(op.Name() + ": Conv currently supports rank-4 tensors only");
     }
     if (!IsFloatType(y_type.ElemType())) {
         Fail(op.Name() + ": Conv currently supports floating-point tensors only");
     }
+    if (HasDynamicShape(w_type)) {
+        Fail(op.Name() + ": Conv weights must have a static shape");
+    }
 
-    std::vector<int64_t> pads = GetIntsAttr(op.Attrs(), "pads", {0, 0, 0, 0});
-    if (pads.size() == 2) {
-        pads = {pads[0], pads[1], pads[0], pads[1]};
+    conv.pads = GetIntsAttr(op.Attrs(), "pads", {0, 0, 0, 0});
+    if (conv.pads.size() == 2) {
+        conv.pads = {conv.pads[0], conv.pads[1], conv.pads[0], conv.pads[1]};
     }
-    if (pads.size() != 4) {
+    if (conv.pads.size() != 4) {
         Fail(op.Name() + ": pads attribute must have size 2 or 4");
     }
-    const std::vector<int64_t> strides = GetIntsAttr(op.Attrs(), "strides", {1, 1});
-    const std::vector<int64_t> dilations = GetIntsAttr(op.Attrs(), "dilations", {1, 1});
-    if (strides.size() != 2 || dilations.size() != 2) {
+    conv.strides = GetIntsAttr(op.Attrs(), "strides", {1, 1});
+    conv.dilations = GetIntsAttr(op.Attrs(), "dilations", {1, 1});
+    if (conv.strides.size() != 2 || conv.dilations.size() != 2) {
         Fail(op.Name() + ": strides/dilations must have size 2");
     }
-    const int64_t group = GetIntAttr(op.Attrs(), "group", 1);
-    if (group <= 0) {
+    conv.group = GetIntAttr(op.Attrs(), "group", 1);
+    if (conv.group <= 0) {
         Fail(op.Name() + ": group must be positive");
     }
 
-    const int64_t n = x_type.Shape()[0];
-    const int64_t c = x_type.Shape()[1];
-    const int64_t h = x_type.Shape()[2];
-    const int64_t width = x_type.Shape()[3];
-    const int64_t out_channels = w_type.Shape()[0];
-    const int64_t channels_per_group = w_type.Shape()[1];
-    const int64_t kernel_h = w_type.Shape()[2];
-    const int64_t kernel_w = w_type.Shape()[3];
-    const int64_t out_h = y_type.Shape()[2];
-    const int64_t out_w = y_type.Shape()[3];
+    const int64_t block = std::max<int64_t>(conv.block, 1);
+    const int64_t c = x_type.Shape()[1] < 0 ? -1 : x_type.Shape()[1] * block;
+    const int64_t out_channels = w_type.Shape()[0] * block;
+    conv.channels_per_group = w_type.Shape()[1] * block;
+    conv.kernel_h = w_type.Shape()[2];
+    conv.kernel_w = w_type.Shape()[3];
 
-    if (c != channels_per_group * group) {
+    if (DimsConflict(c, conv.channels_per_group * conv.group)) {
         Fail(op.Name() + ": input channels do not match weights/group");
     }
-    if (out_channels % group != 0) {
+    if (out_channels % conv.group != 0) {
         Fail(op.Name() + ": output channels are not divisible by group");
     }
-    if (bias != nullptr) {
-        const TensorType& bias_type = RequireTensorType(*bias);
-        if (bias_type.Shape().size() != 1 || bias_type.Shape()[0] != out_channels) {
+    if (conv.bias != nullptr) {
+        const TensorType& bias_type = RequireTensorType(*conv.bias);
+        if (bias_type.Shape().size() != 1 || DimsConflict(bias_type.Shape()[0], out_channels)) {
             Fail(op.Name() + ": bias must have shape [out_channels]");
         }
     }
+    conv.out_channels_per_group = out_channels / conv.group;
+    if (conv.out_channels_per_group % block != 0) {
+        Fail(op.Name() + ": output channels per group are not divisible by the channel block");
+    }
+    return conv;
+}
+
+ConvAlgorithm ChooseConvAlgorithm(const MlirEmitterOptions& options, const ConvParams& conv) {
+    const ConvAlgorithm forced = options.conv_algorithm;
+    if (forced == ConvAlgorithm::kDirect) {
+        return ConvAlgorithm::kDirect;
+    }
+    // the pattern kernels beat the direct loops wherever they apply
+    const bool pointwise = IsPointwiseConv(conv);
+    if (pointwise && (forced == ConvAlgorithm::kAuto || forced == ConvAlgorithm::kPointwise)) {
+        return ConvAlgorithm::kPointwise;
+    }
+    const bool depthwise = IsDepthwiseConv(conv);
+    if (depthwise && (forced == ConvAlgorithm::kAuto || forced == ConvAlgorithm::kDepthwise)) {
+        return ConvAlgorithm::kDepthwise;
+    }
+    // the scratch and the depthwise column ranges are sized at compile time
+    if (!HasStaticShapes(conv) || forced == ConvAlgorithm::kPointwise || forced == ConvAlgorithm::kDepthwise) {
+        return ConvAlgorithm::kDirect;
+    }
+    if (options.conv_algorithm == ConvAlgorithm::kIm2col) {
+        return ConvAlgorithm::kIm2col;
+    }
+    const bool winograd = WinogradTile(conv) != 0;
+    if (options.conv_algorithm == ConvAlgorithm::kWinograd) {
+        return winograd ? ConvAlgorithm::kWinograd : ConvAlgorithm::kDirect;
+    }
+    if (winograd && conv.out_channels_per_group >= kMinReuseOutChannels) {
+        return ConvAlgorithm::kWinograd;
+    }
+    const int64_t kernel_area = conv.kernel_h * conv.kernel_w;
+    const bool worth_packing = kernel_area > 1 && conv.out_channels_per_group >= kMinReuseOutChannels &&
+                               conv.channels_per_group * kernel_area >= kIm2colMinReduction;
+    return worth_packing && Im2colScratchBytes(conv) <= kIm2colMaxScratchBytes ? ConvAlgorithm::kIm2col
+                                                                                : ConvAlgorithm::kDirect;
+}
+
+std::vector<int64_t> Im2colScratchShape(const ConvParams& conv) {
+    const std::vector<LoopBound> rows{LoopBound{*conv.y, 0}, conv.group, LoopBound{*conv.y, 2}};
+    return {rows[ParallelSplitDim(rows)].size, conv.channels_per_group, conv.kernel_h, conv.kernel_w,
+            LoopBound{*conv.y, 3}.size};
+}
+
+std::pair<int64_t, int64_t> ReachableOutputs(int64_t in_size, int64_t out_size, int64_t pad, int64_t stride,
+                                             int64_t offset) {
+    const int64_t first = pad - offset;
+    const int64_t last = in_size - 1 + pad - offset;
+    if (last < 0) {
+        return {0, 0};
+    }
+    const int64_t lo = first <= 0 ? 0 : CeilDiv(first, stride);
+    return {lo, std::min(out_size, last / stride + 1)};
+}
+
+bool IsDepthwiseConv(const ConvParams& conv) {
+    return conv.group > 1 && conv.channels_per_group == 1 && HasStaticShapes(conv);
+}
+
+bool IsPointwiseConv(const ConvParams& conv) {
+    return conv.kernel_h == 1 && conv.kernel_w == 1 && conv.strides == std::vector<int64_t>{1, 1} &&
+           conv.pads == std::vector<int64_t>{0, 0, 0, 0};
+}
+
+int64_t WinogradTile(const ConvParams& conv) {
+    const bool qualifies = conv.kernel_h == 3 && conv.kernel_w == 3 && conv.strides == std::vector<int64_t>{1, 1} &&
+                           conv.dilations == std::vector<int64_t>{1, 1} &&
+                           conv.w->GetBelongsTo() == Value::BelongTo::kInitializer && conv.w->HasInitializerData();
+    if (!qualifies) {
+        return 0;
+    }
+    const int64_t out_h = LoopBound{*conv.y, 2}.size;
+    const int64_t out_w = LoopBound{*conv.y, 3}.size;
+    return out_h >= kWinograd4MinOutSize && out_w >= kWinograd4MinOutSize ? 4 : 2;
+}
+
+const WinogradTransform& WinogradTransformFor(int64_t tile) {
+    if (tile != 2 && tile != 4) {
+        Fail("no Winograd transform for " + std::to_string(tile) + "x" + std::to_string(tile) + " tiles");
+    }
+    return tile == 2 ? kWinograd2 : kWinograd4;
+}
+
+TensorData WinogradWeights(const ConvParams& conv) {
+    const int64_t tile = WinogradTile(conv);
+    const std::vector<std::vector<double>>& g = tile == 2 ? kWinogradG2 : kWinogradG4;
+    const int64_t a = tile + 2;
+    const TensorData& w = *conv.w->InitializerData();
+    const TensorElemType elem_type = w.type.ElemType();
+    const size_t elem_size = TensorType::ElemSizeInBytes(elem_type);
+    const int64_t kernels = conv.out_channels_per_group * conv.group * conv.channels_per_group;
+    if (w.raw.size() != static_cast<size_t>(kernels * 9) * elem_size) {
+        Fail("initializer raw byte size mismatch");
+    }
+    auto read = [&](int64_t index) {
+        if (elem_type == TensorElemType::kFloat64) {
+            double v = 0;
+            std::memcpy(&v, w.raw.data() + index * 8, 8);
+            return v;
+        }
+        float v = 0;
+        std::memcpy(&v, w.raw.data() + index * 4, 4);
+        return static_cast<double>(v);
+    };
+    auto write = [&](std::string& raw, int64_t index, double v) {
+        if (elem_type == TensorElemType::kFloat64) {
+            std::memcpy(raw.data() + index * 8, &v, 8);
+            return;
+        }
+        const float f = static_cast<float>(v);
+        std::memcpy(raw.data() + index * 4, &f, 4);
+    };
+
+    TensorData u{TensorType{elem_type, {kernels / conv.channels_per_group, conv.channels_per_group, a, a}},
+                 std::string(static_cast<size_t>(kernels * a * a) * elem_size, '\0')};
+    for (int64_t kernel = 0; kernel < kernels; ++kernel) {
+        // G w: a x 3, then (G w) G^T: a x a
+        double gw[6][3] = {};
+        for (int64_t i = 0; i < a; ++i) {
+            for (int64_t s = 0; s < 3; ++s) {
+                for (int64_t r = 0; r < 3; ++r) {
+                    gw[i][s] += g[i][r] * read(kernel * 9 + r * 3 + s);
+                }
+            }
+        }
+        for (int64_t i = 0; i < a; ++i) {
+            for (int64_t j = 0; j < a; ++j) {
+                double v = 0;
+                for (int64_t s = 0; s < 3; ++s) {
+                    v += gw[i][s] * g[j][s];
+                }
+                write(u.raw, (kernel * a + i) * a + j, v);
+            }
+        }
+    }
+    return u;
+}
+
+std::string WinogradWeightsKey(const ConvParams& conv) {
+    return conv.w->Name() + "#winograd" + std::to_string(WinogradTile(conv));
+}
+
+std::vector<int64_t> WinogradScratchShape(const ConvParams& conv) {
+    const int64_t tile = WinogradTile(conv);
+    const std::vector<LoopBound> tiles = WinogradTiles(conv, tile);
+    return {tiles[ParallelSplitDim(tiles)].size, conv.channels_per_group + 1, tile + 2, tile + 2};
+}
+
+int64_t ScratchBytesOf(const MlirEmitterOptions& options, const Operation& op) {
+    if (op.Type() != Operation::OpType::kConv) {
+        return 0;
+    }
+    const ConvParams conv = ParseConv(op);
+    const TensorElemType elem_type = RequireTensorType(*conv.y).ElemType();
+    switch (ChooseConvAlgorithm(options, conv)) {
+        case ConvAlgorithm::kIm2col: return Im2colScratchBytes(conv);
+        case ConvAlgorithm::kWinograd: return ByteSizeOf(TensorType{elem_type, WinogradScratchShape(conv)});
+        default: return 0;
+    }
+}
 
-    const int64_t out_channels_per_group = out_channels / group;
-    const std::string scalar_memref_type = "memref<" + ElemTypeToMlir(y_type.ElemType()) + ">";
+std::vector<int64_t> ScratchBytesOf(const MlirEmitterOptions& options, const std::vector<const Operation*>& operations) {
+    std::vector<int64_t> bytes;
+    bytes.reserve(operations.size());
+    for (const Operation* op : operations) {
+        bytes.push_back(ScratchBytesOf(options, *op));
+    }
+    return bytes;
+}
+
+void ModuleEmitter::EmitConv(const Operation& op) {
+    const ConvParams conv = ParseConv(op);
+    switch (ChooseConvAlgorithm(options_, conv)) {
+        case ConvAlgorithm::kIm2col:
+            EmitIm2colConv(op, conv);
+            return;
+        case ConvAlgorithm::kWinograd:
+            EmitWinogradConv(op, conv);
+            return;
+        case ConvAlgorithm::kDepthwise:
+            EmitDepthwiseConv(conv);
+            return;
+        case ConvAlgorithm::kPointwise:
+            EmitPointwiseConv(conv);
+            return;
+        default:
+            EmitDirectConv(conv);
+            return;
+    }
+}
+
+std::string ModuleEmitter::EmitIndexDiv(const std::string& lhs, int64_t rhs, bool ceil, std::string_view hint) {
+    return rhs == 1 ? lhs : EmitIndexBinary(ceil ? "ceildivsi" : "floordivsi", lhs, EmitIndexConst(rhs), hint);
+}
+
+std::pair<std::string, std::string> ModuleEmitter::EmitConvInteriorColumns(const ConvParams& conv) {
+    const LoopBound out_w{*conv.y, 3};
+    // [0, ow_lo) and [ow_hi, out_w) are the border strips, clamped so the three ranges tile the row
+    const std::string ow_lo = EmitIndexBinary("minsi", EmitIndexConst(CeilDiv(conv.pads[1], conv.strides[1])),
+                                              BoundRef(out_w), "ow_lo");
+    const std::string last_iw = EmitIndexBinary("addi", BoundRef(LoopBound{*conv.x, 3}),
+                                                EmitIndexConst(conv.pads[1] - 1 - (conv.kernel_w - 1) * conv.dilations[1]),
+                                                "last_iw");
+    const std::string ow_end = EmitIndexBinary("addi", EmitIndexDiv(last_iw, conv.strides[1], false, "ow_last"),
+                                               EmitIndexConst(1), "ow_end");
+    const std::string ow_hi = EmitIndexBinary("maxsi", EmitIndexBinary("minsi", ow_end, BoundRef(out_w), "ow_hi"),
+                                              ow_lo, "ow_hi");
+    return {ow_lo, ow_hi};
+}
+
+ModuleEmitter::ConvRows ModuleEmitter::EmitConvKernelRows(const ConvParams& conv, const std::string& oh) {
+    // kernel rows [r_lo, r_hi) read inside X: 0 <= oh * stride - pad + r * dilation < h
+    const std::string scaled = EmitIndexBinary("muli", oh, EmitIndexConst(conv.strides[0]), "scaled");
+    const std::string ih_base = EmitIndexBinary("subi", scaled, EmitIndexConst(conv.pads[0]), "ih_base");
+    const std::string above = EmitIndexBinary("subi", EmitIndexConst(0), ih_base, "above");
+    const std::string r_lo = EmitIndexBinary("maxsi", EmitIndexDiv(above, conv.dilations[0], true, "r_first"),
+                                             EmitIndexConst(0), "r_lo");
+    const std::string last_ih = EmitIndexBinary("subi", BoundRef(LoopBound{*conv.x, 2}), EmitIndexConst(1), "last_ih");
+    const std::string below = EmitIndexBinary("subi", last_ih, ih_base, "below");
+    const std::string r_end = EmitIndexBinary("addi", EmitIndexDiv(below, conv.dilations[0], false, "r_last"),
+                                              EmitIndexConst(1), "r_end");
+    const std::string r_hi = EmitIndexBinary("minsi", r_end, EmitIndexConst(conv.kernel_h), "r_hi");
+    return {ih_base, r_lo, r_hi};
+}
+
+// Per output row: the kernel rows whose input rows lie inside X are worked out once, so only the
+// columns need checks, and only in the left and right border strips. The interior columns, whose
+// every tap reads inside X, reduce without any bounds checks or branches
+void ModuleEmitter::EmitDirectConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const std::string scalar_memref_type = "memref<" + ElemTypeToMlir(elem_type) + ">";
+    const LoopBound width{x, 3};
+    const LoopBound out_w{y, 3};
+    const auto columns = EmitConvInteriorColumns(conv);
+
+    std::vector<std::string> outer_indices;
+    EmitLoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group, LoopBound{y, 2}}, 0, outer_indices,
+                 [&](const std::vector<std::string>& ivs) {
+        const std::string oc_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group), "oc_base");
+        const std::string oc = EmitIndexBinary("addi", oc_base, ivs[2], "oc");
+        const std::string c_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.channels_per_group), "c_base");
+        const ConvRows rows = EmitConvKernelRows(conv, ivs[3]);
+
+        auto output_columns = [&](const std::string& lb, const std::string& ub, bool guarded) {
+            EmitRangeLoop(lb, ub, [&](const std::string& ow) {
+                const std::string acc_buf = NewSsa("acc");
+                EmitLine(acc_buf + " = memref.alloca() : " + scalar_memref_type);
+                EmitStoreRaw(EmitNumericConst(elem_type, 0.0), acc_buf, scalar_memref_type, {});
+                const std::string ow_scaled = EmitIndexBinary("muli", ow, EmitIndexConst(conv.strides[1]), "ow_scaled");
+                const std::string iw_base = EmitIndexBinary("subi", ow_scaled, EmitIndexConst(conv.pads[1]), "iw_base");
+
+                auto accumulate = [&](const std::string& c, const std::string& ih, const std::string& r,
+                                      const std::string& s, const std::string& iw) {
+                    const std::string in_c = EmitIndexBinary("addi", c_base, c, "in_c");
+                    const std::string x_val = EmitLoadValue(x, {ivs[0], in_c, ih, iw}, "x");
+                    const std::string w_val = EmitLoadValue(*conv.w, {oc, c, r, s}, "w");
+                    const std::string prod = EmitMulLike(x_val, w_val, elem_type, "prod");
+                    const std::string cur = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "cur");
+                    EmitStoreRaw(EmitAddLike(cur, prod, elem_type, "sum"), acc_buf, scalar_memref_type, {});
+                };
+                EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.channels_per_group), [&](const std::string& c) {
+                    EmitRangeLoop(rows.r_lo, rows.r_hi, [&](const std::string& r) {
+                        const std::string kh_dil = EmitIndexBinary("muli", r, EmitIndexConst(conv.dilations[0]), "kh_dil");
+                        const std::string ih = EmitIndexBinary("addi", rows.ih_base, kh_dil, "ih");
+                        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.kernel_w), [&](const std::string& s) {
+                            const std::string kw_dil = EmitIndexBinary("muli", s, EmitIndexConst(conv.dilations[1]), "kw_dil");
+                            const std::string iw = EmitIndexBinary("addi", iw_base, kw_dil, "iw");
+                            if (!guarded) {
+                                accumulate(c, ih, r, s, iw);
+                                return;
+                            }
+                            EmitLine("scf.if " + EmitInRange(iw, width, "in_w") + " {");
+                            ++indent_;
+                            accumulate(c, ih, r, s, iw);
+                            --indent_;
+                            EmitLine("}");
+                        });
+                    });
+                });
+
+                std::string out_value = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "conv_out");
+                if (conv.bias != nullptr) {
+                    const std::string b = EmitLoadValue(*conv.bias, {oc}, "bias");
+                    out_value = EmitAddLike(out_value, b, elem_type, "biased");
+                }
+                EmitStoreValue(out_value, y, {ivs[0], oc, ivs[3], ow});
+            });
+        };
+        output_columns(EmitIndexConst(0), columns.first, true);
+        output_columns(columns.first, columns.second, false);
+        output_columns(columns.second, BoundRef(out_w), true);
+    });
+}
+
+// Direct loops over NCHW[b]c (see graph/layout.hpp), split into rows and border strips like
+// EmitDirectConv. Each output pixel keeps b accumulators, one per output channel of its block; every
+// input value read is multiplied with the b contiguous weights of its input channel and added to
+// all of them, so the innermost loop runs over unit-stride W and accumulators for the vectorizer
+void ModuleEmitter::EmitNchwcConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const int64_t block = conv.block;
+    const std::string acc_memref_type = "memref<" + std::to_string(block) + "x" + ElemTypeToMlir(elem_type) + ">";
+    const LoopBound width{x, 3};
+    const LoopBound out_w{y, 3};
+    const auto columns = EmitConvInteriorColumns(conv);
+
+    // over every lane of a block
+    auto lanes = [&](const std::function<void(const std::string&)>& body) {
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(block), body);
+    };
 
     std::vector<std::string> outer_indices;
-    EmitLoopNest({n, group, out_channels_per_group, out_h, out_w}, 0, outer_indices, [&](const std::vector<std::string>& ivs) {
-        const std::string oc_group_mul = NewSsa("oc_group_mul");
-        const std::string ocg_const = EmitIndexConst(out_channels_per_group);
-        EmitLine(oc_group_mul + " = arith.muli " + ivs[1] + ", " + ocg_const + " : index");
-        const std::string oc = NewSsa("oc");
-        EmitLine(oc + " = arith.addi " + oc_group_mul + ", " + ivs[2] + " : index");
-
-        const std::string c_group_mul = NewSsa("c_group_mul");
-        const std::string cpg_const = EmitIndexConst(channels_per_group);
-        EmitLine(c_group_mul + " = arith.muli " + ivs[1] + ", " + cpg_const + " : index");
-
-        const std::string acc_buf = NewSsa("acc");
-        EmitLine(acc_buf + " = memref.alloca() : " + scalar_memref_type);
-        const std::string zero = EmitNumericConst(y_type.ElemType(), 0.0);
-        EmitStoreRaw(zero, acc_buf, scalar_memref_type, {});
-
-        std::vector<std::string> reduce_indices;
-        EmitLoopNest({channels_per_group, kernel_h, kernel_w}, 0, reduce_indices, [&](const std::vector<std::string>& r) {
-            const std::string in_c = NewSsa("in_c");
-            EmitLine(in_c + " = arith.addi " + c_group_mul + ", " + r[0] + " : index");
-
-            const std::string oh_mul = NewSsa("oh_mul");
-            const std::string sh = EmitIndexConst(strides[0]);
-            EmitLine(oh_mul + " = arith.muli " + ivs[3] + ", " + sh + " : index");
-            const std::string kh_dil = NewSsa("kh_dil");
-            const std::string dh = EmitIndexConst(dilations[0]);
-            EmitLine(kh_dil + " = arith.muli " + r[1] + ", " + dh + " : index");
-            const std::string ih_tmp = NewSsa("ih_tmp");
-            const std::string pad_t = EmitIndexConst(pads[0]);
-            EmitLine(ih_tmp + " = arith.subi " + oh_mul + ", " + pad_t + " : index");
-            const std::string ih = NewSsa("ih");
-            EmitLine(ih + " = arith.addi " + ih_tmp + ", " + kh_dil + " : index");
-
-            const std::string ow_mul = NewSsa("ow_mul");
-            const std::string sw = EmitIndexConst(strides[1]);
-            EmitLine(ow_mul + " = arith.muli " + ivs[4] + ", " + sw + " : index");
-            const std::string kw_dil = NewSsa("kw_dil");
-            const std::string dw = EmitIndexConst(dilations[1]);
-            EmitLine(kw_dil + " = arith.muli " + r[2] + ", " + dw + " : index");
-            const std::string iw_tmp = NewSsa("iw_tmp");
-            const std::string pad_l = EmitIndexConst(pads[1]);
-            EmitLine(iw_tmp + " = arith.subi " + ow_mul + ", " + pad_l + " : index");
-            const std::string iw = NewSsa("iw");
-            EmitLine(iw + " = arith.addi " + iw_tmp + ", " + kw_dil + " : index");
-
-            const std::string zero_idx = EmitIndexConst(0);
-            const std::string h_idx = EmitIndexConst(h);
-            const std::string w_idx = EmitIndexConst(width);
-            const std::string ih_ge_0 = NewSsa("ih_ge_0");
-            EmitLine(ih_ge_0 + " = arith.cmpi sge, " + ih + ", " + zero_idx + " : index");
-            const std::string ih_lt_h = NewSsa("ih_lt_h");
-            EmitLine(ih_lt_h + " = arith.cmpi slt, " + ih + ", " + h_idx + " : index");
-            const std::string iw_ge_0 = NewSsa("iw_ge_0");
-            EmitLine(iw_ge_0 + " = arith.cmpi sge, " + iw + ", " + zero_idx + " : index");
-            const std::string iw_lt_w = NewSsa("iw_lt_w");
-            EmitLine(iw_lt_w + " = arith.cmpi slt, " + iw + ", " + w_idx + " : index");
-            const std::string in_h = NewSsa("in_h");
-            EmitLine(in_h + " = arith.andi " + ih_ge_0 + ", " + ih_lt_h + " : i1");
-            const std::string in_w = NewSsa("in_w");
-            EmitLine(in_w + " = arith.andi " + iw_ge_0 + ", " + iw_lt_w + " : i1");
-            const std::string in_bounds = NewSsa("in_bounds");
-            EmitLine(in_bounds + " = arith.andi " + in_h + ", " + in_w + " : i1");
-
-            EmitLine("scf.if " + in_bounds + " {");
+    EmitLoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group / block, LoopBound{y, 2}}, 0, outer_indices,
+                 [&](const std::vector<std::string>& ivs) {
+        const std::string ob_base =
+            EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group / block), "ob_base");
+        const std::string ob = EmitIndexBinary("addi", ob_base, ivs[2], "ob");
+        const std::string ib_base =
+            EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.channels_per_group / block), "ib_base");
+        const ConvRows rows = EmitConvKernelRows(conv, ivs[3]);
+
+        auto output_columns = [&](const std::string& lb, const std::string& ub, bool guarded) {
+            EmitRangeLoop(lb, ub, [&](const std::string& ow) {
+                const std::string acc_buf = NewSsa("acc");
+                EmitLine(acc_buf + " = memref.alloca() : " + acc_memref_type);
+                lanes([&](const std::string& lane) {
+                    std::string init = EmitNumericConst(elem_type, 0.0);
+                    if (conv.bias != nullptr) {
+                        const std::string oc_base = EmitIndexBinary("muli", ob, EmitIndexConst(block), "oc_base");
+                        init = EmitLoadValue(*conv.bias, {EmitIndexBinary("addi", oc_base, lane, "oc")}, "bias");
+                    }
+                    EmitStoreRaw(init, acc_buf, acc_memref_type, {lane});
+                });
+                const std::string ow_scaled = EmitIndexBinary("muli", ow, EmitIndexConst(conv.strides[1]), "ow_scaled");
+                const std::string iw_base = EmitIndexBinary("subi", ow_scaled, EmitIndexConst(conv.pads[1]), "iw_base");
+
+                auto accumulate = [&](const std::string& icb, const std::string& ih, const std::string& r,
+                                      const std::string& s, const std::string& iw) {
+                    const std::string ib = EmitIndexBinary("addi", ib_base, icb, "ib");
+                    lanes([&](const std::string& i) {
+                        const std::string x_val = EmitLoadValue(x, {ivs[0], ib, ih, iw, i}, "x");
+                        lanes([&](const std::string& lane) {
+                            const std::string w_val = EmitLoadValue(*conv.w, {ob, icb, r, s, i, lane}, "w");
+                            const std::string prod = EmitMulLike(x_val, w_val, elem_type, "prod");
+                            const std::string cur = EmitLoadRaw(acc_buf, acc_memref_type, {lane}, "cur");
+                            EmitStoreRaw(EmitAddLike(cur, prod, elem_type, "sum"), acc_buf, acc_memref_type, {lane});
+                        });
+                    });
+                };
+                EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.channels_per_group / block), [&](const std::string& icb) {
+                    EmitRangeLoop(rows.r_lo, rows.r_hi, [&](const std::string& r) {
+                        const std::string kh_dil = EmitIndexBinary("muli", r, EmitIndexConst(conv.dilations[0]), "kh_dil");
+                        const std::string ih = EmitIndexBinary("addi", rows.ih_base, kh_dil, "ih");
+                        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.kernel_w), [&](const std::string& s) {
+                            const std::string kw_dil = EmitIndexBinary("muli", s, EmitIndexConst(conv.dilations[1]), "kw_dil");
+                            const std::string iw = EmitIndexBinary("addi", iw_base, kw_dil, "iw");
+                            if (!guarded) {
+                                accumulate(icb, ih, r, s, iw);
+                                return;
+                            }
+                            EmitLine("scf.if " + EmitInRange(iw, width, "in_w") + " {");
+                            ++indent_;
+                            accumulate(icb, ih, r, s, iw);
+                            --indent_;
+                            EmitLine("}");
+                        });
+                    });
+                });
+
+                lanes([&](const std::string& lane) {
+                    const std::string out_value = EmitLoadRaw(acc_buf, acc_memref_type, {lane}, "conv_out");
+                    EmitStoreValue(out_value, y, {ivs[0], ob, ivs[3], ow, lane});
+                });
+            });
+        };
+        output_columns(EmitIndexConst(0), columns.first, true);
+        output_columns(columns.first, columns.second, false);
+        output_columns(columns.second, BoundRef(out_w), true);
+    });
+}
+
+// Per output row (n, group, oh): the patches the row reads are packed into a scratch slot as a
+// [channels_per_group * kernel_h * kernel_w, out_w] matrix, zeros where they fall into the padding,
+// then the row of every output channel of the group is the product of its weights with that matrix,
+// accumulated row by row in the mkn order of a tuned Gemm: unit stride on the scratch and on Y
+void ModuleEmitter::EmitIm2colConv(const Operation& op, const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const std::vector<int64_t> scratch_shape = Im2colScratchShape(conv);
+    std::string scratch_type = "memref<";
+    for (int64_t dim : scratch_shape) {
+        scratch_type += std::to_string(dim) + "x";
+    }
+    scratch_type += ElemTypeToMlir(elem_type) + ">";
+
+    const std::string scratch = NewSsa("im2col");
+    if (options_.use_workspace) {
+        const std::string offset = EmitIndexConst(workspace_.scratch.at(&op));
+        EmitLine(scratch + " = memref.view " + workspace_ref_ + "[" + offset + "][] : " + WorkspaceType() + " to " + scratch_type);
+    } else {
+        EmitLine(scratch + " = memref.alloc() : " + scratch_type);
+    }
+
+    // out * stride - pad + tap * dilation
+    auto input_coord = [&](const std::string& out, const std::string& tap, size_t axis) {
+        const std::string scaled = EmitIndexBinary("muli", out, EmitIndexConst(conv.strides[axis]), "scaled");
+        const std::string shifted = EmitIndexBinary("subi", scaled, EmitIndexConst(conv.pads[axis]), "shifted");
+        const std::string dilated = EmitIndexBinary("muli", tap, EmitIndexConst(conv.dilations[axis]), "dilated");
+        return EmitIndexBinary("addi", shifted, dilated, axis == 0 ? "ih" : "iw");
+    };
+
+    const std::vector<LoopBound> rows{LoopBound{y, 0}, conv.group, LoopBound{y, 2}};
+    const size_t slot_dim = ParallelSplitDim(rows);
+    const LoopBound out_w{y, 3};
+    std::vector<std::string> row_indices;
+    EmitLoopNest(rows, 0, row_indices, [&](const std::vector<std::string>& ivs) {
+        const std::string& slot = ivs[slot_dim];
+        const std::string c_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.channels_per_group), "c_base");
+        const std::string oc_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group), "oc_base");
+
+        const std::string zero = EmitNumericConst(elem_type, 0.0);
+        std::vector<std::string> tap_indices;
+        EmitLoopNest({conv.channels_per_group, conv.kernel_h, conv.kernel_w}, 0, tap_indices, [&](const std::vector<std::string>& t) {
+            const std::string in_c = EmitIndexBinary("addi", c_base, t[0], "in_c");
+            const std::string ih = input_coord(ivs[2], t[1], 0);
+            const std::string in_h = EmitInRange(ih, LoopBound{x, 2}, "in_h");
+            EmitRangeLoop(EmitIndexConst(0), BoundRef(out_w), [&](const std::string& j) {
+                const std::string iw = input_coord(j, t[2], 1);
+                const std::string in_w = EmitInRange(iw, LoopBound{x, 3}, "in_w");
+                const std::string in_bounds = NewSsa("in_bounds");
+                EmitLine(in_bounds + " = arith.andi " + in_h + ", " + in_w + " : i1");
+                const std::string patch = NewSsa("patch");
+                EmitLine(patch + " = scf.if " + in_bounds + " -> (" + ElemTypeToMlir(elem_type) + ") {");
+                ++indent_;
+                const std::string x_val = EmitLoadValue(x, {ivs[0], in_c, ih, iw}, "x");
+                EmitLine("scf.yield " + x_val + " : " + ElemTypeToMlir(elem_type));
+                --indent_;
+                EmitLine("} else {");
+                ++indent_;
+                EmitLine("scf.yield " + zero + " : " + ElemTypeToMlir(elem_type));
+                --indent_;
+                EmitLine("}");
+                EmitStoreRaw(patch, scratch, scratch_type, {slot, t[0], t[1], t[2], j});
+            });
+        });
+
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.out_channels_per_group), [&](const std::string& ocg) {
+            const std::string oc = EmitIndexBinary("addi", oc_base, ocg, "oc");
+            const std::string init = conv.bias != nullptr ? EmitLoadValue(*conv.bias, {oc}, "bias")
+                                                          : EmitNumericConst(elem_type, 0.0);
+            EmitRangeLoop(EmitIndexConst(0), BoundRef(out_w), [&](const std::string& j) {
+                EmitStoreValue(init, y, {ivs[0], oc, ivs[2], j});
+            });
+            std::vector<std::string> k_indices;
+            EmitLoopNest({conv.channels_per_group, conv.kernel_h, conv.kernel_w}, 0, k_indices, [&](const std::vector<std::string>& k) {
+                const std::string w_val = EmitLoadValue(*conv.w, {oc, k[0], k[1], k[2]}, "w");
+                EmitRangeLoop(EmitIndexConst(0), BoundRef(out_w), [&](const std::string& j) {
+                    const std::string patch = EmitLoadRaw(scratch, scratch_type, {slot, k[0], k[1], k[2], j}, "patch");
+                    const std::string prod = EmitMulLike(w_val, patch, elem_type, "prod");
+                    const std::string cur = EmitLoadValue(y, {ivs[0], oc, ivs[2], j}, "cur");
+                    EmitStoreValue(EmitAddLike(cur, prod, elem_type, "sum"), y, {ivs[0], oc, ivs[2], j});
+                });
+            });
+        });
+    });
+
+    if (!options_.use_workspace) {
+        EmitLine("memref.dealloc " + scratch + " : " + scratch_type);
+    }
+}
+
+// Per tile of m x m outputs (n, group, tile row, tile col): the (m + 2)^2 input tile of every
+// input channel, zeros where it falls into the padding, is transformed to B^T d B into a scratch
+// slot; per output channel the products with the weights transformed at compile time are summed
+// over the channels into the slot's accumulator, and A^T M A is the output tile. The transforms
+// are unrolled, so their additions and constant multiplies are all that is left of the matrices
+void ModuleEmitter::EmitWinogradConv(const Operation& op, const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const std::string elem = ElemTypeToMlir(elem_type);
+    const int64_t m = WinogradTile(conv);
+    const WinogradTransform& transform = WinogradTransformFor(m);
+    const int64_t a = m + 2;
+    const std::string scratch_type = MemRefTypeToMlir(TensorType{elem_type, WinogradScratchShape(conv)});
+    const std::string weights_type = MemRefTypeToMlir(
+        TensorType{elem_type, {conv.group * conv.out_channels_per_group, conv.channels_per_group, a, a}});
+
+    const std::string weights = NewSsa("winograd_w");
+    EmitLine(weights + " = memref.get_global " + global_refs_.at(WinogradWeightsKey(conv)) + " : " + weights_type);
+    const std::string scratch = NewSsa("winograd");
+    if (options_.use_workspace) {
+        const std::string offset = EmitIndexConst(workspace_.scratch.at(&op));
+        EmitLine(scratch + " = memref.view " + workspace_ref_ + "[" + offset + "][] : " + WorkspaceType() + " to " + scratch_type);
+    } else {
+        EmitLine(scratch + " = memref.alloc() : " + scratch_type);
+    }
+
+    const int64_t out_h = LoopBound{y, 2}.size;
+    const int64_t out_w = LoopBound{y, 3}.size;
+    const std::vector<LoopBound> tiles = WinogradTiles(conv, m);
+    const size_t slot_dim = ParallelSplitDim(tiles);
+    std::vector<std::string> tile_indices;
+    EmitLoopNest(tiles, 0, tile_indices, [&](const std::vector<std::string>& ivs) {
+        const std::string& slot = ivs[slot_dim];
+        const std::string c_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.channels_per_group), "c_base");
+        const std::string oc_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group), "oc_base");
+        const std::string oh_base = EmitIndexBinary("muli", ivs[2], EmitIndexConst(m), "oh_base");
+        const std::string ow_base = EmitIndexBinary("muli", ivs[3], EmitIndexConst(m), "ow_base");
+
+        // input rows and columns of the tile and whether they lie inside X
+        std::vector<std::string> ih(a);
+        std::vector<std::string> iw(a);
+        std::vector<std::string> in_h(a);
+        std::vector<std::string> in_w(a);
+        const std::string ih_base = EmitIndexBinary("subi", oh_base, EmitIndexConst(conv.pads[0]), "ih_base");
+        const std::string iw_base = EmitIndexBinary("subi", ow_base, EmitIndexConst(conv.pads[1]), "iw_base");
+        for (int64_t i = 0; i < a; ++i) {
+            ih[i] = EmitIndexBinary("addi", ih_base, EmitIndexConst(i), "ih");
+            in_h[i] = EmitInRange(ih[i], LoopBound{x, 2}, "in_h");
+            iw[i] = EmitIndexBinary("addi", iw_base, EmitIndexConst(i), "iw");
+            in_w[i] = EmitInRange(iw[i], LoopBound{x, 3}, "in_w");
+        }
+
+        const std::string zero = EmitNumericConst(elem_type, 0.0);
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.channels_per_group), [&](const std::string& c) {
+            const std::string in_c = EmitIndexBinary("addi", c_base, c, "in_c");
+            std::vector<std::vector<std::string>> d(a, std::vector<std::string>(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    const std::string in_bounds = NewSsa("in_bounds");
+                    EmitLine(in_bounds + " = arith.andi " + in_h[i] + ", " + in_w[j] + " : i1");
+                    d[i][j] = NewSsa("d");
+                    EmitLine(d[i][j] + " = scf.if " + in_bounds + " -> (" + elem + ") {");
+                    ++indent_;
+                    const std::string x_val = EmitLoadValue(x, {ivs[0], in_c, ih[i], iw[j]}, "x");
+                    EmitLine("scf.yield " + x_val + " : " + elem);
+                    --indent_;
+                    EmitLine("} else {");
+                    ++indent_;
+                    EmitLine("scf.yield " + zero + " : " + elem);
+                    --indent_;
+                    EmitLine("}");
+                }
+            }
+            // B^T d, then (B^T d) B
+            std::vector<std::vector<std::string>> bd(a, std::vector<std::string>(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    std::vector<std::string> column;
+                    for (int64_t k = 0; k < a; ++k) {
+                        column.push_back(d[k][j]);
+                    }
+                    bd[i][j] = EmitLinearCombination(transform.bt[i], column, elem_type, "bd");
+                }
+            }
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    const std::string v = EmitLinearCombination(transform.bt[j], bd[i], elem_type, "v");
+                    EmitStoreRaw(v, scratch, scratch_type, {slot, c, EmitIndexConst(i), EmitIndexConst(j)});
+                }
+            }
+        });
+
+        const std::string acc = EmitIndexConst(conv.channels_per_group);
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.out_channels_per_group), [&](const std::string& ocg) {
+            const std::string oc = EmitIndexBinary("addi", oc_base, ocg, "oc");
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    EmitStoreRaw(zero, scratch, scratch_type, {slot, acc, EmitIndexConst(i), EmitIndexConst(j)});
+                }
+            }
+            std::vector<std::string> k_indices;
+            EmitLoopNest({conv.channels_per_group, a, a}, 0, k_indices, [&](const std::vector<std::string>& k) {
+                const std::string u = EmitLoadRaw(weights, weights_type, {oc, k[0], k[1], k[2]}, "u");
+                const std::string v = EmitLoadRaw(scratch, scratch_type, {slot, k[0], k[1], k[2]}, "v");
+                const std::string prod = EmitMulLike(u, v, elem_type, "prod");
+                const std::string cur = EmitLoadRaw(scratch, scratch_type, {slot, acc, k[1], k[2]}, "cur");
+                EmitStoreRaw(EmitAddLike(cur, prod, elem_type, "sum"), scratch, scratch_type, {slot, acc, k[1], k[2]});
+            });
+
+            std::vector<std::vector<std::string>> sums(a, std::vector<std::string>(a));
+            for (int64_t i = 0; i < a; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    sums[i][j] = EmitLoadRaw(scratch, scratch_type, {slot, acc, EmitIndexConst(i), EmitIndexConst(j)}, "m");
+                }
+            }
+            // A^T M, then (A^T M) A
+            std::vector<std::vector<std::string>> am(m, std::vector<std::string>(a));
+            for (int64_t i = 0; i < m; ++i) {
+                for (int64_t j = 0; j < a; ++j) {
+                    std::vector<std::string> column;
+                    for (int64_t k = 0; k < a; ++k) {
+                        column.push_back(sums[k][j]);
+                    }
+                    am[i][j] = EmitLinearCombination(transform.at[i], column, elem_type, "am");
+                }
+            }
+            const std::string b = conv.bias != nullptr ? EmitLoadValue(*conv.bias, {oc}, "bias") : std::string{};
+            for (int64_t i = 0; i < m; ++i) {
+                const std::string oh = EmitIndexBinary("addi", oh_base, EmitIndexConst(i), "oh");
+                for (int64_t j = 0; j < m; ++j) {
+                    const std::string ow = EmitIndexBinary("addi", ow_base, EmitIndexConst(j), "ow");
+                    std::string out = EmitLinearCombination(transform.at[j], am[i], elem_type, "y");
+                    if (!b.empty()) {
+                        out = EmitAddLike(out, b, elem_type, "biased");
+                    }
+                    // only the last tile of a side that m does not divide sticks out of Y
+                    std::vector<std::string> checks;
+                    if (out_h % m != 0 && i >= out_h % m) {
+                        checks.push_back(NewSsa("oh_lt"));
+                        EmitLine(checks.back() + " = arith.cmpi slt, " + oh + ", " + EmitIndexConst(out_h) + " : index");
+                    }
+                    if (out_w % m != 0 && j >= out_w % m) {
+                        checks.push_back(NewSsa("ow_lt"));
+                        EmitLine(checks.back() + " = arith.cmpi slt, " + ow + ", " + EmitIndexConst(out_w) + " : index");
+                    }
+                    if (checks.empty()) {
+                        EmitStoreValue(out, y, {ivs[0], oc, oh, ow});
+                        continue;
+                    }
+                    std::string in_y = checks[0];
+                    if (checks.size() == 2) {
+                        in_y = NewSsa("in_y");
+                        EmitLine(in_y + " = arith.andi " + checks[0] + ", " + checks[1] + " : i1");
+                    }
+                    EmitLine("scf.if " + in_y + " {");
+                    ++indent_;
+                    EmitStoreValue(out, y, {ivs[0], oc, oh, ow});
+                    --indent_;
+                    EmitLine("}");
+                }
+            }
+        });
+    });
+
+    if (!options_.use_workspace) {
+        EmitLine("memref.dealloc " + scratch + " : " + scratch_type);
+    }
+}
+
+// Per output row of a channel: every kernel tap whose input row lies inside X adds its weight
+// times a slice of that row to the whole output row. The columns each kernel column reaches
+// inside X are known at compile time, so the innermost loop runs over them unguarded, with unit
+// stride on Y and on X for unit strides
+void ModuleEmitter::EmitDepthwiseConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const LoopBound out_w{y, 3};
+
+    std::vector<std::string> row_indices;
+    EmitLoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group, LoopBound{y, 2}}, 0, row_indices,
+                 [&](const std::vector<std::string>& ivs) {
+        const std::string oc_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group), "oc_base");
+        const std::string oc = EmitIndexBinary("addi", oc_base, ivs[2], "oc");
+        const std::string init = conv.bias != nullptr ? EmitLoadValue(*conv.bias, {oc}, "bias")
+                                                      : EmitNumericConst(elem_type, 0.0);
+        EmitRangeLoop(EmitIndexConst(0), BoundRef(out_w), [&](const std::string& j) {
+            EmitStoreValue(init, y, {ivs[0], oc, ivs[3], j});
+        });
+
+        const std::string scaled = EmitIndexBinary("muli", ivs[3], EmitIndexConst(conv.strides[0]), "scaled");
+        const std::string ih_base = EmitIndexBinary("subi", scaled, EmitIndexConst(conv.pads[0]), "ih_base");
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.kernel_h), [&](const std::string& r) {
+            const std::string dilated = EmitIndexBinary("muli", r, EmitIndexConst(conv.dilations[0]), "dilated");
+            const std::string ih = EmitIndexBinary("addi", ih_base, dilated, "ih");
+            EmitLine("scf.if " + EmitInRange(ih, LoopBound{x, 2}, "in_h") + " {");
             ++indent_;
-            const std::string x_val = EmitLoadValue(x, {ivs[0], in_c, ih, iw}, "x");
-            const std::string w_val = EmitLoadValue(w, {oc, r[0], r[1], r[2]}, "w");
-            const std::string prod = EmitMulLike(x_val, w_val, y_type.ElemType(), "prod");
-            const std::string cur = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "cur");
-            const std::string next = EmitAddLike(cur, prod, y_type.ElemType(), "sum");
-            EmitStoreRaw(next, acc_buf, scalar_memref_type, {});
+            for (int64_t s = 0; s < conv.kernel_w; ++s) {
+                const auto [lo, hi] = ReachableOutputs(LoopBound{x, 3}.size, out_w.size, conv.pads[1], conv.strides[1],
+                                                       s * conv.dilations[1]);
+                if (lo >= hi) {
+                    continue;
+                }
+                const std::string w_val = EmitLoadValue(*conv.w, {oc, EmitIndexConst(0), r, EmitIndexConst(s)}, "w");
+                const std::string shift = EmitIndexConst(s * conv.dilations[1] - conv.pads[1]);
+                EmitRangeLoop(EmitIndexConst(lo), EmitIndexConst(hi), [&](const std::string& j) {
+                    const std::string iw_scaled = EmitIndexBinary("muli", j, EmitIndexConst(conv.strides[1]), "iw_scaled");
+                    const std::string iw = EmitIndexBinary("addi", iw_scaled, shift, "iw");
+                    const std::string prod = EmitMulLike(w_val, EmitLoadValue(x, {ivs[0], ivs[1], ih, iw}, "x"), elem_type, "prod");
+                    const std::string cur = EmitLoadValue(y, {ivs[0], oc, ivs[3], j}, "cur");
+                    EmitStoreValue(EmitAddLike(cur, prod, elem_type, "sum"), y, {ivs[0], oc, ivs[3], j});
+                });
+            }
             --indent_;
             EmitLine("}");
         });
+    });
+}
 
-        std::string out_value = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "conv_out");
-        if (bias != nullptr) {
-            const std::string b = EmitLoadValue(*bias, {oc}, "bias");
-            out_value = EmitAddLike(out_value, b, y_type.ElemType(), "biased");
-        }
-        EmitStoreValue(out_value, y, {ivs[0], oc, ivs[3], ivs[4]});
+// Per output channel: Y[n, oc] starts as the bias, then adds W[oc, c] times the plane X[n, c] for
+// every input channel of the group. These are the rows of a Gemm accumulated in mkn order, with
+// unit stride on X and Y
+void ModuleEmitter::EmitPointwiseConv(const ConvParams& conv) {
+    const Value& x = *conv.x;
+    const Value& y = *conv.y;
+    const TensorElemType elem_type = RequireTensorType(y).ElemType();
+    const std::vector<LoopBound> plane{LoopBound{y, 2}, LoopBound{y, 3}};
+
+    std::vector<std::string> channel_indices;
+    EmitLoopNest({LoopBound{y, 0}, conv.group, conv.out_channels_per_group}, 0, channel_indices,
+                 [&](const std::vector<std::string>& ivs) {
+        const std::string oc_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.out_channels_per_group), "oc_base");
+        const std::string oc = EmitIndexBinary("addi", oc_base, ivs[2], "oc");
+        const std::string c_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(conv.channels_per_group), "c_base");
+        const std::string init = conv.bias != nullptr ? EmitLoadValue(*conv.bias, {oc}, "bias")
+                                                      : EmitNumericConst(elem_type, 0.0);
+        std::vector<std::string> init_indices;
+        EmitLoopNest(plane, 0, init_indices, [&](const std::vector<std::string>& hw) {
+            EmitStoreValue(init, y, {ivs[0], oc, hw[0], hw[1]});
+        });
+
+        EmitRangeLoop(EmitIndexConst(0), EmitIndexConst(conv.channels_per_group), [&](const std::string& c) {
+            const std::string in_c = EmitIndexBinary("addi", c_base, c, "in_c");
+            const std::string zero = EmitIndexConst(0);
+            const std::string w_val = EmitLoadValue(*conv.w, {oc, c, zero, zero}, "w");
+            std::vector<std::string> hw_indices;
+            EmitLoopNest(plane, 0, hw_indices, [&](const std::vector<std::string>& hw) {
+                const std::string prod = EmitMulLike(w_val, EmitLoadValue(x, {ivs[0], in_c, hw[0], hw[1]}, "x"), elem_type, "prod");
+                const std::string cur = EmitLoadValue(y, {ivs[0], oc, hw[0], hw[1]}, "cur");
+                EmitStoreValue(EmitAddLike(cur, prod, elem_type, "sum"), y, {ivs[0], oc, hw[0], hw[1]});
+            });
+        });
     });
 }
 
+std::string ModuleEmitter::EmitLinearCombination(const std::vector<double>& coefs,
+                                                 const std::vector<std::string>& terms,
+                                                 TensorElemType elem_type,
+                                                 std::string_view hint) {
+    const std::string type = ElemTypeToMlir(elem_type);
+    std::string sum;
+    for (size_t k = 0; k < coefs.size(); ++k) {
+        const double coef = coefs[k];
+        if (coef == 0.0) {
+            continue;
+        }
+        std::string term = terms[k];
+        if (coef != 1.0 && coef != -1.0) {
+            term = EmitMulLike(EmitNumericConst(elem_type, coef), term, elem_type, hint);
+        }
+        if (sum.empty() && coef == -1.0) {
+            sum = NewSsa(hint);
+            EmitLine(sum + " = arith.negf " + term + " : " + type);
+        } else if (sum.empty()) {
+            sum = term;
+        } else if (coef == -1.0) {
+            const std::string diff = NewSsa(hint);
+            EmitLine(diff + " = arith.subf " + sum + ", " + term + " : " + type);
+            sum = diff;
+        } else {
+            sum = EmitAddLike(sum, term, elem_type, hint);
+        }
+    }
+    return sum.empty() ? EmitNumericConst(elem_type, 0.0) : sum;
+}
+
 } // namespace tc::detail
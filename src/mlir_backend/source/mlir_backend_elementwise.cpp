@@ -13,7 +13,7 @@ void ModuleEmitter::EmitElementwiseBinary(const Operation& op, bool is_add) {
     const TensorElemType elem_type = RequireTensorType(out_value).ElemType();
 
     std::vector<std::string> indices;
-    EmitLoopNest(ShapeOf(out_value), 0, indices, [&](const std::vector<std::string>& ivs) {
+    EmitLoopNest(BoundsOf(out_value), 0, indices, [&](const std::vector<std::string>& ivs) {
         const std::string lhs = EmitLoadValue(lhs_value, BroadcastIndices(lhs_value, out_value, ivs), "lhs");
         const std::string rhs = EmitLoadValue(rhs_value, BroadcastIndices(rhs_value, out_value, ivs), "rhs");
         const std::string result = is_add
@@ -39,7 +39,7 @@ void ModuleEmitter::EmitRelu(const Operation& op) {
     }
 
     std::vector<std::string> indices;
-    EmitLoopNest(ShapeOf(output), 0, indices, [&](const std::vector<std::string>& ivs) {
+    EmitLoopNest(BoundsOf(output), 0, indices, [&](const std::vector<std::string>& ivs) {
         const std::string arg = EmitLoadValue(input, BroadcastIndices(input, output, ivs), "relu_in");
         const std::string zero = EmitNumericConst(elem_type, 0.0);
         const std::string result = NewSsa("relu");
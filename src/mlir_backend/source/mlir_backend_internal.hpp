@@ -3,7 +3,6 @@
 
 #include <functional>
 #include <optional>
-#include <sstream>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -12,7 +11,10 @@
 
 #include "graph/graph.hpp"
 #include "graph/node.hpp"
+#include "helpers/output_sink.hpp"
+#include "helpers/phase_timer.hpp"
 #include "mlir_backend/mlir_backend.hpp"
+#include "mlir_backend/tuning.hpp"
 
 namespace tc::detail {
 
@@ -22,7 +24,8 @@ bool IsFloatType(TensorElemType elem_type);
 bool IsIntegerLikeType(TensorElemType elem_type);
 std::string ElemTypeToMlir(TensorElemType elem_type);
 std::string MemRefTypeToMlir(const TensorType& type);
-std::string DenseLiteral(const TensorData& data);
+// streams dense<...> straight from the initializer bytes without materializing the literal
+void WriteDenseLiteral(hlp::OutputSink& out, const TensorData& data);
 std::string SanitizeIdentifier(std::string_view value, std::string_view prefix);
 
 std::vector<const Value*> CollectValuesByBelong(const Graph& graph, Value::BelongTo belong);
@@ -30,6 +33,143 @@ std::vector<const Value*> CollectInternalValues(const Graph& graph);
 std::vector<const Operation*> CollectOperations(const Graph& graph);
 
 const TensorType& RequireTensorType(const Value& value);
+bool HasDynamicShape(const TensorType& type);
+// sizes that cannot describe the same dimension: both known and different
+bool DimsConflict(int64_t lhs, int64_t rhs);
+void ValidateGraphValues(const std::vector<const Value*>& inputs,
+                         const std::vector<const Value*>& outputs,
+                         const std::vector<const Value*>& initializers,
+                         const std::vector<const Value*>& temporaries);
+// byte offsets of temporaries inside the entry workspace
+struct WorkspaceLayout {
+    static constexpr int64_t kAlignment = 64;
+
+    std::unordered_map<std::string, int64_t> offsets;
+    int64_t size = 0;
+    // temporaries with dynamic shapes: placed back to back after the static part at run time,
+    // in this order and without sharing bytes
+    std::vector<const Value*> dynamic;
+    // byte offsets of the scratch buffers of operations that need one, live while their op runs only
+    std::unordered_map<const Operation*, int64_t> scratch;
+};
+
+int64_t ByteSizeOf(const TensorType& type);
+// scratch_bytes: per operation, the bytes of scratch it needs (ScratchBytesOf), empty for none at all
+WorkspaceLayout PlanWorkspace(const std::vector<const Value*>& temporaries,
+                              const std::vector<const Operation*>& operations,
+                              const std::vector<int64_t>& scratch_bytes = {});
+
+// trip count of one loop: a constant or a dimension of a value, which may be dynamic
+struct LoopBound {
+    LoopBound(int64_t size) : size{size} {} // NOLINT(google-explicit-constructor)
+    LoopBound(const Value& value, size_t axis);
+
+    bool IsDynamic() const { return size < 0; }
+
+    int64_t size;
+    const Value* value = nullptr;
+    size_t axis = 0;
+};
+
+std::vector<LoopBound> BoundsOf(const Value& value);
+// loop of a task's outermost nest that is split across threads: the first one with more than one iteration
+size_t ParallelSplitDim(const std::vector<LoopBound>& bounds);
+
+// a MatMul or Gemm as the scheduled loop nests see it: Y[m, n] = alpha * sum_k A[m, k] B[k, n] + beta * C
+struct Contraction {
+    const Value* a;
+    const Value* b;
+    const Value* c; // null for MatMul and a Gemm without bias
+    const Value* y;
+    bool trans_a = false;
+    bool trans_b = false;
+    float alpha = 1.0f;
+    float beta = 1.0f;
+    LoopBound m = 1;
+    LoopBound n = 1;
+    LoopBound k = 1;
+};
+
+// the schedule options.tuning holds for op, the default one without a database or an entry
+ContractionSchedule ScheduleOf(const MlirEmitterOptions& options, const Operation& op);
+
+// a Conv's or an NchwcConv's operands and attributes, checked against each other; channel counts
+// are in channels for both
+struct ConvParams {
+    const Value* x;
+    const Value* w;
+    const Value* bias; // null without
+    const Value* y;
+    std::vector<int64_t> pads; // top, left, bottom, right
+    std::vector<int64_t> strides;
+    std::vector<int64_t> dilations;
+    int64_t group = 1;
+    int64_t channels_per_group = 0;
+    int64_t out_channels_per_group = 0;
+    int64_t kernel_h = 0;
+    int64_t kernel_w = 0;
+    // NchwcConv: channels per block of X, W and Y (see graph/layout.hpp); 0 for a Conv over NCHW
+    int64_t block = 0;
+};
+
+ConvParams ParseConv(const Operation& op);
+// the lowering conv gets: options.conv_algorithm where it applies, otherwise the one its shape favors.
+// Never kAuto
+ConvAlgorithm ChooseConvAlgorithm(const MlirEmitterOptions& options, const ConvParams& conv);
+// patches of one output row per slot: [slots, channels_per_group, kernel_h, kernel_w, out_w], where
+// the slots are the iterations of the loop a task splits among {n, group, out_h}, so concurrent
+// tasks never pack into the same one
+std::vector<int64_t> Im2colScratchShape(const ConvParams& conv);
+
+// [lo, hi) of the outputs along an axis whose input coordinate out * stride - pad + offset lies
+// inside [0, in_size); empty as lo >= hi
+std::pair<int64_t, int64_t> ReachableOutputs(int64_t in_size, int64_t out_size, int64_t pad, int64_t stride,
+                                             int64_t offset);
+// group == channels, so every output channel reads one input channel. Static shapes only, since
+// the output columns each kernel column reaches inside X are worked out at compile time
+bool IsDepthwiseConv(const ConvParams& conv);
+// 1x1 with unit strides and no padding, so Y[n, group] is W[group] times X[n, group] viewed as a
+// [channels_per_group, h * w] matrix
+bool IsPointwiseConv(const ConvParams& conv);
+
+// Winograd F(m x m, 3x3): Y = A^T [(G w G^T) . (B^T d B)] A over input tiles d of (m + 2)^2
+struct WinogradTransform {
+    int64_t tile; // m
+    std::vector<std::vector<double>> bt; // B^T, (m + 2) x (m + 2)
+    std::vector<std::vector<double>> at; // A^T, m x (m + 2)
+};
+
+// output tile size of the Winograd lowering of conv, 0 where it does not apply: a 3x3 kernel
+// with unit strides and dilations whose weights are an initializer
+int64_t WinogradTile(const ConvParams& conv);
+const WinogradTransform& WinogradTransformFor(int64_t tile);
+// G w G^T per output and input channel: [out_channels, channels_per_group, m + 2, m + 2]
+TensorData WinogradWeights(const ConvParams& conv);
+// name the transformed weights of conv are found under in the emitters' globals
+std::string WinogradWeightsKey(const ConvParams& conv);
+// [slots, channels_per_group + 1, m + 2, m + 2]: the transformed input tile per channel, then
+// the accumulator of one output channel, with slots as in Im2colScratchShape over the tiles
+std::vector<int64_t> WinogradScratchShape(const ConvParams& conv);
+// bytes of workspace scratch op needs while it runs, 0 for none
+int64_t ScratchBytesOf(const MlirEmitterOptions& options, const Operation& op);
+std::vector<int64_t> ScratchBytesOf(const MlirEmitterOptions& options, const std::vector<const Operation*>& operations);
+
+// where the size of a dynamic output dimension of an operation comes from: the operand's
+// dimension as is when stride is 0, (operand dimension + offset) / stride + 1 otherwise
+struct DimSource {
+    const Value* operand;
+    size_t axis;
+    int64_t offset = 0;
+    int64_t stride = 0;
+};
+
+// size of a dimension given the size of its source dimension
+int64_t SourcedDimSize(int64_t source_size, int64_t offset, int64_t stride);
+DimSource InferDimSource(const Operation& op, const Value& output, size_t axis);
+std::vector<DynamicDim> CollectDynamicDims(const std::vector<const Value*>& inputs);
+// throws unless every MlirEmitterOptions::specializations entry sizes all of dims
+void ValidateSpecializations(const std::vector<DynamicDim>& dims, const MlirEmitterOptions& options);
+
 float GetFloatAttr(const AttributeMap& attrs, const std::string& name, float default_value);
 int64_t GetIntAttr(const AttributeMap& attrs, const std::string& name, int64_t default_value);
 std::vector<int64_t> GetIntsAttr(const AttributeMap& attrs,
@@ -38,14 +178,14 @@ std::vector<int64_t> GetIntsAttr(const AttributeMap& attrs,
 
 class ModuleEmitter {
   public:
-    ModuleEmitter(const Graph& graph, MlirEmitterOptions options);
+    ModuleEmitter(const Graph& graph, MlirEmitterOptions options, hlp::OutputSink& out);
 
-    std::string Emit();
+    void Emit();
 
   private:
     const Graph& graph_;
     MlirEmitterOptions options_;
-    std::ostringstream out_;
+    hlp::OutputSink& out_;
     int indent_ = 0;
     size_t unique_id_ = 0;
     std::unordered_map<std::string, std::string> value_refs_;
@@ -55,7 +195,25 @@ class ModuleEmitter {
     std::vector<const Value*> initializers_;
     std::vector<const Value*> temporaries_;
     std::vector<const Operation*> operations_;
+    WorkspaceLayout workspace_;
+    std::string workspace_ref_;
+    std::vector<DynamicDim> dims_;
+    bool dynamic_ = false;
+    // index SSA values of the dynamic dimensions of the function being emitted, per value and axis
+    std::unordered_map<std::string, std::vector<std::string>> dim_refs_;
+    std::unordered_map<std::string, std::string> dynamic_offsets_;
+    std::string dims_ref_;
+
+    // [lo, hi) index SSA values replacing the bounds of the next top-level loop nest's split loop
+    struct SplitLoop {
+        std::string lo;
+        std::string hi;
+        size_t dim = 0;
+    };
+    std::optional<SplitLoop> pending_split_;
+    LoopBound split_bound_ = 1;
 
+    void EmitIndent();
     void EmitLine(const std::string& line = {});
     std::string NewSsa(std::string_view hint);
     std::string NewSymbol(std::string_view hint);
@@ -65,10 +223,52 @@ class ModuleEmitter {
     std::string ElemType(const Value& value) const;
     const std::vector<int64_t>& ShapeOf(const Value& value) const;
     std::string RefOf(const Value& value) const;
+    std::string ArgType(const Value& value) const;
+    std::string DimsType() const;
+    std::string WorkspaceType() const;
+    static std::string Join(const std::vector<std::string>& items);
     static std::string JoinNames(const std::vector<const Value*>& values);
 
+    void Collect();
     void EmitGlobals();
+    void EmitGlobal(const std::string& symbol, const TensorData& data);
+    // constants the lowering of operations derives from initializers, e.g. WinogradWeights
+    void EmitDerivedGlobals();
+    void EmitEntryFunctions();
+    std::vector<std::string> BindArguments();
+    void BindInputDims();
+    void BindDims();
+    void CastDynamicArguments();
+    std::string EmitDynamicWorkspace();
+    void BindStorage();
     void EmitFunction();
+    void EmitWorkspaceSizeFunction();
+    void EmitTaskFunctions();
+    void EmitProfileHookDecls();
+    // calls hook with the op's index in graph order (MlirEmitterOptions::instrument)
+    void EmitProfileHook(std::string_view hook, size_t op_index);
+    // value emits the body and returns the i64 result; takes_dims adds the dims array argument
+    void EmitI64Function(const std::string& symbol, bool takes_dims, const std::function<std::string()>& value);
+    std::string EmitI64Const(int64_t value);
+    std::string EmitIndexToI64(const std::string& index);
+
+    void EmitSpecialized();
+    std::string EmitVariantIndex();
+    // scf.index_switch on index: case k emits variant k through body, the default the generic
+    // code (body(count)); body returns the value to yield unless result_type is empty
+    std::string EmitVariantSwitch(const std::string& index, const std::string& result_type,
+                                  const std::function<std::string(size_t)>& body);
+    void EmitVariantCall(const ModuleEmitter& variant, const std::string& symbol,
+                         const std::vector<std::string>& trailing_i64);
+    std::string EmitVariantI64Call(const ModuleEmitter& variant, const std::string& symbol);
+
+    std::string& DimSlot(const Value& value, size_t axis);
+    std::string DimRef(const Value& value, size_t axis);
+    std::string BoundRef(const LoopBound& bound);
+    std::vector<std::string> DynamicSizes(const Value& value);
+    std::string EmitIndexBinary(std::string_view op, const std::string& lhs, const std::string& rhs, std::string_view hint);
+    // 0 <= coord < bound, as an i1
+    std::string EmitInRange(const std::string& coord, const LoopBound& bound, std::string_view hint);
 
     std::string EmitIndexConst(int64_t value);
     std::string EmitNumericConst(TensorElemType elem_type, double value);
@@ -89,10 +289,23 @@ class ModuleEmitter {
     std::vector<std::string> BroadcastIndices(const Value& src,
                                               const Value& dst,
                                               const std::vector<std::string>& dst_indices);
-    void EmitLoopNest(const std::vector<int64_t>& shape,
+    void EmitLoopNest(const std::vector<LoopBound>& bounds,
                       size_t dim,
                       std::vector<std::string>& indices,
                       const std::function<void(const std::vector<std::string>&)>& body);
+    void EmitLoopNestImpl(const std::vector<LoopBound>& bounds,
+                          size_t dim,
+                          std::vector<std::string>& indices,
+                          const std::function<void(const std::vector<std::string>&)>& body,
+                          const SplitLoop* split);
+
+    // loop over [lb, ub) in steps of tile, calling body with the [lo, hi) of every tile;
+    // for tile 0 no loop is emitted and body gets [lb, ub) itself
+    void EmitTileLoop(const std::string& lb,
+                      const std::string& ub,
+                      int64_t tile,
+                      const std::function<void(const std::string&, const std::string&)>& body);
+    void EmitRangeLoop(const std::string& lb, const std::string& ub, const std::function<void(const std::string&)>& body);
 
     std::string EmitAddLike(const std::string& lhs,
                             const std::string& rhs,
@@ -103,12 +316,41 @@ class ModuleEmitter {
                             TensorElemType elem_type,
                             std::string_view hint);
 
+    // alpha * acc + beta * C[ij]
+    std::string EmitContractionEpilogue(const Contraction& contraction, std::string acc, const std::vector<std::string>& ij);
+    void EmitScheduledContraction(const Contraction& contraction, const ContractionSchedule& schedule);
+
     void EmitElementwiseBinary(const Operation& op, bool is_add);
     void EmitRelu(const Operation& op);
     void EmitMatMul(const Operation& op);
     void EmitTranspose(const Operation& op);
+    // ReorderInput and ReorderOutput: one loop nest over the blocked side
+    void EmitReorder(const Operation& op);
     void EmitGemm(const Operation& op);
     void EmitConv(const Operation& op);
+    // lhs / rhs rounded down or up, for a positive constant rhs
+    std::string EmitIndexDiv(const std::string& lhs, int64_t rhs, bool ceil, std::string_view hint);
+    // [ow_lo, ow_hi): the output columns all of whose kernel taps read inside X, between the
+    // border strips; clamped so [0, ow_lo), [ow_lo, ow_hi) and [ow_hi, out_w) tile the row
+    std::pair<std::string, std::string> EmitConvInteriorColumns(const ConvParams& conv);
+    // for output row oh: oh * stride - pad, and the kernel rows [r_lo, r_hi) whose input rows lie inside X
+    struct ConvRows {
+        std::string ih_base;
+        std::string r_lo;
+        std::string r_hi;
+    };
+    ConvRows EmitConvKernelRows(const ConvParams& conv, const std::string& oh);
+    void EmitDirectConv(const ConvParams& conv);
+    void EmitNchwcConv(const ConvParams& conv);
+    void EmitIm2colConv(const Operation& op, const ConvParams& conv);
+    void EmitWinogradConv(const Operation& op, const ConvParams& conv);
+    void EmitDepthwiseConv(const ConvParams& conv);
+    void EmitPointwiseConv(const ConvParams& conv);
+    // sum of coef * term, skipping zero coefficients and multiplying by none of +-1
+    std::string EmitLinearCombination(const std::vector<double>& coefs,
+                                      const std::vector<std::string>& terms,
+                                      TensorElemType elem_type,
+                                      std::string_view hint);
     void EmitOperation(const Operation& op);
 };
 
@@ -16,16 +16,22 @@ void ModuleEmitter::EmitMatMul(const Operation& op) {
     if (a_type.Shape().size() != 2 || b_type.Shape().size() != 2 || y_type.Shape().size() != 2) {
         Fail(op.Name() + ": MatMul currently supports rank-2 tensors only");
     }
-    if (a_type.Shape()[1] != b_type.Shape()[0]) {
+    if (DimsConflict(a_type.Shape()[1], b_type.Shape()[0])) {
         Fail(op.Name() + ": incompatible MatMul inner dimensions");
     }
     if (!IsFloatType(y_type.ElemType()) && y_type.ElemType() != TensorElemType::kInt32 && y_type.ElemType() != TensorElemType::kInt64) {
         Fail(op.Name() + ": unsupported MatMul element type");
     }
 
-    const int64_t m = y_type.Shape()[0];
-    const int64_t n = y_type.Shape()[1];
-    const int64_t k = a_type.Shape()[1];
+    const LoopBound m{y, 0};
+    const LoopBound n{y, 1};
+    const LoopBound k{a, 1};
+    const ContractionSchedule schedule = ScheduleOf(options_, op);
+    if (!schedule.IsDefault()) {
+        EmitScheduledContraction(Contraction{&a, &b, nullptr, &y, false, false, 1.0f, 1.0f, m, n, k}, schedule);
+        return;
+    }
+
     const std::string scalar_memref_type = "memref<" + ElemTypeToMlir(y_type.ElemType()) + ">";
 
     std::vector<std::string> outer_indices;
@@ -84,7 +90,7 @@ void ModuleEmitter::EmitTranspose(const Operation& op) {
     }
 
     std::vector<std::string> indices;
-    EmitLoopNest(ShapeOf(output), 0, indices, [&](const std::vector<std::string>& out_indices) {
+    EmitLoopNest(BoundsOf(output), 0, indices, [&](const std::vector<std::string>& out_indices) {
         std::vector<std::string> in_indices(rank);
         for (size_t src_axis = 0; src_axis < rank; ++src_axis) {
             in_indices[src_axis] = out_indices[inverse_perm[src_axis]];
@@ -94,6 +100,33 @@ void ModuleEmitter::EmitTranspose(const Operation& op) {
     });
 }
 
+void ModuleEmitter::EmitReorder(const Operation& op) {
+    if (op.Inputs().size() != 1 || op.Outputs().size() != 1) {
+        Fail(op.Name() + ": expected 1 input and 1 output");
+    }
+
+    const bool to_blocked = op.Type() == Operation::OpType::kReorderInput;
+    const Value& plain = to_blocked ? *op.Inputs()[0] : *op.Outputs()[0];
+    const Value& blocked = to_blocked ? *op.Outputs()[0] : *op.Inputs()[0];
+    const std::vector<int64_t>& blocked_shape = ShapeOf(blocked);
+    if (ShapeOf(plain).size() != 4 || blocked_shape.size() != 5 || blocked_shape[4] <= 0 ||
+        DimsConflict(ShapeOf(plain)[1], blocked_shape[1] * blocked_shape[4])) {
+        Fail(op.Name() + ": expected [N, C, H, W] and [N, C / b, H, W, b]");
+    }
+
+    std::vector<std::string> indices;
+    EmitLoopNest(BoundsOf(blocked), 0, indices, [&](const std::vector<std::string>& ivs) {
+        // c = c_block * b + lane
+        const std::string c_base = EmitIndexBinary("muli", ivs[1], EmitIndexConst(blocked_shape[4]), "c_base");
+        const std::vector<std::string> plain_indices{ivs[0], EmitIndexBinary("addi", c_base, ivs[4], "c"), ivs[2], ivs[3]};
+        if (to_blocked) {
+            EmitStoreValue(EmitLoadValue(plain, plain_indices, "reorder_in"), blocked, ivs);
+        } else {
+            EmitStoreValue(EmitLoadValue(blocked, ivs, "reorder_in"), plain, plain_indices);
+        }
+    });
+}
+
 void ModuleEmitter::EmitGemm(const Operation& op) {
     if ((op.Inputs().size() != 2 && op.Inputs().size() != 3) || op.Outputs().size() != 1) {
         Fail(op.Name() + ": expected 2 or 3 inputs and 1 output");
@@ -119,17 +152,24 @@ void ModuleEmitter::EmitGemm(const Operation& op) {
     const float alpha = GetFloatAttr(op.Attrs(), "alpha", 1.0f);
     const float beta = GetFloatAttr(op.Attrs(), "beta", 1.0f);
 
-    const int64_t a_m = trans_a ? a_type.Shape()[1] : a_type.Shape()[0];
-    const int64_t a_k = trans_a ? a_type.Shape()[0] : a_type.Shape()[1];
-    const int64_t b_k = trans_b ? b_type.Shape()[1] : b_type.Shape()[0];
-    const int64_t b_n = trans_b ? b_type.Shape()[0] : b_type.Shape()[1];
-    if (a_k != b_k) {
+    const LoopBound a_m{a, trans_a ? 1u : 0u};
+    const LoopBound a_k{a, trans_a ? 0u : 1u};
+    const LoopBound b_k{b, trans_b ? 1u : 0u};
+    const LoopBound b_n{b, trans_b ? 0u : 1u};
+    if (DimsConflict(a_k.size, b_k.size)) {
         Fail(op.Name() + ": Gemm inner dimensions mismatch");
     }
-    if (y_type.Shape()[0] != a_m || y_type.Shape()[1] != b_n) {
+    if (DimsConflict(y_type.Shape()[0], a_m.size) || DimsConflict(y_type.Shape()[1], b_n.size)) {
         Fail(op.Name() + ": Gemm output shape mismatch");
     }
 
+    const Contraction contraction{&a, &b, c, &y, trans_a != 0, trans_b != 0, alpha, beta, a_m, b_n, a_k};
+    const ContractionSchedule schedule = ScheduleOf(options_, op);
+    if (!schedule.IsDefault()) {
+        EmitScheduledContraction(contraction, schedule);
+        return;
+    }
+
     const std::string scalar_memref_type = "memref<" + ElemTypeToMlir(y_type.ElemType()) + ">";
     std::vector<std::string> outer_indices;
     EmitLoopNest({a_m, b_n}, 0, outer_indices, [&](const std::vector<std::string>& ij) {
@@ -150,22 +190,112 @@ void ModuleEmitter::EmitGemm(const Operation& op) {
             EmitStoreRaw(next, acc_buf, scalar_memref_type, {});
         });
 
-        std::string result = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "gemm_acc");
-        if (alpha != 1.0f) {
-            const std::string alpha_cst = EmitNumericConst(y_type.ElemType(), alpha);
-            result = EmitMulLike(result, alpha_cst, y_type.ElemType(), "alpha_scaled");
-        }
+        const std::string result = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "gemm_acc");
+        EmitStoreValue(EmitContractionEpilogue(contraction, result, ij), y, ij);
+    });
+}
+
+std::string ModuleEmitter::EmitContractionEpilogue(const Contraction& contraction,
+                                                   std::string acc,
+                                                   const std::vector<std::string>& ij) {
+    const TensorElemType elem_type = RequireTensorType(*contraction.y).ElemType();
+    if (contraction.alpha != 1.0f) {
+        const std::string alpha_cst = EmitNumericConst(elem_type, contraction.alpha);
+        acc = EmitMulLike(acc, alpha_cst, elem_type, "alpha_scaled");
+    }
 
-        if (c != nullptr) {
-            std::string c_value = EmitLoadValue(*c, BroadcastIndices(*c, y, ij), "c_bias");
-            if (beta != 1.0f) {
-                const std::string beta_cst = EmitNumericConst(y_type.ElemType(), beta);
-                c_value = EmitMulLike(c_value, beta_cst, y_type.ElemType(), "beta_scaled");
-            }
-            result = EmitAddLike(result, c_value, y_type.ElemType(), "gemm_out");
+    if (contraction.c != nullptr) {
+        std::string c_value = EmitLoadValue(*contraction.c, BroadcastIndices(*contraction.c, *contraction.y, ij), "c_bias");
+        if (contraction.beta != 1.0f) {
+            const std::string beta_cst = EmitNumericConst(elem_type, contraction.beta);
+            c_value = EmitMulLike(c_value, beta_cst, elem_type, "beta_scaled");
         }
+        acc = EmitAddLike(acc, c_value, elem_type, "gemm_out");
+    }
+    return acc;
+}
+
+void ModuleEmitter::EmitScheduledContraction(const Contraction& contraction, const ContractionSchedule& schedule) {
+    if (schedule.tile_k != 0 && schedule.order != ContractionSchedule::Order::kMkn) {
+        Fail("tiling the reduction of a contraction needs the mkn loop order");
+    }
+    const Contraction& c = contraction;
+    const TensorElemType elem_type = RequireTensorType(*c.y).ElemType();
+    auto a_index = [&](const std::string& i, const std::string& kk) {
+        return c.trans_a ? std::vector<std::string>{kk, i} : std::vector<std::string>{i, kk};
+    };
+    auto b_index = [&](const std::string& kk, const std::string& j) {
+        return c.trans_b ? std::vector<std::string>{j, kk} : std::vector<std::string>{kk, j};
+    };
 
-        EmitStoreValue(result, y, ij);
+    // a task runs the [lo, hi) of the same loop the default nest would split, and every tile of it
+    std::optional<SplitLoop> split = std::exchange(pending_split_, std::nullopt);
+    if (split.has_value()) {
+        split->dim = ParallelSplitDim({c.m, c.n});
+        split_bound_ = split->dim == 0 ? c.m : c.n;
+    }
+    const bool split_m = split.has_value() && split->dim == 0;
+    const bool split_n = split.has_value() && split->dim == 1;
+    const std::string m_lo = split_m ? split->lo : EmitIndexConst(0);
+    const std::string m_hi = split_m ? split->hi : BoundRef(c.m);
+    const std::string n_lo = split_n ? split->lo : EmitIndexConst(0);
+    const std::string n_hi = split_n ? split->hi : BoundRef(c.n);
+
+    if (schedule.order == ContractionSchedule::Order::kMnk) {
+        const std::string scalar_memref_type = "memref<" + ElemTypeToMlir(elem_type) + ">";
+        EmitTileLoop(m_lo, m_hi, schedule.tile_m, [&](const std::string& i_lo, const std::string& i_hi) {
+            EmitTileLoop(n_lo, n_hi, schedule.tile_n, [&](const std::string& j_lo, const std::string& j_hi) {
+                EmitRangeLoop(i_lo, i_hi, [&](const std::string& i) {
+                    EmitRangeLoop(j_lo, j_hi, [&](const std::string& j) {
+                        const std::string acc_buf = NewSsa("acc");
+                        EmitLine(acc_buf + " = memref.alloca() : " + scalar_memref_type);
+                        EmitStoreRaw(EmitNumericConst(elem_type, 0.0), acc_buf, scalar_memref_type, {});
+                        EmitRangeLoop(EmitIndexConst(0), BoundRef(c.k), [&](const std::string& kk) {
+                            const std::string lhs = EmitLoadValue(*c.a, a_index(i, kk), "a");
+                            const std::string rhs = EmitLoadValue(*c.b, b_index(kk, j), "b");
+                            const std::string prod = EmitMulLike(lhs, rhs, elem_type, "prod");
+                            const std::string cur = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "cur");
+                            EmitStoreRaw(EmitAddLike(cur, prod, elem_type, "sum"), acc_buf, scalar_memref_type, {});
+                        });
+                        const std::string result = EmitLoadRaw(acc_buf, scalar_memref_type, {}, "final");
+                        EmitStoreValue(EmitContractionEpilogue(c, result, {i, j}), *c.y, {i, j});
+                    });
+                });
+            });
+        });
+        return;
+    }
+
+    // mkn: Y holds the partial sums, so it is zeroed first and scaled / biased after the last k tile
+    EmitTileLoop(m_lo, m_hi, schedule.tile_m, [&](const std::string& i_lo, const std::string& i_hi) {
+        EmitRangeLoop(i_lo, i_hi, [&](const std::string& i) {
+            EmitRangeLoop(n_lo, n_hi, [&](const std::string& j) {
+                EmitStoreValue(EmitNumericConst(elem_type, 0.0), *c.y, {i, j});
+            });
+        });
+        EmitTileLoop(EmitIndexConst(0), BoundRef(c.k), schedule.tile_k, [&](const std::string& k_lo, const std::string& k_hi) {
+            EmitTileLoop(n_lo, n_hi, schedule.tile_n, [&](const std::string& j_lo, const std::string& j_hi) {
+                EmitRangeLoop(i_lo, i_hi, [&](const std::string& i) {
+                    EmitRangeLoop(k_lo, k_hi, [&](const std::string& kk) {
+                        const std::string lhs = EmitLoadValue(*c.a, a_index(i, kk), "a");
+                        EmitRangeLoop(j_lo, j_hi, [&](const std::string& j) {
+                            const std::string rhs = EmitLoadValue(*c.b, b_index(kk, j), "b");
+                            const std::string prod = EmitMulLike(lhs, rhs, elem_type, "prod");
+                            const std::string cur = EmitLoadValue(*c.y, {i, j}, "cur");
+                            EmitStoreValue(EmitAddLike(cur, prod, elem_type, "sum"), *c.y, {i, j});
+                        });
+                    });
+                });
+            });
+        });
+        if (c.alpha != 1.0f || c.c != nullptr) {
+            EmitRangeLoop(i_lo, i_hi, [&](const std::string& i) {
+                EmitRangeLoop(n_lo, n_hi, [&](const std::string& j) {
+                    const std::string acc = EmitLoadValue(*c.y, {i, j}, "final");
+                    EmitStoreValue(EmitContractionEpilogue(c, acc, {i, j}), *c.y, {i, j});
+                });
+            });
+        }
     });
 }
 
@@ -1,11 +1,42 @@
 #include "mlir_backend_internal.hpp"
 
+#include <algorithm>
+#include <memory>
+
 namespace tc::detail {
 
-ModuleEmitter::ModuleEmitter(const Graph& graph, MlirEmitterOptions options)
-    : graph_{graph}, options_{std::move(options)} {}
+ModuleEmitter::ModuleEmitter(const Graph& graph, MlirEmitterOptions options, hlp::OutputSink& out)
+    : graph_{graph}, options_{std::move(options)}, out_{out} {}
+
+void ModuleEmitter::Emit() {
+    Collect();
+    ValidateSpecializations(dims_, options_);
+
+    out_ << "module {\n";
+    ++indent_;
+    {
+        // mostly the DenseElementsAttr literals of the initializers
+        const hlp::ScopedPhase phase{"emit globals"};
+        EmitGlobals();
+        EmitDerivedGlobals();
+    }
+    if (options_.instrument) {
+        EmitProfileHookDecls();
+    }
+    {
+        const hlp::ScopedPhase phase{"emit functions"};
+        if (options_.specializations.empty()) {
+            EmitEntryFunctions();
+        } else {
+            EmitSpecialized();
+        }
+    }
+    --indent_;
+    out_ << "}\n";
+    out_.Flush();
+}
 
-std::string ModuleEmitter::Emit() {
+void ModuleEmitter::Collect() {
     inputs_ = CollectValuesByBelong(graph_, Value::BelongTo::kInput);
     outputs_ = CollectValuesByBelong(graph_, Value::BelongTo::kOutput);
     initializers_ = CollectValuesByBelong(graph_, Value::BelongTo::kInitializer);
@@ -13,18 +44,39 @@ std::string ModuleEmitter::Emit() {
     operations_ = CollectOperations(graph_);
 
     ValidateGraph();
+    if (options_.use_workspace) {
+        workspace_ = PlanWorkspace(temporaries_, operations_, ScratchBytesOf(options_, operations_));
+    }
+    dims_ = CollectDynamicDims(inputs_);
+    for (const std::vector<const Value*>* values : {&inputs_, &outputs_, &temporaries_}) {
+        for (const Value* value : *values) {
+            dynamic_ = dynamic_ || HasDynamicShape(RequireTensorType(*value));
+        }
+    }
+}
 
-    out_ << "module {\n";
-    ++indent_;
-    EmitGlobals();
+void ModuleEmitter::EmitEntryFunctions() {
     EmitFunction();
-    --indent_;
-    out_ << "}\n";
-    return out_.str();
+    if (options_.use_workspace) {
+        EmitWorkspaceSizeFunction();
+    }
+    if (options_.use_workspace && options_.emit_tasks) {
+        EmitTaskFunctions();
+    }
+}
+
+void ModuleEmitter::EmitIndent() {
+    static constexpr std::string_view kSpaces = "                                ";
+    for (size_t n = static_cast<size_t>(indent_ * 2); n != 0;) {
+        const size_t chunk = std::min(n, kSpaces.size());
+        out_ << kSpaces.substr(0, chunk);
+        n -= chunk;
+    }
 }
 
 void ModuleEmitter::EmitLine(const std::string& line) {
-    out_ << std::string(static_cast<size_t>(indent_ * 2), ' ') << line << '\n';
+    EmitIndent();
+    out_ << line << '\n';
 }
 
 std::string ModuleEmitter::NewSsa(std::string_view hint) {
@@ -36,29 +88,7 @@ std::string ModuleEmitter::NewSymbol(std::string_view hint) {
 }
 
 void ModuleEmitter::ValidateGraph() const {
-    auto validate_value = [](const Value* value) {
-        const TensorType& type = RequireTensorType(*value);
-        (void)MemRefTypeToMlir(type);
-    };
-
-    for (const Value* value : inputs_) {
-        validate_value(value);
-    }
-    for (const Value* value : outputs_) {
-        validate_value(value);
-    }
-    for (const Value* value : initializers_) {
-        validate_value(value);
-        if (!value->HasInitializerData()) {
-            Fail("initializer value '" + value->Name() + "' has no payload");
-        }
-    }
-    for (const Value* value : temporaries_) {
-        validate_value(value);
-    }
-    if (outputs_.empty()) {
-        Fail("graph has no outputs");
-    }
+    ValidateGraphValues(inputs_, outputs_, initializers_, temporaries_);
 }
 
 std::string ModuleEmitter::MemRefType(const Value& value) const {
@@ -81,6 +111,84 @@ std::string ModuleEmitter::RefOf(const Value& value) const {
     return it->second;
 }
 
+// dynamically shaped tensors cross the bare-pointer ABI as base pointers of a static type
+std::string ModuleEmitter::ArgType(const Value& value) const {
+    const TensorType& type = RequireTensorType(value);
+    if (options_.use_workspace && HasDynamicShape(type)) {
+        return "memref<1x" + ElemTypeToMlir(type.ElemType()) + ">";
+    }
+    return MemRefTypeToMlir(type);
+}
+
+std::string ModuleEmitter::DimsType() const {
+    return "memref<" + std::to_string(dims_.size()) + "xi64>";
+}
+
+std::string ModuleEmitter::WorkspaceType() const {
+    return workspace_.dynamic.empty() ? "memref<" + std::to_string(workspace_.size) + "xi8>" : "memref<?xi8>";
+}
+
+std::string& ModuleEmitter::DimSlot(const Value& value, size_t axis) {
+    std::vector<std::string>& refs = dim_refs_[value.Name()];
+    refs.resize(ShapeOf(value).size());
+    return refs[axis];
+}
+
+std::string ModuleEmitter::DimRef(const Value& value, size_t axis) {
+    const int64_t size = ShapeOf(value).at(axis);
+    if (size >= 0) {
+        return EmitIndexConst(size);
+    }
+    const std::string& ref = DimSlot(value, axis);
+    if (ref.empty()) {
+        Fail("size of dimension " + std::to_string(axis) + " of '" + value.Name() + "' is unknown");
+    }
+    return ref;
+}
+
+std::string ModuleEmitter::BoundRef(const LoopBound& bound) {
+    return bound.IsDynamic() ? DimRef(*bound.value, bound.axis) : EmitIndexConst(bound.size);
+}
+
+// operands of memref.alloc / memref.view for the dynamic dimensions of value
+std::vector<std::string> ModuleEmitter::DynamicSizes(const Value& value) {
+    std::vector<std::string> sizes;
+    for (size_t axis = 0; axis < ShapeOf(value).size(); ++axis) {
+        if (ShapeOf(value)[axis] < 0) {
+            sizes.push_back(DimRef(value, axis));
+        }
+    }
+    return sizes;
+}
+
+std::string ModuleEmitter::EmitIndexBinary(std::string_view op, const std::string& lhs, const std::string& rhs,
+                                           std::string_view hint) {
+    const std::string name = NewSsa(hint);
+    EmitLine(name + " = arith." + std::string{op} + " " + lhs + ", " + rhs + " : index");
+    return name;
+}
+
+std::string ModuleEmitter::EmitInRange(const std::string& coord, const LoopBound& bound, std::string_view hint) {
+    const std::string ge = NewSsa(std::string{hint} + "_ge_0");
+    EmitLine(ge + " = arith.cmpi sge, " + coord + ", " + EmitIndexConst(0) + " : index");
+    const std::string lt = NewSsa(std::string{hint} + "_lt");
+    EmitLine(lt + " = arith.cmpi slt, " + coord + ", " + BoundRef(bound) + " : index");
+    const std::string both = NewSsa(hint);
+    EmitLine(both + " = arith.andi " + ge + ", " + lt + " : i1");
+    return both;
+}
+
+std::string ModuleEmitter::Join(const std::vector<std::string>& items) {
+    std::string out;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i != 0) {
+            out += ", ";
+        }
+        out += items[i];
+    }
+    return out;
+}
+
 std::string ModuleEmitter::JoinNames(const std::vector<const Value*>& values) {
     std::string out;
     for (size_t i = 0; i < values.size(); ++i) {
@@ -92,48 +200,179 @@ std::string ModuleEmitter::JoinNames(const std::vector<const Value*>& values) {
     return out;
 }
 
+void ModuleEmitter::EmitGlobal(const std::string& symbol, const TensorData& data) {
+    EmitIndent();
+    out_ << "memref.global \"private\" constant " << symbol << " : " << MemRefTypeToMlir(data.type) << " = ";
+    WriteDenseLiteral(out_, data);
+    out_ << '\n';
+}
+
 void ModuleEmitter::EmitGlobals() {
     for (const Value* value : initializers_) {
         const std::string symbol = NewSymbol(value->Name());
         global_refs_.emplace(value->Name(), symbol);
-        const TensorData& data = *value->InitializerData();
-        EmitLine("memref.global \"private\" constant " + symbol + " : " + MemRefType(*value) + " = " + DenseLiteral(data));
+        EmitGlobal(symbol, *value->InitializerData());
     }
     if (!initializers_.empty()) {
         EmitLine();
     }
 }
 
-void ModuleEmitter::EmitFunction() {
+// constants the lowerings compute from initializers at compile time, named after the initializer's
+// global so that the variants of a specialized module share them
+void ModuleEmitter::EmitDerivedGlobals() {
+    bool emitted = false;
+    for (const Operation* op : operations_) {
+        if (op->Type() != Operation::OpType::kConv) {
+            continue;
+        }
+        const ConvParams conv = ParseConv(*op);
+        const std::string key = WinogradWeightsKey(conv);
+        if (ChooseConvAlgorithm(options_, conv) != ConvAlgorithm::kWinograd || global_refs_.contains(key)) {
+            continue;
+        }
+        const std::string symbol = global_refs_.at(conv.w->Name()) + "_winograd" + std::to_string(WinogradTile(conv));
+        global_refs_.emplace(key, symbol);
+        EmitGlobal(symbol, WinogradWeights(conv));
+        emitted = true;
+    }
+    if (emitted) {
+        EmitLine();
+    }
+}
+
+// binds the entry arguments (inputs, outputs, workspace) of the function about to be emitted
+std::vector<std::string> ModuleEmitter::BindArguments() {
     std::vector<std::string> args;
     for (const Value* value : inputs_) {
         const std::string arg_name = NewSsa("arg_" + value->Name());
         value_refs_[value->Name()] = arg_name;
-        args.push_back(arg_name + ": " + MemRefType(*value));
+        args.push_back(arg_name + ": " + ArgType(*value));
     }
     for (const Value* value : outputs_) {
         const std::string arg_name = NewSsa("out_" + value->Name());
         value_refs_[value->Name()] = arg_name;
-        args.push_back(arg_name + ": " + MemRefType(*value));
+        args.push_back(arg_name + ": " + ArgType(*value));
     }
+    if (options_.use_workspace) {
+        workspace_ref_ = NewSsa("workspace");
+        args.push_back(workspace_ref_ + ": memref<" + std::to_string(workspace_.size) + "xi8>");
+        if (!dims_.empty()) {
+            dims_ref_ = NewSsa("dims");
+            args.push_back(dims_ref_ + ": " + DimsType());
+        }
+    }
+    return args;
+}
 
-    std::string signature;
-    for (size_t i = 0; i < args.size(); ++i) {
-        if (i != 0) {
-            signature += ", ";
+// sizes of the dynamic input dimensions
+void ModuleEmitter::BindInputDims() {
+    dim_refs_.clear();
+    for (size_t i = 0; i < dims_.size(); ++i) {
+        const DynamicDim& dim = dims_[i];
+        const std::string size = NewSsa("dim");
+        if (options_.use_workspace) {
+            const std::string raw = EmitLoadRaw(dims_ref_, DimsType(), {EmitIndexConst(static_cast<int64_t>(i))}, "dim_raw");
+            EmitLine(size + " = arith.index_cast " + raw + " : i64 to index");
+        } else {
+            const std::string axis = EmitIndexConst(static_cast<int64_t>(dim.axis));
+            EmitLine(size + " = memref.dim " + RefOf(*dim.input) + ", " + axis + " : " + MemRefType(*dim.input));
         }
-        signature += args[i];
+        DimSlot(*dim.input, dim.axis) = size;
     }
+}
 
-    EmitLine("func.func @" + SanitizeIdentifier(options_.entry_name, "entry") + "(" + signature + ") {");
-    ++indent_;
-    EmitLine("// graph inputs: " + JoinNames(inputs_));
-    EmitLine("// graph outputs: " + JoinNames(outputs_));
-    if (!initializers_.empty()) {
-        EmitLine("// initializers: " + JoinNames(initializers_));
+// sizes of the dynamic input dimensions, then of every dynamic operation output in graph order
+void ModuleEmitter::BindDims() {
+    BindInputDims();
+    for (const Operation* op : operations_) {
+        for (const Value* output : op->Outputs()) {
+            for (size_t axis = 0; axis < ShapeOf(*output).size(); ++axis) {
+                if (ShapeOf(*output)[axis] >= 0) {
+                    continue;
+                }
+                const DimSource source = InferDimSource(*op, *output, axis);
+                std::string size = DimRef(*source.operand, source.axis);
+                if (source.stride != 0) {
+                    size = EmitIndexBinary("addi", size, EmitIndexConst(source.offset), "dim_sum");
+                    size = EmitIndexBinary("divsi", size, EmitIndexConst(source.stride), "dim_div");
+                    size = EmitIndexBinary("addi", size, EmitIndexConst(1), "dim");
+                }
+                DimSlot(*output, axis) = size;
+            }
+        }
     }
-    EmitLine();
+}
+
+// views the base pointers of dynamically shaped arguments (and the workspace) with their run-time sizes
+void ModuleEmitter::CastDynamicArguments() {
+    for (const std::vector<const Value*>* values : {&inputs_, &outputs_}) {
+        for (const Value* value : *values) {
+            const std::vector<int64_t>& shape = ShapeOf(*value);
+            if (!HasDynamicShape(RequireTensorType(*value))) {
+                continue;
+            }
+
+            // row-major strides stay literals up to the innermost dynamic dimension
+            std::vector<std::string> strides(shape.size());
+            int64_t static_stride = 1;
+            std::string stride_ref;
+            for (size_t axis = shape.size(); axis-- > 0;) {
+                strides[axis] = stride_ref.empty() ? std::to_string(static_stride) : stride_ref;
+                if (axis == 0) {
+                    break;
+                }
+                if (shape[axis] >= 0 && stride_ref.empty()) {
+                    static_stride *= shape[axis];
+                    continue;
+                }
+                const std::string lhs = stride_ref.empty() ? EmitIndexConst(static_stride) : stride_ref;
+                stride_ref = EmitIndexBinary("muli", lhs, DimRef(*value, axis), "stride");
+            }
+
+            std::string sizes;
+            std::string stride_list;
+            for (size_t axis = 0; axis < shape.size(); ++axis) {
+                sizes += (axis != 0 ? ", " : "") + (shape[axis] < 0 ? DimRef(*value, axis) : std::to_string(shape[axis]));
+                stride_list += (axis != 0 ? ", " : "") + strides[axis];
+            }
+            const std::string ssa = NewSsa("dyn_" + value->Name());
+            EmitLine(ssa + " = memref.reinterpret_cast " + RefOf(*value) + " to offset: [0], sizes: [" + sizes +
+                     "], strides: [" + stride_list + "] : " + ArgType(*value) + " to " + MemRefType(*value));
+            value_refs_[value->Name()] = ssa;
+        }
+    }
+
+    if (!workspace_.dynamic.empty()) {
+        const std::string total = EmitDynamicWorkspace();
+        const std::string ssa = NewSsa("dyn_workspace");
+        EmitLine(ssa + " = memref.reinterpret_cast " + workspace_ref_ + " to offset: [0], sizes: [" + total +
+                 "], strides: [1] : memref<" + std::to_string(workspace_.size) + "xi8> to " + WorkspaceType());
+        workspace_ref_ = ssa;
+    }
+}
+
+// offsets of the dynamically shaped temporaries behind the static part; returns the total size
+std::string ModuleEmitter::EmitDynamicWorkspace() {
+    constexpr int64_t kAlign = WorkspaceLayout::kAlignment;
+    std::string end = EmitIndexConst(workspace_.size);
+    for (const Value* value : workspace_.dynamic) {
+        dynamic_offsets_[value->Name()] = end;
+        const TensorType& type = RequireTensorType(*value);
+        std::string bytes = EmitIndexConst(static_cast<int64_t>(TensorType::ElemSizeInBytes(type.ElemType())));
+        for (size_t axis = 0; axis < type.Shape().size(); ++axis) {
+            bytes = EmitIndexBinary("muli", bytes, DimRef(*value, axis), "bytes");
+        }
+        const std::string padded = EmitIndexBinary("addi", bytes, EmitIndexConst(kAlign - 1), "padded");
+        const std::string blocks = EmitIndexBinary("divui", padded, EmitIndexConst(kAlign), "blocks");
+        const std::string aligned = EmitIndexBinary("muli", blocks, EmitIndexConst(kAlign), "aligned");
+        end = EmitIndexBinary("addi", end, aligned, "end");
+    }
+    return end;
+}
 
+// binds initializers and temporaries inside the function body
+void ModuleEmitter::BindStorage() {
     for (const Value* value : initializers_) {
         const std::string ssa = NewSsa("init_" + value->Name());
         value_refs_[value->Name()] = ssa;
@@ -144,30 +383,353 @@ void ModuleEmitter::EmitFunction() {
     }
 
     for (const Value* value : temporaries_) {
+        const std::string sizes = Join(DynamicSizes(*value));
+        if (options_.use_workspace) {
+            auto it = workspace_.offsets.find(value->Name());
+            const std::string offset = it != workspace_.offsets.end() ? EmitIndexConst(it->second)
+                                                                      : dynamic_offsets_.at(value->Name());
+            const std::string ssa = NewSsa("tmp_" + value->Name());
+            value_refs_[value->Name()] = ssa;
+            EmitLine(ssa + " = memref.view " + workspace_ref_ + "[" + offset + "][" + sizes + "] : " + WorkspaceType() + " to " + MemRefType(*value));
+            continue;
+        }
         const std::string ssa = NewSsa("tmp_" + value->Name());
         value_refs_[value->Name()] = ssa;
-        EmitLine(ssa + " = memref.alloc() : " + MemRefType(*value));
+        EmitLine(ssa + " = memref.alloc(" + sizes + ") : " + MemRefType(*value));
     }
     if (!temporaries_.empty()) {
         EmitLine();
     }
+}
 
-    for (const Operation* op : operations_) {
-        EmitLine("// op: " + op->Name() + " (" + Operation::OpTypeToStr(op->Type()) + ")");
-        EmitOperation(*op);
+void ModuleEmitter::EmitFunction() {
+    const std::string attributes = options_.emit_c_interface ? " attributes {llvm.emit_c_interface}" : "";
+    EmitLine("func.func @" + EntrySymbol(options_) + "(" + Join(BindArguments()) + ")" + attributes + " {");
+    ++indent_;
+    EmitLine("// graph inputs: " + JoinNames(inputs_));
+    EmitLine("// graph outputs: " + JoinNames(outputs_));
+    if (!initializers_.empty()) {
+        EmitLine("// initializers: " + JoinNames(initializers_));
+    }
+    EmitLine();
+
+    if (dynamic_) {
+        BindDims();
+        if (options_.use_workspace) {
+            CastDynamicArguments();
+        }
         EmitLine();
     }
+    BindStorage();
 
-    for (auto it = temporaries_.rbegin(); it != temporaries_.rend(); ++it) {
-        EmitLine("memref.dealloc " + RefOf(**it) + " : " + MemRefType(**it));
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        const Operation& op = *operations_[i];
+        EmitLine("// op: " + op.Name() + " (" + Operation::OpTypeToStr(op.Type()) + ")");
+        EmitProfileHook(kProfileEnterHook, i);
+        EmitOperation(op);
+        EmitProfileHook(kProfileExitHook, i);
+        EmitLine();
     }
-    if (!temporaries_.empty()) {
+
+    if (!options_.use_workspace) {
+        for (auto it = temporaries_.rbegin(); it != temporaries_.rend(); ++it) {
+            EmitLine("memref.dealloc " + RefOf(**it) + " : " + MemRefType(**it));
+        }
+        if (!temporaries_.empty()) {
+            EmitLine();
+        }
+    }
+
+    EmitLine("return");
+    --indent_;
+    EmitLine("}");
+}
+
+void ModuleEmitter::EmitI64Function(const std::string& symbol, bool takes_dims,
+                                    const std::function<std::string()>& value) {
+    EmitLine();
+    std::string params;
+    if (takes_dims && !dims_.empty()) {
+        dims_ref_ = NewSsa("dims");
+        params = dims_ref_ + ": " + DimsType();
+    }
+    EmitLine("func.func @" + symbol + "(" + params + ") -> i64 {");
+    ++indent_;
+    const std::string ssa = value();
+    EmitLine("return " + ssa + " : i64");
+    --indent_;
+    EmitLine("}");
+}
+
+void ModuleEmitter::EmitProfileHookDecls() {
+    for (std::string_view hook : {kProfileEnterHook, kProfileExitHook}) {
+        EmitLine("func.func private @" + std::string{hook} + "(i64)");
+    }
+    EmitLine();
+}
+
+void ModuleEmitter::EmitProfileHook(std::string_view hook, size_t op_index) {
+    if (!options_.instrument) {
+        return;
+    }
+    const std::string index = EmitI64Const(static_cast<int64_t>(op_index));
+    EmitLine("func.call @" + std::string{hook} + "(" + index + ") : (i64) -> ()");
+}
+
+std::string ModuleEmitter::EmitI64Const(int64_t value) {
+    const std::string ssa = NewSsa("value");
+    EmitLine(ssa + " = arith.constant " + std::to_string(value) + " : i64");
+    return ssa;
+}
+
+std::string ModuleEmitter::EmitIndexToI64(const std::string& index) {
+    const std::string ssa = NewSsa("value");
+    EmitLine(ssa + " = arith.index_cast " + index + " : index to i64");
+    return ssa;
+}
+
+void ModuleEmitter::EmitWorkspaceSizeFunction() {
+    EmitI64Function(WorkspaceSizeSymbol(options_), true, [&] {
+        if (workspace_.dynamic.empty()) {
+            return EmitI64Const(workspace_.size);
+        }
+        BindDims();
+        return EmitIndexToI64(EmitDynamicWorkspace());
+    });
+}
+
+void ModuleEmitter::EmitTaskFunctions() {
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        const Operation& op = *operations_[i];
+        value_refs_.clear();
+
+        std::vector<std::string> args = BindArguments();
+        const std::string lo = NewSsa("lo");
+        const std::string hi = NewSsa("hi");
+        args.push_back(lo + ": i64");
+        args.push_back(hi + ": i64");
+
+        EmitLine();
+        EmitLine("func.func @" + TaskSymbol(options_, i) + "(" + Join(args) + ") {");
+        ++indent_;
+        EmitLine("// op: " + op.Name() + " (" + Operation::OpTypeToStr(op.Type()) + ")");
+        if (dynamic_) {
+            BindDims();
+            CastDynamicArguments();
+        }
+        BindStorage();
+
+        const std::string lo_idx = NewSsa("lo_idx");
+        EmitLine(lo_idx + " = arith.index_cast " + lo + " : i64 to index");
+        const std::string hi_idx = NewSsa("hi_idx");
+        EmitLine(hi_idx + " = arith.index_cast " + hi + " : i64 to index");
+        split_bound_ = 1;
+        pending_split_ = SplitLoop{lo_idx, hi_idx};
+        EmitProfileHook(kProfileEnterHook, i);
+        EmitOperation(op);
+        EmitProfileHook(kProfileExitHook, i);
+        pending_split_.reset();
+
+        EmitLine("return");
+        --indent_;
+        EmitLine("}");
+        const LoopBound extent = split_bound_;
+        EmitI64Function(TaskExtentSymbol(options_, i), true, [&] {
+            if (!extent.IsDynamic()) {
+                return EmitI64Const(extent.size);
+            }
+            BindDims();
+            return EmitIndexToI64(DimRef(*extent.value, extent.axis));
+        });
+    }
+    EmitI64Function(TaskCountSymbol(options_), false, [&] {
+        return EmitI64Const(static_cast<int64_t>(operations_.size()));
+    });
+}
+
+// one fully static variant per specialization, then the dynamic code, behind dispatchers that
+// keep the symbols and signatures of the unspecialized module
+void ModuleEmitter::EmitSpecialized() {
+    const size_t count = options_.specializations.size();
+    std::vector<Graph> graphs;
+    graphs.reserve(count);
+    std::vector<std::unique_ptr<ModuleEmitter>> variants;
+    for (size_t k = 0; k <= count; ++k) {
+        const Graph* graph = &graph_;
+        if (k < count) {
+            graphs.push_back(Specialize(graph_, options_.specializations[k]));
+            graph = &graphs.back();
+        }
+        variants.push_back(std::make_unique<ModuleEmitter>(*graph, VariantOptions(options_, k), out_));
+        ModuleEmitter& variant = *variants.back();
+        variant.Collect();
+        variant.global_refs_ = global_refs_;
+        variant.indent_ = indent_;
+        // a static variant may lower a Conv the dynamic code does not
+        variant.EmitDerivedGlobals();
+        global_refs_ = variant.global_refs_;
+        variant.EmitEntryFunctions();
         EmitLine();
     }
 
+    value_refs_.clear();
+    const std::string attributes = options_.emit_c_interface ? " attributes {llvm.emit_c_interface}" : "";
+    EmitLine("func.func @" + EntrySymbol(options_) + "(" + Join(BindArguments()) + ")" + attributes + " {");
+    ++indent_;
+    EmitVariantSwitch(EmitVariantIndex(), {}, [&](size_t k) {
+        EmitVariantCall(*variants[k], EntrySymbol(variants[k]->options_), {});
+        return std::string{};
+    });
     EmitLine("return");
     --indent_;
     EmitLine("}");
+
+    if (options_.use_workspace) {
+        EmitI64Function(WorkspaceSizeSymbol(options_), true, [&] {
+            return EmitVariantSwitch(EmitVariantIndex(), "i64", [&](size_t k) {
+                return EmitVariantI64Call(*variants[k], WorkspaceSizeSymbol(variants[k]->options_));
+            });
+        });
+    }
+    if (!options_.use_workspace || !options_.emit_tasks) {
+        return;
+    }
+    for (size_t i = 0; i < operations_.size(); ++i) {
+        value_refs_.clear();
+        std::vector<std::string> args = BindArguments();
+        const std::string lo = NewSsa("lo");
+        const std::string hi = NewSsa("hi");
+        args.push_back(lo + ": i64");
+        args.push_back(hi + ": i64");
+
+        EmitLine();
+        EmitLine("func.func @" + TaskSymbol(options_, i) + "(" + Join(args) + ") {");
+        ++indent_;
+        EmitVariantSwitch(EmitVariantIndex(), {}, [&](size_t k) {
+            EmitVariantCall(*variants[k], TaskSymbol(variants[k]->options_, i), {lo, hi});
+            return std::string{};
+        });
+        EmitLine("return");
+        --indent_;
+        EmitLine("}");
+        EmitI64Function(TaskExtentSymbol(options_, i), true, [&] {
+            return EmitVariantSwitch(EmitVariantIndex(), "i64", [&](size_t k) {
+                return EmitVariantI64Call(*variants[k], TaskExtentSymbol(variants[k]->options_, i));
+            });
+        });
+    }
+    EmitI64Function(TaskCountSymbol(options_), false, [&] {
+        return EmitI64Const(static_cast<int64_t>(operations_.size()));
+    });
+}
+
+// index of the first specialization matching the dims of the call, or their count
+std::string ModuleEmitter::EmitVariantIndex() {
+    BindInputDims();
+    const size_t count = options_.specializations.size();
+    std::string index = EmitIndexConst(static_cast<int64_t>(count));
+    for (size_t k = count; k-- > 0;) {
+        std::string match;
+        for (size_t i = 0; i < dims_.size(); ++i) {
+            const std::string size = DimSlot(*dims_[i].input, dims_[i].axis);
+            const std::string equal = NewSsa("is_spec");
+            EmitLine(equal + " = arith.cmpi eq, " + size + ", " + EmitIndexConst(options_.specializations[k][i]) + " : index");
+            if (match.empty()) {
+                match = equal;
+                continue;
+            }
+            const std::string both = NewSsa("is_spec");
+            EmitLine(both + " = arith.andi " + match + ", " + equal + " : i1");
+            match = both;
+        }
+        const std::string selected = NewSsa("variant");
+        EmitLine(selected + " = arith.select " + match + ", " + EmitIndexConst(static_cast<int64_t>(k)) + ", " + index + " : index");
+        index = selected;
+    }
+    return index;
+}
+
+std::string ModuleEmitter::EmitVariantSwitch(const std::string& index, const std::string& result_type,
+                                             const std::function<std::string(size_t)>& body) {
+    const size_t count = options_.specializations.size();
+    const std::string result = result_type.empty() ? std::string{} : NewSsa("result");
+    EmitLine((result.empty() ? "" : result + " = ") + "scf.index_switch " + index +
+             (result.empty() ? "" : " -> " + result_type));
+    for (size_t k = 0; k <= count; ++k) {
+        EmitLine(k < count ? "case " + std::to_string(k) + " {" : "default {");
+        ++indent_;
+        const std::string value = body(k);
+        EmitLine(result.empty() ? "scf.yield" : "scf.yield " + value + " : " + result_type);
+        --indent_;
+        EmitLine("}");
+    }
+    return result;
+}
+
+// calls symbol of variant with the arguments of the dispatcher being emitted, viewed with the variant's types
+void ModuleEmitter::EmitVariantCall(const ModuleEmitter& variant, const std::string& symbol,
+                                    const std::vector<std::string>& trailing_i64) {
+    std::vector<std::string> refs;
+    std::vector<std::string> types;
+    auto pass = [&](const std::string& ref, const std::string& from, const std::string& to,
+                    const std::vector<int64_t>& shape, std::string_view hint) {
+        refs.push_back(ref);
+        types.push_back(to);
+        if (from == to) {
+            return;
+        }
+        const std::string cast = NewSsa(hint);
+        if (!options_.use_workspace) {
+            EmitLine(cast + " = memref.cast " + ref + " : " + from + " to " + to);
+            refs.back() = cast;
+            return;
+        }
+        std::vector<std::string> sizes;
+        std::vector<std::string> strides(shape.size());
+        int64_t stride = 1;
+        for (size_t axis = shape.size(); axis-- > 0;) {
+            strides[axis] = std::to_string(stride);
+            stride *= shape[axis];
+        }
+        for (int64_t size : shape) {
+            sizes.push_back(std::to_string(size));
+        }
+        EmitLine(cast + " = memref.reinterpret_cast " + ref + " to offset: [0], sizes: [" + Join(sizes) +
+                 "], strides: [" + Join(strides) + "] : " + from + " to " + to);
+        refs.back() = cast;
+    };
+
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        pass(RefOf(*inputs_[i]), ArgType(*inputs_[i]), variant.ArgType(*variant.inputs_[i]),
+             variant.ShapeOf(*variant.inputs_[i]), "as_" + inputs_[i]->Name());
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        pass(RefOf(*outputs_[i]), ArgType(*outputs_[i]), variant.ArgType(*variant.outputs_[i]),
+             variant.ShapeOf(*variant.outputs_[i]), "as_" + outputs_[i]->Name());
+    }
+    if (options_.use_workspace) {
+        pass(workspace_ref_, "memref<" + std::to_string(workspace_.size) + "xi8>",
+             "memref<" + std::to_string(variant.workspace_.size) + "xi8>", {variant.workspace_.size}, "as_workspace");
+        if (!variant.dims_.empty()) {
+            refs.push_back(dims_ref_);
+            types.push_back(DimsType());
+        }
+    }
+    for (const std::string& value : trailing_i64) {
+        refs.push_back(value);
+        types.push_back("i64");
+    }
+    EmitLine("func.call @" + symbol + "(" + Join(refs) + ") : (" + Join(types) + ") -> ()");
+}
+
+std::string ModuleEmitter::EmitVariantI64Call(const ModuleEmitter& variant, const std::string& symbol) {
+    const std::string ssa = NewSsa("value");
+    if (variant.dims_.empty()) {
+        EmitLine(ssa + " = func.call @" + symbol + "() : () -> i64");
+    } else {
+        EmitLine(ssa + " = func.call @" + symbol + "(" + dims_ref_ + ") : (" + DimsType() + ") -> i64");
+    }
+    return ssa;
 }
 
 void ModuleEmitter::EmitOperation(const Operation& op) {
@@ -193,6 +755,13 @@ void ModuleEmitter::EmitOperation(const Operation& op) {
         case Operation::OpType::kConv:
             EmitConv(op);
             return;
+        case Operation::OpType::kReorderInput:
+        case Operation::OpType::kReorderOutput:
+            EmitReorder(op);
+            return;
+        case Operation::OpType::kNchwcConv:
+            EmitNchwcConv(ParseConv(op));
+            return;
     }
     Fail("unsupported operation kind");
 }
@@ -201,9 +770,80 @@ void ModuleEmitter::EmitOperation(const Operation& op) {
 
 namespace tc {
 
+EntrySignature EntrySignatureOf(const Graph& graph) {
+    std::vector<const Value*> inputs = detail::CollectValuesByBelong(graph, Value::BelongTo::kInput);
+    std::vector<DynamicDim> dims = detail::CollectDynamicDims(inputs);
+    return EntrySignature{
+        std::move(inputs),
+        detail::CollectValuesByBelong(graph, Value::BelongTo::kOutput),
+        std::move(dims),
+    };
+}
+
+namespace {
+
+std::string SymbolOf(const MlirEmitterOptions& options, const std::string& function) {
+    return detail::SanitizeIdentifier(options.entry_name, "entry") + function + options.symbol_suffix;
+}
+
+} // namespace
+
+std::string EntrySymbol(const MlirEmitterOptions& options) {
+    return SymbolOf(options, "");
+}
+
+std::string WorkspaceSizeSymbol(const MlirEmitterOptions& options) {
+    return SymbolOf(options, "_workspace_size");
+}
+
+std::string TaskCountSymbol(const MlirEmitterOptions& options) {
+    return SymbolOf(options, "_task_count");
+}
+
+std::string TaskSymbol(const MlirEmitterOptions& options, size_t index) {
+    return SymbolOf(options, "_task" + std::to_string(index));
+}
+
+std::string TaskExtentSymbol(const MlirEmitterOptions& options, size_t index) {
+    return SymbolOf(options, "_task" + std::to_string(index) + "_extent");
+}
+
+std::vector<std::string> ExportedSymbols(const Graph& graph, const MlirEmitterOptions& options) {
+    std::vector<std::string> symbols{EntrySymbol(options)};
+    if (!options.use_workspace) {
+        return symbols;
+    }
+    symbols.push_back(WorkspaceSizeSymbol(options));
+    if (options.emit_tasks) {
+        const size_t tasks = detail::CollectOperations(graph).size();
+        for (size_t i = 0; i < tasks; ++i) {
+            symbols.push_back(TaskSymbol(options, i));
+            symbols.push_back(TaskExtentSymbol(options, i));
+        }
+        symbols.push_back(TaskCountSymbol(options));
+    }
+    return symbols;
+}
+
+MlirEmitterOptions VariantOptions(const MlirEmitterOptions& options, size_t variant) {
+    MlirEmitterOptions variant_options = options;
+    variant_options.entry_name += variant < options.specializations.size() ? "_spec" + std::to_string(variant)
+                                                                            : std::string{"_generic"};
+    variant_options.emit_c_interface = false;
+    variant_options.specializations.clear();
+    return variant_options;
+}
+
+void MlirBackend::EmitModule(const Graph& graph, hlp::OutputSink& out, const MlirEmitterOptions& options) const {
+    const hlp::ScopedPhase phase{"emit MLIR text"};
+    detail::ModuleEmitter emitter{graph, options, out};
+    emitter.Emit();
+}
+
 std::string MlirBackend::EmitModule(const Graph& graph, const MlirEmitterOptions& options) const {
-    detail::ModuleEmitter emitter{graph, options};
-    return emitter.Emit();
+    hlp::StringSink out;
+    EmitModule(graph, out, options);
+    return out.Take();
 }
 
 } // namespace tc
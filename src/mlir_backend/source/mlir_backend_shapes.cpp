@@ -0,0 +1,317 @@
+#include "mlir_backend_internal.hpp"
+
+#include <stdexcept>
+
+namespace tc::detail {
+
+namespace {
+
+DimSource ElementwiseDimSource(const Operation& op, const Value& output, size_t axis) {
+    // a known non-unit size wins, then a dynamic one: dynamic dimensions are assumed not to broadcast
+    const size_t rank = RequireTensorType(output).Shape().size();
+    const DimSource* unit = nullptr;
+    const DimSource* dynamic = nullptr;
+    std::vector<DimSource> candidates;
+    candidates.reserve(op.Inputs().size());
+    for (const Value* operand : op.Inputs()) {
+        const size_t operand_rank = RequireTensorType(*operand).Shape().size();
+        if (operand_rank + axis >= rank) {
+            candidates.push_back(DimSource{operand, axis + operand_rank - rank});
+        }
+    }
+    for (const DimSource& candidate : candidates) {
+        const int64_t size = RequireTensorType(*candidate.operand).Shape()[candidate.axis];
+        if (size > 1) {
+            return candidate;
+        }
+        if (size < 0 && dynamic == nullptr) {
+            dynamic = &candidate;
+        }
+        if (size == 1 && unit == nullptr) {
+            unit = &candidate;
+        }
+    }
+    if (dynamic != nullptr) {
+        return *dynamic;
+    }
+    if (unit != nullptr) {
+        return *unit;
+    }
+    Fail(op.Name() + ": cannot infer dimension " + std::to_string(axis) + " of '" + output.Name() + "'");
+}
+
+DimSource ConvDimSource(const Operation& op, size_t axis) {
+    const Value& x = *op.Inputs().at(0);
+    const Value& w = *op.Inputs().at(1);
+    if (HasDynamicShape(RequireTensorType(w))) {
+        Fail(op.Name() + ": Conv weights must have a static shape");
+    }
+    if (axis == 0) {
+        return DimSource{&x, 0};
+    }
+    if (axis == 1) {
+        return DimSource{&w, 0};
+    }
+
+    std::vector<int64_t> pads = GetIntsAttr(op.Attrs(), "pads", {0, 0, 0, 0});
+    if (pads.size() == 2) {
+        pads = {pads[0], pads[1], pads[0], pads[1]};
+    }
+    const std::vector<int64_t> strides = GetIntsAttr(op.Attrs(), "strides", {1, 1});
+    const std::vector<int64_t> dilations = GetIntsAttr(op.Attrs(), "dilations", {1, 1});
+    if (pads.size() != 4 || strides.size() != 2 || dilations.size() != 2) {
+        Fail(op.Name() + ": invalid Conv pads/strides/dilations");
+    }
+    const size_t i = axis - 2;
+    const int64_t kernel = RequireTensorType(w).Shape()[axis];
+    return DimSource{&x, axis, pads[i] + pads[i + 2] - dilations[i] * (kernel - 1) - 1, strides[i]};
+}
+
+} // namespace
+
+bool HasDynamicShape(const TensorType& type) {
+    for (int64_t dim : type.Shape()) {
+        if (dim < 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DimsConflict(int64_t lhs, int64_t rhs) {
+    return lhs >= 0 && rhs >= 0 && lhs != rhs;
+}
+
+LoopBound::LoopBound(const Value& value, size_t axis)
+    : size{RequireTensorType(value).Shape().at(axis)}, value{&value}, axis{axis} {}
+
+std::vector<LoopBound> BoundsOf(const Value& value) {
+    std::vector<LoopBound> bounds;
+    for (size_t axis = 0; axis < RequireTensorType(value).Shape().size(); ++axis) {
+        bounds.emplace_back(value, axis);
+    }
+    return bounds;
+}
+
+size_t ParallelSplitDim(const std::vector<LoopBound>& bounds) {
+    for (size_t dim = 0; dim < bounds.size(); ++dim) {
+        if (bounds[dim].size > 1 || bounds[dim].IsDynamic()) {
+            return dim;
+        }
+    }
+    return 0;
+}
+
+int64_t SourcedDimSize(int64_t source_size, int64_t offset, int64_t stride) {
+    return stride == 0 ? source_size : (source_size + offset) / stride + 1;
+}
+
+DimSource InferDimSource(const Operation& op, const Value& output, size_t axis) {
+    const size_t rank = RequireTensorType(output).Shape().size();
+    switch (op.Type()) {
+        case Operation::OpType::kAdd:
+        case Operation::OpType::kMul:
+        case Operation::OpType::kRelu:
+            return ElementwiseDimSource(op, output, axis);
+        case Operation::OpType::kMatMul:
+            if (rank == 2 && op.Inputs().size() == 2) {
+                return axis == 0 ? DimSource{op.Inputs()[0], 0} : DimSource{op.Inputs()[1], 1};
+            }
+            break;
+        case Operation::OpType::kGemm:
+            if (rank == 2 && op.Inputs().size() >= 2) {
+                const bool trans_a = GetIntAttr(op.Attrs(), "transA", 0) != 0;
+                const bool trans_b = GetIntAttr(op.Attrs(), "transB", 0) != 0;
+                return axis == 0 ? DimSource{op.Inputs()[0], trans_a ? 1u : 0u}
+                                 : DimSource{op.Inputs()[1], trans_b ? 0u : 1u};
+            }
+            break;
+        case Operation::OpType::kTranspose: {
+            std::vector<int64_t> perm = GetIntsAttr(op.Attrs(), "perm", {});
+            if (perm.empty()) {
+                return DimSource{op.Inputs().at(0), rank - 1 - axis};
+            }
+            if (perm.size() == rank && perm[axis] >= 0 && perm[axis] < static_cast<int64_t>(rank)) {
+                return DimSource{op.Inputs().at(0), static_cast<size_t>(perm[axis])};
+            }
+            break;
+        }
+        case Operation::OpType::kConv:
+            if (rank == 4 && op.Inputs().size() >= 2) {
+                return ConvDimSource(op, axis);
+            }
+            break;
+        case Operation::OpType::kReorderInput:
+        case Operation::OpType::kReorderOutput:
+            // N, H and W keep their axes; the channel blocks are static
+            if ((rank == 4 || rank == 5) && (axis == 0 || axis == 2 || axis == 3)) {
+                return DimSource{op.Inputs().at(0), axis};
+            }
+            break;
+        case Operation::OpType::kNchwcConv:
+            if (rank == 5 && op.Inputs().size() >= 2) {
+                return ConvDimSource(op, axis);
+            }
+            break;
+    }
+    Fail(op.Name() + ": cannot infer dimension " + std::to_string(axis) + " of '" + output.Name() + "'");
+}
+
+std::vector<DynamicDim> CollectDynamicDims(const std::vector<const Value*>& inputs) {
+    std::vector<DynamicDim> dims;
+    for (const Value* input : inputs) {
+        const std::vector<int64_t>& shape = RequireTensorType(*input).Shape();
+        for (size_t axis = 0; axis < shape.size(); ++axis) {
+            if (shape[axis] < 0) {
+                dims.push_back(DynamicDim{input, axis});
+            }
+        }
+    }
+    return dims;
+}
+
+void ValidateSpecializations(const std::vector<DynamicDim>& dims, const MlirEmitterOptions& options) {
+    if (options.specializations.empty()) {
+        return;
+    }
+    if (dims.empty()) {
+        Fail("specializations need a graph with dynamic dimensions");
+    }
+    for (const std::vector<int64_t>& sizes : options.specializations) {
+        if (sizes.size() != dims.size()) {
+            Fail("a specialization must give " + std::to_string(dims.size()) + " dimension sizes, got " +
+                 std::to_string(sizes.size()));
+        }
+        for (int64_t size : sizes) {
+            if (size <= 0) {
+                Fail("specialized dimension sizes must be positive, got " + std::to_string(size));
+            }
+        }
+    }
+}
+
+} // namespace tc::detail
+
+namespace tc {
+
+ShapeResolver::ShapeResolver(const Graph& graph) {
+    using namespace detail;
+
+    std::unordered_map<const Value*, size_t> index;
+    auto index_of = [&](const Value& value) {
+        auto [it, inserted] = index.emplace(&value, shapes_.size());
+        if (inserted) {
+            shapes_.push_back(RequireTensorType(value).Shape());
+        }
+        return it->second;
+    };
+
+    for (const DynamicDim& dim : CollectDynamicDims(CollectValuesByBelong(graph, Value::BelongTo::kInput))) {
+        dims_.emplace_back(index_of(*dim.input), dim.axis);
+    }
+    for (const Operation* op : CollectOperations(graph)) {
+        for (const Value* output : op->Outputs()) {
+            const size_t value = index_of(*output);
+            for (size_t axis = 0; axis < shapes_[value].size(); ++axis) {
+                if (shapes_[value][axis] >= 0) {
+                    continue;
+                }
+                const DimSource source = InferDimSource(*op, *output, axis);
+                steps_.push_back(Step{value, axis, index_of(*source.operand), source.axis, source.offset, source.stride});
+            }
+        }
+    }
+    for (const Value* output : CollectValuesByBelong(graph, Value::BelongTo::kOutput)) {
+        outputs_.push_back(index_of(*output));
+    }
+}
+
+std::vector<std::vector<int64_t>> ShapeResolver::OutputShapes(std::span<const int64_t> dims) const {
+    if (dims.size() != dims_.size()) {
+        throw std::runtime_error{"shapes: expected " + std::to_string(dims_.size()) + " dynamic dimensions, got " +
+                                 std::to_string(dims.size())};
+    }
+
+    std::vector<std::vector<int64_t>> shapes = shapes_;
+    for (size_t i = 0; i < dims.size(); ++i) {
+        if (dims[i] <= 0) {
+            throw std::runtime_error{"shapes: dynamic dimension " + std::to_string(i) + " must be positive"};
+        }
+        shapes[dims_[i].first][dims_[i].second] = dims[i];
+    }
+    for (const Step& step : steps_) {
+        const int64_t size = shapes[step.operand][step.operand_axis];
+        if (size < 0) {
+            throw std::runtime_error{"shapes: a dimension does not follow from the inputs"};
+        }
+        shapes[step.value][step.axis] = detail::SourcedDimSize(size, step.offset, step.stride);
+    }
+
+    std::vector<std::vector<int64_t>> outputs;
+    outputs.reserve(outputs_.size());
+    for (size_t value : outputs_) {
+        outputs.push_back(shapes[value]);
+    }
+    return outputs;
+}
+
+Graph Specialize(const Graph& graph, std::span<const int64_t> dims) {
+    using namespace detail;
+    const hlp::ScopedPhase phase{"specialize"};
+
+    const std::vector<DynamicDim> dynamic = CollectDynamicDims(CollectValuesByBelong(graph, Value::BelongTo::kInput));
+    if (dims.size() != dynamic.size()) {
+        throw std::runtime_error{"shapes: expected " + std::to_string(dynamic.size()) + " dynamic dimensions, got " +
+                                 std::to_string(dims.size())};
+    }
+
+    std::unordered_map<const Value*, std::vector<int64_t>> shapes;
+    auto shape_of = [&](const Value& value) -> std::vector<int64_t>& {
+        return shapes.try_emplace(&value, RequireTensorType(value).Shape()).first->second;
+    };
+    for (size_t i = 0; i < dims.size(); ++i) {
+        if (dims[i] <= 0) {
+            throw std::runtime_error{"shapes: dynamic dimension " + std::to_string(i) + " must be positive"};
+        }
+        shape_of(*dynamic[i].input)[dynamic[i].axis] = dims[i];
+    }
+    for (const Operation* op : CollectOperations(graph)) {
+        for (const Value* output : op->Outputs()) {
+            std::vector<int64_t>& shape = shape_of(*output);
+            for (size_t axis = 0; axis < shape.size(); ++axis) {
+                if (shape[axis] < 0) {
+                    const DimSource source = InferDimSource(*op, *output, axis);
+                    shape[axis] = SourcedDimSize(shape_of(*source.operand)[source.axis], source.offset, source.stride);
+                }
+            }
+        }
+    }
+
+    Graph out;
+    std::unordered_map<const Value*, Value*> mapped;
+    auto map_values = [&](const std::vector<Value*>& values) {
+        std::vector<Value*> result;
+        result.reserve(values.size());
+        for (const Value* value : values) {
+            result.push_back(mapped.at(value));
+        }
+        return result;
+    };
+    for (const INode* node : graph) {
+        if (const auto* value = dynamic_cast<const Value*>(node)) {
+            Value* copy = out.AddNode<Value>(value->Name(), value->GetBelongsTo(), value->InitializerData());
+            if (value->HasTensorType() && !value->HasInitializerData()) {
+                auto it = shapes.find(value);
+                const TensorType& type = *value->MaybeTensorType();
+                copy->MergeTensorType(it == shapes.end() ? type : TensorType{type.ElemType(), it->second});
+            }
+            mapped.emplace(value, copy);
+        } else if (const auto* op = dynamic_cast<const Operation*>(node)) {
+            out.AddNode<Operation>(op->Name(), op->Type(), map_values(op->Inputs()), map_values(op->Outputs()),
+                                   op->Attrs());
+        }
+    }
+    return out;
+}
+
+} // namespace tc
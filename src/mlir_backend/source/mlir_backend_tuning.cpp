@@ -0,0 +1,233 @@
+#include "mlir_backend/tuning.hpp"
+
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <unistd.h>
+
+#include "mlir_backend_internal.hpp"
+
+namespace tc {
+
+namespace {
+
+constexpr std::string_view kHeader = "# tc tuning database v1";
+
+constexpr int64_t kTileM[] = {0, 8, 32};
+constexpr int64_t kTileN[] = {0, 16, 64};
+constexpr int64_t kTileK[] = {0, 32, 128};
+
+[[noreturn]] void Malformed(const std::string& message) {
+    throw std::runtime_error{"tuning database: " + message};
+}
+
+std::string_view OrderToStr(ContractionSchedule::Order order) {
+    return order == ContractionSchedule::Order::kMkn ? "mkn" : "mnk";
+}
+
+std::string ShapeToStr(const Value& value) {
+    const std::vector<int64_t>& shape = detail::RequireTensorType(value).Shape();
+    if (shape.empty()) {
+        return "scalar";
+    }
+    std::string text;
+    for (size_t i = 0; i < shape.size(); ++i) {
+        text += (i == 0 ? "" : "x") + (shape[i] < 0 ? std::string{"?"} : std::to_string(shape[i]));
+    }
+    return text;
+}
+
+int64_t ParseInt(std::string_view text, std::string_view what) {
+    int64_t value = 0;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size()) {
+        Malformed("invalid " + std::string{what} + " '" + std::string{text} + "'");
+    }
+    return value;
+}
+
+// true if a tile of this size splits a dimension of the given static size into more than one tile
+bool Splits(int64_t tile, int64_t size) {
+    return tile == 0 || size < 0 || tile < size;
+}
+
+} // namespace
+
+std::string FormatSchedule(const ContractionSchedule& schedule) {
+    return "order=" + std::string{OrderToStr(schedule.order)} + " tile_m=" + std::to_string(schedule.tile_m) +
+           " tile_n=" + std::to_string(schedule.tile_n) + " tile_k=" + std::to_string(schedule.tile_k);
+}
+
+ContractionSchedule ParseSchedule(std::string_view text) {
+    ContractionSchedule schedule;
+    std::istringstream fields{std::string{text}};
+    for (std::string field; fields >> field;) {
+        const size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            Malformed("invalid schedule field '" + field + "'");
+        }
+        const std::string_view key = std::string_view{field}.substr(0, eq);
+        const std::string_view value = std::string_view{field}.substr(eq + 1);
+        if (key == "order") {
+            if (value != "mnk" && value != "mkn") {
+                Malformed("unknown loop order '" + std::string{value} + "'");
+            }
+            schedule.order = value == "mkn" ? ContractionSchedule::Order::kMkn : ContractionSchedule::Order::kMnk;
+        } else if (key == "tile_m" || key == "tile_n" || key == "tile_k") {
+            const int64_t tile = ParseInt(value, key);
+            if (tile < 0) {
+                Malformed("negative " + std::string{key});
+            }
+            (key == "tile_m" ? schedule.tile_m : key == "tile_n" ? schedule.tile_n : schedule.tile_k) = tile;
+        } else {
+            Malformed("unknown schedule field '" + std::string{key} + "'");
+        }
+    }
+    if (schedule.tile_k != 0 && schedule.order != ContractionSchedule::Order::kMkn) {
+        Malformed("tile_k needs order=mkn");
+    }
+    return schedule;
+}
+
+bool IsTunable(const Operation& op) {
+    return op.Type() == Operation::OpType::kMatMul || op.Type() == Operation::OpType::kGemm;
+}
+
+std::string TuningSignature(const Operation& op) {
+    if (!IsTunable(op)) {
+        throw std::runtime_error{op.Name() + ": " + Operation::OpTypeToStr(op.Type()) + " has no tunable schedule"};
+    }
+    std::string signature = Operation::OpTypeToStr(op.Type());
+    signature += ' ' + detail::ElemTypeToMlir(detail::RequireTensorType(*op.Outputs().at(0)).ElemType());
+    for (const Value* input : op.Inputs()) {
+        signature += ' ' + ShapeToStr(*input);
+    }
+    if (op.Type() == Operation::OpType::kGemm) {
+        signature += " transA=" + std::to_string(detail::GetIntAttr(op.Attrs(), "transA", 0));
+        signature += " transB=" + std::to_string(detail::GetIntAttr(op.Attrs(), "transB", 0));
+    }
+    return signature;
+}
+
+std::vector<ContractionSchedule> CandidateSchedules(const Operation& op) {
+    const Value& a = *op.Inputs().at(0);
+    const Value& y = *op.Outputs().at(0);
+    const bool trans_a = op.Type() == Operation::OpType::kGemm && detail::GetIntAttr(op.Attrs(), "transA", 0) != 0;
+    // static sizes, -1 when dynamic
+    const int64_t m = detail::LoopBound{y, 0}.size;
+    const int64_t n = detail::LoopBound{y, 1}.size;
+    const int64_t k = detail::LoopBound{a, trans_a ? 0u : 1u}.size;
+
+    std::vector<ContractionSchedule> candidates;
+    for (ContractionSchedule::Order order : {ContractionSchedule::Order::kMnk, ContractionSchedule::Order::kMkn}) {
+        for (int64_t tile_m : kTileM) {
+            for (int64_t tile_n : kTileN) {
+                for (int64_t tile_k : kTileK) {
+                    if (tile_k != 0 && order != ContractionSchedule::Order::kMkn) {
+                        continue;
+                    }
+                    if (!Splits(tile_m, m) || !Splits(tile_n, n) || !Splits(tile_k, k)) {
+                        continue;
+                    }
+                    candidates.push_back(ContractionSchedule{order, tile_m, tile_n, tile_k});
+                }
+            }
+        }
+    }
+    return candidates;
+}
+
+TuningDatabase TuningDatabase::Load(const std::string& path) {
+    std::ifstream in{path, std::ios::binary};
+    if (!in) {
+        return {};
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return Parse(text.str());
+}
+
+TuningDatabase TuningDatabase::Parse(std::string_view text) {
+    TuningDatabase database;
+    size_t line_number = 0;
+    while (!text.empty()) {
+        const size_t end = text.find('\n');
+        const std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+        ++line_number;
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        const size_t first_tab = line.find('\t');
+        const size_t second_tab = first_tab == std::string_view::npos ? first_tab : line.find('\t', first_tab + 1);
+        if (second_tab == std::string_view::npos) {
+            Malformed("line " + std::to_string(line_number) + ": expected <signature>\\t<schedule>\\t<micros>");
+        }
+        Entry entry;
+        entry.schedule = ParseSchedule(line.substr(first_tab + 1, second_tab - first_tab - 1));
+        const std::string micros{line.substr(second_tab + 1)};
+        try {
+            entry.micros = std::stod(micros);
+        } catch (const std::exception&) {
+            Malformed("line " + std::to_string(line_number) + ": invalid time '" + micros + "'");
+        }
+        database.Set(std::string{line.substr(0, first_tab)}, entry);
+    }
+    return database;
+}
+
+void TuningDatabase::Save(const std::string& path) const {
+    const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+        out << Serialize();
+        if (!out.flush()) {
+            throw std::runtime_error{"tuning database: unable to write " + tmp};
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error{"tuning database: unable to replace " + path};
+    }
+}
+
+std::string TuningDatabase::Serialize() const {
+    std::string text{kHeader};
+    text += '\n';
+    char micros[32];
+    for (const auto& [signature, entry] : entries_) {
+        std::snprintf(micros, sizeof(micros), "%.3f", entry.micros);
+        text += signature + '\t' + FormatSchedule(entry.schedule) + '\t' + micros + '\n';
+    }
+    return text;
+}
+
+void TuningDatabase::Set(const std::string& signature, const Entry& entry) {
+    if (signature.empty() || signature.find_first_of("\t\n") != std::string::npos) {
+        Malformed("invalid signature '" + signature + "'");
+    }
+    entries_.insert_or_assign(signature, entry);
+}
+
+const TuningDatabase::Entry* TuningDatabase::Find(const std::string& signature) const {
+    const auto it = entries_.find(signature);
+    return it == entries_.end() ? nullptr : &it->second;
+}
+
+ContractionSchedule TuningDatabase::ScheduleFor(const Operation& op) const {
+    if (!IsTunable(op) || entries_.empty()) {
+        return {};
+    }
+    const Entry* entry = Find(TuningSignature(op));
+    return entry != nullptr ? entry->schedule : ContractionSchedule{};
+}
+
+} // namespace tc
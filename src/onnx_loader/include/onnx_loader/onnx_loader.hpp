@@ -1,7 +1,7 @@
 #ifndef ONNX_LOADER_HPP_
 #define ONNX_LOADER_HPP_
 
-#include <string>
+#include <string_view>
 
 #include "helpers/trace_calls.hpp"
 #include "graph/loader.hpp"
@@ -11,8 +11,9 @@ namespace tc {
 class OnnxLoader : public ILoader {
   public:
     ~OnnxLoader() override = default;
-  private:
-    Graph ParseRaw(const std::string& model_raw) override;
+
+    // parses a serialized ModelProto already in memory; Load() maps a file and calls this
+    Graph ParseRaw(std::string_view model_raw) override;
 };
 
 } // namespace tc
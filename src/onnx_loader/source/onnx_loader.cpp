@@ -1,5 +1,6 @@
 #include "onnx_loader/onnx_loader.hpp"
 
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -11,6 +12,7 @@
 #include "onnx/onnx_pb.h"
 #include "onnx/proto_utils.h"
 
+#include "helpers/phase_timer.hpp"
 #include "helpers/trace_calls.hpp"
 #include "graph/attribute.hpp"
 #include "graph/node.hpp"
@@ -71,19 +73,20 @@ std::optional<TensorType> ParseValueType(const onnx::ValueInfoProto& value_info)
     return TensorType{elem_type, std::move(shape)};
 }
 
-TensorData ParseTensorData(const onnx::TensorProto& tensor) {
+// takes ownership of the payload instead of copying it: weights stay in memory exactly once
+TensorData ParseTensorData(onnx::TensorProto* tensor) {
     std::vector<int64_t> shape;
-    shape.reserve(static_cast<size_t>(tensor.dims_size()));
-    for (int i = 0; i < tensor.dims_size(); ++i) {
-        shape.push_back(static_cast<int64_t>(tensor.dims(i)));
+    shape.reserve(static_cast<size_t>(tensor->dims_size()));
+    for (int i = 0; i < tensor->dims_size(); ++i) {
+        shape.push_back(static_cast<int64_t>(tensor->dims(i)));
     }
 
     std::string raw;
-    if (tensor.has_raw_data()) {
-        raw = tensor.raw_data();
+    if (tensor->has_raw_data()) {
+        raw = std::move(*tensor->mutable_raw_data());
     }
 
-    return TensorData{TensorType{ParseElemType(tensor.data_type()), std::move(shape)}, std::move(raw)};
+    return TensorData{TensorType{ParseElemType(tensor->data_type()), std::move(shape)}, std::move(raw)};
 }
 
 Value* EnsureValue(Graph* graph, const std::string& name, Value::BelongTo belong) {
@@ -220,17 +223,25 @@ void AddOpNode(Graph* graph, const onnx::NodeProto& g_node) {
 
 } // namespace
 
-Graph OnnxLoader::ParseRaw(const std::string& model_raw) {
+Graph OnnxLoader::ParseRaw(std::string_view model_raw) {
     hlp::trace_call();
 
+    if (model_raw.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error{"onnx model exceeds the 2 GiB protobuf limit"};
+    }
+
     onnx::ModelProto model;
-    bool success = model.ParseFromString(model_raw);
-    if (!success) {
-        throw std::runtime_error{"Unable to parse onnx model"};
+    {
+        const hlp::ScopedPhase phase{"protobuf parse"};
+        bool success = model.ParseFromArray(model_raw.data(), static_cast<int>(model_raw.size()));
+        if (!success) {
+            throw std::runtime_error{"Unable to parse onnx model"};
+        }
     }
 
+    const hlp::ScopedPhase phase{"graph build"};
     Graph graph;
-    const onnx::GraphProto& onnx_graph = model.graph();
+    onnx::GraphProto& onnx_graph = *model.mutable_graph();
 
     for (const onnx::ValueInfoProto& input : onnx_graph.input()) {
         MergeValueInfo(&graph, input, Value::BelongTo::kInput);
@@ -244,8 +255,8 @@ Graph OnnxLoader::ParseRaw(const std::string& model_raw) {
         MergeValueInfo(&graph, value_info, Value::BelongTo::kInternal);
     }
 
-    for (const onnx::TensorProto& init_tensor : onnx_graph.initializer()) {
-        TensorData tensor_data = ParseTensorData(init_tensor);
+    for (onnx::TensorProto& init_tensor : *onnx_graph.mutable_initializer()) {
+        TensorData tensor_data = ParseTensorData(&init_tensor);
         Value* value = EnsureValue(&graph, init_tensor.name(), Value::BelongTo::kInitializer);
         value->UpgradeBelongsTo(Value::BelongTo::kInitializer);
         value->MergeInitializerData(std::move(tensor_data));
@@ -0,0 +1,46 @@
+#ifndef AUTOTUNER_HPP_
+#define AUTOTUNER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+#include "mlir_backend/tuning.hpp"
+
+namespace tc::runtime {
+
+struct AutotuneOptions {
+    // timed calls per candidate after the warmup ones; the median is what counts
+    size_t iterations = 20;
+    size_t warmup = 3;
+    // LLVM optimization level of the candidates, the one the tuned code will be compiled with
+    unsigned opt_level = 2;
+    // measure signatures again that the database already has an entry for
+    bool retune = false;
+    uint32_t seed = 42;
+};
+
+struct AutotuneResult {
+    std::string signature;
+    std::string op;                // first op of the graph with the signature
+    ContractionSchedule schedule;  // the fastest candidate
+    double micros;                 // its median time per call
+    double default_micros;         // of ContractionSchedule{}
+    size_t candidates;
+};
+
+// op alone as a graph: its operands become inputs, initializers included, and its results outputs
+Graph IsolateOperation(const Operation& op);
+
+// JIT-compiles every CandidateSchedules() entry of each tunable op of graph, times it on random
+// inputs and records the fastest in database. Ops with dynamic shapes are skipped, since their
+// best schedule depends on sizes only known at run time, and so are signatures seen before in
+// graph or, without options.retune, in database. Every candidate's outputs are checked against
+// the default schedule's. Throws unless JitAvailable().
+std::vector<AutotuneResult> Autotune(const Graph& graph, TuningDatabase& database, const AutotuneOptions& options = {});
+
+} // namespace tc::runtime
+
+#endif // AUTOTUNER_HPP_
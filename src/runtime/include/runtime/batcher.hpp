@@ -0,0 +1,101 @@
+#ifndef BATCHER_HPP_
+#define BATCHER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "runtime/compiled_model.hpp"
+#include "runtime/session.hpp"
+#include "runtime/thread_pool.hpp"
+
+namespace tc::runtime {
+
+struct BatcherOptions {
+    // longest the oldest queued request waits for others to join its batch
+    std::chrono::microseconds max_delay{1000};
+    // splits each batch across the pool when the variants were compiled with tasks
+    std::shared_ptr<ThreadPool> pool;
+};
+
+struct BatcherStats {
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    // rows computed only to fill a variant larger than the batch
+    uint64_t padded_rows = 0;
+};
+
+// Coalesces single-row requests into batches. variants are one graph compiled for several
+// batch sizes (see tc::Rebatch); every input and output of a variant starts with its batch
+// dimension. A dispatcher thread takes up to the largest batch size of queued requests once
+// that many are waiting or the oldest one has waited max_delay, and runs them through the
+// smallest variant that fits, padding the unused rows.
+class DynamicBatcher {
+  public:
+    DynamicBatcher(std::vector<std::shared_ptr<const CompiledModel>> variants, BatcherOptions options = {});
+    ~DynamicBatcher(); // runs the requests still queued, then stops the dispatcher
+
+    DynamicBatcher(const DynamicBatcher&) = delete;
+    DynamicBatcher& operator=(const DynamicBatcher&) = delete;
+
+    size_t MaxBatch() const { return variants_.back().batch; }
+    // bytes of one request's row of every input / output
+    const std::vector<size_t>& InputRowBytes() const { return input_row_bytes_; }
+    const std::vector<size_t>& OutputRowBytes() const { return output_row_bytes_; }
+
+    // blocks until the request ran as part of a batch. Thread-safe; the buffers hold one row each.
+    // Rethrows what running the batch threw, for every request of that batch
+    void Infer(std::span<const void* const> inputs, std::span<void* const> outputs);
+
+    BatcherStats Stats() const;
+
+  private:
+    struct Variant {
+        size_t batch = 0;
+        std::unique_ptr<Session> session;
+        std::vector<std::vector<std::byte>> inputs;  // batch rows of each input
+        std::vector<std::vector<std::byte>> outputs; // batch rows of each output
+        std::vector<const void*> input_ptrs;
+        std::vector<void*> output_ptrs;
+    };
+
+    struct Request {
+        std::span<const void* const> inputs;
+        std::span<void* const> outputs;
+        std::chrono::steady_clock::time_point arrival;
+        bool done = false;
+        std::exception_ptr error; // set by the dispatcher before done
+    };
+
+    std::vector<Variant> variants_; // ascending batch size
+    std::vector<size_t> input_row_bytes_;
+    std::vector<size_t> output_row_bytes_;
+    std::chrono::microseconds max_delay_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::condition_variable completed_;
+    std::deque<Request*> queue_;
+    BatcherStats stats_;
+    bool stop_ = false;
+
+    // dispatcher only
+    std::vector<Request*> batch_; // capacity MaxBatch()
+    size_t padded_rows_ = 0;
+    std::thread dispatcher_;
+
+    void DispatchLoop();
+    void RunBatch();
+};
+
+} // namespace tc::runtime
+
+#endif // BATCHER_HPP_
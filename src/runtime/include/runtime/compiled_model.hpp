@@ -0,0 +1,88 @@
+#ifndef COMPILED_MODEL_HPP_
+#define COMPILED_MODEL_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "runtime/jit_model.hpp"
+
+namespace tc {
+class ShapeResolver;
+} // namespace tc
+
+namespace tc::runtime {
+
+// Native code of one graph behind the C ABI of `tc.x --emit-shared`:
+// entry(inputs..., outputs..., workspace [, dims]), one bare pointer per tensor.
+// Immutable once loaded, so it can be shared by any number of sessions and threads.
+class CompiledModel {
+  public:
+    // most tensor arguments an entry may take
+    static constexpr size_t kMaxTensors = 31;
+    static constexpr size_t kWorkspaceAlignment = 64;
+
+    // dlopens a library that `tc.x --emit-shared` produced for graph
+    static std::shared_ptr<const CompiledModel> LoadSharedLibrary(const std::string& path, const Graph& graph);
+
+    // compiles graph in-process with the same ABI (see JitAvailable())
+    static std::shared_ptr<const CompiledModel> Jit(const Graph& graph, const JitOptions& options = {});
+
+    const std::vector<TensorSpec>& Inputs() const { return inputs_; }
+    const std::vector<TensorSpec>& Outputs() const { return outputs_; }
+
+    // dynamic input dimensions; every call that takes dims expects one size per entry, in this order
+    const std::vector<DimSpec>& Dims() const { return dims_; }
+    // output shapes for the given sizes of Dims()
+    std::vector<std::vector<int64_t>> OutputShapes(std::span<const int64_t> dims) const;
+
+    size_t WorkspaceSize(std::span<const int64_t> dims = {}) const;
+
+    // one call of the entry; workspace must hold WorkspaceSize(dims) bytes aligned to kWorkspaceAlignment
+    // and must not be used by another call at the same time. Does not allocate.
+    void Invoke(const void* const* inputs, void* const* outputs, void* workspace,
+                const int64_t* dims = nullptr) const;
+
+    // per-operation tasks (MlirEmitterOptions::emit_tasks); empty for code compiled without them.
+    // Running every task in order over [0, TaskExtent(i)) has the effect of one Invoke(); the
+    // ranges of one task may run on different threads at the same time.
+    size_t TaskCount() const { return tasks_.size(); }
+    int64_t TaskExtent(size_t task, std::span<const int64_t> dims = {}) const;
+    void InvokeTask(size_t task, const void* const* inputs, void* const* outputs, void* workspace,
+                    int64_t lo, int64_t hi, const int64_t* dims = nullptr) const;
+
+  private:
+    struct Task {
+        void* fn;
+        void* extent_fn; // called with the dims of dynamic models
+        int64_t extent;
+    };
+
+    std::shared_ptr<void> code_; // keeps the library / execution engine alive
+    void* entry_ = nullptr;
+    void* workspace_size_fn_ = nullptr;
+    size_t workspace_size_ = 0;
+    std::vector<Task> tasks_;
+    std::vector<TensorSpec> inputs_;
+    std::vector<TensorSpec> outputs_;
+    std::vector<DimSpec> dims_;
+    std::shared_ptr<const ShapeResolver> shapes_;
+
+    // resolves symbol names to addresses, nullptr when missing
+    using SymbolLookup = std::function<void*(const std::string& name)>;
+
+    CompiledModel(const Graph& graph, std::shared_ptr<void> code, const SymbolLookup& lookup);
+
+    void CheckDims(std::span<const int64_t> dims) const;
+    // entry arguments in call order; returns their count
+    size_t PackArgs(void** args, const void* const* inputs, void* const* outputs, void* workspace,
+                    const int64_t* dims) const;
+};
+
+} // namespace tc::runtime
+
+#endif // COMPILED_MODEL_HPP_
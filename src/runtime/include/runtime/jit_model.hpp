@@ -0,0 +1,86 @@
+#ifndef JIT_MODEL_HPP_
+#define JIT_MODEL_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "graph/node.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+
+namespace tc {
+class ShapeResolver;
+class TuningDatabase;
+} // namespace tc
+
+namespace tc::runtime {
+
+struct TensorSpec {
+    std::string name;
+    TensorType type;
+
+    // only meaningful for static shapes
+    size_t ByteSize() const {
+        return static_cast<size_t>(type.NumElements()) * TensorType::ElemSizeInBytes(type.ElemType());
+    }
+};
+
+// input dimension whose size is given per call (-1 in the model)
+struct DimSpec {
+    size_t input;
+    size_t axis;
+};
+
+struct JitOptions {
+    // LLVM optimization level of the JIT, 0..3
+    unsigned opt_level = 2;
+    // sizes of Dims() to compile static variants for (see MlirEmitterOptions::specializations)
+    std::vector<std::vector<int64_t>> specializations;
+    // calls the profiling hooks around every operation (see MlirEmitterOptions::instrument)
+    bool instrument = false;
+    // MatMul / Gemm loop schedules (see MlirEmitterOptions::tuning)
+    std::shared_ptr<const TuningDatabase> tuning;
+    // lowering of Conv ops (see MlirEmitterOptions::conv_algorithm)
+    ConvAlgorithm conv_algorithm = ConvAlgorithm::kAuto;
+};
+
+// true when tc was built against the MLIR/LLVM libraries and can compile graphs in-process
+bool JitAvailable();
+
+// A graph compiled to native code inside the current process through mlir::ExecutionEngine.
+// Run() keeps no state between calls, so one model can be run from several threads at once.
+class JitModel {
+  public:
+    explicit JitModel(const Graph& graph, const JitOptions& options = {});
+    ~JitModel();
+
+    JitModel(const JitModel&) = delete;
+    JitModel& operator=(const JitModel&) = delete;
+
+    const std::vector<TensorSpec>& Inputs() const { return inputs_; }
+    const std::vector<TensorSpec>& Outputs() const { return outputs_; }
+    // dynamic input dimensions, in the order the zero-copy Run() takes their sizes
+    const std::vector<DimSpec>& Dims() const { return dims_; }
+
+    // inputs in Inputs() order as dense row-major bytes; returns the outputs in Outputs() order.
+    // The sizes of dynamic dimensions are taken from the inputs' types.
+    std::vector<TensorData> Run(const std::vector<TensorData>& inputs) const;
+
+    // zero-copy variant over caller-owned host buffers sized for the shapes dims resolves to
+    void Run(const std::vector<const void*>& inputs, const std::vector<void*>& outputs,
+             const std::vector<int64_t>& dims = {}) const;
+
+  private:
+    struct Engine;
+
+    std::unique_ptr<Engine> engine_;
+    std::vector<TensorSpec> inputs_;
+    std::vector<TensorSpec> outputs_;
+    std::vector<DimSpec> dims_;
+    std::shared_ptr<const ShapeResolver> shapes_;
+};
+
+} // namespace tc::runtime
+
+#endif // JIT_MODEL_HPP_
@@ -0,0 +1,59 @@
+#ifndef PERF_COUNTERS_HPP_
+#define PERF_COUNTERS_HPP_
+
+#include <cstdint>
+#include <string>
+
+namespace tc::runtime {
+
+// hardware event counts; -1 where a counter is unavailable
+struct CounterValues {
+    int64_t cycles = -1;
+    int64_t instructions = -1;
+    int64_t cache_misses = -1;  // last-level cache
+    int64_t branch_misses = -1;
+
+    static CounterValues Zero() { return CounterValues{0, 0, 0, 0}; }
+
+    // instructions per cycle, -1 if either is unknown
+    double Ipc() const;
+
+    // fieldwise; a field that is -1 on either side stays -1
+    CounterValues operator-(const CounterValues& rhs) const;
+    CounterValues& operator+=(const CounterValues& rhs);
+};
+
+// Cycles, instructions, cache misses and branch misses of the thread that constructs it, user
+// space only, through one perf_event_open group, so a Read() is a single read(). Events the
+// kernel or the machine does not offer (containers, most VMs, perf_event_paranoid > 2) read as
+// -1. With none of them, Available() is false and Read() returns without a system call.
+// Counts are scaled up when the kernel had to multiplex the group with other users.
+class PerfCounters {
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool Available() const { return leader_ >= 0; }
+    // why no counter could be opened, empty if Available()
+    const std::string& Unavailable() const { return unavailable_; }
+
+    // totals since construction
+    CounterValues Read() const;
+
+  private:
+    static constexpr int kEvents = 4;
+
+    int leader_ = -1;
+    int fds_[kEvents] = {-1, -1, -1, -1};
+    // position of each event in the group's read, -1 if it is not in the group
+    int slot_[kEvents] = {-1, -1, -1, -1};
+    int opened_ = 0;
+    std::string unavailable_;
+};
+
+} // namespace tc::runtime
+
+#endif // PERF_COUNTERS_HPP_
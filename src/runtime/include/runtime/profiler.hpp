@@ -0,0 +1,98 @@
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "graph/graph.hpp"
+#include "runtime/perf_counters.hpp"
+
+// definitions of the hooks that code compiled with MlirEmitterOptions::instrument calls around
+// every operation (kProfileEnterHook / kProfileExitHook); they do nothing unless a Profiler is recording
+extern "C" {
+void tc_profile_enter(int64_t op);
+void tc_profile_exit(int64_t op);
+}
+
+namespace tc::runtime {
+
+// one run of an operation, or of one chunk of its task, on one thread
+struct ProfileEvent {
+    int64_t op;       // index in graph order
+    uint32_t thread;  // per-profiler thread number, in order of first event
+    int64_t begin_ns; // since Start()
+    int64_t end_ns;
+    CounterValues counters; // of this call; all -1 without ProfilerOptions::hardware_counters
+};
+
+struct OpProfile {
+    std::string name;
+    std::string type;
+    size_t calls = 0;     // hook pairs; every task chunk is one
+    double total_us = 0;  // summed over threads
+    double share = 0;     // of the total of all operations
+    // the op's EstimateCost() times the profiled runs over total_us; -1 if the cost is unknown
+    double flops_per_s = -1;
+    double bytes_per_s = -1;
+    // summed over calls, and derived from them; -1 without hardware counters
+    CounterValues counters;
+    double ipc = -1;
+    double cache_misses_per_flop = -1;
+};
+
+struct ProfilerOptions {
+    // also read the calling thread's PerfCounters around every op; one read() per hook,
+    // so short ops run measurably slower
+    bool hardware_counters = false;
+};
+
+// Records the hook calls of instrumented code between Start() and Stop(), from any thread.
+// Each thread appends to its own log, so recording takes no lock after a thread's first event.
+// Only one profiler may record at a time.
+class Profiler {
+  public:
+    explicit Profiler(ProfilerOptions options = {}) : options_{options} {}
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // throws if another profiler is recording
+    void Start();
+    // the instrumented calls being profiled must have returned before the results are read
+    void Stop();
+
+    std::vector<ProfileEvent> Events() const;
+
+    // per-op totals for runs calls of the model compiled from graph, in graph order; FLOP/s and
+    // bytes/s need the static shapes of the run (see Specialize for dynamic models)
+    std::vector<OpProfile> Summarize(const Graph& graph, size_t runs) const;
+    static std::string FormatTable(const std::vector<OpProfile>& ops);
+
+    // chrome://tracing / Perfetto JSON with one complete event per ProfileEvent
+    std::string ChromeTrace(const Graph& graph) const;
+
+  private:
+    struct ThreadLog {
+        uint32_t thread;
+        std::vector<ProfileEvent> events;
+    };
+
+    ProfilerOptions options_;
+    uint64_t generation_ = 0;
+    int64_t start_ns_ = 0;
+    mutable std::mutex mutex_;
+    std::deque<ThreadLog> logs_;
+
+    ThreadLog& RegisterThread();
+
+    friend void ::tc_profile_enter(int64_t op);
+    friend void ::tc_profile_exit(int64_t op);
+};
+
+} // namespace tc::runtime
+
+#endif // PROFILER_HPP_
@@ -0,0 +1,69 @@
+#ifndef SESSION_HPP_
+#define SESSION_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "runtime/compiled_model.hpp"
+#include "runtime/thread_pool.hpp"
+
+namespace tc::runtime {
+
+struct SessionOptions {
+    // number of workspaces, i.e. calls that can run in parallel (0 = hardware threads)
+    size_t concurrency = 0;
+    // splits every operation of a model compiled with tasks across the pool's workers; sessions
+    // sharing one pool share its threads and CPU affinity. nullptr runs each call on the caller's thread
+    std::shared_ptr<ThreadPool> pool;
+    // iterations per chunk of a task's split loop; 0 lets the pool choose
+    int64_t grain = 0;
+    // largest sizes of the model's Dims() any call will pass; sizes the workspaces of dynamic models
+    std::vector<int64_t> max_dims;
+};
+
+// Serving front end of a CompiledModel. All workspaces are allocated up front, so Run() does
+// no heap allocation in steady state. Run() may be called from several threads at once: each
+// call borrows one workspace and blocks while all of them are in use.
+class Session {
+  public:
+    Session(std::shared_ptr<const CompiledModel> model, SessionOptions options);
+    explicit Session(std::shared_ptr<const CompiledModel> model, size_t concurrency = 0);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    const CompiledModel& Model() const { return *model_; }
+    size_t Concurrency() const { return workspaces_.size(); }
+
+    // caller-owned dense row-major buffers in Inputs()/Outputs() order; dims gives the sizes of the
+    // model's Dims() for this call, whose workspace must fit in what max_dims reserved
+    void Run(std::span<const void* const> inputs, std::span<void* const> outputs,
+             std::span<const int64_t> dims = {}) const;
+
+  private:
+    struct AlignedFree {
+        void operator()(std::byte* ptr) const;
+    };
+
+    std::shared_ptr<const CompiledModel> model_;
+    std::shared_ptr<ThreadPool> pool_;
+    int64_t grain_ = 0;
+    size_t workspace_bytes_ = 0;
+    std::vector<std::unique_ptr<std::byte, AlignedFree>> workspaces_;
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable released_;
+    mutable std::vector<std::byte*> free_; // capacity reserved for every workspace
+
+    std::byte* Acquire() const;
+    void Release(std::byte* workspace) const;
+};
+
+} // namespace tc::runtime
+
+#endif // SESSION_HPP_
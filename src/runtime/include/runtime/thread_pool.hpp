@@ -0,0 +1,93 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tc::runtime {
+
+struct ThreadPoolOptions {
+    // worker threads; 0 = one per hardware thread
+    size_t threads = 0;
+    // worker i is pinned to cpus[i % cpus.size()]; empty = no pinning
+    std::vector<int> cpus;
+};
+
+// Fixed set of workers with one work-stealing deque each. A ParallelFor spreads its chunks over the
+// deques; a worker drains its own deque from the back and steals from the front of the others.
+// Pools are meant to be shared: sessions that use the same pool never put more runnable threads on
+// the cores than the pool has workers (plus the calling threads, which help with their own loops).
+class ThreadPool {
+  public:
+    explicit ThreadPool(ThreadPoolOptions options = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t Size() const { return workers_.size(); }
+
+    // calls fn(lo, hi) on disjoint chunks of at most grain iterations covering [begin, end) and
+    // returns once all of them ran; grain <= 0 picks one from the pool size. fn must not throw.
+    // Safe to call from several threads at once. Does not allocate.
+    template <typename F>
+    void ParallelFor(int64_t begin, int64_t end, int64_t grain, F&& fn) {
+        auto call = [](void* f, int64_t lo, int64_t hi) { (*static_cast<std::remove_reference_t<F>*>(f))(lo, hi); };
+        ParallelForImpl(begin, end, grain, RangeFn{const_cast<void*>(static_cast<const void*>(&fn)), call});
+    }
+
+  private:
+    struct RangeFn {
+        void* obj;
+        void (*call)(void* obj, int64_t lo, int64_t hi);
+    };
+    struct Job {
+        RangeFn fn;
+        std::atomic<int64_t> pending{0};
+    };
+    struct Chunk {
+        Job* job = nullptr;
+        int64_t lo = 0;
+        int64_t hi = 0;
+    };
+
+    // bounded ring; the owner pushes and pops at the back, thieves take from the front
+    class WorkDeque {
+      public:
+        explicit WorkDeque(size_t capacity) : ring_(capacity) {}
+
+        bool PushBack(const Chunk& chunk);
+        bool PopBack(Chunk* chunk);
+        bool StealFront(Chunk* chunk);
+
+      private:
+        std::mutex mutex_;
+        std::vector<Chunk> ring_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+
+    std::vector<std::unique_ptr<WorkDeque>> deques_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_deque_{0};
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    uint64_t epoch_ = 0;
+    bool stop_ = false;
+
+    void ParallelForImpl(int64_t begin, int64_t end, int64_t grain, RangeFn fn);
+    bool RunOne(size_t home);
+    void WorkerLoop(size_t index);
+    static void Run(const Chunk& chunk);
+};
+
+} // namespace tc::runtime
+
+#endif // THREAD_POOL_HPP_
@@ -0,0 +1,211 @@
+#include "runtime/autotuner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "runtime/compiled_model.hpp"
+
+namespace tc::runtime {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+bool HasStaticShapes(const Operation& op) {
+    auto is_static = [](const Value* value) {
+        const std::optional<TensorType>& type = value->MaybeTensorType();
+        return type.has_value() &&
+               std::none_of(type->Shape().begin(), type->Shape().end(), [](int64_t dim) { return dim < 0; });
+    };
+    return std::all_of(op.Inputs().begin(), op.Inputs().end(), is_static) &&
+           std::all_of(op.Outputs().begin(), op.Outputs().end(), is_static);
+}
+
+std::vector<std::byte> RandomBytes(const TensorSpec& spec, std::mt19937& rng) {
+    std::vector<std::byte> raw(spec.ByteSize());
+    if (spec.type.ElemType() == TensorElemType::kFloat32) {
+        std::uniform_real_distribution<float> dist{-1.0f, 1.0f};
+        for (size_t offset = 0; offset + sizeof(float) <= raw.size(); offset += sizeof(float)) {
+            const float v = dist(rng);
+            std::memcpy(raw.data() + offset, &v, sizeof(float));
+        }
+    }
+    return raw;
+}
+
+// equal up to the rounding a different summation order may cause
+bool SameOutputs(const TensorSpec& spec, const std::vector<std::byte>& lhs, const std::vector<std::byte>& rhs) {
+    if (spec.type.ElemType() != TensorElemType::kFloat32) {
+        return lhs == rhs;
+    }
+    for (size_t offset = 0; offset + sizeof(float) <= lhs.size(); offset += sizeof(float)) {
+        float a = 0;
+        float b = 0;
+        std::memcpy(&a, lhs.data() + offset, sizeof(float));
+        std::memcpy(&b, rhs.data() + offset, sizeof(float));
+        if (std::fabs(a - b) > 1e-4f * std::max(1.0f, std::fabs(a))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// one compiled candidate with its inputs, outputs and workspace
+class Trial {
+  public:
+    Trial(const Graph& graph, const std::string& signature, const ContractionSchedule& schedule,
+          const AutotuneOptions& options) {
+        auto database = std::make_shared<TuningDatabase>();
+        database->Set(signature, TuningDatabase::Entry{schedule, -1});
+        JitOptions jit_options;
+        jit_options.opt_level = options.opt_level;
+        jit_options.tuning = std::move(database);
+        model_ = CompiledModel::Jit(graph, jit_options);
+
+        std::mt19937 rng{options.seed};
+        for (const TensorSpec& spec : model_->Inputs()) {
+            inputs_.push_back(RandomBytes(spec, rng));
+            input_ptrs_.push_back(inputs_.back().data());
+        }
+        for (const TensorSpec& spec : model_->Outputs()) {
+            outputs_.emplace_back(spec.ByteSize());
+            output_ptrs_.push_back(outputs_.back().data());
+        }
+        constexpr size_t kAlign = CompiledModel::kWorkspaceAlignment;
+        const size_t bytes = std::max<size_t>(1, (model_->WorkspaceSize() + kAlign - 1) / kAlign) * kAlign;
+        workspace_.reset(static_cast<std::byte*>(std::aligned_alloc(kAlign, bytes)));
+        if (workspace_ == nullptr) {
+            throw std::bad_alloc{};
+        }
+    }
+
+    // median microseconds per call
+    double Measure(const AutotuneOptions& options) {
+        for (size_t i = 0; i < options.warmup; ++i) {
+            Invoke();
+        }
+        std::vector<double> micros;
+        micros.reserve(std::max<size_t>(options.iterations, 1));
+        for (size_t i = 0; i < std::max<size_t>(options.iterations, 1); ++i) {
+            const Clock::time_point begin = Clock::now();
+            Invoke();
+            micros.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+        }
+        std::nth_element(micros.begin(), micros.begin() + static_cast<std::ptrdiff_t>(micros.size() / 2), micros.end());
+        return micros[micros.size() / 2];
+    }
+
+    bool SameOutputsAs(const Trial& other) const {
+        for (size_t o = 0; o < outputs_.size(); ++o) {
+            if (!SameOutputs(model_->Outputs()[o], outputs_[o], other.outputs_[o])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    struct AlignedFree {
+        void operator()(std::byte* ptr) const { std::free(ptr); }
+    };
+
+    std::shared_ptr<const CompiledModel> model_;
+    std::vector<std::vector<std::byte>> inputs_;
+    std::vector<std::vector<std::byte>> outputs_;
+    std::vector<const void*> input_ptrs_;
+    std::vector<void*> output_ptrs_;
+    std::unique_ptr<std::byte, AlignedFree> workspace_;
+
+    void Invoke() { model_->Invoke(input_ptrs_.data(), output_ptrs_.data(), workspace_.get()); }
+};
+
+} // namespace
+
+Graph IsolateOperation(const Operation& op) {
+    Graph graph;
+    std::unordered_map<const Value*, Value*> mapped;
+    auto map_values = [&](const std::vector<Value*>& values, Value::BelongTo belong) {
+        std::vector<Value*> copies;
+        for (const Value* value : values) {
+            auto [it, inserted] = mapped.emplace(value, nullptr);
+            if (inserted) {
+                it->second = graph.AddNode<Value>(value->Name(), belong);
+                if (value->MaybeTensorType().has_value()) {
+                    it->second->MergeTensorType(*value->MaybeTensorType());
+                }
+            }
+            copies.push_back(it->second);
+        }
+        return copies;
+    };
+    std::vector<Value*> inputs = map_values(op.Inputs(), Value::BelongTo::kInput);
+    std::vector<Value*> outputs = map_values(op.Outputs(), Value::BelongTo::kOutput);
+    graph.AddNode<Operation>(op.Name(), op.Type(), std::move(inputs), std::move(outputs), op.Attrs());
+    return graph;
+}
+
+std::vector<AutotuneResult> Autotune(const Graph& graph, TuningDatabase& database, const AutotuneOptions& options) {
+    if (!JitAvailable()) {
+        throw std::runtime_error{"autotune: tc was built without the MLIR libraries"};
+    }
+
+    std::vector<AutotuneResult> results;
+    std::unordered_set<std::string> seen;
+    for (const INode* node : graph) {
+        const auto* op = dynamic_cast<const Operation*>(node);
+        if (op == nullptr || !IsTunable(*op) || !HasStaticShapes(*op)) {
+            continue;
+        }
+        const std::string signature = TuningSignature(*op);
+        if (!seen.insert(signature).second || (!options.retune && database.Find(signature) != nullptr)) {
+            continue;
+        }
+
+        const Graph isolated = IsolateOperation(*op);
+        const std::vector<ContractionSchedule> candidates = CandidateSchedules(*op);
+        Trial reference{isolated, signature, ContractionSchedule{}, options};
+        AutotuneResult result{signature, op->Name(), ContractionSchedule{}, reference.Measure(options), 0,
+                              candidates.size()};
+        result.default_micros = result.micros;
+
+        for (const ContractionSchedule& candidate : candidates) {
+            if (candidate.IsDefault()) {
+                continue;
+            }
+            Trial trial{isolated, signature, candidate, options};
+            const double micros = trial.Measure(options);
+            if (!trial.SameOutputsAs(reference)) {
+                throw std::runtime_error{"autotune: " + op->Name() + " computes different results with " +
+                                         FormatSchedule(candidate)};
+            }
+            spdlog::debug("autotune: {} {}: {:.2f} us", signature, FormatSchedule(candidate), micros);
+            if (micros < result.micros) {
+                result.schedule = candidate;
+                result.micros = micros;
+            }
+        }
+
+        spdlog::info("autotune: {}: {} ({:.2f} us, default {:.2f} us, {} candidates)", signature,
+                     FormatSchedule(result.schedule), result.micros, result.default_micros, result.candidates);
+        database.Set(signature, TuningDatabase::Entry{result.schedule, result.micros});
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+
+} // namespace tc::runtime
@@ -0,0 +1,182 @@
+#include "runtime/batcher.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace tc::runtime {
+
+namespace {
+
+size_t BatchOf(const CompiledModel& model) {
+    if (model.Inputs().empty() || model.Inputs()[0].type.Shape().empty()) {
+        throw std::runtime_error{"batcher: model has no batched input"};
+    }
+    const int64_t batch = model.Inputs()[0].type.Shape()[0];
+    if (batch <= 0) {
+        throw std::runtime_error{"batcher: batch size must be positive, got " + std::to_string(batch)};
+    }
+    return static_cast<size_t>(batch);
+}
+
+// bytes per batch row of each tensor; every tensor must start with the batch dimension
+std::vector<size_t> RowBytes(const std::vector<TensorSpec>& specs, size_t batch) {
+    std::vector<size_t> rows;
+    rows.reserve(specs.size());
+    for (const TensorSpec& spec : specs) {
+        const std::vector<int64_t>& shape = spec.type.Shape();
+        if (shape.empty() || shape[0] != static_cast<int64_t>(batch)) {
+            throw std::runtime_error{"batcher: tensor '" + spec.name + "' does not start with batch dimension " +
+                                     std::to_string(batch)};
+        }
+        rows.push_back(spec.ByteSize() / batch);
+    }
+    return rows;
+}
+
+void CheckCount(const char* what, size_t got, size_t expected) {
+    if (got != expected) {
+        throw std::runtime_error{std::string{"batcher: expected "} + std::to_string(expected) + " " + what +
+                                 ", got " + std::to_string(got)};
+    }
+}
+
+} // namespace
+
+DynamicBatcher::DynamicBatcher(std::vector<std::shared_ptr<const CompiledModel>> variants, BatcherOptions options)
+    : max_delay_{options.max_delay} {
+    if (variants.empty()) {
+        throw std::runtime_error{"batcher: no model variants"};
+    }
+    std::sort(variants.begin(), variants.end(), [](const auto& l, const auto& r) { return BatchOf(*l) < BatchOf(*r); });
+
+    for (std::shared_ptr<const CompiledModel>& model : variants) {
+        const size_t batch = BatchOf(*model);
+        const std::vector<size_t> in_rows = RowBytes(model->Inputs(), batch);
+        const std::vector<size_t> out_rows = RowBytes(model->Outputs(), batch);
+        if (variants_.empty()) {
+            input_row_bytes_ = in_rows;
+            output_row_bytes_ = out_rows;
+        } else if (batch == variants_.back().batch) {
+            throw std::runtime_error{"batcher: two variants for batch size " + std::to_string(batch)};
+        } else if (in_rows != input_row_bytes_ || out_rows != output_row_bytes_) {
+            throw std::runtime_error{"batcher: variant for batch size " + std::to_string(batch) +
+                                     " does not match the others' tensors"};
+        }
+
+        Variant variant;
+        variant.batch = batch;
+        for (size_t row : in_rows) {
+            variant.inputs.emplace_back(row * batch);
+            variant.input_ptrs.push_back(variant.inputs.back().data());
+        }
+        for (size_t row : out_rows) {
+            variant.outputs.emplace_back(row * batch);
+            variant.output_ptrs.push_back(variant.outputs.back().data());
+        }
+        // batches run one at a time on the dispatcher
+        variant.session = std::make_unique<Session>(std::move(model), SessionOptions{1, options.pool, 0, {}});
+        variants_.push_back(std::move(variant));
+    }
+
+    batch_.reserve(MaxBatch());
+    dispatcher_ = std::thread{[this] { DispatchLoop(); }};
+}
+
+DynamicBatcher::~DynamicBatcher() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    arrived_.notify_one();
+    dispatcher_.join();
+}
+
+void DynamicBatcher::Infer(std::span<const void* const> inputs, std::span<void* const> outputs) {
+    CheckCount("inputs", inputs.size(), input_row_bytes_.size());
+    CheckCount("outputs", outputs.size(), output_row_bytes_.size());
+
+    Request request{inputs, outputs, std::chrono::steady_clock::now(), false, nullptr};
+    std::unique_lock lock{mutex_};
+    if (stop_) {
+        throw std::runtime_error{"batcher: shutting down"};
+    }
+    queue_.push_back(&request);
+    if (queue_.size() == 1 || queue_.size() == MaxBatch()) {
+        arrived_.notify_one();
+    }
+    completed_.wait(lock, [&] { return request.done; });
+    if (request.error) {
+        std::rethrow_exception(request.error);
+    }
+}
+
+BatcherStats DynamicBatcher::Stats() const {
+    std::lock_guard lock{mutex_};
+    return stats_;
+}
+
+void DynamicBatcher::DispatchLoop() {
+    std::unique_lock lock{mutex_};
+    while (true) {
+        arrived_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        const auto deadline = queue_.front()->arrival + max_delay_;
+        arrived_.wait_until(lock, deadline, [&] { return stop_ || queue_.size() >= MaxBatch(); });
+
+        const size_t n = std::min(queue_.size(), MaxBatch());
+        batch_.assign(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(n));
+        queue_.erase(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(n));
+
+        lock.unlock();
+        RunBatch();
+        lock.lock();
+
+        for (Request* request : batch_) {
+            request->done = true;
+        }
+        stats_.requests += batch_.size();
+        stats_.batches += 1;
+        stats_.padded_rows += padded_rows_;
+        completed_.notify_all();
+    }
+}
+
+void DynamicBatcher::RunBatch() {
+    const size_t n = batch_.size();
+    Variant& variant = *std::find_if(variants_.begin(), variants_.end(), [&](const Variant& v) { return v.batch >= n; });
+
+    // rows past n keep whatever the previous batch left there; their results are dropped
+    for (size_t i = 0; i < input_row_bytes_.size(); ++i) {
+        const size_t row = input_row_bytes_[i];
+        for (size_t r = 0; r < n; ++r) {
+            std::memcpy(variant.inputs[i].data() + r * row, batch_[r]->inputs[i], row);
+        }
+    }
+
+    padded_rows_ = variant.batch - n;
+    // the dispatcher must survive a failed batch, or every queued Infer would wait forever
+    try {
+        variant.session->Run(variant.input_ptrs, variant.output_ptrs);
+    } catch (...) {
+        const std::exception_ptr error = std::current_exception();
+        for (Request* request : batch_) {
+            request->error = error;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < output_row_bytes_.size(); ++i) {
+        const size_t row = output_row_bytes_[i];
+        for (size_t r = 0; r < n; ++r) {
+            std::memcpy(batch_[r]->outputs[i], variant.outputs[i].data() + r * row, row);
+        }
+    }
+}
+
+} // namespace tc::runtime
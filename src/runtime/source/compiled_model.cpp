@@ -0,0 +1,278 @@
+#include "runtime/compiled_model.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include <spdlog/spdlog.h>
+
+#include "mlir_backend/mlir_backend.hpp"
+#include "runtime/profiler.hpp"
+
+#if defined(TC_HAVE_MLIR)
+
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/Mangling.h>
+#include <llvm/Support/Error.h>
+
+#include <mlir/ExecutionEngine/ExecutionEngine.h>
+#include <mlir/ExecutionEngine/OptUtils.h>
+#include <mlir/IR/MLIRContext.h>
+
+#include "driver/inprocess_lowering.hpp"
+#include "mlir_backend/mlir_builder.hpp"
+
+#endif // TC_HAVE_MLIR
+
+namespace tc::runtime {
+
+namespace {
+
+using Trampoline = void (*)(void* fn, void* const* args);
+using TaskTrampoline = void (*)(void* fn, void* const* args, int64_t lo, int64_t hi);
+
+template <size_t I>
+using PointerArg = void*;
+
+// the bare-pointer ABI passes every tensor as one pointer, so entries and tasks are called
+// through pointer-only prototypes of their arity: fn(args[0], ..., args[N-1] [, lo, hi])
+template <size_t... I>
+void CallWithArgs(void* fn, void* const* args, std::index_sequence<I...> /*unused*/) {
+    reinterpret_cast<void (*)(PointerArg<I>...)>(fn)(args[I]...);
+}
+
+template <size_t... I>
+void CallTaskWithArgs(void* fn, void* const* args, int64_t lo, int64_t hi, std::index_sequence<I...> /*unused*/) {
+    reinterpret_cast<void (*)(PointerArg<I>..., int64_t, int64_t)>(fn)(args[I]..., lo, hi);
+}
+
+template <size_t N>
+void Call(void* fn, void* const* args) {
+    CallWithArgs(fn, args, std::make_index_sequence<N>{});
+}
+
+template <size_t N>
+void CallTask(void* fn, void* const* args, int64_t lo, int64_t hi) {
+    CallTaskWithArgs(fn, args, lo, hi, std::make_index_sequence<N>{});
+}
+
+template <size_t... N>
+constexpr std::array<Trampoline, sizeof...(N)> MakeTrampolines(std::index_sequence<N...> /*unused*/) {
+    return {&Call<N>...};
+}
+
+template <size_t... N>
+constexpr std::array<TaskTrampoline, sizeof...(N)> MakeTaskTrampolines(std::index_sequence<N...> /*unused*/) {
+    return {&CallTask<N>...};
+}
+
+// indexed by the number of pointer arguments, workspace and dims included
+constexpr auto kTrampolines = MakeTrampolines(std::make_index_sequence<CompiledModel::kMaxTensors + 3>{});
+constexpr auto kTaskTrampolines = MakeTaskTrampolines(std::make_index_sequence<CompiledModel::kMaxTensors + 3>{});
+
+std::vector<TensorSpec> SpecsOf(const std::vector<const Value*>& values) {
+    std::vector<TensorSpec> specs;
+    specs.reserve(values.size());
+    for (const Value* value : values) {
+        specs.push_back(TensorSpec{value->Name(), *value->MaybeTensorType()});
+    }
+    return specs;
+}
+
+// options tc.x compiles with for --emit-shared
+MlirEmitterOptions CAbiOptions() {
+    MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    return options;
+}
+
+int64_t CallI64(void* fn) {
+    return reinterpret_cast<int64_t (*)()>(fn)();
+}
+
+int64_t CallI64(void* fn, const int64_t* dims) {
+    return reinterpret_cast<int64_t (*)(const int64_t*)>(fn)(dims);
+}
+
+size_t CheckedWorkspaceSize(int64_t size) {
+    if (size < 0) {
+        throw std::runtime_error{"runtime: negative workspace size"};
+    }
+    return static_cast<size_t>(size);
+}
+
+} // namespace
+
+CompiledModel::CompiledModel(const Graph& graph, std::shared_ptr<void> code, const SymbolLookup& lookup)
+    : code_{std::move(code)} {
+    const EntrySignature signature = EntrySignatureOf(graph);
+    inputs_ = SpecsOf(signature.inputs);
+    outputs_ = SpecsOf(signature.outputs);
+    for (const DynamicDim& dim : signature.dims) {
+        const size_t input = static_cast<size_t>(
+            std::find(signature.inputs.begin(), signature.inputs.end(), dim.input) - signature.inputs.begin());
+        dims_.push_back(DimSpec{input, dim.axis});
+    }
+    shapes_ = std::make_shared<const ShapeResolver>(graph);
+    if (inputs_.size() + outputs_.size() > kMaxTensors) {
+        throw std::runtime_error{"runtime: entry takes " + std::to_string(inputs_.size() + outputs_.size()) +
+                                 " tensors, at most " + std::to_string(kMaxTensors) + " are supported"};
+    }
+
+    const MlirEmitterOptions options = CAbiOptions();
+    auto require = [&](const std::string& name) {
+        void* address = lookup(name);
+        if (address == nullptr) {
+            throw std::runtime_error{"runtime: missing symbol " + name};
+        }
+        return address;
+    };
+
+    entry_ = require(EntrySymbol(options));
+    workspace_size_fn_ = require(WorkspaceSizeSymbol(options));
+    if (dims_.empty()) {
+        workspace_size_ = CheckedWorkspaceSize(CallI64(workspace_size_fn_));
+    }
+
+    // tasks are optional: without them the session calls the entry on one thread
+    void* task_count_fn = lookup(TaskCountSymbol(options));
+    const int64_t task_count = task_count_fn != nullptr ? CallI64(task_count_fn) : 0;
+    tasks_.reserve(static_cast<size_t>(std::max<int64_t>(task_count, 0)));
+    for (int64_t i = 0; i < task_count; ++i) {
+        const size_t index = static_cast<size_t>(i);
+        void* extent_fn = require(TaskExtentSymbol(options, index));
+        tasks_.push_back(Task{require(TaskSymbol(options, index)), extent_fn, dims_.empty() ? CallI64(extent_fn) : 0});
+    }
+}
+
+std::shared_ptr<const CompiledModel> CompiledModel::LoadSharedLibrary(const std::string& path, const Graph& graph) {
+    void* handle = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        throw std::runtime_error{"runtime: unable to load " + path + ": " + ::dlerror()};
+    }
+    std::shared_ptr<void> library{handle, [](void* h) { ::dlclose(h); }};
+
+    std::shared_ptr<const CompiledModel> model{new CompiledModel{
+        graph, std::move(library), [&](const std::string& name) { return ::dlsym(handle, name.c_str()); }}};
+    spdlog::info("runtime: loaded {} ({} dynamic dims, workspace {} bytes, {} tasks)", path, model->Dims().size(),
+                 model->Dims().empty() ? model->WorkspaceSize() : 0, model->TaskCount());
+    return model;
+}
+
+#if defined(TC_HAVE_MLIR)
+
+std::shared_ptr<const CompiledModel> CompiledModel::Jit(const Graph& graph, const JitOptions& options) {
+    MlirEmitterOptions emit_options = CAbiOptions();
+    emit_options.specializations = options.specializations;
+    emit_options.instrument = options.instrument;
+    emit_options.tuning = options.tuning;
+    emit_options.conv_algorithm = options.conv_algorithm;
+
+    mlir::MLIRContext context;
+    mlir::OwningOpRef<mlir::ModuleOp> module = BuildMlirModule(context, graph, emit_options);
+    driver::RunLlvmLoweringPipeline(*module, /*bare_ptr_call_conv=*/true);
+
+    mlir::ExecutionEngineOptions engine_options;
+    engine_options.transformer = mlir::makeOptimizingTransformer(options.opt_level, 0, nullptr);
+
+    auto jit = mlir::ExecutionEngine::create(*module, engine_options);
+    if (!jit) {
+        throw std::runtime_error{"JIT: unable to create execution engine: " + llvm::toString(jit.takeError())};
+    }
+
+    mlir::ExecutionEngine& engine = **jit;
+    if (options.instrument) {
+        engine.registerSymbols([](llvm::orc::MangleAndInterner interner) {
+            llvm::orc::SymbolMap symbols;
+            symbols[interner(kProfileEnterHook)] = {llvm::orc::ExecutorAddr::fromPtr(&tc_profile_enter),
+                                                    llvm::JITSymbolFlags::Exported};
+            symbols[interner(kProfileExitHook)] = {llvm::orc::ExecutorAddr::fromPtr(&tc_profile_exit),
+                                                   llvm::JITSymbolFlags::Exported};
+            return symbols;
+        });
+    }
+    auto lookup = [&](const std::string& name) -> void* {
+        auto address = engine.lookup(name);
+        if (!address) {
+            llvm::consumeError(address.takeError());
+            return nullptr;
+        }
+        return *address;
+    };
+
+    std::shared_ptr<void> code{std::move(*jit)};
+    return std::shared_ptr<const CompiledModel>{new CompiledModel{graph, std::move(code), lookup}};
+}
+
+#else // TC_HAVE_MLIR
+
+std::shared_ptr<const CompiledModel> CompiledModel::Jit(const Graph& /*graph*/, const JitOptions& /*options*/) {
+    throw std::runtime_error{"JIT: tc was built without the MLIR libraries"};
+}
+
+#endif // TC_HAVE_MLIR
+
+std::vector<std::vector<int64_t>> CompiledModel::OutputShapes(std::span<const int64_t> dims) const {
+    return shapes_->OutputShapes(dims);
+}
+
+size_t CompiledModel::WorkspaceSize(std::span<const int64_t> dims) const {
+    if (dims_.empty()) {
+        return workspace_size_;
+    }
+    CheckDims(dims);
+    return CheckedWorkspaceSize(CallI64(workspace_size_fn_, dims.data()));
+}
+
+int64_t CompiledModel::TaskExtent(size_t task, std::span<const int64_t> dims) const {
+    if (dims_.empty()) {
+        return tasks_[task].extent;
+    }
+    CheckDims(dims);
+    return CallI64(tasks_[task].extent_fn, dims.data());
+}
+
+void CompiledModel::CheckDims(std::span<const int64_t> dims) const {
+    if (dims.size() != dims_.size()) {
+        throw std::runtime_error{"runtime: expected " + std::to_string(dims_.size()) + " dynamic dimensions, got " +
+                                 std::to_string(dims.size())};
+    }
+}
+
+size_t CompiledModel::PackArgs(void** args, const void* const* inputs, void* const* outputs, void* workspace,
+                               const int64_t* dims) const {
+    size_t n = 0;
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        args[n++] = const_cast<void*>(inputs[i]);
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        args[n++] = outputs[i];
+    }
+    args[n++] = workspace;
+    if (!dims_.empty()) {
+        args[n++] = const_cast<int64_t*>(dims);
+    }
+    return n;
+}
+
+void CompiledModel::Invoke(const void* const* inputs, void* const* outputs, void* workspace,
+                           const int64_t* dims) const {
+    std::array<void*, kMaxTensors + 2> args;
+    const size_t n = PackArgs(args.data(), inputs, outputs, workspace, dims);
+    kTrampolines[n](entry_, args.data());
+}
+
+void CompiledModel::InvokeTask(size_t task, const void* const* inputs, void* const* outputs, void* workspace,
+                               int64_t lo, int64_t hi, const int64_t* dims) const {
+    std::array<void*, kMaxTensors + 2> args;
+    const size_t n = PackArgs(args.data(), inputs, outputs, workspace, dims);
+    kTaskTrampolines[n](tasks_[task].fn, args.data(), lo, hi);
+}
+
+} // namespace tc::runtime
@@ -0,0 +1,247 @@
+#include "runtime/jit_model.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "mlir_backend/mlir_backend.hpp"
+
+#if defined(TC_HAVE_MLIR)
+
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/Error.h>
+
+#include <mlir/ExecutionEngine/ExecutionEngine.h>
+#include <mlir/ExecutionEngine/OptUtils.h>
+#include <mlir/IR/MLIRContext.h>
+
+#include "driver/inprocess_lowering.hpp"
+#include "mlir_backend/mlir_builder.hpp"
+
+#endif // TC_HAVE_MLIR
+
+namespace tc::runtime {
+
+namespace {
+
+void CheckArity(const char* what, size_t got, size_t expected) {
+    if (got != expected) {
+        throw std::runtime_error{std::string{"JIT: expected "} + std::to_string(expected) + " " + what +
+                                 ", got " + std::to_string(got)};
+    }
+}
+
+} // namespace
+
+#if defined(TC_HAVE_MLIR)
+
+struct JitModel::Engine {
+    std::unique_ptr<mlir::ExecutionEngine> jit;
+    // packed wrapper of _mlir_ciface_<entry>: args[i] points at the i-th descriptor pointer
+    void (*entry)(void**) = nullptr;
+};
+
+namespace {
+
+std::vector<TensorSpec> SpecsOf(const std::vector<const Value*>& values) {
+    std::vector<TensorSpec> specs;
+    specs.reserve(values.size());
+    for (const Value* value : values) {
+        specs.push_back(TensorSpec{value->Name(), *value->MaybeTensorType()});
+    }
+    return specs;
+}
+
+std::vector<DimSpec> DimSpecsOf(const EntrySignature& signature) {
+    std::vector<DimSpec> dims;
+    for (const DynamicDim& dim : signature.dims) {
+        const size_t input = static_cast<size_t>(
+            std::find(signature.inputs.begin(), signature.inputs.end(), dim.input) - signature.inputs.begin());
+        dims.push_back(DimSpec{input, dim.axis});
+    }
+    return dims;
+}
+
+// StridedMemRefType<T, rank> laid out field by field:
+// {allocated ptr, aligned ptr, offset, sizes[rank], strides[rank]} for a dense row-major buffer
+void AppendDescriptor(std::vector<int64_t>* out, const std::vector<int64_t>& shape, const void* data) {
+    static_assert(sizeof(void*) == sizeof(int64_t), "memref descriptors assume 64-bit pointers");
+
+    const int64_t ptr = static_cast<int64_t>(reinterpret_cast<intptr_t>(data));
+    out->push_back(ptr);
+    out->push_back(ptr);
+    out->push_back(0);
+    for (int64_t dim : shape) {
+        out->push_back(dim);
+    }
+    int64_t stride = 1;
+    std::vector<int64_t> strides(shape.size());
+    for (size_t i = shape.size(); i-- > 0;) {
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+    out->insert(out->end(), strides.begin(), strides.end());
+}
+
+llvm::CodeGenOptLevel ToCodeGenOptLevel(unsigned opt_level) {
+    switch (opt_level) {
+        case 0: return llvm::CodeGenOptLevel::None;
+        case 1: return llvm::CodeGenOptLevel::Less;
+        case 2: return llvm::CodeGenOptLevel::Default;
+        default: return llvm::CodeGenOptLevel::Aggressive;
+    }
+}
+
+} // namespace
+
+bool JitAvailable() {
+    return true;
+}
+
+JitModel::JitModel(const Graph& graph, const JitOptions& options) {
+    MlirEmitterOptions emit_options;
+    emit_options.emit_c_interface = true;
+    emit_options.specializations = options.specializations;
+    emit_options.tuning = options.tuning;
+    emit_options.conv_algorithm = options.conv_algorithm;
+
+    mlir::MLIRContext context;
+    mlir::OwningOpRef<mlir::ModuleOp> module = BuildMlirModule(context, graph, emit_options);
+    driver::RunLlvmLoweringPipeline(*module);
+
+    const EntrySignature signature = EntrySignatureOf(graph);
+    inputs_ = SpecsOf(signature.inputs);
+    outputs_ = SpecsOf(signature.outputs);
+    dims_ = DimSpecsOf(signature);
+    shapes_ = std::make_shared<const ShapeResolver>(graph);
+
+    mlir::ExecutionEngineOptions engine_options;
+    engine_options.transformer = mlir::makeOptimizingTransformer(options.opt_level, 0, nullptr);
+    engine_options.jitCodeGenOptLevel = ToCodeGenOptLevel(options.opt_level);
+
+    auto jit = mlir::ExecutionEngine::create(*module, engine_options);
+    if (!jit) {
+        throw std::runtime_error{"JIT: unable to create execution engine: " + llvm::toString(jit.takeError())};
+    }
+
+    const std::string entry_name = "_mlir_ciface_" + EntrySymbol(emit_options);
+    auto entry = (*jit)->lookupPacked(entry_name);
+    if (!entry) {
+        throw std::runtime_error{"JIT: missing entry " + entry_name + ": " + llvm::toString(entry.takeError())};
+    }
+
+    engine_ = std::make_unique<Engine>(Engine{std::move(*jit), *entry});
+    spdlog::info("jit: compiled {} ({} inputs, {} outputs)", entry_name, inputs_.size(), outputs_.size());
+}
+
+void JitModel::Run(const std::vector<const void*>& inputs, const std::vector<void*>& outputs,
+                   const std::vector<int64_t>& dims) const {
+    CheckArity("inputs", inputs.size(), inputs_.size());
+    CheckArity("outputs", outputs.size(), outputs_.size());
+
+    // the descriptors carry the run-time sizes the emitted code reads with memref.dim
+    const std::vector<std::vector<int64_t>> output_shapes = shapes_->OutputShapes(dims);
+    std::vector<int64_t> fields;
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+        std::vector<int64_t> shape = inputs_[i].type.Shape();
+        for (size_t d = 0; d < dims_.size(); ++d) {
+            if (dims_[d].input == i) {
+                shape[dims_[d].axis] = dims[d];
+            }
+        }
+        offsets.push_back(fields.size());
+        AppendDescriptor(&fields, shape, inputs[i]);
+    }
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        offsets.push_back(fields.size());
+        AppendDescriptor(&fields, output_shapes[i], outputs[i]);
+    }
+
+    std::vector<void*> descriptors;
+    descriptors.reserve(offsets.size());
+    for (size_t offset : offsets) {
+        descriptors.push_back(fields.data() + offset);
+    }
+    std::vector<void*> args;
+    args.reserve(descriptors.size());
+    for (void*& descriptor : descriptors) {
+        args.push_back(&descriptor);
+    }
+
+    engine_->entry(args.data());
+}
+
+#else // TC_HAVE_MLIR
+
+struct JitModel::Engine {};
+
+bool JitAvailable() {
+    return false;
+}
+
+JitModel::JitModel(const Graph& /*graph*/, const JitOptions& /*options*/) {
+    throw std::runtime_error{"JIT: tc was built without the MLIR libraries"};
+}
+
+void JitModel::Run(const std::vector<const void*>& /*inputs*/, const std::vector<void*>& /*outputs*/,
+                   const std::vector<int64_t>& /*dims*/) const {
+    throw std::runtime_error{"JIT: tc was built without the MLIR libraries"};
+}
+
+#endif // TC_HAVE_MLIR
+
+JitModel::~JitModel() = default;
+
+std::vector<TensorData> JitModel::Run(const std::vector<TensorData>& inputs) const {
+    CheckArity("inputs", inputs.size(), inputs_.size());
+
+    std::vector<int64_t> dims;
+    dims.reserve(dims_.size());
+    for (const DimSpec& dim : dims_) {
+        const std::vector<int64_t>& shape = inputs[dim.input].type.Shape();
+        if (shape.size() != inputs_[dim.input].type.Shape().size() || shape[dim.axis] <= 0) {
+            throw std::runtime_error{"JIT: input '" + inputs_[dim.input].name + "' needs a concrete shape"};
+        }
+        dims.push_back(shape[dim.axis]);
+    }
+
+    std::vector<const void*> input_ptrs;
+    input_ptrs.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const TensorSpec spec{inputs_[i].name, dims_.empty() ? inputs_[i].type : inputs[i].type};
+        if (inputs[i].raw.size() != spec.ByteSize()) {
+            throw std::runtime_error{"JIT: input '" + spec.name + "' expects " +
+                                     std::to_string(spec.ByteSize()) + " bytes, got " +
+                                     std::to_string(inputs[i].raw.size())};
+        }
+        input_ptrs.push_back(inputs[i].raw.data());
+    }
+
+    std::vector<std::vector<int64_t>> output_shapes;
+    if (!dims_.empty()) {
+        output_shapes = shapes_->OutputShapes(dims);
+    }
+    std::vector<TensorData> outputs;
+    std::vector<void*> output_ptrs;
+    outputs.reserve(outputs_.size());
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+        TensorType type = outputs_[i].type;
+        if (!dims_.empty()) {
+            type = TensorType{type.ElemType(), output_shapes[i]};
+        }
+        const TensorSpec spec{outputs_[i].name, type};
+        outputs.push_back(TensorData{spec.type, std::string(spec.ByteSize(), '\0')});
+        output_ptrs.push_back(outputs.back().raw.data());
+    }
+
+    Run(input_ptrs, output_ptrs, dims);
+    return outputs;
+}
+
+} // namespace tc::runtime
@@ -0,0 +1,116 @@
+#include "runtime/perf_counters.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tc::runtime {
+
+namespace {
+
+constexpr uint64_t kEventConfigs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+int OpenEvent(uint64_t config, int group_fd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd < 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+int64_t Difference(int64_t lhs, int64_t rhs) {
+    return lhs < 0 || rhs < 0 ? -1 : lhs - rhs;
+}
+
+int64_t Sum(int64_t lhs, int64_t rhs) {
+    return lhs < 0 || rhs < 0 ? -1 : lhs + rhs;
+}
+
+} // namespace
+
+double CounterValues::Ipc() const {
+    if (cycles <= 0 || instructions < 0) {
+        return -1;
+    }
+    return static_cast<double>(instructions) / static_cast<double>(cycles);
+}
+
+CounterValues CounterValues::operator-(const CounterValues& rhs) const {
+    return CounterValues{Difference(cycles, rhs.cycles), Difference(instructions, rhs.instructions),
+                         Difference(cache_misses, rhs.cache_misses), Difference(branch_misses, rhs.branch_misses)};
+}
+
+CounterValues& CounterValues::operator+=(const CounterValues& rhs) {
+    cycles = Sum(cycles, rhs.cycles);
+    instructions = Sum(instructions, rhs.instructions);
+    cache_misses = Sum(cache_misses, rhs.cache_misses);
+    branch_misses = Sum(branch_misses, rhs.branch_misses);
+    return *this;
+}
+
+PerfCounters::PerfCounters() {
+    for (int event = 0; event < kEvents; ++event) {
+        const int fd = OpenEvent(kEventConfigs[event], leader_);
+        if (fd < 0) {
+            if (unavailable_.empty()) {
+                unavailable_ = std::string{"perf_event_open: "} + std::strerror(errno);
+            }
+            continue;
+        }
+        fds_[event] = fd;
+        slot_[event] = opened_++;
+        if (leader_ < 0) {
+            leader_ = fd;
+        }
+    }
+    if (leader_ < 0) {
+        return;
+    }
+    unavailable_.clear();
+    ::ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+CounterValues PerfCounters::Read() const {
+    CounterValues values;
+    if (leader_ < 0) {
+        return values;
+    }
+    // nr, time_enabled, time_running, then one value per event in the order they joined
+    uint64_t data[3 + kEvents] = {};
+    const ssize_t size = ::read(leader_, data, sizeof(data));
+    if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || data[2] == 0) {
+        return values;
+    }
+    const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+    int64_t* fields[kEvents] = {&values.cycles, &values.instructions, &values.cache_misses, &values.branch_misses};
+    for (int event = 0; event < kEvents; ++event) {
+        if (slot_[event] >= 0 && static_cast<uint64_t>(slot_[event]) < data[0]) {
+            *fields[event] = static_cast<int64_t>(static_cast<double>(data[3 + slot_[event]]) * scale);
+        }
+    }
+    return values;
+}
+
+} // namespace tc::runtime
@@ -0,0 +1,245 @@
+#include "runtime/profiler.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "graph/cost_model.hpp"
+#include "helpers/json.hpp"
+
+namespace {
+
+std::atomic<tc::runtime::Profiler*> g_active{nullptr};
+std::atomic<uint64_t> g_generation{0};
+
+// where the calling thread logs for the recording profiler; generation tells whether it is stale
+struct ThreadState {
+    uint64_t generation = 0;
+    std::vector<tc::runtime::ProfileEvent>* events = nullptr;
+    uint32_t thread = 0;
+    uint64_t begin_generation = 0;
+    int64_t begin_ns = 0;
+    tc::runtime::CounterValues begin_counters;
+};
+
+thread_local ThreadState t_state;
+// opened on a thread's first hook under a profiler with hardware counters, kept until it exits
+thread_local std::unique_ptr<tc::runtime::PerfCounters> t_counters;
+
+int64_t NowNs() {
+    timespec now{};
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+}
+
+std::vector<const tc::Operation*> OperationsOf(const tc::Graph& graph) {
+    std::vector<const tc::Operation*> ops;
+    for (const tc::INode* node : graph) {
+        if (const auto* op = dynamic_cast<const tc::Operation*>(node)) {
+            ops.push_back(op);
+        }
+    }
+    return ops;
+}
+
+const tc::Operation& OperationAt(const std::vector<const tc::Operation*>& ops, int64_t index) {
+    if (index < 0 || static_cast<size_t>(index) >= ops.size()) {
+        throw std::runtime_error{"profiler: event of op " + std::to_string(index) + ", the graph has " +
+                                 std::to_string(ops.size()) + " operations"};
+    }
+    return *ops[static_cast<size_t>(index)];
+}
+
+} // namespace
+
+extern "C" void tc_profile_enter(int64_t /*op*/) {
+    tc::runtime::Profiler* profiler = g_active.load(std::memory_order_acquire);
+    if (profiler == nullptr) {
+        return;
+    }
+    t_state.begin_generation = profiler->generation_;
+    if (profiler->options_.hardware_counters) {
+        if (t_counters == nullptr) {
+            t_counters = std::make_unique<tc::runtime::PerfCounters>();
+        }
+        t_state.begin_counters = t_counters->Read();
+    }
+    t_state.begin_ns = NowNs();
+}
+
+extern "C" void tc_profile_exit(int64_t op) {
+    tc::runtime::Profiler* profiler = g_active.load(std::memory_order_acquire);
+    if (profiler == nullptr || t_state.begin_generation != profiler->generation_) {
+        return;
+    }
+    const int64_t end_ns = NowNs();
+    tc::runtime::CounterValues counters;
+    if (profiler->options_.hardware_counters && t_counters != nullptr) {
+        counters = t_counters->Read() - t_state.begin_counters;
+    }
+    if (t_state.generation != profiler->generation_) {
+        tc::runtime::Profiler::ThreadLog& log = profiler->RegisterThread();
+        t_state.generation = profiler->generation_;
+        t_state.events = &log.events;
+        t_state.thread = log.thread;
+    }
+    t_state.events->push_back(tc::runtime::ProfileEvent{
+        op, t_state.thread, t_state.begin_ns - profiler->start_ns_, end_ns - profiler->start_ns_, counters});
+}
+
+namespace tc::runtime {
+
+Profiler::~Profiler() {
+    Stop();
+}
+
+void Profiler::Start() {
+    if (options_.hardware_counters) {
+        const PerfCounters probe;
+        if (!probe.Available()) {
+            spdlog::warn("profiler: no hardware counters, timing only ({})", probe.Unavailable());
+        }
+    }
+    {
+        std::lock_guard lock{mutex_};
+        logs_.clear();
+    }
+    generation_ = g_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    start_ns_ = NowNs();
+    Profiler* expected = nullptr;
+    if (!g_active.compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+        throw std::runtime_error{"profiler: another profiler is already recording"};
+    }
+}
+
+void Profiler::Stop() {
+    Profiler* expected = this;
+    g_active.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+}
+
+Profiler::ThreadLog& Profiler::RegisterThread() {
+    std::lock_guard lock{mutex_};
+    ThreadLog& log = logs_.emplace_back(ThreadLog{static_cast<uint32_t>(logs_.size()), {}});
+    log.events.reserve(4096);
+    return log;
+}
+
+std::vector<ProfileEvent> Profiler::Events() const {
+    std::lock_guard lock{mutex_};
+    std::vector<ProfileEvent> events;
+    for (const ThreadLog& log : logs_) {
+        events.insert(events.end(), log.events.begin(), log.events.end());
+    }
+    return events;
+}
+
+std::vector<OpProfile> Profiler::Summarize(const Graph& graph, size_t runs) const {
+    const std::vector<const Operation*> ops = OperationsOf(graph);
+    std::vector<OpProfile> profiles(ops.size());
+    double total_us = 0;
+    for (const ProfileEvent& event : Events()) {
+        OperationAt(ops, event.op);
+        OpProfile& profile = profiles[static_cast<size_t>(event.op)];
+        const double us = static_cast<double>(event.end_ns - event.begin_ns) / 1e3;
+        if (profile.calls == 0 && options_.hardware_counters) {
+            profile.counters = CounterValues::Zero();
+        }
+        profile.counters += event.counters;
+        ++profile.calls;
+        profile.total_us += us;
+        total_us += us;
+    }
+
+    for (size_t i = 0; i < ops.size(); ++i) {
+        OpProfile& profile = profiles[i];
+        profile.name = ops[i]->Name();
+        profile.type = Operation::OpTypeToStr(ops[i]->Type());
+        profile.share = total_us > 0 ? profile.total_us / total_us : 0;
+        if (profile.total_us <= 0) {
+            continue;
+        }
+        const OpCost cost = EstimateCost(*ops[i]);
+        const double seconds = profile.total_us / 1e6;
+        const auto scaled = static_cast<double>(runs);
+        if (cost.flops >= 0) {
+            profile.flops_per_s = static_cast<double>(cost.flops) * scaled / seconds;
+        }
+        if (cost.bytes_read >= 0 && cost.bytes_written >= 0) {
+            profile.bytes_per_s = static_cast<double>(cost.bytes_read + cost.bytes_written) * scaled / seconds;
+        }
+        profile.ipc = profile.counters.Ipc();
+        if (cost.flops > 0 && profile.counters.cache_misses >= 0) {
+            profile.cache_misses_per_flop =
+                static_cast<double>(profile.counters.cache_misses) / (static_cast<double>(cost.flops) * scaled);
+        }
+    }
+    return profiles;
+}
+
+std::string Profiler::FormatTable(const std::vector<OpProfile>& ops) {
+    auto rate = [](double value, double scale) {
+        char text[32];
+        if (value < 0) {
+            std::snprintf(text, sizeof(text), "%10s", "-");
+        } else {
+            std::snprintf(text, sizeof(text), "%10.2f", value * scale);
+        }
+        return std::string{text};
+    };
+
+    std::string table;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-24s %-10s %10s %12s %7s %10s %10s %10s %10s\n", "op", "type", "calls",
+                  "total ms", "%", "GFLOP/s", "GB/s", "IPC", "miss/kFLOP");
+    table += line;
+    for (const OpProfile& op : ops) {
+        std::snprintf(line, sizeof(line), "%-24s %-10s %10zu %12.3f %7.1f ", op.name.c_str(), op.type.c_str(),
+                      op.calls, op.total_us / 1e3, op.share * 100.0);
+        table += line + rate(op.flops_per_s, 1e-9) + " " + rate(op.bytes_per_s, 1e-9) + " " + rate(op.ipc, 1.0) + " " +
+                 rate(op.cache_misses_per_flop, 1e3) + "\n";
+    }
+    return table;
+}
+
+std::string Profiler::ChromeTrace(const Graph& graph) const {
+    const std::vector<const Operation*> ops = OperationsOf(graph);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    bool first = true;
+    for (const ProfileEvent& event : Events()) {
+        const Operation& op = OperationAt(ops, event.op);
+        out << (first ? "\n" : ",\n") << "{\"name\": " << hlp::JsonQuote(op.Name())
+            << ", \"cat\": " << hlp::JsonQuote(Operation::OpTypeToStr(op.Type()))
+            << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread
+            << ", \"ts\": " << static_cast<double>(event.begin_ns) / 1e3
+            << ", \"dur\": " << static_cast<double>(event.end_ns - event.begin_ns) / 1e3
+            << ", \"args\": {\"op\": " << event.op;
+        if (event.counters.cycles >= 0) {
+            out << ", \"cycles\": " << event.counters.cycles;
+        }
+        if (event.counters.instructions >= 0) {
+            out << ", \"instructions\": " << event.counters.instructions;
+        }
+        if (event.counters.cache_misses >= 0) {
+            out << ", \"cache_misses\": " << event.counters.cache_misses;
+        }
+        if (event.counters.branch_misses >= 0) {
+            out << ", \"branch_misses\": " << event.counters.branch_misses;
+        }
+        out << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+} // namespace tc::runtime
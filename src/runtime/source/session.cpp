@@ -0,0 +1,105 @@
+#include "runtime/session.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace tc::runtime {
+
+namespace {
+
+void CheckArity(const char* what, size_t got, size_t expected) {
+    if (got != expected) {
+        throw std::runtime_error{std::string{"session: expected "} + std::to_string(expected) + " " + what +
+                                 ", got " + std::to_string(got)};
+    }
+}
+
+} // namespace
+
+void Session::AlignedFree::operator()(std::byte* ptr) const {
+    std::free(ptr);
+}
+
+Session::Session(std::shared_ptr<const CompiledModel> model, size_t concurrency)
+    : Session{std::move(model), SessionOptions{concurrency, nullptr, 0, {}}} {}
+
+Session::Session(std::shared_ptr<const CompiledModel> model, SessionOptions options)
+    : model_{std::move(model)}, pool_{std::move(options.pool)}, grain_{options.grain} {
+    size_t concurrency = options.concurrency;
+    if (concurrency == 0) {
+        concurrency = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    if (!model_->Dims().empty() && options.max_dims.empty()) {
+        throw std::runtime_error{"session: the model has dynamic dimensions, max_dims must be set"};
+    }
+
+    // aligned_alloc wants a non-zero multiple of the alignment
+    constexpr size_t kAlign = CompiledModel::kWorkspaceAlignment;
+    workspace_bytes_ = model_->WorkspaceSize(options.max_dims);
+    const size_t bytes = std::max<size_t>(1, (workspace_bytes_ + kAlign - 1) / kAlign) * kAlign;
+
+    workspaces_.reserve(concurrency);
+    free_.reserve(concurrency);
+    for (size_t i = 0; i < concurrency; ++i) {
+        auto* workspace = static_cast<std::byte*>(std::aligned_alloc(kAlign, bytes));
+        if (workspace == nullptr) {
+            throw std::bad_alloc{};
+        }
+        workspaces_.emplace_back(workspace);
+        free_.push_back(workspace);
+    }
+}
+
+Session::~Session() = default;
+
+void Session::Run(std::span<const void* const> inputs, std::span<void* const> outputs,
+                  std::span<const int64_t> dims) const {
+    CheckArity("inputs", inputs.size(), model_->Inputs().size());
+    CheckArity("outputs", outputs.size(), model_->Outputs().size());
+    if (!model_->Dims().empty() && model_->WorkspaceSize(dims) > workspace_bytes_) {
+        throw std::runtime_error{"session: dims exceed the max_dims the workspaces were sized for"};
+    }
+
+    std::byte* workspace = Acquire();
+    // a failed call must still return its workspace, or later calls wait for it forever
+    try {
+        if (pool_ == nullptr || model_->TaskCount() == 0) {
+            model_->Invoke(inputs.data(), outputs.data(), workspace, dims.data());
+        } else {
+            // operations stay in order, each one fans out over the pool
+            for (size_t task = 0; task < model_->TaskCount(); ++task) {
+                pool_->ParallelFor(0, model_->TaskExtent(task, dims), grain_, [&](int64_t lo, int64_t hi) {
+                    model_->InvokeTask(task, inputs.data(), outputs.data(), workspace, lo, hi, dims.data());
+                });
+            }
+        }
+    } catch (...) {
+        Release(workspace);
+        throw;
+    }
+    Release(workspace);
+}
+
+std::byte* Session::Acquire() const {
+    std::unique_lock lock{mutex_};
+    released_.wait(lock, [&] { return !free_.empty(); });
+    std::byte* workspace = free_.back();
+    free_.pop_back();
+    return workspace;
+}
+
+void Session::Release(std::byte* workspace) const {
+    {
+        std::lock_guard lock{mutex_};
+        free_.push_back(workspace);
+    }
+    released_.notify_one();
+}
+
+} // namespace tc::runtime
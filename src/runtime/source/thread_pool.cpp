@@ -0,0 +1,177 @@
+#include "runtime/thread_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace tc::runtime {
+
+namespace {
+
+constexpr size_t kDequeCapacity = 1024;
+
+void PinToCpu(std::thread& thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int rc = ::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (rc != 0) {
+        throw std::runtime_error{"thread pool: unable to pin worker to cpu " + std::to_string(cpu) + ": " +
+                                 std::strerror(rc)};
+    }
+}
+
+} // namespace
+
+bool ThreadPool::WorkDeque::PushBack(const Chunk& chunk) {
+    std::lock_guard lock{mutex_};
+    if (size_ == ring_.size()) {
+        return false;
+    }
+    ring_[(head_ + size_) % ring_.size()] = chunk;
+    ++size_;
+    return true;
+}
+
+bool ThreadPool::WorkDeque::PopBack(Chunk* chunk) {
+    std::lock_guard lock{mutex_};
+    if (size_ == 0) {
+        return false;
+    }
+    --size_;
+    *chunk = ring_[(head_ + size_) % ring_.size()];
+    return true;
+}
+
+bool ThreadPool::WorkDeque::StealFront(Chunk* chunk) {
+    std::lock_guard lock{mutex_};
+    if (size_ == 0) {
+        return false;
+    }
+    *chunk = ring_[head_];
+    head_ = (head_ + 1) % ring_.size();
+    --size_;
+    return true;
+}
+
+ThreadPool::ThreadPool(ThreadPoolOptions options) {
+    const size_t threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    deques_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        deques_.push_back(std::make_unique<WorkDeque>(kDequeCapacity));
+    }
+
+    workers_.reserve(threads);
+    try {
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this, i] { WorkerLoop(i); });
+            if (!options.cpus.empty()) {
+                PinToCpu(workers_.back(), options.cpus[i % options.cpus.size()]);
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard lock{sleep_mutex_};
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+        throw;
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{sleep_mutex_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelForImpl(int64_t begin, int64_t end, int64_t grain, RangeFn fn) {
+    if (begin >= end) {
+        return;
+    }
+    const int64_t extent = end - begin;
+    if (grain <= 0) {
+        // a few chunks per worker leaves room for stealing when chunks take uneven time
+        grain = std::max<int64_t>(1, extent / static_cast<int64_t>(4 * (workers_.size() + 1)));
+    }
+
+    Job job{fn};
+    job.pending.store((extent + grain - 1) / grain, std::memory_order_relaxed);
+
+    const size_t first = next_deque_.fetch_add(1, std::memory_order_relaxed);
+    size_t target = first;
+    for (int64_t lo = begin; lo < end; lo += grain) {
+        const Chunk chunk{&job, lo, std::min(end, lo + grain)};
+        if (!deques_[target++ % deques_.size()]->PushBack(chunk)) {
+            Run(chunk);
+        }
+    }
+    {
+        std::lock_guard lock{sleep_mutex_};
+        ++epoch_;
+    }
+    wake_.notify_all();
+
+    // help until the last chunk of this job is done; other jobs' chunks are fair game too
+    while (job.pending.load(std::memory_order_acquire) != 0) {
+        if (!RunOne(first % deques_.size())) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::RunOne(size_t home) {
+    Chunk chunk;
+    if (deques_[home]->PopBack(&chunk)) {
+        Run(chunk);
+        return true;
+    }
+    for (size_t i = 1; i < deques_.size(); ++i) {
+        if (deques_[(home + i) % deques_.size()]->StealFront(&chunk)) {
+            Run(chunk);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    for (;;) {
+        if (RunOne(index)) {
+            continue;
+        }
+        std::unique_lock lock{sleep_mutex_};
+        if (stop_) {
+            return;
+        }
+        const uint64_t seen = epoch_;
+        lock.unlock();
+        // work pushed before `seen` was read is visible now; anything later bumps the epoch
+        if (RunOne(index)) {
+            continue;
+        }
+        lock.lock();
+        wake_.wait(lock, [&] { return stop_ || epoch_ != seen; });
+    }
+}
+
+void ThreadPool::Run(const Chunk& chunk) {
+    chunk.job->fn.call(chunk.job->fn.obj, chunk.lo, chunk.hi);
+    // last touch of the job: its owner may return as soon as pending reaches zero
+    chunk.job->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+} // namespace tc::runtime
@@ -0,0 +1,210 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "driver/compile_cache.hpp"
+#include "driver/driver_options.hpp"
+#include "driver/fat_binary.hpp"
+#include "driver/inprocess_lowering.hpp"
+#include "driver/process_pipeline.hpp"
+#include "driver/tool_runner.hpp"
+#include "helpers/phase_timer.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+fs::path FreshDir(const std::string& name) {
+    fs::path dir = fs::temp_directory_path() / name;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir;
+}
+
+} // namespace
+
+TEST(driver, CacheKeyDependsOnTuningFlags) {
+    tc::driver::DriverOptions o2;
+    tc::driver::DriverOptions o3;
+    o3.opt_level = "-O3";
+    tc::driver::DriverOptions skx;
+    skx.mcpu = "skylake-avx512";
+    tc::driver::DriverOptions specialized;
+    specialized.specializations = {{8}};
+    tc::driver::DriverOptions fat;
+    fat.mcpus = {"haswell", "x86-64"};
+    tc::driver::DriverOptions im2col;
+    im2col.conv_algorithm = "im2col";
+
+    const std::string fp = "0123456789abcdef0123456789abcdef";
+    EXPECT_EQ(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, o2));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, o3));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, skx));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, specialized));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, fat));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, im2col));
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey("ffff", o2));
+    // the in-process lowering and the external tools are keyed apart where both exist
+    tc::driver::DriverOptions tools;
+    tools.external_tools = true;
+    EXPECT_EQ(tc::driver::CacheKey(fp, o2) != tc::driver::CacheKey(fp, tools),
+              tc::driver::InProcessLoweringAvailable());
+    tc::driver::DriverOptions text;
+    text.text_emitter = true;
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, text));
+
+    // a tuning database counts by contents: a missing one is no database
+    const fs::path work = FreshDir("tc_cache_key_tuning");
+    tc::driver::DriverOptions tuned;
+    tuned.tuning_db_path = (work / "tuning.txt").string();
+    EXPECT_EQ(tc::driver::CacheKey(fp, o2), tc::driver::CacheKey(fp, tuned));
+    tc::driver::WriteTextFile(tuned.tuning_db_path, "MatMul f32 2x3 3x4\torder=mkn tile_m=0 tile_n=0 tile_k=0\t1.0\n");
+    const std::string key = tc::driver::CacheKey(fp, tuned);
+    EXPECT_NE(tc::driver::CacheKey(fp, o2), key);
+    tc::driver::WriteTextFile(tuned.tuning_db_path, "MatMul f32 2x3 3x4\torder=mnk tile_m=8 tile_n=0 tile_k=0\t1.0\n");
+    EXPECT_NE(tc::driver::CacheKey(fp, tuned), key);
+}
+
+TEST(driver, CacheRoundTrip) {
+    const fs::path work = FreshDir("tc_cache_roundtrip");
+    const fs::path src = work / "module.s";
+    tc::driver::WriteTextFile(src.string(), "ret\n");
+
+    tc::driver::CompileCache cache{work / "cache", 1 << 20};
+    EXPECT_FALSE(cache.Contains("k", "s"));
+    cache.Store("k", "s", src);
+    EXPECT_TRUE(cache.Contains("k", "s"));
+
+    const fs::path dst = work / "copy.s";
+    ASSERT_TRUE(cache.Fetch("k", "s", dst.string()));
+    EXPECT_EQ(tc::driver::ReadTextFile(dst), "ret\n");
+    EXPECT_FALSE(cache.Fetch("missing", "s", dst.string()));
+}
+
+TEST(driver, CacheEvictsLeastRecentlyUsed) {
+    const fs::path work = FreshDir("tc_cache_evict");
+    const fs::path src = work / "payload";
+    tc::driver::WriteTextFile(src.string(), std::string(600, 'x'));
+
+    tc::driver::CompileCache cache{work / "cache", 1000};
+    cache.Store("old", "s", src);
+    fs::last_write_time(work / "cache" / "old.s", fs::file_time_type::clock::now() - std::chrono::hours{1});
+    cache.Store("new", "s", src);
+    cache.Evict();
+
+    EXPECT_FALSE(cache.Contains("old", "s"));
+    EXPECT_TRUE(cache.Contains("new", "s"));
+}
+
+TEST(driver, PipelineChainsStagesThroughPipes) {
+    tc::driver::ProcessPipeline pipeline{
+        {{"tr", "a-z", "A-Z"}, {"rev"}},
+        tc::driver::ProcessPipeline::kPipeOutput
+    };
+
+    const std::string input = "hello pipeline\n";
+    ASSERT_EQ(::write(pipeline.InputFd(), input.data(), input.size()), static_cast<ssize_t>(input.size()));
+    pipeline.CloseInput();
+
+    std::string output;
+    char chunk[64];
+    for (ssize_t n; (n = ::read(pipeline.OutputFd(), chunk, sizeof(chunk))) > 0;) {
+        output.append(chunk, static_cast<size_t>(n));
+    }
+    pipeline.Wait();
+
+    EXPECT_EQ(output, "ENILEPIP OLLEH\n");
+}
+
+TEST(driver, PipelineReportsFailedStage) {
+    tc::driver::ProcessPipeline pipeline{{{"cat"}, {"sh", "-c", "cat >/dev/null; exit 3"}}, STDOUT_FILENO};
+    EXPECT_THROW(pipeline.Wait(), std::runtime_error);
+
+    EXPECT_THROW(tc::driver::ProcessPipeline({{"tc-no-such-tool"}}, STDOUT_FILENO), std::runtime_error);
+}
+
+TEST(driver, FatBinaryDispatchesOnCpu) {
+    EXPECT_EQ(tc::driver::CpuSymbolSuffix("x86-64-v3"), "_x86_64_v3");
+    EXPECT_THROW(tc::driver::CpuDispatchFeatures("native"), std::runtime_error);
+
+    const fs::path work = FreshDir("tc_fat_binary");
+    tc::driver::DriverOptions opt;
+    opt.mcpus = {"haswell", "x86-64"};
+    opt.emit_shared_path = (work / "fat.so").string();
+
+    // stands in for the MLIR pipeline: each target's entry returns the index of its CPU
+    const auto compile_target = [&](const tc::driver::DriverOptions& target, const std::string& suffix) {
+        const long index = target.mcpu == "haswell" ? 0 : 1;
+        const fs::path source = work / ("entry" + suffix + ".c");
+        std::ofstream{source} << "long entry_main" << suffix << "(void) { return " << index << "; }\n";
+        tc::driver::ProcessPipeline cc{
+            {{"cc", "-c", "-fPIC", "-march=" + target.mcpu, "-o", target.emit_obj_path, source.string()}},
+            STDERR_FILENO};
+        cc.Wait();
+    };
+    try {
+        tc::driver::EmitFatBinary(opt, {"entry_main"}, compile_target);
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+
+    void* library = dlopen(opt.emit_shared_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    ASSERT_NE(library, nullptr) << dlerror();
+    auto* entry = reinterpret_cast<long (*)()>(dlsym(library, "entry_main"));
+    ASSERT_NE(entry, nullptr);
+
+    __builtin_cpu_init();
+    const bool haswell = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                         __builtin_cpu_supports("bmi2");
+    EXPECT_EQ(entry(), haswell ? 0 : 1);
+    dlclose(library);
+}
+
+TEST(driver, ParsesChannelBlock) {
+    const char* argv[] = {"tc.x", "model.onnx", "--nchwc", "8"};
+    EXPECT_EQ(tc::driver::ParseArgs(4, argv).channel_block, 8);
+    EXPECT_EQ(tc::driver::ParseArgs(2, argv).channel_block, 0);
+
+    const char* zero[] = {"tc.x", "model.onnx", "--nchwc", "0"};
+    EXPECT_THROW(tc::driver::ParseArgs(4, zero), std::runtime_error);
+}
+
+TEST(driver, RecordsNestedPhases) {
+    const char* argv[] = {"tc.x", "model.onnx", "--time-report", "--trace-out", "trace.json"};
+    const tc::driver::DriverOptions opt = tc::driver::ParseArgs(5, argv);
+    EXPECT_TRUE(opt.time_report);
+    EXPECT_EQ(opt.trace_out_path, "trace.json");
+
+    hlp::PhaseRecorder& recorder = hlp::PhaseRecorder::Instance();
+    recorder.Enable();
+    {
+        const hlp::ScopedPhase outer{"test outer"};
+        const hlp::ScopedPhase inner{"test inner"};
+    }
+
+    const hlp::PhaseRecord* outer = nullptr;
+    const hlp::PhaseRecord* inner = nullptr;
+    const std::vector<hlp::PhaseRecord> records = recorder.Records();
+    for (const hlp::PhaseRecord& record : records) {
+        outer = record.name == "test outer" ? &record : outer;
+        inner = record.name == "test inner" ? &record : inner;
+    }
+    ASSERT_NE(outer, nullptr);
+    ASSERT_NE(inner, nullptr);
+    EXPECT_EQ(inner->depth, outer->depth + 1);
+    EXPECT_LE(outer->begin_ns, inner->begin_ns);
+    EXPECT_GE(outer->end_ns, inner->end_ns);
+    EXPECT_LT(outer, inner);
+
+    EXPECT_NE(recorder.Table().find("  test inner"), std::string::npos);
+    EXPECT_NE(recorder.ChromeTrace().find("{\"name\": \"test inner\", \"cat\": \"phase\", \"ph\": \"X\""),
+              std::string::npos);
+}
@@ -1,11 +1,16 @@
 #include "gtest/gtest.h"
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "graph/cost_model.hpp"
+#include "graph/fingerprint.hpp"
 #include "graph/graph.hpp"
+#include "graph/layout.hpp"
 #include "graph/node.hpp"
+#include "graph/rebatch.hpp"
 
 using namespace tc;
 
@@ -48,4 +53,240 @@ TEST(graph, ReusesValueAndUpgradesBelonging) {
     ASSERT_TRUE(same->HasInitializerData());
     EXPECT_EQ(same->MaybeTensorType()->ElemType(), TensorElemType::kFloat32);
     EXPECT_EQ(same->MaybeTensorType()->Shape(), (std::vector<int64_t>{3, 4}));
-}
\ No newline at end of file
+}
+namespace {
+
+void BuildScaledMul(Graph* graph, float scale, int64_t alpha) {
+    Value* x = graph->AddNode<Value>("X", Value::BelongTo::kInput);
+    x->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 2}});
+
+    std::string raw(sizeof(float), '\0');
+    std::memcpy(raw.data(), &scale, sizeof(float));
+    Value* s = graph->AddNode<Value>(
+        "S", Value::BelongTo::kInitializer, TensorData{TensorType{TensorElemType::kFloat32, {}}, raw});
+
+    Value* y = graph->AddNode<Value>("Y", Value::BelongTo::kOutput);
+    y->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 2}});
+
+    AttributeMap attrs;
+    attrs.emplace("alpha", Attribute{"alpha", alpha});
+    attrs.emplace("beta", Attribute{"beta", std::vector<int64_t>{1, 2}});
+    graph->AddNode<Operation>("mul0", Operation::OpType::kMul, std::vector<Value*>{x, s}, std::vector<Value*>{y}, attrs);
+}
+
+} // namespace
+
+TEST(graph, FingerprintIsStableForIdenticalGraphs) {
+    Graph lhs;
+    Graph rhs;
+    BuildScaledMul(&lhs, 0.5f, 1);
+    BuildScaledMul(&rhs, 0.5f, 1);
+
+    EXPECT_EQ(Fingerprint(lhs).size(), 32u);
+    EXPECT_EQ(Fingerprint(lhs), Fingerprint(rhs));
+}
+
+TEST(graph, FingerprintTracksWeightsAndAttrs) {
+    Graph base;
+    Graph other_weight;
+    Graph other_attr;
+    BuildScaledMul(&base, 0.5f, 1);
+    BuildScaledMul(&other_weight, 0.25f, 1);
+    BuildScaledMul(&other_attr, 0.5f, 2);
+
+    EXPECT_NE(Fingerprint(base), Fingerprint(other_weight));
+    EXPECT_NE(Fingerprint(base), Fingerprint(other_attr));
+}
+
+TEST(graph, RebatchResizesBatchedValuesOnly) {
+    Graph graph;
+    Value* x = graph.AddNode<Value>("X", Value::BelongTo::kInput);
+    x->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 3}});
+    Value* w = graph.AddNode<Value>("W", Value::BelongTo::kInitializer,
+                                    TensorData{TensorType{TensorElemType::kFloat32, {3, 2}},
+                                               std::string(6 * sizeof(float), '\0')});
+    Value* h = graph.AddNode<Value>("H", Value::BelongTo::kInternal);
+    h->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 2}});
+    Value* y = graph.AddNode<Value>("Y", Value::BelongTo::kOutput);
+    y->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 2}});
+    graph.AddNode<Operation>("mm", Operation::OpType::kMatMul, std::vector<Value*>{x, w}, std::vector<Value*>{h});
+    graph.AddNode<Operation>("relu", Operation::OpType::kRelu, std::vector<Value*>{h}, std::vector<Value*>{y});
+
+    EXPECT_EQ(BatchSizeOf(graph), 2);
+    const Graph rebatched = Rebatch(graph, 8);
+    auto shape_of = [&](const std::string& name) {
+        return static_cast<const Value*>(rebatched.FindByName(name))->MaybeTensorType()->Shape();
+    };
+    EXPECT_EQ(shape_of("X"), (std::vector<int64_t>{8, 3}));
+    EXPECT_EQ(shape_of("W"), (std::vector<int64_t>{3, 2}));
+    EXPECT_EQ(shape_of("H"), (std::vector<int64_t>{8, 2}));
+    EXPECT_EQ(shape_of("Y"), (std::vector<int64_t>{8, 2}));
+    EXPECT_EQ(Fingerprint(Rebatch(graph, 2)), Fingerprint(graph));
+
+    // the batch ends up in a reduced axis when X is the right-hand operand
+    Graph swapped;
+    Value* a = swapped.AddNode<Value>("A", Value::BelongTo::kInitializer,
+                                      TensorData{TensorType{TensorElemType::kFloat32, {4, 2}},
+                                                 std::string(8 * sizeof(float), '\0')});
+    Value* b = swapped.AddNode<Value>("B", Value::BelongTo::kInput);
+    b->MergeTensorType(TensorType{TensorElemType::kFloat32, {2, 3}});
+    Value* c = swapped.AddNode<Value>("C", Value::BelongTo::kOutput);
+    c->MergeTensorType(TensorType{TensorElemType::kFloat32, {4, 3}});
+    swapped.AddNode<Operation>("mm", Operation::OpType::kMatMul, std::vector<Value*>{a, b}, std::vector<Value*>{c});
+    EXPECT_THROW(Rebatch(swapped, 8), std::runtime_error);
+}
+
+TEST(graph, BlockedLayoutCoversConvRegions) {
+    Graph graph;
+    auto tensor = [&](const std::string& name, Value::BelongTo belong) {
+        Value* value = graph.AddNode<Value>(name, belong);
+        value->MergeTensorType(TensorType{TensorElemType::kFloat32, {1, 8, 5, 5}});
+        return value;
+    };
+    auto weights = [&](const std::string& name, std::vector<int64_t> shape) {
+        std::vector<float> data(static_cast<size_t>(TensorType{TensorElemType::kFloat32, shape}.NumElements()));
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<float>(i);
+        }
+        std::string raw(data.size() * sizeof(float), '\0');
+        std::memcpy(raw.data(), data.data(), raw.size());
+        return graph.AddNode<Value>(name, Value::BelongTo::kInitializer,
+                                    TensorData{TensorType{TensorElemType::kFloat32, std::move(shape)}, raw});
+    };
+
+    // X -> Conv -> Relu -> depthwise Conv -> Y: the dense Conv and the Relu are blocked, the
+    // depthwise Conv has a single input channel per group and stays NCHW
+    Value* x = tensor("X", Value::BelongTo::kInput);
+    Value* h = tensor("H", Value::BelongTo::kInternal);
+    Value* r = tensor("R", Value::BelongTo::kInternal);
+    Value* y = tensor("Y", Value::BelongTo::kOutput);
+    AttributeMap pads;
+    pads.emplace("pads", Attribute{"pads", std::vector<int64_t>{1, 1, 1, 1}});
+    AttributeMap depthwise = pads;
+    depthwise.emplace("group", Attribute{"group", int64_t{8}});
+    graph.AddNode<Operation>("conv0", Operation::OpType::kConv,
+                             std::vector<Value*>{x, weights("W", {8, 8, 3, 3}), weights("B", {8})},
+                             std::vector<Value*>{h}, pads);
+    graph.AddNode<Operation>("relu", Operation::OpType::kRelu, std::vector<Value*>{h}, std::vector<Value*>{r});
+    graph.AddNode<Operation>("conv1", Operation::OpType::kConv,
+                             std::vector<Value*>{r, weights("DW", {8, 1, 3, 3})}, std::vector<Value*>{y},
+                             depthwise);
+
+    const Graph blocked = AssignBlockedLayout(graph, 4);
+    std::vector<std::string> ops;
+    for (const INode* node : blocked) {
+        if (const auto* op = dynamic_cast<const Operation*>(node)) {
+            ops.push_back(Operation::OpTypeToStr(op->Type()));
+        }
+    }
+    EXPECT_EQ(ops, (std::vector<std::string>{"ReorderInput", "NchwcConv", "Relu", "ReorderOutput", "Conv"}));
+    auto value_of = [&](const std::string& name) { return static_cast<const Value*>(blocked.FindByName(name)); };
+    EXPECT_EQ(value_of("X")->GetBelongsTo(), Value::BelongTo::kInput);
+    EXPECT_EQ(value_of("Y")->GetBelongsTo(), Value::BelongTo::kOutput);
+    EXPECT_EQ(value_of("R_nchw4c")->MaybeTensorType()->Shape(), (std::vector<int64_t>{1, 2, 5, 5, 4}));
+
+    // W[oc = 5, c = 6, tap = 4] lands in block (1, 1), tap 4, input lane 2, output lane 1
+    const Value* packed = value_of("W_nchw4c");
+    ASSERT_NE(packed, nullptr);
+    EXPECT_EQ(packed->MaybeTensorType()->Shape(), (std::vector<int64_t>{2, 2, 3, 3, 4, 4}));
+    float moved = 0.0f;
+    std::memcpy(&moved, packed->InitializerData()->raw.data() + (((1 * 2 + 1) * 9 + 4) * 16 + 2 * 4 + 1) * sizeof(float),
+                sizeof(float));
+    EXPECT_EQ(moved, static_cast<float>((5 * 8 + 6) * 9 + 4));
+
+    // 8 channels do not split into blocks of 3
+    for (const INode* node : AssignBlockedLayout(graph, 3)) {
+        const auto* op = dynamic_cast<const Operation*>(node);
+        EXPECT_TRUE(op == nullptr || (op->Type() != Operation::OpType::kNchwcConv &&
+                                      op->Type() != Operation::OpType::kReorderInput));
+    }
+    EXPECT_THROW(AssignBlockedLayout(graph, 0), std::runtime_error);
+}
+
+TEST(graph, EstimatesOpCostFromShapesAndAttrs) {
+    Graph graph;
+    auto tensor = [&](const std::string& name, std::vector<int64_t> shape) {
+        Value* value = graph.AddNode<Value>(name, Value::BelongTo::kInternal);
+        value->MergeTensorType(TensorType{TensorElemType::kFloat32, std::move(shape)});
+        return value;
+    };
+
+    // A is [K=3, M=2] under transA: 2*3 FLOPs per output plus the scaled C
+    AttributeMap trans_a;
+    trans_a.emplace("transA", Attribute{"transA", int64_t{1}});
+    const auto* gemm = graph.AddNode<Operation>(
+        "gemm", Operation::OpType::kGemm,
+        std::vector<Value*>{tensor("A", {3, 2}), tensor("B", {3, 4}), tensor("C", {4})},
+        std::vector<Value*>{tensor("G", {2, 4})}, trans_a);
+    const OpCost gemm_cost = EstimateCost(*gemm);
+    EXPECT_EQ(gemm_cost.flops, 8 * (2 * 3 + 2));
+    EXPECT_EQ(gemm_cost.bytes_read, (6 + 12 + 4) * 4);
+    EXPECT_EQ(gemm_cost.bytes_written, 8 * 4);
+
+    // grouped conv: W is [8, 4/2, 3, 3], every output reduces over 2*3*3 taps
+    const auto* conv = graph.AddNode<Operation>(
+        "conv", Operation::OpType::kConv,
+        std::vector<Value*>{tensor("X", {1, 4, 6, 6}), tensor("W", {8, 2, 3, 3})},
+        std::vector<Value*>{tensor("Y", {1, 8, 4, 4})});
+    EXPECT_EQ(EstimateCost(*conv).flops, 8 * 4 * 4 * 2 * 18);
+
+    // pads 1, stride 2 over 4 inputs: the two outputs of an axis see 2 and 3 of the 3 taps
+    AttributeMap strided;
+    strided.emplace("pads", Attribute{"pads", std::vector<int64_t>{1, 1, 1, 1}});
+    strided.emplace("strides", Attribute{"strides", std::vector<int64_t>{2, 2}});
+    const auto* padded = graph.AddNode<Operation>(
+        "padded", Operation::OpType::kConv,
+        std::vector<Value*>{tensor("PX", {1, 1, 4, 4}), tensor("PW", {1, 1, 3, 3})},
+        std::vector<Value*>{tensor("PY", {1, 1, 2, 2})}, strided);
+    EXPECT_EQ(EstimateCost(*padded).flops, 2 * (2 + 3) * (2 + 3));
+
+    const auto* dynamic = graph.AddNode<Operation>(
+        "relu", Operation::OpType::kRelu, std::vector<Value*>{tensor("D", {-1, 4})},
+        std::vector<Value*>{tensor("R", {-1, 4})});
+    EXPECT_EQ(EstimateCost(*dynamic).flops, -1);
+    EXPECT_EQ(EstimateCost(*dynamic).bytes_read, -1);
+}
+
+TEST(graph, CostReportSortsAndAnnotatesDot) {
+    Graph graph;
+    auto tensor = [&](const std::string& name, std::vector<int64_t> shape) {
+        Value* value = graph.AddNode<Value>(name, Value::BelongTo::kInternal);
+        value->MergeTensorType(TensorType{TensorElemType::kFloat32, std::move(shape)});
+        return value;
+    };
+
+    // 64x64x64 MatMul: 2*64^3 FLOPs over 3*64*64*4 bytes, ~10.7 FLOP/byte; Relu is 1/8
+    Value* a = tensor("A", {64, 64});
+    Value* b = tensor("B", {64, 64});
+    Value* c = tensor("C", {64, 64});
+    Value* r = tensor("R", {64, 64});
+    graph.AddNode<Operation>("relu", Operation::OpType::kRelu, std::vector<Value*>{a}, std::vector<Value*>{r});
+    graph.AddNode<Operation>("matmul", Operation::OpType::kMatMul, std::vector<Value*>{r, b},
+                             std::vector<Value*>{c});
+    graph.AddNode<Operation>("untyped", Operation::OpType::kRelu,
+                             std::vector<Value*>{graph.AddNode<Value>("U", Value::BelongTo::kInternal)},
+                             std::vector<Value*>{graph.AddNode<Value>("V", Value::BelongTo::kInternal)});
+
+    std::vector<OpCostEntry> report = CostReport(graph);
+    ASSERT_EQ(report.size(), 3u);
+    EXPECT_EQ(report[0].op->Name(), "relu");
+    EXPECT_EQ(report[0].bound, Bound::kMemory);
+    EXPECT_DOUBLE_EQ(report[0].intensity, 0.125);
+    EXPECT_EQ(report[1].bound, Bound::kCompute);
+    EXPECT_EQ(report[2].bound, Bound::kUnknown);
+    EXPECT_EQ(ClassifyBound(report[1].cost, 16.0), Bound::kMemory);
+
+    SortCostReport(report, ParseCostSortKey("intensity"));
+    EXPECT_EQ(report[0].op->Name(), "matmul");
+    EXPECT_EQ(report[2].op->Name(), "untyped");
+    EXPECT_NE(FormatCostReport(report).find("compute"), std::string::npos);
+    EXPECT_THROW(ParseCostSortKey("time"), std::runtime_error);
+
+    DotOptions dot_options;
+    dot_options.show_cost = true;
+    const std::string dot = graph.ToDot(dot_options);
+    EXPECT_NE(dot.find("0.524 MFLOP"), std::string::npos);
+    EXPECT_NE(dot.find("#EF9A9A"), std::string::npos);
+    EXPECT_NE(dot.find("#90CAF9"), std::string::npos);
+    EXPECT_EQ(graph.ToDot().find("MFLOP"), std::string::npos);
+}
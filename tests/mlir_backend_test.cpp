@@ -1,12 +1,19 @@
 #include "gtest/gtest.h"
 
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "graph/graph.hpp"
+#include "graph/layout.hpp"
 #include "graph/node.hpp"
+#include "helpers/output_sink.hpp"
 #include "mlir_backend/mlir_backend.hpp"
+#include "mlir_backend/tuning.hpp"
 
 namespace {
 
@@ -53,6 +60,79 @@ tc::Graph MakeMatmulMulGraph() {
     return graph;
 }
 
+// Y[?,3] = Relu(X[?,3] + B[3]) through a dynamically shaped temporary
+tc::Graph MakeDynamicBiasReluGraph() {
+    tc::Graph graph;
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 3}});
+
+    tc::TensorData bias_data{
+        tc::TensorType{tc::TensorElemType::kFloat32, {3}},
+        RawFloat(1.0f) + RawFloat(-2.0f) + RawFloat(0.5f)
+    };
+    auto* bias = graph.AddNode<tc::Value>("B", tc::Value::BelongTo::kInitializer, bias_data);
+
+    auto* t = graph.AddNode<tc::Value>("T", tc::Value::BelongTo::kInternal);
+    t->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 3}});
+
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 3}});
+
+    graph.AddNode<tc::Operation>(
+        "add0",
+        tc::Operation::OpType::kAdd,
+        std::vector<tc::Value*>{x, bias},
+        std::vector<tc::Value*>{t}
+    );
+    graph.AddNode<tc::Operation>(
+        "relu0",
+        tc::Operation::OpType::kRelu,
+        std::vector<tc::Value*>{t},
+        std::vector<tc::Value*>{y}
+    );
+
+    return graph;
+}
+
+// Y[1,8,6,6] = Conv(X[1,4,6,6], W[8,4/group,k,k], B[8]) with the padding that keeps the spatial size
+tc::Graph MakeConvGraph(int64_t kernel, int64_t dilation = 1, int64_t group = 1) {
+    tc::Graph graph;
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, 4, 6, 6}});
+
+    tc::TensorData w_data{
+        tc::TensorType{tc::TensorElemType::kFloat32, {8, 4 / group, kernel, kernel}},
+        std::string(static_cast<size_t>(8 * 4 / group * kernel * kernel) * sizeof(float), '\0')
+    };
+    auto* w = graph.AddNode<tc::Value>("W", tc::Value::BelongTo::kInitializer, w_data);
+
+    tc::TensorData b_data{
+        tc::TensorType{tc::TensorElemType::kFloat32, {8}},
+        std::string(8 * sizeof(float), '\0')
+    };
+    auto* b = graph.AddNode<tc::Value>("B", tc::Value::BelongTo::kInitializer, b_data);
+
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, 8, 6, 6}});
+
+    const int64_t pad = kernel / 2 * dilation;
+    tc::AttributeMap attrs;
+    attrs.emplace("pads", tc::Attribute{"pads", std::vector<int64_t>{pad, pad, pad, pad}});
+    attrs.emplace("dilations", tc::Attribute{"dilations", std::vector<int64_t>{dilation, dilation}});
+    attrs.emplace("group", tc::Attribute{"group", group});
+    graph.AddNode<tc::Operation>(
+        "conv0",
+        tc::Operation::OpType::kConv,
+        std::vector<tc::Value*>{x, w, b},
+        std::vector<tc::Value*>{y},
+        attrs
+    );
+
+    return graph;
+}
+
 } // namespace
 
 TEST(mlir_backend, EmitsModuleForMatmulAndMul) {
@@ -72,22 +152,464 @@ TEST(mlir_backend, EmitsModuleForMatmulAndMul) {
     EXPECT_NE(mlir.find("memref.store"), std::string::npos);
 }
 
-TEST(mlir_backend, RejectsDynamicShapes) {
+TEST(mlir_backend, EmitsDynamicBatch) {
+    const tc::Graph graph = MakeDynamicBiasReluGraph();
+
+    tc::MlirBackend backend;
+    const std::string mlir = backend.EmitModule(graph);
+    EXPECT_NE(mlir.find("memref<?x3xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref.dim"), std::string::npos);
+    EXPECT_NE(mlir.find("memref.alloc(%v_dim_"), std::string::npos);
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    const std::string c_abi = backend.EmitModule(graph, options);
+    // tensors keep static argument types for the bare-pointer ABI, the batch comes in memref<1xi64>
+    EXPECT_NE(c_abi.find("memref<1xf32>, %v_out_Y_"), std::string::npos);
+    EXPECT_NE(c_abi.find(": memref<1xi64>)"), std::string::npos);
+    EXPECT_NE(c_abi.find("memref.reinterpret_cast"), std::string::npos);
+    EXPECT_NE(c_abi.find("memref<?xi8>"), std::string::npos);
+    EXPECT_NE(c_abi.find("func.func @entry_main_workspace_size(%v_dims_"), std::string::npos);
+    const size_t extent = c_abi.find("func.func @entry_main_task0_extent(%v_dims_");
+    ASSERT_NE(extent, std::string::npos);
+    EXPECT_NE(c_abi.find("arith.index_cast", extent), std::string::npos);
+
+    hlp::StringSink header;
+    backend.EmitCHeader(graph, header, options);
+    EXPECT_NE(header.Str().find("int64_t entry_main_workspace_size(const int64_t* dims);"), std::string::npos);
+    EXPECT_NE(header.Str().find(" *   X[0]\n"), std::string::npos);
+    EXPECT_NE(header.Str().find("const int64_t* dims);"), std::string::npos);
+}
+
+TEST(mlir_backend, EmitsShapeSpecializedVariants) {
+    const tc::Graph graph = MakeDynamicBiasReluGraph();
+
+    const std::vector<int64_t> eight{8};
+    const tc::Graph specialized = tc::Specialize(graph, eight);
+    const tc::EntrySignature signature = tc::EntrySignatureOf(specialized);
+    EXPECT_TRUE(signature.dims.empty());
+    EXPECT_EQ(signature.outputs[0]->MaybeTensorType()->Shape(), (std::vector<int64_t>{8, 3}));
+
+    tc::MlirBackend backend;
+    tc::MlirEmitterOptions options;
+    options.specializations = {{1}, {8}};
+    const std::string mlir = backend.EmitModule(graph, options);
+    EXPECT_NE(mlir.find("func.func @entry_main_spec1(%v_arg_X_0: memref<8x3xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("func.func @entry_main_generic(%v_arg_X_0: memref<?x3xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref.cast %v_arg_X_"), std::string::npos);
+    EXPECT_NE(mlir.find("scf.index_switch"), std::string::npos);
+
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    const std::string c_abi = backend.EmitModule(graph, options);
+    // the dispatchers keep the symbols and signatures of the unspecialized module
+    EXPECT_NE(c_abi.find("func.func @entry_main(%v_arg_X_"), std::string::npos);
+    EXPECT_NE(c_abi.find("func.func @entry_main_workspace_size(%v_dims_"), std::string::npos);
+    EXPECT_NE(c_abi.find("func.call @entry_main_spec0_task1("), std::string::npos);
+    EXPECT_NE(c_abi.find("func.call @entry_main_generic_task1_extent(%v_dims_"), std::string::npos);
+    EXPECT_NE(c_abi.find("to memref<8x3xf32>"), std::string::npos);
+
+    options.specializations = {{1, 2}};
+    EXPECT_THROW(backend.EmitModule(graph, options), std::runtime_error);
+    options.specializations = {{4}};
+    EXPECT_THROW(backend.EmitModule(MakeMatmulMulGraph(), options), std::runtime_error);
+}
+
+TEST(mlir_backend, ResolvesDynamicConvShapes) {
     tc::Graph graph;
 
     auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
-    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 4}});
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, 1, -1, -1}});
+
+    tc::TensorData w_data{
+        tc::TensorType{tc::TensorElemType::kFloat32, {2, 1, 3, 3}},
+        std::string(2 * 9 * sizeof(float), '\0')
+    };
+    auto* w = graph.AddNode<tc::Value>("W", tc::Value::BelongTo::kInitializer, w_data);
 
     auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
-    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 4}});
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, 2, -1, -1}});
 
+    tc::AttributeMap attrs;
+    attrs.emplace("pads", tc::Attribute{"pads", std::vector<int64_t>{1, 1, 1, 1}});
+    attrs.emplace("strides", tc::Attribute{"strides", std::vector<int64_t>{2, 2}});
     graph.AddNode<tc::Operation>(
-        "relu0",
-        tc::Operation::OpType::kRelu,
-        std::vector<tc::Value*>{x},
+        "conv0",
+        tc::Operation::OpType::kConv,
+        std::vector<tc::Value*>{x, w},
+        std::vector<tc::Value*>{y},
+        attrs
+    );
+
+    const tc::ShapeResolver shapes{graph};
+    ASSERT_EQ(shapes.DimCount(), 2u);
+    const std::vector<int64_t> dims{7, 5};
+    EXPECT_EQ(shapes.OutputShapes(dims), (std::vector<std::vector<int64_t>>{{1, 2, 4, 3}}));
+    EXPECT_THROW(static_cast<void>(shapes.OutputShapes(std::vector<int64_t>{7})), std::runtime_error);
+
+    // the output spatial sizes are computed in the module from the input ones
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph);
+    EXPECT_NE(mlir.find("arith.divsi"), std::string::npos);
+}
+
+TEST(mlir_backend, RejectsDynamicConvWeights) {
+    tc::Graph graph;
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, 1, 4, 4}});
+
+    auto* w = graph.AddNode<tc::Value>("W", tc::Value::BelongTo::kInput);
+    w->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {-1, 1, 3, 3}});
+
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {1, -1, 2, 2}});
+
+    graph.AddNode<tc::Operation>(
+        "conv0",
+        tc::Operation::OpType::kConv,
+        std::vector<tc::Value*>{x, w},
         std::vector<tc::Value*>{y}
     );
 
     tc::MlirBackend backend;
     EXPECT_THROW(static_cast<void>(backend.EmitModule(graph)), std::runtime_error);
-}
\ No newline at end of file
+}
+
+TEST(mlir_backend, StreamsModuleThroughSmallBuffer) {
+    tc::Graph graph;
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {2, 2}});
+
+    const float weights[] = {1.0f, -0.0f, 0.1f, 2.5f};
+    std::string raw(sizeof(weights), '\0');
+    std::memcpy(raw.data(), weights, sizeof(weights));
+    auto* w = graph.AddNode<tc::Value>(
+        "W", tc::Value::BelongTo::kInitializer,
+        tc::TensorData{tc::TensorType{tc::TensorElemType::kFloat32, {2, 2}}, raw});
+
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {2, 2}});
+
+    graph.AddNode<tc::Operation>(
+        "add0",
+        tc::Operation::OpType::kAdd,
+        std::vector<tc::Value*>{x, w},
+        std::vector<tc::Value*>{y}
+    );
+
+    tc::MlirBackend backend;
+    const std::string expected = backend.EmitModule(graph);
+    EXPECT_NE(expected.find("dense<[[1.0, 0.0], [0.10000000149011612, 2.5]]>"), std::string::npos);
+
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    {
+        hlp::FdSink sink{::fileno(file), 7};
+        backend.EmitModule(graph, sink);
+    }
+    std::rewind(file);
+    std::string streamed;
+    char chunk[256];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) != 0;) {
+        streamed.append(chunk, n);
+    }
+    std::fclose(file);
+
+    EXPECT_EQ(streamed, expected);
+}
+
+TEST(mlir_backend, EmitsWorkspaceEntryAndCHeader) {
+    const tc::Graph graph = MakeMatmulMulGraph();
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+
+    tc::MlirBackend backend;
+    const std::string mlir = backend.EmitModule(graph, options);
+    EXPECT_NE(mlir.find("memref.view"), std::string::npos);
+    EXPECT_NE(mlir.find("func.func @entry_main_workspace_size() -> i64"), std::string::npos);
+    EXPECT_EQ(mlir.find("memref.alloc()"), std::string::npos);
+    EXPECT_EQ(mlir.find("memref.dealloc"), std::string::npos);
+
+    hlp::StringSink header;
+    backend.EmitCHeader(graph, header, options);
+    EXPECT_NE(header.Str().find("int64_t entry_main_workspace_size(void);"), std::string::npos);
+    EXPECT_NE(header.Str().find("void entry_main(const float* in_A,"), std::string::npos);
+    EXPECT_NE(header.Str().find("float* out_Y,"), std::string::npos);
+    EXPECT_NE(header.Str().find("void* workspace);"), std::string::npos);
+}
+
+TEST(mlir_backend, WorkspaceReusesDeadTemporaries) {
+    tc::Graph graph;
+    const tc::TensorType type{tc::TensorElemType::kFloat32, {4, 16}}; // 256 bytes
+
+    auto* prev = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    prev->MergeTensorType(type);
+    for (int i = 0; i < 4; ++i) {
+        auto* next = graph.AddNode<tc::Value>(i == 3 ? "Y" : "T" + std::to_string(i),
+                                              i == 3 ? tc::Value::BelongTo::kOutput : tc::Value::BelongTo::kInternal);
+        next->MergeTensorType(type);
+        graph.AddNode<tc::Operation>("relu" + std::to_string(i), tc::Operation::OpType::kRelu,
+                                     std::vector<tc::Value*>{prev}, std::vector<tc::Value*>{next});
+        prev = next;
+    }
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph, options);
+
+    // T0 is dead once T1 is computed, so T2 takes its bytes: two slots for three temporaries
+    EXPECT_NE(mlir.find("arith.constant 512 : i64"), std::string::npos);
+    EXPECT_NE(mlir.find("memref<512xi8>"), std::string::npos);
+}
+
+TEST(mlir_backend, EmitsSplittableTasks) {
+    const tc::Graph graph = MakeMatmulMulGraph();
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph, options);
+
+    EXPECT_NE(mlir.find("func.func @entry_main("), std::string::npos);
+    EXPECT_NE(mlir.find("func.func @entry_main_task_count() -> i64"), std::string::npos);
+    const size_t task = mlir.find("func.func @entry_main_task1(");
+    ASSERT_NE(task, std::string::npos);
+    EXPECT_NE(mlir.find("%v_lo_", task), std::string::npos);
+    EXPECT_NE(mlir.find("arith.index_cast", task), std::string::npos);
+    // mul0 writes Y[2,4], split over its rows
+    const size_t extent = mlir.find("func.func @entry_main_task1_extent() -> i64");
+    ASSERT_NE(extent, std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 2 : i64", extent), std::string::npos);
+}
+
+TEST(mlir_backend, InstrumentsOperationsOnlyWhenAsked) {
+    const tc::Graph graph = MakeMatmulMulGraph();
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    const std::string plain = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_EQ(plain.find("tc_profile"), std::string::npos);
+
+    options.instrument = true;
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_NE(mlir.find("func.func private @tc_profile_enter(i64)"), std::string::npos);
+    EXPECT_NE(mlir.find("func.func private @tc_profile_exit(i64)"), std::string::npos);
+
+    // mul0 is op 1, in the entry right after matmul0 and in its own task
+    const size_t mul = mlir.find("// op: mul0 (Mul)");
+    ASSERT_NE(mul, std::string::npos);
+    const size_t enter = mlir.find("func.call @tc_profile_enter(", mul);
+    ASSERT_NE(enter, std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 1 : i64", mul), std::string::npos);
+    EXPECT_LT(enter, mlir.find("func.call @tc_profile_exit(", mul));
+    const size_t task = mlir.find("func.func @entry_main_task1(");
+    ASSERT_NE(task, std::string::npos);
+    EXPECT_NE(mlir.find("func.call @tc_profile_enter(", task), std::string::npos);
+}
+
+TEST(mlir_backend, TuningDatabaseRoundTrips) {
+    const tc::Graph graph = MakeMatmulMulGraph();
+    const auto& matmul = dynamic_cast<const tc::Operation&>(*graph.FindByName("matmul0"));
+    ASSERT_TRUE(tc::IsTunable(matmul));
+    EXPECT_EQ(tc::TuningSignature(matmul), "MatMul f32 2x3 3x4");
+
+    // every tile would cover a whole dimension of the 2x3 * 3x4 product
+    const std::vector<tc::ContractionSchedule> candidates = tc::CandidateSchedules(matmul);
+    ASSERT_EQ(candidates.size(), 2u);
+    EXPECT_TRUE(candidates[0].IsDefault());
+    EXPECT_EQ(candidates[1].order, tc::ContractionSchedule::Order::kMkn);
+
+    const tc::ContractionSchedule schedule{tc::ContractionSchedule::Order::kMkn, 8, 16, 32};
+    EXPECT_EQ(tc::ParseSchedule(tc::FormatSchedule(schedule)), schedule);
+    EXPECT_THROW(tc::ParseSchedule("order=mnk tile_k=8"), std::runtime_error);
+    EXPECT_THROW(tc::ParseSchedule("order=kmn"), std::runtime_error);
+
+    tc::TuningDatabase database;
+    database.Set(tc::TuningSignature(matmul), tc::TuningDatabase::Entry{schedule, 1.5});
+    const std::string path = (std::filesystem::temp_directory_path() / "tc_tuning_test.txt").string();
+    database.Save(path);
+    const tc::TuningDatabase loaded = tc::TuningDatabase::Load(path);
+    std::filesystem::remove(path);
+    EXPECT_EQ(loaded.Serialize(), database.Serialize());
+    EXPECT_EQ(loaded.ScheduleFor(matmul), schedule);
+    ASSERT_NE(loaded.Find("MatMul f32 2x3 3x4"), nullptr);
+    EXPECT_DOUBLE_EQ(loaded.Find("MatMul f32 2x3 3x4")->micros, 1.5);
+
+    EXPECT_EQ(tc::TuningDatabase::Load(path).Size(), 0u);
+    EXPECT_THROW(tc::TuningDatabase::Parse("MatMul f32 2x3 3x4\torder=mkn\n"), std::runtime_error);
+}
+
+TEST(mlir_backend, EmitsTunedContractionSchedule) {
+    const tc::Graph graph = MakeMatmulMulGraph();
+    const auto& matmul = dynamic_cast<const tc::Operation&>(*graph.FindByName("matmul0"));
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    const std::string untuned = tc::MlirBackend{}.EmitModule(graph, options);
+
+    auto database = std::make_shared<tc::TuningDatabase>();
+    database->Set(tc::TuningSignature(matmul),
+                  tc::TuningDatabase::Entry{tc::ContractionSchedule{tc::ContractionSchedule::Order::kMkn, 0, 2, 2}, -1});
+    options.tuning = database;
+    const std::string tuned = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_NE(tuned, untuned);
+    EXPECT_EQ(untuned.find("arith.minsi"), std::string::npos);
+
+    // mkn accumulates in the output itself: no scalar accumulator, n and k loops tiled by 2
+    const size_t op = tuned.find("// op: matmul0 (MatMul)");
+    ASSERT_NE(op, std::string::npos);
+    const size_t next = tuned.find("// op: mul0 (Mul)", op);
+    const std::string body = tuned.substr(op, next - op);
+    EXPECT_EQ(body.find("memref.alloca"), std::string::npos);
+    EXPECT_NE(body.find("arith.minsi"), std::string::npos);
+    EXPECT_NE(body.find("arith.constant 2 : index"), std::string::npos);
+
+    // the task still splits the rows of MM[2,4]
+    const size_t task = tuned.find("func.func @entry_main_task0(");
+    ASSERT_NE(task, std::string::npos);
+    EXPECT_NE(tuned.find("%v_lo_", task), std::string::npos);
+    const size_t extent = tuned.find("func.func @entry_main_task0_extent() -> i64");
+    ASSERT_NE(extent, std::string::npos);
+    EXPECT_NE(tuned.find("arith.constant 2 : i64", extent), std::string::npos);
+
+    // schedules apply by signature only
+    auto other = std::make_shared<tc::TuningDatabase>();
+    other->Set("MatMul f32 4x3 3x4", tc::TuningDatabase::Entry{tc::ContractionSchedule{tc::ContractionSchedule::Order::kMkn, 0, 2, 2}, -1});
+    options.tuning = other;
+    EXPECT_EQ(tc::MlirBackend{}.EmitModule(graph, options), untuned);
+}
+
+TEST(mlir_backend, ChoosesIm2colConvByShape) {
+    EXPECT_EQ(tc::ParseConvAlgorithm("im2col"), tc::ConvAlgorithm::kIm2col);
+    EXPECT_THROW(tc::ParseConvAlgorithm("fft"), std::runtime_error);
+
+    // dilated, so Winograd does not apply
+    const tc::Graph graph = MakeConvGraph(3, 2);
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+
+    // one [4*3*3, 6] patch matrix per output row, since the tasks split the 6 rows:
+    // 6 * 4*3*3 * 6 floats, the only thing in the workspace
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_NE(mlir.find("memref<6x4x3x3x6xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 5184 : i64"), std::string::npos);
+    const size_t extent = mlir.find("func.func @entry_main_task0_extent() -> i64");
+    ASSERT_NE(extent, std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 6 : i64", extent), std::string::npos);
+
+    options.conv_algorithm = tc::ConvAlgorithm::kDirect;
+    const std::string direct = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_EQ(direct.find("memref<6x4x3x3x6xf32>"), std::string::npos);
+    EXPECT_NE(direct.find("arith.constant 0 : i64"), std::string::npos);
+
+    // without a workspace the scratch is allocated around the op
+    const std::string allocated = tc::MlirBackend{}.EmitModule(graph);
+    EXPECT_NE(allocated.find("memref.alloc() : memref<6x4x3x3x6xf32>"), std::string::npos);
+    EXPECT_NE(allocated.find("memref.dealloc"), std::string::npos);
+
+    // a 1x1 kernel has no patches to share, so it stays direct unless forced
+    const tc::Graph pointwise = MakeConvGraph(1);
+    EXPECT_EQ(tc::MlirBackend{}.EmitModule(pointwise).find("memref<6x4x1x1x6xf32>"), std::string::npos);
+    tc::MlirEmitterOptions forced;
+    forced.conv_algorithm = tc::ConvAlgorithm::kIm2col;
+    EXPECT_NE(tc::MlirBackend{}.EmitModule(pointwise, forced).find("memref<6x4x1x1x6xf32>"), std::string::npos);
+}
+
+TEST(mlir_backend, ChoosesWinogradConvFor3x3) {
+    EXPECT_EQ(tc::ParseConvAlgorithm("winograd"), tc::ConvAlgorithm::kWinograd);
+
+    const tc::Graph graph = MakeConvGraph(3);
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+
+    // 6x6 outputs take F(2x2, 3x3): the weights become a [8, 4, 4, 4] global, and each of the
+    // 3 tile rows the tasks split gets 4 transformed input tiles and an accumulator of 4x4 floats
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_NE(mlir.find("memref.global \"private\" constant @g_W_0_winograd2 : memref<8x4x4x4xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref.get_global @g_W_0_winograd2"), std::string::npos);
+    EXPECT_NE(mlir.find("memref<3x5x4x4xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 960 : i64"), std::string::npos);
+    EXPECT_NE(mlir.find("arith.subf"), std::string::npos);
+    const size_t extent = mlir.find("func.func @entry_main_task0_extent() -> i64");
+    ASSERT_NE(extent, std::string::npos);
+    EXPECT_NE(mlir.find("arith.constant 3 : i64", extent), std::string::npos);
+
+    // the direct lowering needs neither
+    options.conv_algorithm = tc::ConvAlgorithm::kDirect;
+    const std::string direct = tc::MlirBackend{}.EmitModule(graph, options);
+    EXPECT_EQ(direct.find("winograd"), std::string::npos);
+
+    // dilated kernels stay direct even when forced
+    options.conv_algorithm = tc::ConvAlgorithm::kWinograd;
+    EXPECT_EQ(tc::MlirBackend{}.EmitModule(MakeConvGraph(3, 2), options).find("winograd"), std::string::npos);
+}
+
+TEST(mlir_backend, ChoosesDepthwiseAndPointwiseConvByPattern) {
+    EXPECT_EQ(tc::ParseConvAlgorithm("depthwise"), tc::ConvAlgorithm::kDepthwise);
+    EXPECT_EQ(tc::ParseConvAlgorithm("pointwise"), tc::ConvAlgorithm::kPointwise);
+
+    // the direct lowering checks both input coordinates of every tap
+    tc::MlirEmitterOptions direct;
+    direct.conv_algorithm = tc::ConvAlgorithm::kDirect;
+    const tc::Graph depthwise = MakeConvGraph(3, 1, 4);
+    EXPECT_NE(tc::MlirBackend{}.EmitModule(depthwise, direct).find("in_w"), std::string::npos);
+
+    // a depthwise Conv only checks the input row of each kernel row, the columns are known
+    const std::string sliding = tc::MlirBackend{}.EmitModule(depthwise);
+    EXPECT_NE(sliding.find("in_h"), std::string::npos);
+    EXPECT_EQ(sliding.find("in_w"), std::string::npos);
+
+    // a pointwise one checks nothing and needs no scratch, not even with a workspace
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    const std::string gemm = tc::MlirBackend{}.EmitModule(MakeConvGraph(1), options);
+    EXPECT_EQ(gemm.find("in_h"), std::string::npos);
+    EXPECT_EQ(gemm.find("scf.if"), std::string::npos);
+    EXPECT_NE(gemm.find("arith.constant 0 : i64"), std::string::npos);
+
+    // neither pattern applies to a dense 3x3 Conv, forcing one keeps the direct lowering
+    options.conv_algorithm = tc::ConvAlgorithm::kDepthwise;
+    options.use_workspace = false;
+    EXPECT_EQ(tc::MlirBackend{}.EmitModule(MakeConvGraph(3, 2), options),
+              tc::MlirBackend{}.EmitModule(MakeConvGraph(3, 2), direct));
+}
+
+TEST(mlir_backend, DirectConvChecksOnlyBorderColumns) {
+    tc::MlirEmitterOptions options;
+    options.conv_algorithm = tc::ConvAlgorithm::kDirect;
+    const std::string mlir = tc::MlirBackend{}.EmitModule(MakeConvGraph(3), options);
+
+    // the kernel rows come from per-row bounds, and of the three column loops of a row only the
+    // left and right border strips check their taps
+    size_t guards = 0;
+    for (size_t pos = mlir.find("scf.if"); pos != std::string::npos; pos = mlir.find("scf.if", pos + 1)) {
+        ++guards;
+    }
+    EXPECT_EQ(guards, 2u);
+    EXPECT_EQ(mlir.find("in_h"), std::string::npos);
+    EXPECT_NE(mlir.find(" = %v_r_lo_"), std::string::npos);
+    EXPECT_NE(mlir.find(" to %v_ow_hi_"), std::string::npos);
+}
+
+TEST(mlir_backend, EmitsBlockedConvWithReorders) {
+    const tc::Graph graph = tc::AssignBlockedLayout(MakeConvGraph(3), 4);
+    const std::string mlir = tc::MlirBackend{}.EmitModule(graph);
+
+    // X and Y keep their NCHW signature, the Conv accumulates one block of output channels per pixel
+    EXPECT_NE(mlir.find("memref<1x4x6x6xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref<1x1x6x6x4xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref<2x1x3x3x4x4xf32>"), std::string::npos);
+    EXPECT_NE(mlir.find("memref.alloca() : memref<4xf32>"), std::string::npos);
+
+    tc::MlirEmitterOptions options;
+    options.use_workspace = true;
+    options.emit_tasks = true;
+    EXPECT_NE(tc::MlirBackend{}.EmitModule(graph, options).find("func.func @entry_main_task2("), std::string::npos);
+}
@@ -0,0 +1,794 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "driver/process_pipeline.hpp"
+#include "driver/tool_runner.hpp"
+#include "graph/graph.hpp"
+#include "graph/layout.hpp"
+#include "graph/node.hpp"
+#include "graph/rebatch.hpp"
+#include "helpers/output_sink.hpp"
+#include "mlir_backend/mlir_backend.hpp"
+#include "mlir_backend/tuning.hpp"
+#include "runtime/autotuner.hpp"
+#include "runtime/batcher.hpp"
+#include "runtime/compiled_model.hpp"
+#include "runtime/jit_model.hpp"
+#include "runtime/perf_counters.hpp"
+#include "runtime/profiler.hpp"
+#include "runtime/session.hpp"
+#include "runtime/thread_pool.hpp"
+
+namespace {
+
+std::string RawFloats(const std::vector<float>& values) {
+    std::string raw(values.size() * sizeof(float), '\0');
+    std::memcpy(raw.data(), values.data(), raw.size());
+    return raw;
+}
+
+std::vector<float> Floats(const std::string& raw) {
+    std::vector<float> values(raw.size() / sizeof(float));
+    std::memcpy(values.data(), raw.data(), raw.size());
+    return values;
+}
+
+// Y = relu(X + B) with a constant bias
+tc::Graph MakeBiasReluGraph() {
+    tc::Graph graph;
+    const tc::TensorType type{tc::TensorElemType::kFloat32, {2, 3}};
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(type);
+    auto* b = graph.AddNode<tc::Value>(
+        "B", tc::Value::BelongTo::kInitializer,
+        tc::TensorData{type, RawFloats({1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f})});
+    auto* sum = graph.AddNode<tc::Value>("S", tc::Value::BelongTo::kInternal);
+    sum->MergeTensorType(type);
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(type);
+
+    graph.AddNode<tc::Operation>("add0", tc::Operation::OpType::kAdd,
+                                 std::vector<tc::Value*>{x, b}, std::vector<tc::Value*>{sum});
+    graph.AddNode<tc::Operation>("relu0", tc::Operation::OpType::kRelu,
+                                 std::vector<tc::Value*>{sum}, std::vector<tc::Value*>{y});
+    return graph;
+}
+
+// hand-written stand-in for `tc.x --emit-shared` of MakeBiasReluGraph(): S lives in the workspace
+constexpr const char* kBiasReluLibrary = R"(
+#include <stdint.h>
+static const float kBias[6] = {1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f};
+int64_t entry_main_workspace_size(void) { return 64; }
+void entry_main(const float* x, float* y, void* workspace) {
+    float* s = (float*)workspace;
+    for (int i = 0; i < 6; ++i) s[i] = x[i] + kBias[i];
+    for (int i = 0; i < 6; ++i) y[i] = s[i] > 0.0f ? s[i] : 0.0f;
+}
+int64_t entry_main_task_count(void) { return 2; }
+int64_t entry_main_task0_extent(void) { return 2; }
+int64_t entry_main_task1_extent(void) { return 2; }
+void entry_main_task0(const float* x, float* y, void* workspace, int64_t lo, int64_t hi) {
+    float* s = (float*)workspace;
+    for (int64_t i = lo * 3; i < hi * 3; ++i) s[i] = x[i] + kBias[i];
+}
+void entry_main_task1(const float* x, float* y, void* workspace, int64_t lo, int64_t hi) {
+    const float* s = (const float*)workspace;
+    for (int64_t i = lo * 3; i < hi * 3; ++i) y[i] = s[i] > 0.0f ? s[i] : 0.0f;
+}
+)";
+
+// kBiasReluLibrary as built with --instrument: the hooks bind to the test executable's definitions
+constexpr const char* kInstrumentedBiasReluLibrary = R"(
+#include <stdint.h>
+void tc_profile_enter(int64_t op);
+void tc_profile_exit(int64_t op);
+static const float kBias[6] = {1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f};
+int64_t entry_main_workspace_size(void) { return 64; }
+void entry_main(const float* x, float* y, void* workspace) {
+    float* s = (float*)workspace;
+    tc_profile_enter(0);
+    for (int i = 0; i < 6; ++i) s[i] = x[i] + kBias[i];
+    tc_profile_exit(0);
+    tc_profile_enter(1);
+    for (int i = 0; i < 6; ++i) y[i] = s[i] > 0.0f ? s[i] : 0.0f;
+    tc_profile_exit(1);
+}
+)";
+
+// rows of Y = relu(X + B) for a [BATCH, 3] X and a broadcast [3] bias, no temporaries
+constexpr const char* kBatchedBiasReluLibrary = R"(
+#include <stdint.h>
+static const float kBias[3] = {1.0f, -1.0f, 0.5f};
+int64_t entry_main_workspace_size(void) { return 0; }
+void entry_main(const float* x, float* y, void* workspace) {
+    for (int i = 0; i < BATCH * 3; ++i) {
+        const float s = x[i] + kBias[i % 3];
+        y[i] = s > 0.0f ? s : 0.0f;
+    }
+}
+)";
+
+// a [1, 3] -> [1, 3] model whose every call fails, as a model error surfaced by the runtime would;
+// the C++ runtime comes from the process loading it
+constexpr const char* kThrowingLibrary = R"(
+#include <stdint.h>
+#include <stdexcept>
+extern "C" int64_t entry_main_workspace_size(void) { return 0; }
+extern "C" void entry_main(const float*, float*, void*) { throw std::runtime_error{"model failed"}; }
+)";
+
+// stand-in for a dynamic-batch build of MakeBatchedBiasReluGraph(): dims[0] is the number of rows
+constexpr const char* kDynamicBiasReluLibrary = R"(
+#include <stdint.h>
+static const float kBias[3] = {1.0f, -1.0f, 0.5f};
+int64_t entry_main_workspace_size(const int64_t* dims) { return dims[0] * 12; }
+void entry_main(const float* x, float* y, void* workspace, const int64_t* dims) {
+    float* s = (float*)workspace;
+    for (int64_t i = 0; i < dims[0] * 3; ++i) s[i] = x[i] + kBias[i % 3];
+    for (int64_t i = 0; i < dims[0] * 3; ++i) y[i] = s[i] > 0.0f ? s[i] : 0.0f;
+}
+int64_t entry_main_task_count(void) { return 1; }
+int64_t entry_main_task0_extent(const int64_t* dims) { return dims[0]; }
+void entry_main_task0(const float* x, float* y, void* workspace, const int64_t* dims, int64_t lo, int64_t hi) {
+    for (int64_t i = lo * 3; i < hi * 3; ++i) {
+        const float s = x[i] + kBias[i % 3];
+        y[i] = s > 0.0f ? s : 0.0f;
+    }
+}
+)";
+
+// compiled as C++ when extension is "cpp"
+std::string BuildLibrary(tc::driver::ScratchDir& scratch, const std::string& name, const char* code,
+                         const std::vector<std::string>& defines = {}, const std::string& extension = "c") {
+    const std::string source = scratch.File(name + "." + extension).string();
+    const std::string library = scratch.File(name + ".so").string();
+    std::ofstream{source} << code;
+    std::vector<std::string> argv{"cc", "-shared", "-fPIC", "-o", library, source};
+    argv.insert(argv.end(), defines.begin(), defines.end());
+    tc::driver::ProcessPipeline cc{{argv}, STDERR_FILENO};
+    cc.Wait();
+    return library;
+}
+
+// -1 leaves the batch dynamic
+tc::Graph MakeBatchedBiasReluGraph(int64_t batch = 1) {
+    tc::Graph graph;
+    const tc::TensorType row{tc::TensorElemType::kFloat32, {batch, 3}};
+
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(row);
+    auto* b = graph.AddNode<tc::Value>(
+        "B", tc::Value::BelongTo::kInitializer,
+        tc::TensorData{tc::TensorType{tc::TensorElemType::kFloat32, {3}}, RawFloats({1.0f, -1.0f, 0.5f})});
+    auto* sum = graph.AddNode<tc::Value>("S", tc::Value::BelongTo::kInternal);
+    sum->MergeTensorType(row);
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(row);
+
+    graph.AddNode<tc::Operation>("add0", tc::Operation::OpType::kAdd,
+                                 std::vector<tc::Value*>{x, b}, std::vector<tc::Value*>{sum});
+    graph.AddNode<tc::Operation>("relu0", tc::Operation::OpType::kRelu,
+                                 std::vector<tc::Value*>{sum}, std::vector<tc::Value*>{y});
+    return graph;
+}
+
+// runs the session from several threads and counts wrong results
+int RunConcurrently(const tc::runtime::Session& session, size_t threads, int iterations) {
+    const std::vector<float> x{0.0f, 0.0f, 1.0f, 1.0f, -3.0f, 3.0f};
+    const std::vector<float> expected{1.0f, 0.0f, 1.5f, 0.5f, 0.0f, 1.0f};
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&] {
+            for (int i = 0; i < iterations; ++i) {
+                std::vector<float> y(6, -1.0f);
+                const void* inputs[] = {x.data()};
+                void* outputs[] = {y.data()};
+                session.Run(inputs, outputs);
+                mismatches += y != expected ? 1 : 0;
+            }
+        });
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    return mismatches.load();
+}
+
+} // namespace
+
+TEST(runtime, SessionRunsSharedLibraryConcurrently) {
+    tc::driver::ScratchDir scratch;
+    std::string library;
+    try {
+        library = BuildLibrary(scratch, "model", kBiasReluLibrary);
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+
+    const tc::Graph graph = MakeBiasReluGraph();
+    const auto model = tc::runtime::CompiledModel::LoadSharedLibrary(library, graph);
+    EXPECT_EQ(model->WorkspaceSize(), 64u);
+    ASSERT_EQ(model->Inputs().size(), 1u);
+    ASSERT_EQ(model->Outputs().size(), 1u);
+    ASSERT_EQ(model->TaskCount(), 2u);
+    EXPECT_EQ(model->TaskExtent(0), 2);
+
+    const tc::runtime::Session session{model, 2};
+    EXPECT_EQ(session.Concurrency(), 2u);
+    EXPECT_EQ(RunConcurrently(session, 4, 200), 0);
+
+    const std::vector<float> x(6);
+    const void* too_many[] = {x.data(), x.data()};
+    float y[6];
+    void* outputs[] = {y};
+    EXPECT_THROW(session.Run(too_many, outputs), std::runtime_error);
+
+    // two sessions splitting their tasks over one shared pool
+    const auto pool = std::make_shared<tc::runtime::ThreadPool>(tc::runtime::ThreadPoolOptions{3, {}});
+    const tc::runtime::Session first{model, tc::runtime::SessionOptions{2, pool, 1, {}}};
+    const tc::runtime::Session second{model, tc::runtime::SessionOptions{2, pool, 1, {}}};
+    std::thread other{[&] { EXPECT_EQ(RunConcurrently(second, 2, 100), 0); }};
+    EXPECT_EQ(RunConcurrently(first, 2, 100), 0);
+    other.join();
+}
+
+TEST(runtime, ProfilerAggregatesInstrumentedOps) {
+    tc::driver::ScratchDir scratch;
+    std::string library;
+    try {
+        library = BuildLibrary(scratch, "instrumented", kInstrumentedBiasReluLibrary);
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+
+    const tc::Graph graph = MakeBiasReluGraph();
+    const auto model = tc::runtime::CompiledModel::LoadSharedLibrary(library, graph);
+    const tc::runtime::Session session{model, 2};
+    // calls outside Start()/Stop() are not recorded
+    EXPECT_EQ(RunConcurrently(session, 1, 5), 0);
+
+    tc::runtime::Profiler profiler;
+    profiler.Start();
+    tc::runtime::Profiler other;
+    EXPECT_THROW(other.Start(), std::runtime_error);
+    EXPECT_EQ(RunConcurrently(session, 2, 10), 0);
+    profiler.Stop();
+    EXPECT_EQ(RunConcurrently(session, 1, 5), 0);
+
+    EXPECT_EQ(profiler.Events().size(), 40u);
+    const std::vector<tc::runtime::OpProfile> ops = profiler.Summarize(graph, 20);
+    ASSERT_EQ(ops.size(), 2u);
+    EXPECT_EQ(ops[0].name, "add0");
+    EXPECT_EQ(ops[1].type, "Relu");
+    EXPECT_EQ(ops[0].calls, 20u);
+    EXPECT_NEAR(ops[0].share + ops[1].share, 1.0, 1e-9);
+    EXPECT_NE(tc::runtime::Profiler::FormatTable(ops).find("relu0"), std::string::npos);
+
+    const std::string trace = profiler.ChromeTrace(graph);
+    EXPECT_NE(trace.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(trace.find("\"name\": \"add0\", \"cat\": \"Add\", \"ph\": \"X\""), std::string::npos);
+}
+
+TEST(runtime, PerfCountersFallBackWhenUnavailable) {
+    const tc::runtime::CounterValues known{100, 250, 3, -1};
+    EXPECT_DOUBLE_EQ(known.Ipc(), 2.5);
+    tc::runtime::CounterValues sum = tc::runtime::CounterValues::Zero();
+    sum += known;
+    EXPECT_EQ(sum.instructions, 250);
+    EXPECT_EQ(sum.branch_misses, -1);
+    EXPECT_EQ((known - known).cycles, 0);
+    EXPECT_EQ(tc::runtime::CounterValues{}.Ipc(), -1);
+
+    const tc::runtime::PerfCounters counters;
+    const tc::runtime::CounterValues before = counters.Read();
+    volatile double x = 0;
+    for (int i = 0; i < 100000; ++i) {
+        x = x + 1.0;
+    }
+    const tc::runtime::CounterValues after = counters.Read();
+    if (!counters.Available()) {
+        EXPECT_FALSE(counters.Unavailable().empty());
+        EXPECT_EQ(after.cycles, -1);
+        EXPECT_EQ(after.instructions, -1);
+    } else if (after.instructions >= 0) {
+        EXPECT_GT((after - before).instructions, 100000);
+    }
+
+    // an instrumented run with counters requested still records every op, counted or not
+    tc::driver::ScratchDir scratch;
+    std::string library;
+    try {
+        library = BuildLibrary(scratch, "counted", kInstrumentedBiasReluLibrary);
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+    const tc::Graph graph = MakeBiasReluGraph();
+    const tc::runtime::Session session{tc::runtime::CompiledModel::LoadSharedLibrary(library, graph), 1};
+    tc::runtime::Profiler profiler{tc::runtime::ProfilerOptions{true}};
+    profiler.Start();
+    EXPECT_EQ(RunConcurrently(session, 1, 3), 0);
+    profiler.Stop();
+    const std::vector<tc::runtime::OpProfile> ops = profiler.Summarize(graph, 3);
+    ASSERT_EQ(ops.size(), 2u);
+    EXPECT_EQ(ops[0].calls, 3u);
+    EXPECT_EQ(ops[0].counters.instructions >= 0, counters.Available() && after.instructions >= 0);
+    EXPECT_NE(tc::runtime::Profiler::FormatTable(ops).find("IPC"), std::string::npos);
+}
+
+TEST(runtime, ThreadPoolCoversRangeOnce) {
+    cpu_set_t allowed;
+    ASSERT_EQ(::sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) {
+        ++cpu;
+    }
+
+    tc::runtime::ThreadPool pool{tc::runtime::ThreadPoolOptions{4, {cpu}}};
+    EXPECT_EQ(pool.Size(), 4u);
+
+    std::vector<std::atomic<int>> hits(1000);
+    std::vector<std::thread> callers;
+    for (int c = 0; c < 3; ++c) {
+        callers.emplace_back([&] {
+            pool.ParallelFor(0, 1000, 0, [&](int64_t lo, int64_t hi) {
+                for (int64_t i = lo; i < hi; ++i) {
+                    ++hits[static_cast<size_t>(i)];
+                }
+            });
+        });
+    }
+    for (std::thread& caller : callers) {
+        caller.join();
+    }
+    for (const std::atomic<int>& hit : hits) {
+        EXPECT_EQ(hit.load(), 3);
+    }
+
+    int calls = 0;
+    pool.ParallelFor(5, 5, 1, [&](int64_t, int64_t) { ++calls; });
+    EXPECT_EQ(calls, 0);
+}
+
+TEST(runtime, BatcherCoalescesRequests) {
+    tc::driver::ScratchDir scratch;
+    std::string single;
+    std::string quad;
+    try {
+        single = BuildLibrary(scratch, "b1", kBatchedBiasReluLibrary, {"-DBATCH=1"});
+        quad = BuildLibrary(scratch, "b4", kBatchedBiasReluLibrary, {"-DBATCH=4"});
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+
+    const tc::Graph graph = MakeBatchedBiasReluGraph();
+    tc::runtime::BatcherOptions options;
+    options.max_delay = std::chrono::milliseconds{20};
+    tc::runtime::DynamicBatcher batcher{
+        {tc::runtime::CompiledModel::LoadSharedLibrary(quad, tc::Rebatch(graph, 4)),
+         tc::runtime::CompiledModel::LoadSharedLibrary(single, graph)},
+        options};
+    EXPECT_EQ(batcher.MaxBatch(), 4u);
+    EXPECT_EQ(batcher.InputRowBytes(), std::vector<size_t>{12});
+
+    constexpr size_t kRequests = 10;
+    std::atomic<int> mismatches{0};
+    std::vector<std::thread> clients;
+    for (size_t r = 0; r < kRequests; ++r) {
+        clients.emplace_back([&, r] {
+            const float v = static_cast<float>(r);
+            const std::vector<float> x{v, v, -v};
+            std::vector<float> y(3, -1.0f);
+            const void* inputs[] = {x.data()};
+            void* outputs[] = {y.data()};
+            batcher.Infer(inputs, outputs);
+            const std::vector<float> expected{v + 1.0f, std::max(v - 1.0f, 0.0f), std::max(0.5f - v, 0.0f)};
+            mismatches += y != expected ? 1 : 0;
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    EXPECT_EQ(mismatches.load(), 0);
+
+    const tc::runtime::BatcherStats stats = batcher.Stats();
+    EXPECT_EQ(stats.requests, kRequests);
+    EXPECT_GE(stats.batches, 3u);
+    EXPECT_LT(stats.batches, kRequests);
+}
+
+TEST(runtime, BatcherRethrowsFailedBatch) {
+    tc::driver::ScratchDir scratch;
+    std::string library;
+    try {
+        library = BuildLibrary(scratch, "throwing", kThrowingLibrary, {}, "cpp");
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C++ compiler: " << e.what();
+    }
+
+    tc::runtime::DynamicBatcher batcher{
+        {tc::runtime::CompiledModel::LoadSharedLibrary(library, MakeBatchedBiasReluGraph())}};
+    // every queued request of the failed batch gets the error, and the dispatcher keeps serving
+    for (int round = 0; round < 2; ++round) {
+        std::atomic<int> failures{0};
+        std::vector<std::thread> clients;
+        for (int r = 0; r < 4; ++r) {
+            clients.emplace_back([&] {
+                const std::vector<float> x{1.0f, 2.0f, 3.0f};
+                std::vector<float> y(3);
+                const void* inputs[] = {x.data()};
+                void* outputs[] = {y.data()};
+                try {
+                    batcher.Infer(inputs, outputs);
+                } catch (const std::runtime_error& e) {
+                    failures += std::string{e.what()} == "model failed" ? 1 : 0;
+                }
+            });
+        }
+        for (std::thread& client : clients) {
+            client.join();
+        }
+        EXPECT_EQ(failures.load(), 4);
+    }
+    EXPECT_EQ(batcher.Stats().requests, 8u);
+}
+
+TEST(runtime, SessionRunsDynamicBatch) {
+    tc::driver::ScratchDir scratch;
+    std::string library;
+    try {
+        library = BuildLibrary(scratch, "dynamic", kDynamicBiasReluLibrary);
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "no C compiler: " << e.what();
+    }
+
+    const tc::Graph graph = MakeBatchedBiasReluGraph(-1);
+    const auto model = tc::runtime::CompiledModel::LoadSharedLibrary(library, graph);
+    ASSERT_EQ(model->Dims().size(), 1u);
+    EXPECT_EQ(model->Dims()[0].input, 0u);
+    EXPECT_EQ(model->Dims()[0].axis, 0u);
+    EXPECT_EQ(model->WorkspaceSize(std::vector<int64_t>{4}), 48u);
+    EXPECT_EQ(model->OutputShapes(std::vector<int64_t>{5}), (std::vector<std::vector<int64_t>>{{5, 3}}));
+    EXPECT_THROW(model->WorkspaceSize(), std::runtime_error);
+    EXPECT_THROW(tc::runtime::Session(model, 1), std::runtime_error);
+
+    const auto pool = std::make_shared<tc::runtime::ThreadPool>(tc::runtime::ThreadPoolOptions{2, {}});
+    for (const auto& run_pool : {std::shared_ptr<tc::runtime::ThreadPool>{}, pool}) {
+        const tc::runtime::Session session{model, tc::runtime::SessionOptions{1, run_pool, 1, {4}}};
+        for (int64_t rows : {1, 3, 4}) {
+            std::vector<float> x;
+            std::vector<float> expected;
+            for (int64_t r = 0; r < rows; ++r) {
+                const float v = static_cast<float>(r);
+                x.insert(x.end(), {v, v, -v});
+                expected.insert(expected.end(), {v + 1.0f, std::max(v - 1.0f, 0.0f), std::max(0.5f - v, 0.0f)});
+            }
+            std::vector<float> y(x.size(), -1.0f);
+            const void* inputs[] = {x.data()};
+            void* outputs[] = {y.data()};
+            const int64_t dims[] = {rows};
+            session.Run(inputs, outputs, dims);
+            EXPECT_EQ(y, expected) << rows << " rows";
+        }
+
+        const int64_t too_many[] = {5};
+        std::vector<float> x(15);
+        std::vector<float> y(15);
+        const void* inputs[] = {x.data()};
+        void* outputs[] = {y.data()};
+        EXPECT_THROW(session.Run(inputs, outputs, too_many), std::runtime_error);
+    }
+}
+
+TEST(runtime, JitRunsCompiledGraph) {
+    const tc::Graph graph = MakeBiasReluGraph();
+    if (!tc::runtime::JitAvailable()) {
+        EXPECT_THROW(tc::runtime::JitModel{graph}, std::runtime_error);
+        GTEST_SKIP() << "built without the MLIR libraries";
+    }
+
+    const tc::runtime::JitModel model{graph};
+    ASSERT_EQ(model.Inputs().size(), 1u);
+    ASSERT_EQ(model.Outputs().size(), 1u);
+    EXPECT_EQ(model.Inputs()[0].name, "X");
+    EXPECT_EQ(model.Inputs()[0].ByteSize(), 6 * sizeof(float));
+
+    const tc::TensorData x{model.Inputs()[0].type, RawFloats({0.0f, 0.0f, 1.0f, 1.0f, -3.0f, 3.0f})};
+    const std::vector<tc::TensorData> outputs = model.Run({x});
+
+    ASSERT_EQ(outputs.size(), 1u);
+    EXPECT_EQ(Floats(outputs[0].raw), (std::vector<float>{1.0f, 0.0f, 1.5f, 0.5f, 0.0f, 1.0f}));
+}
+
+TEST(runtime, SessionRunsJitCompiledGraph) {
+    const tc::Graph graph = MakeBiasReluGraph();
+    if (!tc::runtime::JitAvailable()) {
+        EXPECT_THROW(tc::runtime::CompiledModel::Jit(graph), std::runtime_error);
+        GTEST_SKIP() << "built without the MLIR libraries";
+    }
+
+    const tc::runtime::Session session{tc::runtime::CompiledModel::Jit(graph), 1};
+    EXPECT_GT(session.Model().WorkspaceSize(), 0u);
+
+    const std::vector<float> x{0.0f, 0.0f, 1.0f, 1.0f, -3.0f, 3.0f};
+    std::vector<float> y(6);
+    const void* inputs[] = {x.data()};
+    void* outputs[] = {y.data()};
+    session.Run(inputs, outputs);
+    EXPECT_EQ(y, (std::vector<float>{1.0f, 0.0f, 1.5f, 0.5f, 0.0f, 1.0f}));
+}
+
+namespace {
+
+struct ConvCase {
+    tc::ConvAlgorithm algorithm;
+    int64_t channels;
+    int64_t out_channels;
+    int64_t kernel;
+    int64_t stride;
+    int64_t pad;
+    int64_t group;
+    int64_t size;
+};
+
+// im2col with and without stride, the strided one grouped; Winograd F(2x2, 3x3) and F(4x4, 3x3)
+// with partial last tiles; a strided depthwise Conv with 2 output channels per input channel and a
+// grouped pointwise one
+constexpr ConvCase kConvCases[] = {
+    {tc::ConvAlgorithm::kIm2col, 4, 8, 3, 1, 1, 1, 6},
+    {tc::ConvAlgorithm::kIm2col, 4, 8, 3, 2, 1, 2, 7},
+    {tc::ConvAlgorithm::kWinograd, 4, 8, 3, 1, 1, 1, 5},
+    {tc::ConvAlgorithm::kWinograd, 4, 8, 3, 1, 1, 1, 10},
+    {tc::ConvAlgorithm::kDepthwise, 4, 8, 3, 2, 1, 4, 7},
+    {tc::ConvAlgorithm::kPointwise, 6, 4, 1, 1, 0, 2, 5},
+};
+
+tc::Value* AddConvInitializer(tc::Graph& graph, const std::string& name, std::vector<int64_t> shape,
+                              const std::vector<float>& values) {
+    return graph.AddNode<tc::Value>(
+        name, tc::Value::BelongTo::kInitializer,
+        tc::TensorData{tc::TensorType{tc::TensorElemType::kFloat32, std::move(shape)}, RawFloats(values)});
+}
+
+std::vector<float> ConvWeights(size_t count) {
+    std::vector<float> weights(count);
+    for (size_t i = 0; i < weights.size(); ++i) {
+        weights[i] = static_cast<float>(static_cast<int>(i * 7 % 11) - 5) / 8.0f;
+    }
+    return weights;
+}
+
+// Y = Conv(X[2, channels, size, size], W, B) of one case
+tc::Graph MakeConvCaseGraph(const ConvCase& c) {
+    const int64_t out_size = (c.size + 2 * c.pad - c.kernel) / c.stride + 1;
+    tc::Graph graph;
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {2, c.channels, c.size, c.size}});
+    auto* w = AddConvInitializer(
+        graph, "W", {c.out_channels, c.channels / c.group, c.kernel, c.kernel},
+        ConvWeights(static_cast<size_t>(c.out_channels * c.channels / c.group * c.kernel * c.kernel)));
+    auto* b = AddConvInitializer(graph, "B", {c.out_channels}, std::vector<float>(static_cast<size_t>(c.out_channels), 0.5f));
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {2, c.out_channels, out_size, out_size}});
+    tc::AttributeMap attrs;
+    attrs.emplace("pads", tc::Attribute{"pads", std::vector<int64_t>{c.pad, c.pad, c.pad, c.pad}});
+    attrs.emplace("strides", tc::Attribute{"strides", std::vector<int64_t>{c.stride, c.stride}});
+    attrs.emplace("group", tc::Attribute{"group", c.group});
+    graph.AddNode<tc::Operation>("conv0", tc::Operation::OpType::kConv, std::vector<tc::Value*>{x, w, b},
+                                 std::vector<tc::Value*>{y}, attrs);
+    return graph;
+}
+
+// Y = Relu(Conv(X[2,8,7,7], W[8,8,3,3], B, stride 2)) * S[1,8,1,1], blocked by 4 end to end
+tc::Graph MakeConvReluScaleGraph() {
+    tc::Graph graph;
+    const tc::TensorType y_type{tc::TensorElemType::kFloat32, {2, 8, 3, 3}};
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {2, 8, 7, 7}});
+    auto* w = AddConvInitializer(graph, "W", {8, 8, 3, 3}, ConvWeights(8 * 8 * 9));
+    auto* b = AddConvInitializer(graph, "B", {8}, std::vector<float>(8, 0.5f));
+    auto* s = AddConvInitializer(graph, "S", {1, 8, 1, 1}, {1.0f, -1.0f, 2.0f, 0.5f, 3.0f, -2.0f, 0.25f, 1.5f});
+    auto* h = graph.AddNode<tc::Value>("H", tc::Value::BelongTo::kInternal);
+    h->MergeTensorType(y_type);
+    auto* r = graph.AddNode<tc::Value>("R", tc::Value::BelongTo::kInternal);
+    r->MergeTensorType(y_type);
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(y_type);
+    tc::AttributeMap attrs;
+    attrs.emplace("pads", tc::Attribute{"pads", std::vector<int64_t>{1, 1, 1, 1}});
+    attrs.emplace("strides", tc::Attribute{"strides", std::vector<int64_t>{2, 2}});
+    graph.AddNode<tc::Operation>("conv0", tc::Operation::OpType::kConv, std::vector<tc::Value*>{x, w, b},
+                                 std::vector<tc::Value*>{h}, attrs);
+    graph.AddNode<tc::Operation>("relu0", tc::Operation::OpType::kRelu, std::vector<tc::Value*>{h},
+                                 std::vector<tc::Value*>{r});
+    graph.AddNode<tc::Operation>("mul0", tc::Operation::OpType::kMul, std::vector<tc::Value*>{r, s},
+                                 std::vector<tc::Value*>{y});
+    return graph;
+}
+
+const tc::TensorType& TypeOf(const tc::Graph& graph, const std::string& name) {
+    return *static_cast<const tc::Value*>(graph.FindByName(name))->MaybeTensorType();
+}
+
+// values for the graph's input X
+tc::TensorData ConvInput(const tc::Graph& graph) {
+    const tc::TensorType& type = TypeOf(graph, "X");
+    std::vector<float> input(static_cast<size_t>(type.NumElements()));
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<float>(static_cast<int>(i * 13 % 17) - 8) / 4.0f;
+    }
+    return tc::TensorData{type, RawFloats(input)};
+}
+
+void ExpectNearConv(const std::vector<float>& actual, const std::vector<float>& expected, const std::string& what) {
+    ASSERT_EQ(actual.size(), expected.size()) << what;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(actual[i], expected[i], 1e-4f * std::max(1.0f, std::fabs(expected[i]))) << what << " at " << i;
+    }
+}
+
+bool OnPath(const std::string& tool) {
+    const char* path = std::getenv("PATH");
+    std::string_view dirs = path != nullptr ? path : "";
+    while (!dirs.empty()) {
+        const size_t end = std::min(dirs.find(':'), dirs.size());
+        const std::string candidate = std::string{dirs.substr(0, end)} + "/" + tool;
+        if (::access(candidate.c_str(), X_OK) == 0) {
+            return true;
+        }
+        dirs.remove_prefix(std::min(end + 1, dirs.size()));
+    }
+    return false;
+}
+
+// graph through the text emitter, mlir-opt, mlir-translate, llc and cc, as
+// `tc.x --external-tools --emit-shared` builds it, then run on x with its tasks split over two threads
+std::vector<float> RunThroughTools(tc::driver::ScratchDir& scratch, const std::string& name, const tc::Graph& graph,
+                                   tc::ConvAlgorithm algorithm, const tc::TensorData& x) {
+    tc::driver::DriverOptions opt;
+    opt.external_tools = true;
+    opt.emit_shared_path = scratch.File(name + ".so").string();
+    tc::MlirEmitterOptions emit_options;
+    emit_options.use_workspace = true;
+    emit_options.emit_tasks = true;
+    emit_options.conv_algorithm = algorithm;
+    tc::driver::EmitMlirAndLower(opt, [&](hlp::OutputSink& out) {
+        tc::MlirBackend{}.EmitModule(graph, out, emit_options);
+    });
+
+    const tc::runtime::Session session{
+        tc::runtime::CompiledModel::LoadSharedLibrary(opt.emit_shared_path, graph),
+        tc::runtime::SessionOptions{1, std::make_shared<tc::runtime::ThreadPool>(tc::runtime::ThreadPoolOptions{2, {}}), 0, {}}};
+    std::vector<float> y(static_cast<size_t>(TypeOf(graph, "Y").NumElements()));
+    const void* inputs[] = {x.raw.data()};
+    void* outputs[] = {y.data()};
+    session.Run(inputs, outputs);
+    return y;
+}
+
+} // namespace
+
+TEST(runtime, ConvLoweringsMatchDirect) {
+    for (const ConvCase& c : kConvCases) {
+        const tc::Graph graph = MakeConvCaseGraph(c);
+        if (!tc::runtime::JitAvailable()) {
+            GTEST_SKIP() << "built without the MLIR libraries";
+        }
+
+        const tc::TensorData x_data = ConvInput(graph);
+        tc::runtime::JitOptions options;
+        options.conv_algorithm = tc::ConvAlgorithm::kDirect;
+        const std::vector<float> direct = Floats(tc::runtime::JitModel{graph, options}.Run({x_data})[0].raw);
+        options.conv_algorithm = c.algorithm;
+        const std::vector<float> lowered = Floats(tc::runtime::JitModel{graph, options}.Run({x_data})[0].raw);
+        ExpectNearConv(lowered, direct, std::string{tc::ConvAlgorithmName(c.algorithm)} + " size " + std::to_string(c.size));
+    }
+}
+
+TEST(runtime, BlockedLayoutMatchesNchw) {
+    const tc::Graph graph = MakeConvReluScaleGraph();
+    const tc::Graph blocked = tc::AssignBlockedLayout(graph, 4);
+    if (!tc::runtime::JitAvailable()) {
+        GTEST_SKIP() << "built without the MLIR libraries";
+    }
+
+    const tc::TensorData x_data = ConvInput(graph);
+    const std::vector<float> expected = Floats(tc::runtime::JitModel{graph}.Run({x_data})[0].raw);
+    const std::vector<float> actual = Floats(tc::runtime::JitModel{blocked}.Run({x_data})[0].raw);
+    ExpectNearConv(actual, expected, "nchw4c");
+}
+
+// the same checks on the text emitter's output lowered by the external tools, for builds without
+// the MLIR libraries
+TEST(runtime, ConvLoweringsMatchDirectThroughTools) {
+    for (const char* tool : {"mlir-opt", "mlir-translate", "llc", "cc"}) {
+        if (!OnPath(tool)) {
+            GTEST_SKIP() << tool << " not on PATH";
+        }
+    }
+
+    tc::driver::ScratchDir scratch;
+    for (const ConvCase& c : kConvCases) {
+        const tc::Graph graph = MakeConvCaseGraph(c);
+        const tc::TensorData x_data = ConvInput(graph);
+        const std::string name = std::string{tc::ConvAlgorithmName(c.algorithm)} + std::to_string(c.size);
+        const std::vector<float> direct = RunThroughTools(scratch, name + "_direct", graph, tc::ConvAlgorithm::kDirect, x_data);
+        const std::vector<float> lowered = RunThroughTools(scratch, name, graph, c.algorithm, x_data);
+        ExpectNearConv(lowered, direct, name);
+    }
+
+    const tc::Graph graph = MakeConvReluScaleGraph();
+    const tc::TensorData x_data = ConvInput(graph);
+    ExpectNearConv(RunThroughTools(scratch, "nchw4c", tc::AssignBlockedLayout(graph, 4), tc::ConvAlgorithm::kAuto, x_data),
+                   RunThroughTools(scratch, "nchw", graph, tc::ConvAlgorithm::kDirect, x_data), "nchw4c");
+}
+
+TEST(runtime, AutotuneRecordsCheckedSchedules) {
+    // Y[16,24] = 0.5 * X[16,40] * W^T + B with W[24,40] a constant
+    tc::Graph graph;
+    auto* x = graph.AddNode<tc::Value>("X", tc::Value::BelongTo::kInput);
+    x->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {16, 40}});
+    auto* w = graph.AddNode<tc::Value>(
+        "W", tc::Value::BelongTo::kInitializer,
+        tc::TensorData{tc::TensorType{tc::TensorElemType::kFloat32, {24, 40}}, RawFloats(std::vector<float>(24 * 40, 0.25f))});
+    auto* b = graph.AddNode<tc::Value>(
+        "B", tc::Value::BelongTo::kInitializer,
+        tc::TensorData{tc::TensorType{tc::TensorElemType::kFloat32, {24}}, RawFloats(std::vector<float>(24, 1.0f))});
+    auto* y = graph.AddNode<tc::Value>("Y", tc::Value::BelongTo::kOutput);
+    y->MergeTensorType(tc::TensorType{tc::TensorElemType::kFloat32, {16, 24}});
+    tc::AttributeMap attrs;
+    attrs.emplace("transB", tc::Attribute{"transB", int64_t{1}});
+    attrs.emplace("alpha", tc::Attribute{"alpha", 0.5f});
+    graph.AddNode<tc::Operation>("gemm0", tc::Operation::OpType::kGemm, std::vector<tc::Value*>{x, w, b},
+                                 std::vector<tc::Value*>{y}, attrs);
+    const auto& gemm = dynamic_cast<const tc::Operation&>(*graph.FindByName("gemm0"));
+
+    // the isolated op takes the constants as inputs and keeps its signature
+    const tc::Graph isolated = tc::runtime::IsolateOperation(gemm);
+    const auto& copy = dynamic_cast<const tc::Operation&>(*isolated.FindByName("gemm0"));
+    EXPECT_EQ(tc::TuningSignature(copy), tc::TuningSignature(gemm));
+    EXPECT_EQ(tc::TuningSignature(gemm), "Gemm f32 16x40 24x40 24 transA=0 transB=1");
+    EXPECT_EQ(dynamic_cast<const tc::Value&>(*isolated.FindByName("W")).GetBelongsTo(), tc::Value::BelongTo::kInput);
+
+    tc::TuningDatabase database;
+    tc::runtime::AutotuneOptions options;
+    options.iterations = 2;
+    options.warmup = 0;
+    if (!tc::runtime::JitAvailable()) {
+        EXPECT_THROW(tc::runtime::Autotune(graph, database, options), std::runtime_error);
+        GTEST_SKIP() << "built without the MLIR libraries";
+    }
+
+    const std::vector<tc::runtime::AutotuneResult> results = tc::runtime::Autotune(graph, database, options);
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].candidates, tc::CandidateSchedules(gemm).size());
+    const tc::TuningDatabase::Entry* entry = database.Find(results[0].signature);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->schedule, results[0].schedule);
+    // already tuned
+    EXPECT_TRUE(tc::runtime::Autotune(graph, database, options).empty());
+
+    // every row of X is 1: Y = 0.5 * 40 * 0.25 + 1 = 6 whatever the schedule
+    tc::runtime::JitOptions jit_options;
+    jit_options.tuning = std::make_shared<const tc::TuningDatabase>(database);
+    const tc::runtime::JitModel model{graph, jit_options};
+    const tc::TensorData input{model.Inputs()[0].type, RawFloats(std::vector<float>(16 * 40, 1.0f))};
+    EXPECT_EQ(Floats(model.Run({input})[0].raw), std::vector<float>(16 * 24, 6.0f));
+}